@@ -106,11 +106,16 @@
 #define ATT_CHAR_PROPER_AUTH			0x40
 #define ATT_CHAR_PROPER_EXT_PROPER		0x80
 
+/* Execute Write Request flags */
+#define ATT_EXEC_WRITE_CANCEL			0x00
+#define ATT_EXEC_WRITE_COMMIT			0x01
+
 /* Client Characteristic Configuration bit field */
 #define ATT_CLIENT_CHAR_CONF_NOTIFICATION	0x0001
 #define ATT_CLIENT_CHAR_CONF_INDICATION		0x0002
 
 #define ATT_MAX_MTU				256
+#define ATT_MAX_VALUE_LEN			512
 #define ATT_DEFAULT_L2CAP_MTU			48
 #define ATT_DEFAULT_LE_MTU			23
 
@@ -161,6 +166,11 @@ struct att_char {
 	uint16_t value_handle;
 };
 
+struct att_desc {
+	bt_uuid_t uuid;
+	uint16_t handle;
+};
+
 /* These functions do byte conversion */
 static inline uint8_t att_get_u8(const void *ptr)
 {
@@ -310,6 +320,15 @@ uint16_t dec_indication(const uint8_t *pdu, int len, uint16_t *handle,
 						uint8_t *value, int vlen);
 uint16_t enc_confirmation(uint8_t *pdu, int len);
 
+uint16_t enc_prep_write_req(uint16_t handle, uint16_t offset,
+					const uint8_t *value, int vlen,
+					uint8_t *pdu, int len);
+uint16_t dec_prep_write_resp(const uint8_t *pdu, int len, uint16_t *handle,
+				uint16_t *offset, uint8_t *value, int vsize,
+				int *vlen);
+uint16_t enc_exec_write_req(uint8_t flags, uint8_t *pdu, int len);
+uint16_t dec_exec_write_resp(const uint8_t *pdu, int len);
+
 uint16_t enc_mtu_req(uint16_t mtu, uint8_t *pdu, int len);
 uint16_t dec_mtu_req(const uint8_t *pdu, int len, uint16_t *mtu);
 uint16_t enc_mtu_resp(uint16_t mtu, uint8_t *pdu, int len);
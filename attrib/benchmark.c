@@ -0,0 +1,586 @@
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *  Copyright (C) 2012  Nokia Corporation
+ *
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+#include <glib.h>
+
+#include <bluetooth/bluetooth.h>
+#include <bluetooth/uuid.h>
+
+#include "att.h"
+#include "btio.h"
+#include "gattrib.h"
+#include "gatt.h"
+#include "gatttool.h"
+
+/*
+ * Throughput and latency benchmark shared by gatttool and the interactive
+ * shell. Every connection keeps one operation in flight (ATT allows a
+ * single outstanding request per bearer) and records the time it took:
+ *
+ *   read, write	request to response
+ *   write-cmd		queueing to the PDU being written to the socket
+ *   notify		time between consecutive notifications
+ *
+ * For notify the handle is the Client Characteristic Configuration
+ * descriptor, which is enabled for the run and disabled afterwards.
+ *
+ * The attrib may be shared with an interactive session, so only the
+ * requests issued here are ever cancelled. A connection that drops ends
+ * its part of the run, counting the operation in flight as an error.
+ */
+
+enum bench_op {
+	BENCH_READ,
+	BENCH_WRITE,
+	BENCH_WRITE_CMD,
+	BENCH_NOTIFY,
+};
+
+static const char *bench_op_str[] = {
+	"read",
+	"write",
+	"write-cmd",
+	"notify",
+};
+
+struct bench_conn {
+	struct benchmark *bench;
+	GAttrib *attrib;
+	guint notify_id;
+	guint req_id;		/* operation in flight */
+	guint setup_id;		/* MTU exchange or subscription */
+	guint hup_id;
+	uint16_t mtu;
+	uint8_t *value;
+	size_t vlen;
+	double sent;
+	unsigned int ops;
+	unsigned int errors;
+	guint64 bytes;
+	GArray *latency;	/* guint32, microseconds */
+	gboolean done;
+};
+
+struct benchmark {
+	enum bench_op op;
+	uint16_t handle;
+	uint8_t *value;
+	size_t vlen;
+	unsigned int count;
+	unsigned int duration;
+	unsigned int issued;
+	unsigned int active;
+	gboolean stopped;
+	GSList *conns;
+	GTimer *timer;
+	guint timeout_id;
+	guint done_id;
+	benchmark_done_t done;
+	gpointer user_data;
+};
+
+static void conn_next(struct bench_conn *conn);
+
+static void conn_record(struct bench_conn *conn, double now, size_t bytes)
+{
+	guint32 usec = (now - conn->sent) * 1000000;
+
+	g_array_append_val(conn->latency, usec);
+	conn->bytes += bytes;
+	conn->ops++;
+	conn->sent = now;
+}
+
+static gboolean bench_done(gpointer user_data)
+{
+	struct benchmark *bench = user_data;
+
+	bench->done_id = 0;
+
+	if (bench->done)
+		bench->done(bench, bench->user_data);
+
+	return FALSE;
+}
+
+static void bench_finish(struct benchmark *bench)
+{
+	g_timer_stop(bench->timer);
+
+	if (bench->timeout_id > 0) {
+		g_source_remove(bench->timeout_id);
+		bench->timeout_id = 0;
+	}
+
+	/* Deferred so that the callback may free the benchmark */
+	bench->done_id = g_idle_add(bench_done, bench);
+}
+
+static void conn_cancel(struct bench_conn *conn)
+{
+	guint id;
+
+	/* Cleared first, cancelling may call write_cmd_sent() */
+	if (conn->req_id > 0) {
+		id = conn->req_id;
+		conn->req_id = 0;
+		g_attrib_cancel(conn->attrib, id);
+	}
+
+	if (conn->setup_id > 0) {
+		id = conn->setup_id;
+		conn->setup_id = 0;
+		g_attrib_cancel(conn->attrib, id);
+	}
+
+	if (conn->notify_id > 0) {
+		g_attrib_unregister(conn->attrib, conn->notify_id);
+		conn->notify_id = 0;
+	}
+
+	if (conn->hup_id > 0) {
+		g_source_remove(conn->hup_id);
+		conn->hup_id = 0;
+	}
+}
+
+static void conn_finish(struct bench_conn *conn)
+{
+	struct benchmark *bench = conn->bench;
+
+	if (conn->done)
+		return;
+
+	conn->done = TRUE;
+
+	if (conn->notify_id > 0) {
+		uint8_t disable[] = { 0x00, 0x00 };
+
+		g_attrib_unregister(conn->attrib, conn->notify_id);
+		conn->notify_id = 0;
+		gatt_write_char(conn->attrib, bench->handle, disable,
+					sizeof(disable), NULL, NULL);
+	}
+
+	if (--bench->active == 0)
+		bench_finish(bench);
+}
+
+static gboolean conn_disconnected(GIOChannel *io, GIOCondition cond,
+							gpointer user_data)
+{
+	struct bench_conn *conn = user_data;
+
+	conn->hup_id = 0;
+
+	if (conn->done)
+		return FALSE;
+
+	if (conn->req_id > 0 || conn->setup_id > 0)
+		conn->errors++;
+
+	/* Nothing can be sent anymore, not even the unsubscription */
+	conn_cancel(conn);
+	conn_finish(conn);
+
+	return FALSE;
+}
+
+static void bench_stop(struct benchmark *bench)
+{
+	GSList *l;
+
+	bench->stopped = TRUE;
+
+	/* Requests in flight complete through conn_next() */
+	if (bench->op == BENCH_NOTIFY)
+		for (l = bench->conns; l; l = l->next)
+			conn_finish(l->data);
+}
+
+static void response_cb(guint8 status, const guint8 *pdu, guint16 plen,
+							gpointer user_data)
+{
+	struct bench_conn *conn = user_data;
+	double now = g_timer_elapsed(conn->bench->timer, NULL);
+
+	conn->req_id = 0;
+
+	if (status != 0) {
+		conn->errors++;
+		conn->sent = now;
+	} else if (pdu[0] == ATT_OP_READ_RESP)
+		conn_record(conn, now, plen - 1);
+	else
+		conn_record(conn, now, conn->vlen);
+
+	conn_next(conn);
+}
+
+static void write_cmd_sent(gpointer user_data)
+{
+	struct bench_conn *conn = user_data;
+	double now;
+
+	if (conn->done || conn->req_id == 0)
+		return;
+
+	conn->req_id = 0;
+
+	now = g_timer_elapsed(conn->bench->timer, NULL);
+	conn_record(conn, now, conn->vlen);
+	conn_next(conn);
+}
+
+static void notify_handler(const uint8_t *pdu, uint16_t len,
+							gpointer user_data)
+{
+	struct bench_conn *conn = user_data;
+	struct benchmark *bench = conn->bench;
+	double now = g_timer_elapsed(bench->timer, NULL);
+
+	if (conn->done || len < 3)
+		return;
+
+	conn_record(conn, now, len - 3);
+
+	if (bench->count > 0 && ++bench->issued >= bench->count)
+		bench_stop(bench);
+}
+
+static void subscribe_cb(guint8 status, const guint8 *pdu, guint16 plen,
+							gpointer user_data)
+{
+	struct bench_conn *conn = user_data;
+
+	conn->setup_id = 0;
+
+	if (status == 0) {
+		conn->sent = g_timer_elapsed(conn->bench->timer, NULL);
+		return;
+	}
+
+	g_printerr("Enabling notifications failed: %s\n",
+						att_ecode2str(status));
+	conn->errors++;
+	conn_finish(conn);
+}
+
+static void conn_next(struct bench_conn *conn)
+{
+	struct benchmark *bench = conn->bench;
+	uint8_t *buf;
+	int buflen;
+	uint16_t plen;
+	guint id;
+
+	if (conn->done)
+		return;
+
+	if (bench->stopped || (bench->count > 0 &&
+					bench->issued >= bench->count)) {
+		conn_finish(conn);
+		return;
+	}
+
+	buf = g_attrib_get_buffer(conn->attrib, &buflen);
+
+	switch (bench->op) {
+	case BENCH_READ:
+		plen = enc_read_req(bench->handle, buf, buflen);
+		id = g_attrib_send(conn->attrib, 0, ATT_OP_READ_REQ, buf, plen,
+						response_cb, conn, NULL);
+		break;
+	case BENCH_WRITE:
+		plen = enc_write_req(bench->handle, conn->value, conn->vlen,
+								buf, buflen);
+		id = g_attrib_send(conn->attrib, 0, ATT_OP_WRITE_REQ, buf,
+					plen, response_cb, conn, NULL);
+		break;
+	case BENCH_WRITE_CMD:
+		plen = enc_write_cmd(bench->handle, conn->value, conn->vlen,
+								buf, buflen);
+		id = g_attrib_send(conn->attrib, 0, ATT_OP_WRITE_CMD, buf,
+					plen, NULL, conn, write_cmd_sent);
+		break;
+	default:
+		return;
+	}
+
+	if (id == 0) {
+		conn->errors++;
+		conn_finish(conn);
+		return;
+	}
+
+	conn->req_id = id;
+	bench->issued++;
+}
+
+static void conn_start(struct bench_conn *conn)
+{
+	struct benchmark *bench = conn->bench;
+	uint8_t enable[] = { 0x01, 0x00 };
+
+	conn->mtu = g_attrib_get_mtu(conn->attrib);
+
+	/* Without a user supplied value, fill the whole PDU */
+	if (bench->value != NULL) {
+		conn->value = g_memdup(bench->value, bench->vlen);
+		conn->vlen = bench->vlen;
+	} else {
+		size_t i;
+
+		conn->vlen = conn->mtu - 3;
+		conn->value = g_malloc(conn->vlen);
+		for (i = 0; i < conn->vlen; i++)
+			conn->value[i] = i;
+	}
+
+	conn->sent = g_timer_elapsed(bench->timer, NULL);
+
+	if (bench->op != BENCH_NOTIFY) {
+		conn_next(conn);
+		return;
+	}
+
+	conn->notify_id = g_attrib_register(conn->attrib,
+					ATT_OP_HANDLE_NOTIFY, notify_handler,
+					conn, NULL);
+	conn->setup_id = gatt_write_char(conn->attrib, bench->handle, enable,
+					sizeof(enable), subscribe_cb, conn);
+}
+
+static void exchange_mtu_cb(guint8 status, const guint8 *pdu, guint16 plen,
+							gpointer user_data)
+{
+	struct bench_conn *conn = user_data;
+
+	conn->setup_id = 0;
+
+	/* On failure the run uses the default MTU */
+	conn_start(conn);
+}
+
+static gboolean bench_timeout(gpointer user_data)
+{
+	struct benchmark *bench = user_data;
+
+	bench->timeout_id = 0;
+	bench_stop(bench);
+
+	return FALSE;
+}
+
+struct benchmark *benchmark_new(const char *op, uint16_t handle,
+					const uint8_t *value, size_t vlen,
+					unsigned int count,
+					unsigned int duration,
+					benchmark_done_t done,
+					gpointer user_data)
+{
+	struct benchmark *bench;
+	unsigned int i;
+
+	for (i = 0; i < G_N_ELEMENTS(bench_op_str); i++)
+		if (g_strcmp0(op, bench_op_str[i]) == 0)
+			break;
+
+	if (i == G_N_ELEMENTS(bench_op_str) || handle == 0)
+		return NULL;
+
+	bench = g_new0(struct benchmark, 1);
+	bench->op = i;
+	bench->handle = handle;
+	bench->count = count;
+	bench->duration = duration;
+	bench->done = done;
+	bench->user_data = user_data;
+	bench->timer = g_timer_new();
+
+	if (value != NULL && vlen > 0) {
+		bench->value = g_memdup(value, vlen);
+		bench->vlen = vlen;
+	}
+
+	/* Without any bound, run for ten seconds */
+	if (bench->count == 0 && bench->duration == 0)
+		bench->duration = 10;
+
+	return bench;
+}
+
+gboolean benchmark_add(struct benchmark *bench, GAttrib *attrib, int mtu)
+{
+	struct bench_conn *conn;
+
+	if (bench->stopped)
+		return FALSE;
+
+	/* The clock starts with the first connection */
+	if (bench->conns == NULL) {
+		g_timer_start(bench->timer);
+
+		if (bench->duration > 0)
+			bench->timeout_id = g_timeout_add_seconds(
+							bench->duration,
+							bench_timeout, bench);
+	}
+
+	conn = g_new0(struct bench_conn, 1);
+	conn->bench = bench;
+	conn->attrib = g_attrib_ref(attrib);
+	conn->latency = g_array_new(FALSE, FALSE, sizeof(guint32));
+
+	bench->conns = g_slist_append(bench->conns, conn);
+	bench->active++;
+
+	conn->hup_id = g_io_add_watch(g_attrib_get_channel(attrib),
+					G_IO_HUP | G_IO_ERR | G_IO_NVAL,
+					conn_disconnected, conn);
+
+	if (mtu > g_attrib_get_mtu(attrib))
+		conn->setup_id = gatt_exchange_mtu(attrib, mtu,
+							exchange_mtu_cb, conn);
+
+	if (conn->setup_id == 0)
+		conn_start(conn);
+
+	return TRUE;
+}
+
+static gint latency_cmp(gconstpointer a, gconstpointer b)
+{
+	const guint32 *l1 = a, *l2 = b;
+
+	if (*l1 < *l2)
+		return -1;
+
+	return *l1 > *l2;
+}
+
+static double percentile(GArray *sorted, unsigned int p)
+{
+	unsigned int i = (sorted->len - 1) * p / 100;
+
+	return g_array_index(sorted, guint32, i) / 1000.0;
+}
+
+void benchmark_report(struct benchmark *bench)
+{
+	double elapsed = g_timer_elapsed(bench->timer, NULL);
+	GSList *mtus = NULL, *l, *m;
+
+	g_print("Benchmark %s handle 0x%04x: %u connection(s), %.2f s\n",
+				bench_op_str[bench->op], bench->handle,
+				g_slist_length(bench->conns), elapsed);
+
+	for (l = bench->conns; l; l = l->next) {
+		struct bench_conn *conn = l->data;
+		gpointer key = GUINT_TO_POINTER(conn->mtu);
+
+		if (g_slist_find(mtus, key) == NULL)
+			mtus = g_slist_append(mtus, key);
+	}
+
+	/* Connections are aggregated per negotiated MTU */
+	for (m = mtus; m; m = m->next) {
+		uint16_t mtu = GPOINTER_TO_UINT(m->data);
+		unsigned int ops = 0, errors = 0;
+		guint64 bytes = 0;
+		GArray *latency;
+
+		latency = g_array_new(FALSE, FALSE, sizeof(guint32));
+
+		for (l = bench->conns; l; l = l->next) {
+			struct bench_conn *conn = l->data;
+
+			if (conn->mtu != mtu)
+				continue;
+
+			ops += conn->ops;
+			errors += conn->errors;
+			bytes += conn->bytes;
+			g_array_append_vals(latency, conn->latency->data,
+							conn->latency->len);
+		}
+
+		g_print("  MTU %3u: %u ops, %u errors, %.1f ops/s, "
+				"%.1f bytes/s\n", mtu, ops, errors,
+				elapsed > 0 ? ops / elapsed : 0,
+				elapsed > 0 ? bytes / elapsed : 0);
+
+		if (latency->len > 0) {
+			g_array_sort(latency, latency_cmp);
+			g_print("  latency ms: min %.3f p50 %.3f p90 %.3f "
+				"p99 %.3f max %.3f\n",
+				percentile(latency, 0), percentile(latency, 50),
+				percentile(latency, 90), percentile(latency, 99),
+				percentile(latency, 100));
+		}
+
+		g_array_free(latency, TRUE);
+	}
+
+	g_slist_free(mtus);
+}
+
+static void conn_free(gpointer data)
+{
+	struct bench_conn *conn = data;
+
+	conn->done = TRUE;
+
+	/* Operations still queued must not call back into freed memory */
+	conn_cancel(conn);
+	g_attrib_unref(conn->attrib);
+	g_array_free(conn->latency, TRUE);
+	g_free(conn->value);
+	g_free(conn);
+}
+
+void benchmark_free(struct benchmark *bench)
+{
+	if (bench == NULL)
+		return;
+
+	if (bench->timeout_id > 0)
+		g_source_remove(bench->timeout_id);
+
+	if (bench->done_id > 0)
+		g_source_remove(bench->done_id);
+
+	bench->done = NULL;
+	bench->stopped = TRUE;
+
+	g_slist_free_full(bench->conns, conn_free);
+	g_timer_destroy(bench->timer);
+	g_free(bench->value);
+	g_free(bench);
+}
@@ -48,6 +48,7 @@
 #include "gattrib.h"
 #include "attio.h"
 #include "gatt.h"
+#include "gatt-cache.h"
 #include "client.h"
 
 #define CHAR_INTERFACE "org.bluez.Characteristic"
@@ -723,13 +724,13 @@ static void update_char_value(guint8 status, const guint8 *pdu,
 	g_free(current);
 }
 
-static int uuid_desc16_cmp(bt_uuid_t *uuid, guint16 desc)
+static gboolean uuid_desc16_equal(bt_uuid_t *uuid, guint16 desc)
 {
 	bt_uuid_t u16;
 
 	bt_uuid16_create(&u16, desc);
 
-	return bt_uuid_cmp(uuid, &u16);
+	return bt_uuid_equal(uuid, &u16);
 }
 
 static void descriptor_cb(guint8 status, const guint8 *pdu, guint16 plen,
@@ -772,11 +773,11 @@ static void descriptor_cb(guint8 status, const guint8 *pdu, guint16 plen,
 		qfmt->chr = current->chr;
 		qfmt->handle = handle;
 
-		if (uuid_desc16_cmp(&uuid, GATT_CHARAC_USER_DESC_UUID) == 0) {
+		if (uuid_desc16_equal(&uuid, GATT_CHARAC_USER_DESC_UUID)) {
 			query_list_append(gatt, qfmt);
 			gatt_read_char(gatt->attrib, handle, 0, update_char_desc,
 									qfmt);
-		} else if (uuid_desc16_cmp(&uuid, GATT_CHARAC_FMT_UUID) == 0) {
+		} else if (uuid_desc16_equal(&uuid, GATT_CHARAC_FMT_UUID)) {
 			query_list_append(gatt, qfmt);
 			gatt_read_char(gatt->attrib, handle, 0,
 						update_char_format, qfmt);
@@ -899,8 +900,9 @@ static void send_discover(GAttrib *attrib, gpointer user_data)
 
 	gatt->attrib = g_attrib_ref(attrib);
 
-	gatt_discover_char(gatt->attrib, prim->start, prim->end, NULL,
-						char_discovered_cb, qchr);
+	gatt_cache_discover_char(btd_device_get_gatt_cache(gatt->dev),
+					gatt->attrib, prim->start, prim->end,
+					NULL, char_discovered_cb, qchr);
 }
 
 static void cancel_discover(gpointer user_data)
@@ -0,0 +1,975 @@
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *  Copyright (C) 2012  Nokia Corporation
+ *
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+#include <glib.h>
+
+#include <bluetooth/bluetooth.h>
+#include <bluetooth/uuid.h>
+#include <bluetooth/sdp.h>
+
+#include "log.h"
+#include "storage.h"
+
+#include "att.h"
+#include "gattrib.h"
+#include "gatt.h"
+#include "gatt-cache.h"
+
+/*
+ * Attribute cache of a remote GATT server.
+ *
+ * Characteristic declarations and descriptors are kept sorted by handle,
+ * together with the handle ranges for which discovery completed. Storage
+ * uses one line per device with space separated entries:
+ *
+ *   cSSSS-EEEE			characteristics discovered in range
+ *   dSSSS-EEEE			descriptors discovered in range
+ *   CHHHH#PP#VVVV#<uuid>	characteristic declaration
+ *   DHHHH#<uuid>		descriptor
+ *
+ * UUIDs derived from the Bluetooth Base UUID are stored in 16-bit form.
+ */
+
+struct gatt_cache {
+	bdaddr_t sba;
+	bdaddr_t dba;
+	GSList *char_ranges;		/* struct att_range */
+	GSList *chars;			/* struct att_char */
+	GSList *desc_ranges;		/* struct att_range */
+	GSList *descs;			/* struct att_desc */
+	GSList *pending;		/* struct cache_discover */
+	GSList *waiting;		/* held until validated */
+	GAttrib *attrib;
+	guint validate_id;
+	guint svc_changed_id;
+	uint16_t svc_changed_handle;
+};
+
+struct cache_discover {
+	struct gatt_cache *cache;
+	uint16_t start;
+	uint16_t end;
+	bt_uuid_t uuid;
+	gboolean filter;
+	gboolean descs;
+	gatt_cb_t cb;
+	gpointer user_data;
+};
+
+static gboolean range_covered(GSList *ranges, uint16_t start, uint16_t end)
+{
+	GSList *l;
+
+	for (l = ranges; l; l = l->next) {
+		struct att_range *range = l->data;
+
+		if (range->start <= start && range->end >= end)
+			return TRUE;
+	}
+
+	return FALSE;
+}
+
+static GSList *range_remove(GSList *ranges, uint16_t start, uint16_t end)
+{
+	GSList *l, *next;
+
+	for (l = ranges; l; l = next) {
+		struct att_range *range = l->data;
+
+		next = l->next;
+
+		if (range->end < start || range->start > end)
+			continue;
+
+		if (range->start < start && range->end > end) {
+			struct att_range *tail = g_new0(struct att_range, 1);
+
+			tail->start = end + 1;
+			tail->end = range->end;
+			range->end = start - 1;
+			ranges = g_slist_insert_before(ranges, next, tail);
+			continue;
+		}
+
+		if (range->start < start) {
+			range->end = start - 1;
+			continue;
+		}
+
+		if (range->end > end) {
+			range->start = end + 1;
+			continue;
+		}
+
+		ranges = g_slist_delete_link(ranges, l);
+		g_free(range);
+	}
+
+	return ranges;
+}
+
+static gint range_cmp(gconstpointer a, gconstpointer b)
+{
+	const struct att_range *r1 = a;
+	const struct att_range *r2 = b;
+
+	return r1->start - r2->start;
+}
+
+static GSList *range_add(GSList *ranges, uint16_t start, uint16_t end)
+{
+	struct att_range *range;
+	GSList *l;
+
+	ranges = range_remove(ranges, start, end);
+
+	range = g_new0(struct att_range, 1);
+	range->start = start;
+	range->end = end;
+
+	ranges = g_slist_insert_sorted(ranges, range, range_cmp);
+
+	/* Merge adjacent ranges */
+	for (l = ranges; l && l->next; ) {
+		struct att_range *cur = l->data;
+		struct att_range *next = l->next->data;
+
+		if (cur->end != 0xffff && cur->end + 1 == next->start) {
+			cur->end = next->end;
+			g_free(next);
+			ranges = g_slist_delete_link(ranges, l->next);
+			continue;
+		}
+
+		l = l->next;
+	}
+
+	return ranges;
+}
+
+static gint char_handle_cmp(gconstpointer a, gconstpointer b)
+{
+	const struct att_char *c1 = a;
+	const struct att_char *c2 = b;
+
+	return c1->handle - c2->handle;
+}
+
+static gint desc_handle_cmp(gconstpointer a, gconstpointer b)
+{
+	const struct att_desc *d1 = a;
+	const struct att_desc *d2 = b;
+
+	return d1->handle - d2->handle;
+}
+
+static GSList *chars_remove(GSList *chars, uint16_t start, uint16_t end)
+{
+	GSList *l, *next;
+
+	for (l = chars; l; l = next) {
+		struct att_char *chr = l->data;
+
+		next = l->next;
+
+		if (chr->handle < start || chr->handle > end)
+			continue;
+
+		chars = g_slist_delete_link(chars, l);
+		g_free(chr);
+	}
+
+	return chars;
+}
+
+static GSList *descs_remove(GSList *descs, uint16_t start, uint16_t end)
+{
+	GSList *l, *next;
+
+	for (l = descs; l; l = next) {
+		struct att_desc *desc = l->data;
+
+		next = l->next;
+
+		if (desc->handle < start || desc->handle > end)
+			continue;
+
+		descs = g_slist_delete_link(descs, l);
+		g_free(desc);
+	}
+
+	return descs;
+}
+
+static void uuid_to_compact_string(const bt_uuid_t *uuid, char *str,
+								size_t n)
+{
+	bt_uuid_t canonical, u128;
+
+	bt_uuid_to_canonical(uuid, &canonical);
+
+	if (canonical.type == BT_UUID16) {
+		snprintf(str, n, "%04x", canonical.value.u16);
+		return;
+	}
+
+	bt_uuid_to_uuid128(uuid, &u128);
+	bt_uuid_to_string(&u128, str, n);
+}
+
+static int uuid_from_compact_string(bt_uuid_t *uuid, const char *str)
+{
+	bt_uuid_t tmp;
+
+	if (bt_string_to_uuid(&tmp, str) < 0)
+		return -1;
+
+	bt_uuid_to_uuid128(&tmp, uuid);
+
+	return 0;
+}
+
+static void append_ranges(GString *str, char prefix, GSList *ranges)
+{
+	GSList *l;
+
+	for (l = ranges; l; l = l->next) {
+		struct att_range *range = l->data;
+
+		g_string_append_printf(str, "%c%04X-%04X ", prefix,
+						range->start, range->end);
+	}
+}
+
+static void cache_store(struct gatt_cache *cache)
+{
+	char uuidstr[MAX_LEN_UUID_STR + 1];
+	GString *str;
+	GSList *l;
+
+	str = g_string_new(NULL);
+
+	append_ranges(str, 'c', cache->char_ranges);
+	append_ranges(str, 'd', cache->desc_ranges);
+
+	for (l = cache->chars; l; l = l->next) {
+		struct att_char *chr = l->data;
+		bt_uuid_t uuid;
+
+		if (bt_string_to_uuid(&uuid, chr->uuid) < 0)
+			continue;
+
+		uuid_to_compact_string(&uuid, uuidstr, sizeof(uuidstr));
+		g_string_append_printf(str, "C%04X#%02X#%04X#%s ", chr->handle,
+				chr->properties, chr->value_handle, uuidstr);
+	}
+
+	for (l = cache->descs; l; l = l->next) {
+		struct att_desc *desc = l->data;
+
+		uuid_to_compact_string(&desc->uuid, uuidstr, sizeof(uuidstr));
+		g_string_append_printf(str, "D%04X#%s ", desc->handle,
+								uuidstr);
+	}
+
+	write_device_attribute_cache(&cache->sba, &cache->dba, str->str);
+
+	g_string_free(str, TRUE);
+}
+
+static void cache_load_entry(struct gatt_cache *cache, const char *entry)
+{
+	char uuidstr[MAX_LEN_UUID_STR + 1];
+	uint16_t start, end, handle, value_handle;
+	uint8_t properties;
+	bt_uuid_t uuid;
+
+	switch (entry[0]) {
+	case 'c':
+	case 'd':
+		if (sscanf(&entry[1], "%04hX-%04hX", &start, &end) != 2)
+			break;
+
+		if (entry[0] == 'c')
+			cache->char_ranges = range_add(cache->char_ranges,
+								start, end);
+		else
+			cache->desc_ranges = range_add(cache->desc_ranges,
+								start, end);
+		break;
+	case 'C':
+		if (sscanf(&entry[1], "%04hX#%02hhX#%04hX#%37s", &handle,
+				&properties, &value_handle, uuidstr) != 4)
+			break;
+
+		if (uuid_from_compact_string(&uuid, uuidstr) < 0)
+			break;
+
+		{
+			struct att_char *chr = g_new0(struct att_char, 1);
+
+			chr->handle = handle;
+			chr->properties = properties;
+			chr->value_handle = value_handle;
+			bt_uuid_to_string(&uuid, chr->uuid, sizeof(chr->uuid));
+
+			cache->chars = g_slist_insert_sorted(cache->chars,
+							chr, char_handle_cmp);
+		}
+		break;
+	case 'D':
+		if (sscanf(&entry[1], "%04hX#%37s", &handle, uuidstr) != 2)
+			break;
+
+		if (bt_string_to_uuid(&uuid, uuidstr) < 0)
+			break;
+
+		{
+			struct att_desc *desc = g_new0(struct att_desc, 1);
+
+			desc->handle = handle;
+			desc->uuid = uuid;
+
+			cache->descs = g_slist_insert_sorted(cache->descs,
+							desc, desc_handle_cmp);
+		}
+		break;
+	}
+}
+
+static void cache_load(struct gatt_cache *cache)
+{
+	char **entries;
+	char *str;
+	int i;
+
+	str = read_device_attribute_cache(&cache->sba, &cache->dba);
+	if (str == NULL)
+		return;
+
+	entries = g_strsplit(str, " ", 0);
+	free(str);
+
+	for (i = 0; entries[i]; i++) {
+		if (entries[i][0] == '\0')
+			continue;
+
+		cache_load_entry(cache, entries[i]);
+	}
+
+	g_strfreev(entries);
+}
+
+struct gatt_cache *gatt_cache_new(const bdaddr_t *sba, const bdaddr_t *dba)
+{
+	struct gatt_cache *cache;
+
+	cache = g_new0(struct gatt_cache, 1);
+	bacpy(&cache->sba, sba);
+	bacpy(&cache->dba, dba);
+
+	cache_load(cache);
+
+	return cache;
+}
+
+static void cache_release_attrib(struct gatt_cache *cache)
+{
+	/* Like requests queued in GAttrib, held ones are dropped silently
+	 * when the link goes away */
+	g_slist_free_full(cache->waiting, g_free);
+	cache->waiting = NULL;
+
+	if (cache->attrib == NULL)
+		return;
+
+	if (cache->validate_id > 0) {
+		g_attrib_cancel(cache->attrib, cache->validate_id);
+		cache->validate_id = 0;
+	}
+
+	if (cache->svc_changed_id > 0) {
+		g_attrib_unregister(cache->attrib, cache->svc_changed_id);
+		cache->svc_changed_id = 0;
+	}
+
+	g_attrib_unref(cache->attrib);
+	cache->attrib = NULL;
+}
+
+static void cache_reset(struct gatt_cache *cache)
+{
+	g_slist_free_full(cache->char_ranges, g_free);
+	g_slist_free_full(cache->chars, g_free);
+	g_slist_free_full(cache->desc_ranges, g_free);
+	g_slist_free_full(cache->descs, g_free);
+
+	cache->char_ranges = NULL;
+	cache->chars = NULL;
+	cache->desc_ranges = NULL;
+	cache->descs = NULL;
+	cache->svc_changed_handle = 0;
+}
+
+void gatt_cache_free(struct gatt_cache *cache)
+{
+	GSList *l;
+
+	/* Discoveries still in flight complete without touching the cache */
+	for (l = cache->pending; l; l = l->next) {
+		struct cache_discover *cd = l->data;
+
+		cd->cache = NULL;
+	}
+
+	g_slist_free(cache->pending);
+
+	cache_release_attrib(cache);
+	cache_reset(cache);
+	g_free(cache);
+}
+
+void gatt_cache_clear(struct gatt_cache *cache)
+{
+	DBG("Clearing attribute cache");
+
+	cache_reset(cache);
+	cache_store(cache);
+}
+
+void gatt_cache_invalidate(struct gatt_cache *cache, uint16_t start,
+								uint16_t end)
+{
+	DBG("Invalidating attribute cache range 0x%04x-0x%04x", start, end);
+
+	cache->char_ranges = range_remove(cache->char_ranges, start, end);
+	cache->chars = chars_remove(cache->chars, start, end);
+	cache->desc_ranges = range_remove(cache->desc_ranges, start, end);
+	cache->descs = descs_remove(cache->descs, start, end);
+
+	if (cache->svc_changed_handle >= start &&
+					cache->svc_changed_handle <= end)
+		cache->svc_changed_handle = 0;
+
+	cache_store(cache);
+}
+
+static gboolean cache_lookup_chars(struct gatt_cache *cache, uint16_t start,
+				uint16_t end, bt_uuid_t *uuid, GSList **chars)
+{
+	char uuidstr[MAX_LEN_UUID_STR + 1];
+	GSList *l, *result = NULL;
+
+	if (!range_covered(cache->char_ranges, start, end))
+		return FALSE;
+
+	if (uuid) {
+		bt_uuid_t u128;
+
+		bt_uuid_to_uuid128(uuid, &u128);
+		bt_uuid_to_string(&u128, uuidstr, sizeof(uuidstr));
+	}
+
+	for (l = cache->chars; l; l = l->next) {
+		struct att_char *chr = l->data;
+
+		if (chr->handle < start)
+			continue;
+
+		if (chr->handle > end)
+			break;
+
+		if (uuid && strcasecmp(chr->uuid, uuidstr) != 0)
+			continue;
+
+		result = g_slist_prepend(result, chr);
+	}
+
+	*chars = g_slist_reverse(result);
+
+	return TRUE;
+}
+
+static gboolean cache_lookup_descs(struct gatt_cache *cache, uint16_t start,
+						uint16_t end, GSList **descs)
+{
+	GSList *l, *result = NULL;
+
+	if (!range_covered(cache->desc_ranges, start, end))
+		return FALSE;
+
+	for (l = cache->descs; l; l = l->next) {
+		struct att_desc *desc = l->data;
+
+		if (desc->handle < start)
+			continue;
+
+		if (desc->handle > end)
+			break;
+
+		result = g_slist_prepend(result, desc);
+	}
+
+	*descs = g_slist_reverse(result);
+
+	return TRUE;
+}
+
+/* Entries are not handed out while the revalidation request is in
+ * flight, callers fall back to discovery until it completes */
+gboolean gatt_cache_get_chars(struct gatt_cache *cache, uint16_t start,
+				uint16_t end, bt_uuid_t *uuid, GSList **chars)
+{
+	if (cache->validate_id > 0)
+		return FALSE;
+
+	return cache_lookup_chars(cache, start, end, uuid, chars);
+}
+
+gboolean gatt_cache_get_descs(struct gatt_cache *cache, uint16_t start,
+						uint16_t end, GSList **descs)
+{
+	if (cache->validate_id > 0)
+		return FALSE;
+
+	return cache_lookup_descs(cache, start, end, descs);
+}
+
+void gatt_cache_set_chars(struct gatt_cache *cache, uint16_t start,
+					uint16_t end, GSList *chars)
+{
+	GSList *l;
+
+	cache->chars = chars_remove(cache->chars, start, end);
+
+	for (l = chars; l; l = l->next) {
+		struct att_char *chr = g_memdup(l->data,
+						sizeof(struct att_char));
+
+		cache->chars = g_slist_insert_sorted(cache->chars, chr,
+							char_handle_cmp);
+	}
+
+	cache->char_ranges = range_add(cache->char_ranges, start, end);
+
+	cache_store(cache);
+}
+
+void gatt_cache_set_descs(struct gatt_cache *cache, uint16_t start,
+					uint16_t end, GSList *descs)
+{
+	GSList *l;
+
+	cache->descs = descs_remove(cache->descs, start, end);
+
+	for (l = descs; l; l = l->next) {
+		struct att_desc *desc = g_memdup(l->data,
+						sizeof(struct att_desc));
+
+		cache->descs = g_slist_insert_sorted(cache->descs, desc,
+							desc_handle_cmp);
+	}
+
+	cache->desc_ranges = range_add(cache->desc_ranges, start, end);
+
+	cache_store(cache);
+}
+
+static struct cache_discover *cache_discover_new(struct gatt_cache *cache,
+					uint16_t start, uint16_t end,
+					bt_uuid_t *uuid, gatt_cb_t func,
+					gpointer user_data)
+{
+	struct cache_discover *cd;
+
+	cd = g_new0(struct cache_discover, 1);
+	cd->cache = cache;
+	cd->start = start;
+	cd->end = end;
+	cd->cb = func;
+	cd->user_data = user_data;
+
+	if (uuid) {
+		bt_uuid_to_uuid128(uuid, &cd->uuid);
+		cd->filter = TRUE;
+	}
+
+	cache->pending = g_slist_prepend(cache->pending, cd);
+
+	return cd;
+}
+
+static void cache_wait(struct gatt_cache *cache, uint16_t start,
+					uint16_t end, bt_uuid_t *uuid,
+					gboolean descs, gatt_cb_t func,
+					gpointer user_data)
+{
+	struct cache_discover *cd;
+
+	cd = g_new0(struct cache_discover, 1);
+	cd->start = start;
+	cd->end = end;
+	cd->descs = descs;
+	cd->cb = func;
+	cd->user_data = user_data;
+
+	if (uuid) {
+		bt_uuid_to_uuid128(uuid, &cd->uuid);
+		cd->filter = TRUE;
+	}
+
+	cache->waiting = g_slist_append(cache->waiting, cd);
+}
+
+static void cache_discover_free(struct cache_discover *cd)
+{
+	if (cd->cache)
+		cd->cache->pending = g_slist_remove(cd->cache->pending, cd);
+
+	g_free(cd);
+}
+
+static void char_discovered_cb(GSList *characteristics, guint8 status,
+							gpointer user_data)
+{
+	struct cache_discover *cd = user_data;
+	GSList *l, *filtered = NULL;
+
+	if (status == 0 && cd->cache)
+		gatt_cache_set_chars(cd->cache, cd->start, cd->end,
+							characteristics);
+
+	if (status != 0 || !cd->filter) {
+		cd->cb(characteristics, status, cd->user_data);
+		goto done;
+	}
+
+	for (l = characteristics; l; l = l->next) {
+		struct att_char *chr = l->data;
+		bt_uuid_t uuid;
+
+		if (bt_string_to_uuid(&uuid, chr->uuid) < 0)
+			continue;
+
+		if (bt_uuid_equal(&uuid, &cd->uuid))
+			filtered = g_slist_append(filtered, chr);
+	}
+
+	cd->cb(filtered, status, cd->user_data);
+	g_slist_free(filtered);
+
+done:
+	cache_discover_free(cd);
+}
+
+gboolean gatt_cache_discover_char(struct gatt_cache *cache, GAttrib *attrib,
+					uint16_t start, uint16_t end,
+					bt_uuid_t *uuid, gatt_cb_t func,
+					gpointer user_data)
+{
+	struct cache_discover *cd;
+	GSList *chars;
+
+	if (cache->validate_id > 0) {
+		cache_wait(cache, start, end, uuid, FALSE, func, user_data);
+		return TRUE;
+	}
+
+	if (cache_lookup_chars(cache, start, end, uuid, &chars)) {
+		func(chars, 0, user_data);
+		g_slist_free(chars);
+		return TRUE;
+	}
+
+	/* The whole range is discovered so it can be cached, filtering by
+	 * UUID is done afterwards */
+	cd = cache_discover_new(cache, start, end, uuid, func, user_data);
+	if (gatt_discover_char(attrib, start, end, NULL, char_discovered_cb,
+								cd) == 0) {
+		cache_discover_free(cd);
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+static void desc_discovered_cb(GSList *descriptors, guint8 status,
+							gpointer user_data)
+{
+	struct cache_discover *cd = user_data;
+
+	if (status == 0 && cd->cache)
+		gatt_cache_set_descs(cd->cache, cd->start, cd->end,
+								descriptors);
+
+	cd->cb(descriptors, status, cd->user_data);
+
+	cache_discover_free(cd);
+}
+
+gboolean gatt_cache_discover_desc(struct gatt_cache *cache, GAttrib *attrib,
+					uint16_t start, uint16_t end,
+					gatt_cb_t func, gpointer user_data)
+{
+	struct cache_discover *cd;
+	GSList *descs;
+
+	if (cache->validate_id > 0) {
+		cache_wait(cache, start, end, NULL, TRUE, func, user_data);
+		return TRUE;
+	}
+
+	if (cache_lookup_descs(cache, start, end, &descs)) {
+		func(descs, 0, user_data);
+		g_slist_free(descs);
+		return TRUE;
+	}
+
+	cd = cache_discover_new(cache, start, end, NULL, func, user_data);
+	if (gatt_discover_desc(attrib, start, end, desc_discovered_cb,
+								cd) == 0) {
+		cache_discover_free(cd);
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+static void svc_changed_handler(const uint8_t *pdu, uint16_t len,
+							gpointer user_data)
+{
+	struct gatt_cache *cache = user_data;
+	uint8_t opdu[ATT_DEFAULT_LE_MTU];
+	uint16_t handle, olen;
+
+	if (len < 7)
+		return;
+
+	handle = att_get_u16(&pdu[1]);
+	if (handle == 0 || handle != cache->svc_changed_handle)
+		return;
+
+	gatt_cache_invalidate(cache, att_get_u16(&pdu[3]),
+						att_get_u16(&pdu[5]));
+
+	olen = enc_confirmation(opdu, sizeof(opdu));
+	g_attrib_send(cache->attrib, 0, opdu[0], opdu, olen, NULL, NULL,
+									NULL);
+}
+
+static void svc_changed_watch(struct gatt_cache *cache)
+{
+	struct att_char *svc_changed = NULL;
+	uint16_t end = 0xffff;
+	uint8_t value[2];
+	bt_uuid_t uuid;
+	GSList *l, *descs;
+
+	bt_uuid16_create(&uuid, GATT_CHARAC_SERVICE_CHANGED);
+
+	for (l = cache->chars; l; l = l->next) {
+		struct att_char *chr = l->data;
+		bt_uuid_t u;
+
+		if (svc_changed) {
+			end = chr->handle - 1;
+			break;
+		}
+
+		if (bt_string_to_uuid(&u, chr->uuid) < 0)
+			continue;
+
+		if (bt_uuid_equal(&u, &uuid))
+			svc_changed = chr;
+	}
+
+	if (svc_changed == NULL)
+		return;
+
+	cache->svc_changed_handle = svc_changed->value_handle;
+	cache->svc_changed_id = g_attrib_register(cache->attrib,
+						ATT_OP_HANDLE_IND,
+						svc_changed_handler,
+						cache, NULL);
+
+	if (!cache_lookup_descs(cache, svc_changed->value_handle + 1, end,
+								&descs))
+		return;
+
+	bt_uuid16_create(&uuid, GATT_CLIENT_CHARAC_CFG_UUID);
+
+	for (l = descs; l; l = l->next) {
+		struct att_desc *desc = l->data;
+
+		if (!bt_uuid_equal(&desc->uuid, &uuid))
+			continue;
+
+		att_put_u16(ATT_CLIENT_CHAR_CONF_INDICATION, value);
+		gatt_write_char(cache->attrib, desc->handle, value,
+						sizeof(value), NULL, NULL);
+		break;
+	}
+
+	g_slist_free(descs);
+}
+
+/* Requests held during revalidation are served from whatever survived
+ * it, or discovered again */
+static void cache_resume_waiting(struct gatt_cache *cache)
+{
+	GSList *waiting = cache->waiting, *l;
+
+	cache->waiting = NULL;
+
+	for (l = waiting; l; l = l->next) {
+		struct cache_discover *cd = l->data;
+		gboolean sent;
+
+		if (cd->descs)
+			sent = gatt_cache_discover_desc(cache, cache->attrib,
+						cd->start, cd->end,
+						cd->cb, cd->user_data);
+		else
+			sent = gatt_cache_discover_char(cache, cache->attrib,
+						cd->start, cd->end,
+						cd->filter ? &cd->uuid : NULL,
+						cd->cb, cd->user_data);
+
+		if (!sent)
+			cd->cb(NULL, ATT_ECODE_IO, cd->user_data);
+
+		g_free(cd);
+	}
+
+	g_slist_free(waiting);
+}
+
+static void validate_cb(guint8 status, const guint8 *pdu, guint16 len,
+							gpointer user_data)
+{
+	struct gatt_cache *cache = user_data;
+	struct att_data_list *list;
+	struct att_char *last;
+	gboolean valid = FALSE;
+	bt_uuid_t uuid, cached;
+
+	cache->validate_id = 0;
+
+	/* Servers may refuse the read for security reasons, the cache is
+	 * only dropped when the declaration is known to be gone */
+	if (cache->chars == NULL || (status != 0 &&
+					status != ATT_ECODE_ATTR_NOT_FOUND &&
+					status != ATT_ECODE_INVALID_HANDLE)) {
+		cache_resume_waiting(cache);
+		return;
+	}
+
+	last = g_slist_last(cache->chars)->data;
+
+	if (status != 0)
+		goto done;
+
+	list = dec_read_by_type_resp(pdu, len);
+	if (list == NULL)
+		goto done;
+
+	if (list->num == 1 && (list->len == 7 || list->len == 21)) {
+		uint8_t *value = list->data[0];
+
+		if (list->len == 7)
+			uuid = att_get_uuid16(&value[5]);
+		else
+			uuid = att_get_uuid128(&value[5]);
+
+		if (bt_string_to_uuid(&cached, last->uuid) == 0 &&
+				att_get_u16(value) == last->handle &&
+				value[2] == last->properties &&
+				att_get_u16(&value[3]) == last->value_handle &&
+				bt_uuid_equal(&uuid, &cached))
+			valid = TRUE;
+	}
+
+	att_data_list_free(list);
+
+done:
+	if (valid)
+		DBG("Attribute cache is up to date");
+	else {
+		DBG("Attribute cache is stale");
+		gatt_cache_clear(cache);
+	}
+
+	cache_resume_waiting(cache);
+}
+
+/*
+ * Revalidation costs a single request: the last cached characteristic
+ * declaration is read back and compared. Further changes are tracked
+ * through Service Changed indications while the link is up.
+ */
+void gatt_cache_attach(struct gatt_cache *cache, GAttrib *attrib)
+{
+	struct att_char *last;
+	uint8_t *buf;
+	bt_uuid_t uuid;
+	guint16 plen;
+	int buflen;
+
+	/* Already attached to this link, keep the ongoing validation */
+	if (cache->attrib == attrib)
+		return;
+
+	cache_release_attrib(cache);
+
+	if (cache->chars == NULL)
+		return;
+
+	cache->attrib = g_attrib_ref(attrib);
+
+	svc_changed_watch(cache);
+
+	last = g_slist_last(cache->chars)->data;
+
+	bt_uuid16_create(&uuid, GATT_CHARAC_UUID);
+
+	buf = g_attrib_get_buffer(attrib, &buflen);
+	plen = enc_read_by_type_req(last->handle, last->handle, &uuid, buf,
+								buflen);
+	if (plen == 0)
+		return;
+
+	cache->validate_id = g_attrib_send(attrib, 0, ATT_OP_READ_BY_TYPE_REQ,
+					buf, plen, validate_cb, cache, NULL);
+}
+
+void gatt_cache_detach(struct gatt_cache *cache)
+{
+	cache_release_attrib(cache);
+}
@@ -0,0 +1,56 @@
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *  Copyright (C) 2012  Nokia Corporation
+ *
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+struct gatt_cache;
+
+struct gatt_cache *gatt_cache_new(const bdaddr_t *sba, const bdaddr_t *dba);
+void gatt_cache_free(struct gatt_cache *cache);
+
+void gatt_cache_clear(struct gatt_cache *cache);
+void gatt_cache_invalidate(struct gatt_cache *cache, uint16_t start,
+							uint16_t end);
+
+/* Synchronous lookups: return FALSE if the range was never discovered.
+ * On success the list holds pointers owned by the cache. */
+gboolean gatt_cache_get_chars(struct gatt_cache *cache, uint16_t start,
+				uint16_t end, bt_uuid_t *uuid, GSList **chars);
+gboolean gatt_cache_get_descs(struct gatt_cache *cache, uint16_t start,
+						uint16_t end, GSList **descs);
+
+void gatt_cache_set_chars(struct gatt_cache *cache, uint16_t start,
+					uint16_t end, GSList *chars);
+void gatt_cache_set_descs(struct gatt_cache *cache, uint16_t start,
+					uint16_t end, GSList *descs);
+
+/* Drop-in replacements for gatt_discover_char() and gatt_discover_desc():
+ * the callback is called immediately when the range is cached. */
+gboolean gatt_cache_discover_char(struct gatt_cache *cache, GAttrib *attrib,
+					uint16_t start, uint16_t end,
+					bt_uuid_t *uuid, gatt_cb_t func,
+					gpointer user_data);
+gboolean gatt_cache_discover_desc(struct gatt_cache *cache, GAttrib *attrib,
+					uint16_t start, uint16_t end,
+					gatt_cb_t func, gpointer user_data);
+
+void gatt_cache_attach(struct gatt_cache *cache, GAttrib *attrib);
+void gatt_cache_detach(struct gatt_cache *cache);
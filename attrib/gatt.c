@@ -56,6 +56,14 @@ struct discover_char {
 	void *user_data;
 };
 
+struct discover_desc {
+	GAttrib *attrib;
+	uint16_t end;
+	GSList *descriptors;
+	gatt_cb_t cb;
+	void *user_data;
+};
+
 static void discover_primary_free(struct discover_primary *dp)
 {
 	g_slist_free(dp->primaries);
@@ -71,6 +79,13 @@ static void discover_char_free(struct discover_char *dc)
 	g_free(dc);
 }
 
+static void discover_desc_free(struct discover_desc *dd)
+{
+	g_slist_free_full(dd->descriptors, g_free);
+	g_attrib_unref(dd->attrib);
+	g_free(dd);
+}
+
 static guint16 encode_discover_primary(uint16_t start, uint16_t end,
 				bt_uuid_t *uuid, uint8_t *pdu, size_t len)
 {
@@ -275,29 +290,31 @@ static void char_discovered_cb(guint8 status, const guint8 *ipdu, guint16 iplen,
 	for (i = 0; i < list->num; i++) {
 		uint8_t *value = list->data[i];
 		struct att_char *chars;
-		bt_uuid_t uuid;
+		bt_uuid_t uuid, u128;
 
 		last = att_get_u16(value);
 
-		if (list->len == 7) {
-			bt_uuid_t uuid16 = att_get_uuid16(&value[5]);
-			bt_uuid_to_uuid128(&uuid16, &uuid);
-		} else
+		if (list->len == 7)
+			uuid = att_get_uuid16(&value[5]);
+		else
 			uuid = att_get_uuid128(&value[5]);
 
+		if (dc->uuid && !bt_uuid_equal(dc->uuid, &uuid))
+			break;
+
+		/* Characteristic UUIDs are always reported in 128-bit form */
+		bt_uuid_to_uuid128(&uuid, &u128);
+
 		chars = g_try_new0(struct att_char, 1);
 		if (!chars) {
 			err = ATT_ECODE_INSUFF_RESOURCES;
 			goto done;
 		}
 
-		if (dc->uuid && bt_uuid_cmp(dc->uuid, &uuid))
-			break;
-
 		chars->handle = last;
 		chars->properties = value[2];
 		chars->value_handle = att_get_u16(&value[3]);
-		bt_uuid_to_string(&uuid, chars->uuid, sizeof(chars->uuid));
+		bt_uuid_to_string(&u128, chars->uuid, sizeof(chars->uuid));
 		dc->characteristics = g_slist_append(dc->characteristics,
 									chars);
 	}
@@ -373,17 +390,36 @@ guint gatt_read_char_by_uuid(GAttrib *attrib, uint16_t start, uint16_t end,
 					buf, plen, func, user_data, NULL);
 }
 
+/*
+ * Long values are streamed into a buffer allocated once, when the first
+ * response fills the MTU, with room for the largest attribute value the
+ * protocol allows. The buffer keeps the opcode in the first byte so the
+ * callback gets the same layout as a Read Response.
+ */
 struct read_long_data {
 	GAttrib *attrib;
 	GAttribResultFunc func;
+	gatt_progress_cb_t progress;
 	gpointer user_data;
 	guint8 *buffer;
 	guint16 size;
 	guint16 handle;
+	guint16 offset;
+	GTimer *timer;
 	guint id;
 	gint ref;
 };
 
+static guint32 transfer_rate(GTimer *timer, guint16 bytes)
+{
+	gdouble elapsed = g_timer_elapsed(timer, NULL);
+
+	if (elapsed <= 0)
+		return 0;
+
+	return bytes / elapsed;
+}
+
 static void read_long_destroy(gpointer user_data)
 {
 	struct read_long_data *long_read = user_data;
@@ -394,16 +430,47 @@ static void read_long_destroy(gpointer user_data)
 	if (long_read->buffer != NULL)
 		g_free(long_read->buffer);
 
+	g_timer_destroy(long_read->timer);
 	g_free(long_read);
 }
 
+static gboolean read_long_append(struct read_long_data *long_read,
+					guint8 opcode, const guint8 *value,
+					guint16 vlen)
+{
+	guint16 room;
+
+	if (long_read->buffer == NULL) {
+		long_read->buffer = g_try_malloc(ATT_MAX_VALUE_LEN + 1);
+		if (long_read->buffer == NULL)
+			return FALSE;
+
+		long_read->buffer[0] = opcode;
+		long_read->size = 1;
+	}
+
+	room = ATT_MAX_VALUE_LEN + 1 - long_read->size;
+	if (vlen > room)
+		vlen = room;
+
+	memcpy(&long_read->buffer[long_read->size], value, vlen);
+	long_read->size += vlen;
+
+	if (long_read->progress)
+		long_read->progress(long_read->size - 1, 0,
+				transfer_rate(long_read->timer,
+						long_read->size - 1),
+				long_read->user_data);
+
+	return TRUE;
+}
+
 static void read_blob_helper(guint8 status, const guint8 *rpdu, guint16 rlen,
 							gpointer user_data)
 {
 	struct read_long_data *long_read = user_data;
 	uint8_t *buf;
 	int buflen;
-	guint8 *tmp;
 	guint16 plen;
 	guint id;
 
@@ -412,23 +479,19 @@ static void read_blob_helper(guint8 status, const guint8 *rpdu, guint16 rlen,
 		goto done;
 	}
 
-	tmp = g_try_realloc(long_read->buffer, long_read->size + rlen - 1);
-
-	if (tmp == NULL) {
+	if (!read_long_append(long_read, ATT_OP_READ_BLOB_RESP, &rpdu[1],
+								rlen - 1)) {
 		status = ATT_ECODE_INSUFF_RESOURCES;
 		goto done;
 	}
 
-	memcpy(&tmp[long_read->size], &rpdu[1], rlen - 1);
-	long_read->buffer = tmp;
-	long_read->size += rlen - 1;
-
 	buf = g_attrib_get_buffer(long_read->attrib, &buflen);
-	if (rlen < buflen)
+	if (rlen < buflen || long_read->size > ATT_MAX_VALUE_LEN)
 		goto done;
 
-	plen = enc_read_blob_req(long_read->handle, long_read->size - 1,
-								buf, buflen);
+	plen = enc_read_blob_req(long_read->handle,
+				long_read->offset + long_read->size - 1,
+				buf, buflen);
 	id = g_attrib_send(long_read->attrib, long_read->id,
 				ATT_OP_READ_BLOB_REQ, buf, plen,
 				read_blob_helper, long_read, read_long_destroy);
@@ -457,14 +520,9 @@ static void read_char_helper(guint8 status, const guint8 *rpdu,
 	if (status != 0 || rlen < buflen)
 		goto done;
 
-	long_read->buffer = g_malloc(rlen);
-
-	if (long_read->buffer == NULL)
+	if (!read_long_append(long_read, rpdu[0], &rpdu[1], rlen - 1))
 		goto done;
 
-	memcpy(long_read->buffer, rpdu, rlen);
-	long_read->size = rlen;
-
 	plen = enc_read_blob_req(long_read->handle, rlen - 1, buf, buflen);
 	id = g_attrib_send(long_read->attrib, long_read->id,
 			ATT_OP_READ_BLOB_REQ, buf, plen, read_blob_helper,
@@ -481,8 +539,10 @@ done:
 	long_read->func(status, rpdu, rlen, long_read->user_data);
 }
 
-guint gatt_read_char(GAttrib *attrib, uint16_t handle, uint16_t offset,
-				GAttribResultFunc func, gpointer user_data)
+guint gatt_read_long_char(GAttrib *attrib, uint16_t handle, uint16_t offset,
+				GAttribResultFunc func,
+				gatt_progress_cb_t progress,
+				gpointer user_data)
 {
 	uint8_t *buf;
 	int buflen;
@@ -497,8 +557,11 @@ guint gatt_read_char(GAttrib *attrib, uint16_t handle, uint16_t offset,
 
 	long_read->attrib = attrib;
 	long_read->func = func;
+	long_read->progress = progress;
 	long_read->user_data = user_data;
 	long_read->handle = handle;
+	long_read->offset = offset;
+	long_read->timer = g_timer_new();
 
 	buf = g_attrib_get_buffer(attrib, &buflen);
 	if (offset > 0) {
@@ -512,9 +575,10 @@ guint gatt_read_char(GAttrib *attrib, uint16_t handle, uint16_t offset,
 				read_char_helper, long_read, read_long_destroy);
 	}
 
-	if (id == 0)
+	if (id == 0) {
+		g_timer_destroy(long_read->timer);
 		g_free(long_read);
-	else {
+	} else {
 		g_atomic_int_inc(&long_read->ref);
 		long_read->id = id;
 	}
@@ -522,6 +586,219 @@ guint gatt_read_char(GAttrib *attrib, uint16_t handle, uint16_t offset,
 	return id;
 }
 
+guint gatt_read_char(GAttrib *attrib, uint16_t handle, uint16_t offset,
+				GAttribResultFunc func, gpointer user_data)
+{
+	return gatt_read_long_char(attrib, handle, offset, func, NULL,
+								user_data);
+}
+
+/*
+ * Long and reliable writes queue the value with Prepare Write Requests
+ * filling the MTU and commit it with a single Execute Write Request. All
+ * requests reuse the first command id so they stay at the head of the
+ * GAttrib queue and no other request gets interleaved.
+ */
+struct write_long_data {
+	GAttrib *attrib;
+	GAttribResultFunc func;
+	gatt_progress_cb_t progress;
+	gpointer user_data;
+	guint8 *value;
+	guint16 vlen;
+	guint16 handle;
+	guint16 offset;
+	guint16 chunk;
+	gboolean reliable;
+	guint8 status;
+	GTimer *timer;
+	guint id;
+	gint ref;
+};
+
+static void write_long_destroy(gpointer user_data)
+{
+	struct write_long_data *long_write = user_data;
+
+	if (g_atomic_int_dec_and_test(&long_write->ref) == FALSE)
+		return;
+
+	g_timer_destroy(long_write->timer);
+	g_free(long_write->value);
+	g_free(long_write);
+}
+
+static gboolean write_long_send(struct write_long_data *long_write,
+				guint8 opcode, const guint8 *pdu, guint16 plen,
+				GAttribResultFunc func)
+{
+	guint id;
+
+	id = g_attrib_send(long_write->attrib, long_write->id, opcode, pdu,
+				plen, func, long_write, write_long_destroy);
+	if (id == 0)
+		return FALSE;
+
+	long_write->id = id;
+	g_atomic_int_inc(&long_write->ref);
+
+	return TRUE;
+}
+
+static void exec_write_cb(guint8 status, const guint8 *rpdu, guint16 rlen,
+							gpointer user_data)
+{
+	struct write_long_data *long_write = user_data;
+
+	/* A failure while preparing overrides the cancel result */
+	if (long_write->status != 0)
+		status = long_write->status;
+	else if (status == 0 && !dec_exec_write_resp(rpdu, rlen))
+		status = ATT_ECODE_IO;
+
+	long_write->func(status, rpdu, rlen, long_write->user_data);
+}
+
+static void exec_write(struct write_long_data *long_write, guint8 flags)
+{
+	uint8_t *buf;
+	int buflen;
+	guint16 plen;
+
+	buf = g_attrib_get_buffer(long_write->attrib, &buflen);
+	plen = enc_exec_write_req(flags, buf, buflen);
+
+	if (write_long_send(long_write, ATT_OP_EXEC_WRITE_REQ, buf, plen,
+							exec_write_cb))
+		return;
+
+	if (long_write->status == 0)
+		long_write->status = ATT_ECODE_IO;
+
+	long_write->func(long_write->status, NULL, 0, long_write->user_data);
+}
+
+static void prep_write_cb(guint8 status, const guint8 *rpdu, guint16 rlen,
+							gpointer user_data);
+
+static void prep_write_next(struct write_long_data *long_write)
+{
+	uint8_t *buf;
+	int buflen;
+	guint16 plen, vlen;
+
+	vlen = MIN(long_write->chunk, long_write->vlen - long_write->offset);
+
+	buf = g_attrib_get_buffer(long_write->attrib, &buflen);
+	plen = enc_prep_write_req(long_write->handle, long_write->offset,
+				&long_write->value[long_write->offset], vlen,
+				buf, buflen);
+
+	if (plen == 0 || !write_long_send(long_write, ATT_OP_PREP_WRITE_REQ,
+						buf, plen, prep_write_cb)) {
+		long_write->status = ATT_ECODE_IO;
+		exec_write(long_write, ATT_EXEC_WRITE_CANCEL);
+	}
+}
+
+static void prep_write_cb(guint8 status, const guint8 *rpdu, guint16 rlen,
+							gpointer user_data)
+{
+	struct write_long_data *long_write = user_data;
+	uint8_t value[ATT_MAX_MTU];
+	uint16_t handle, offset;
+	int vlen;
+
+	if (status != 0) {
+		long_write->status = status;
+		exec_write(long_write, ATT_EXEC_WRITE_CANCEL);
+		return;
+	}
+
+	if (!dec_prep_write_resp(rpdu, rlen, &handle, &offset, value,
+						sizeof(value), &vlen)) {
+		long_write->status = ATT_ECODE_IO;
+		exec_write(long_write, ATT_EXEC_WRITE_CANCEL);
+		return;
+	}
+
+	/* Reliable writes check the echoed value before committing */
+	if (long_write->reliable && (handle != long_write->handle ||
+			offset != long_write->offset ||
+			offset + vlen > long_write->vlen ||
+			memcmp(value, &long_write->value[offset], vlen) != 0)) {
+		long_write->status = ATT_ECODE_UNLIKELY;
+		exec_write(long_write, ATT_EXEC_WRITE_CANCEL);
+		return;
+	}
+
+	long_write->offset += MIN(long_write->chunk,
+				long_write->vlen - long_write->offset);
+
+	if (long_write->progress)
+		long_write->progress(long_write->offset, long_write->vlen,
+				transfer_rate(long_write->timer,
+							long_write->offset),
+				long_write->user_data);
+
+	if (long_write->offset < long_write->vlen) {
+		prep_write_next(long_write);
+		return;
+	}
+
+	exec_write(long_write, ATT_EXEC_WRITE_COMMIT);
+}
+
+guint gatt_write_long_char(GAttrib *attrib, uint16_t handle,
+				const uint8_t *value, uint16_t vlen,
+				gboolean reliable, GAttribResultFunc func,
+				gatt_progress_cb_t progress,
+				gpointer user_data)
+{
+	struct write_long_data *long_write;
+	uint8_t *buf;
+	int buflen;
+	guint16 plen;
+
+	buf = g_attrib_get_buffer(attrib, &buflen);
+
+	/* Fits in a single Write Request */
+	if (!reliable && vlen <= buflen - 3)
+		return gatt_write_char(attrib, handle, (uint8_t *) value, vlen,
+							func, user_data);
+
+	if (vlen == 0 || vlen > ATT_MAX_VALUE_LEN || func == NULL)
+		return 0;
+
+	long_write = g_try_new0(struct write_long_data, 1);
+	if (long_write == NULL)
+		return 0;
+
+	long_write->attrib = attrib;
+	long_write->func = func;
+	long_write->progress = progress;
+	long_write->user_data = user_data;
+	long_write->value = g_memdup(value, vlen);
+	long_write->vlen = vlen;
+	long_write->handle = handle;
+	long_write->chunk = buflen - 5;
+	long_write->reliable = reliable;
+	long_write->timer = g_timer_new();
+
+	plen = enc_prep_write_req(handle, 0, value,
+					MIN(long_write->chunk, vlen),
+					buf, buflen);
+	if (!write_long_send(long_write, ATT_OP_PREP_WRITE_REQ, buf, plen,
+							prep_write_cb)) {
+		g_timer_destroy(long_write->timer);
+		g_free(long_write->value);
+		g_free(long_write);
+		return 0;
+	}
+
+	return long_write->id;
+}
+
 guint gatt_write_char(GAttrib *attrib, uint16_t handle, uint8_t *value,
 			int vlen, GAttribResultFunc func, gpointer user_data)
 {
@@ -541,31 +818,124 @@ guint gatt_write_char(GAttrib *attrib, uint16_t handle, uint8_t *value,
 
 guint gatt_exchange_mtu(GAttrib *attrib, uint16_t mtu, GAttribResultFunc func,
 							gpointer user_data)
+{
+	/* GAttrib resizes its buffers before func is called */
+	return g_attrib_exchange_mtu(attrib, mtu, func, user_data);
+}
+
+guint gatt_find_info(GAttrib *attrib, uint16_t start, uint16_t end,
+				GAttribResultFunc func, gpointer user_data)
 {
 	uint8_t *buf;
 	int buflen;
 	guint16 plen;
 
 	buf = g_attrib_get_buffer(attrib, &buflen);
-	plen = enc_mtu_req(mtu, buf, buflen);
-	return g_attrib_send(attrib, 0, ATT_OP_MTU_REQ, buf, plen, func,
+	plen = enc_find_info_req(start, end, buf, buflen);
+	if (plen == 0)
+		return 0;
+
+	return g_attrib_send(attrib, 0, ATT_OP_FIND_INFO_REQ, buf, plen, func,
 							user_data, NULL);
 }
 
-guint gatt_find_info(GAttrib *attrib, uint16_t start, uint16_t end,
-				GAttribResultFunc func, gpointer user_data)
+static void desc_discovered_cb(guint8 status, const guint8 *ipdu, guint16 iplen,
+							gpointer user_data)
 {
+	struct discover_desc *dd = user_data;
+	struct att_data_list *list;
+	unsigned int i, err;
+	uint8_t format;
+	uint16_t last = 0;
+	int buflen;
 	uint8_t *buf;
+	guint16 oplen;
+
+	if (status) {
+		err = status == ATT_ECODE_ATTR_NOT_FOUND ? 0 : status;
+		goto done;
+	}
+
+	list = dec_find_info_resp(ipdu, iplen, &format);
+	if (list == NULL) {
+		err = ATT_ECODE_IO;
+		goto done;
+	}
+
+	for (i = 0; i < list->num; i++) {
+		uint8_t *value = list->data[i];
+		struct att_desc *desc;
+
+		desc = g_try_new0(struct att_desc, 1);
+		if (!desc) {
+			att_data_list_free(list);
+			err = ATT_ECODE_INSUFF_RESOURCES;
+			goto done;
+		}
+
+		last = att_get_u16(value);
+
+		desc->handle = last;
+		if (format == 0x01)
+			desc->uuid = att_get_uuid16(&value[2]);
+		else
+			desc->uuid = att_get_uuid128(&value[2]);
+
+		dd->descriptors = g_slist_append(dd->descriptors, desc);
+	}
+
+	att_data_list_free(list);
+	err = 0;
+
+	if (last != 0 && last < dd->end) {
+		buf = g_attrib_get_buffer(dd->attrib, &buflen);
+
+		oplen = enc_find_info_req(last + 1, dd->end, buf, buflen);
+		if (oplen == 0)
+			goto done;
+
+		if (g_attrib_send(dd->attrib, 0, buf[0], buf, oplen,
+					desc_discovered_cb, dd, NULL) == 0) {
+			err = ATT_ECODE_IO;
+			goto done;
+		}
+
+		return;
+	}
+
+done:
+	dd->cb(dd->descriptors, err, dd->user_data);
+	discover_desc_free(dd);
+}
+
+guint gatt_discover_desc(GAttrib *attrib, uint16_t start, uint16_t end,
+					gatt_cb_t func, gpointer user_data)
+{
 	int buflen;
+	uint8_t *buf = g_attrib_get_buffer(attrib, &buflen);
+	struct discover_desc *dd;
 	guint16 plen;
+	guint id;
 
-	buf = g_attrib_get_buffer(attrib, &buflen);
 	plen = enc_find_info_req(start, end, buf, buflen);
 	if (plen == 0)
 		return 0;
 
-	return g_attrib_send(attrib, 0, ATT_OP_FIND_INFO_REQ, buf, plen, func,
-							user_data, NULL);
+	dd = g_try_new0(struct discover_desc, 1);
+	if (dd == NULL)
+		return 0;
+
+	dd->attrib = g_attrib_ref(attrib);
+	dd->cb = func;
+	dd->user_data = user_data;
+	dd->end = end;
+
+	id = g_attrib_send(attrib, 0, buf[0], buf, plen, desc_discovered_cb,
+								dd, NULL);
+	if (id == 0)
+		discover_desc_free(dd);
+
+	return id;
 }
 
 guint gatt_write_cmd(GAttrib *attrib, uint16_t handle, uint8_t *value, int vlen,
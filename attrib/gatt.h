@@ -25,6 +25,11 @@
 
 typedef void (*gatt_cb_t) (GSList *l, guint8 status, gpointer user_data);
 
+/* Reports bytes transferred so far, the total when known (zero otherwise)
+ * and the throughput in bytes per second */
+typedef void (*gatt_progress_cb_t) (uint16_t done, uint16_t total,
+					uint32_t rate, gpointer user_data);
+
 guint gatt_discover_primary(GAttrib *attrib, bt_uuid_t *uuid, gatt_cb_t func,
 							gpointer user_data);
 
@@ -35,12 +40,26 @@ guint gatt_discover_char(GAttrib *attrib, uint16_t start, uint16_t end,
 guint gatt_read_char(GAttrib *attrib, uint16_t handle, uint16_t offset,
 				GAttribResultFunc func, gpointer user_data);
 
+guint gatt_read_long_char(GAttrib *attrib, uint16_t handle, uint16_t offset,
+				GAttribResultFunc func,
+				gatt_progress_cb_t progress,
+				gpointer user_data);
+
 guint gatt_write_char(GAttrib *attrib, uint16_t handle, uint8_t *value,
 			int vlen, GAttribResultFunc func, gpointer user_data);
 
+guint gatt_write_long_char(GAttrib *attrib, uint16_t handle,
+				const uint8_t *value, uint16_t vlen,
+				gboolean reliable, GAttribResultFunc func,
+				gatt_progress_cb_t progress,
+				gpointer user_data);
+
 guint gatt_find_info(GAttrib *attrib, uint16_t start, uint16_t end,
 				GAttribResultFunc func, gpointer user_data);
 
+guint gatt_discover_desc(GAttrib *attrib, uint16_t start, uint16_t end,
+					gatt_cb_t func, gpointer user_data);
+
 guint gatt_write_cmd(GAttrib *attrib, uint16_t handle, uint8_t *value, int vlen,
 				GDestroyNotify notify, gpointer user_data);
 
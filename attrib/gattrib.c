@@ -43,6 +43,8 @@ struct _GAttrib {
 	gint refs;
 	uint8_t *buf;
 	int buflen;
+	uint8_t *rbuf;
+	int rbuflen;
 	guint read_watch;
 	guint write_watch;
 	guint timeout_watch;
@@ -66,6 +68,13 @@ struct command {
 	GDestroyNotify notify;
 };
 
+struct mtu_exchange {
+	GAttrib *attrib;
+	uint16_t mtu;
+	GAttribResultFunc func;
+	gpointer user_data;
+};
+
 struct event {
 	guint id;
 	guint8 expected;
@@ -198,6 +207,7 @@ static void attrib_destroy(GAttrib *attrib)
 		g_io_channel_unref(attrib->io);
 
 	g_free(attrib->buf);
+	g_free(attrib->rbuf);
 
 	if (attrib->destroy)
 		attrib->destroy(attrib->destroy_user_data);
@@ -308,7 +318,7 @@ static gboolean received_data(GIOChannel *io, GIOCondition cond, gpointer data)
 	struct _GAttrib *attrib = data;
 	struct command *cmd = NULL;
 	GSList *l;
-	uint8_t buf[512], status;
+	uint8_t *buf, status;
 	gsize len;
 	GIOStatus iostat;
 	gboolean qempty;
@@ -323,9 +333,16 @@ static gboolean received_data(GIOChannel *io, GIOCondition cond, gpointer data)
 		return FALSE;
 	}
 
-	memset(buf, 0, sizeof(buf));
+	/* The MTU may have grown while the previous PDU was dispatched */
+	if (attrib->rbuflen < attrib->buflen) {
+		attrib->rbuf = g_realloc(attrib->rbuf, attrib->buflen);
+		attrib->rbuflen = attrib->buflen;
+	}
+
+	buf = attrib->rbuf;
+	memset(buf, 0, attrib->rbuflen);
 
-	iostat = g_io_channel_read_chars(io, (gchar *) buf, sizeof(buf),
+	iostat = g_io_channel_read_chars(io, (gchar *) buf, attrib->rbuflen,
 								&len, NULL);
 	if (iostat != G_IO_STATUS_NORMAL) {
 		status = ATT_ECODE_IO;
@@ -382,7 +399,7 @@ done:
 GAttrib *g_attrib_new(GIOChannel *io)
 {
 	struct _GAttrib *attrib;
-	uint16_t omtu;
+	uint16_t omtu, imtu;
 
 	g_io_channel_set_encoding(io, NULL, NULL);
 	g_io_channel_set_buffered(io, FALSE);
@@ -400,15 +417,22 @@ GAttrib *g_attrib_new(GIOChannel *io)
 
 	if (bt_io_get(attrib->io, BT_IO_L2CAP, NULL,
 			BT_IO_OPT_OMTU, &omtu,
+			BT_IO_OPT_IMTU, &imtu,
 			BT_IO_OPT_INVALID)) {
 		if (omtu == 0 || omtu > ATT_MAX_MTU)
 			omtu = ATT_MAX_MTU;
+		if (imtu == 0 || imtu > ATT_MAX_VALUE_LEN)
+			imtu = ATT_MAX_VALUE_LEN;
 	} else
-		omtu = ATT_DEFAULT_LE_MTU;
+		omtu = imtu = ATT_DEFAULT_LE_MTU;
 
 	attrib->buf = g_malloc0(omtu);
 	attrib->buflen = omtu;
 
+	/* Peers may send anything up to our L2CAP MTU */
+	attrib->rbuflen = MAX(imtu, omtu);
+	attrib->rbuf = g_malloc0(attrib->rbuflen);
+
 	return g_attrib_ref(attrib);
 }
 
@@ -522,6 +546,14 @@ uint8_t *g_attrib_get_buffer(GAttrib *attrib, int *len)
 	return attrib->buf;
 }
 
+uint16_t g_attrib_get_mtu(GAttrib *attrib)
+{
+	if (attrib == NULL)
+		return 0;
+
+	return attrib->buflen;
+}
+
 gboolean g_attrib_set_mtu(GAttrib *attrib, int mtu)
 {
 	if (mtu < ATT_DEFAULT_LE_MTU)
@@ -542,6 +574,53 @@ gboolean g_attrib_set_mtu(GAttrib *attrib, int mtu)
 	return TRUE;
 }
 
+static void exchange_mtu_cb(guint8 status, const guint8 *pdu, guint16 plen,
+							gpointer user_data)
+{
+	struct mtu_exchange *exchange = user_data;
+	uint16_t mtu;
+
+	if (status == 0 && !dec_mtu_resp(pdu, plen, &mtu))
+		status = ATT_ECODE_IO;
+
+	/* Both sides use the smaller of the two receive MTUs */
+	if (status == 0 && !g_attrib_set_mtu(exchange->attrib,
+						MIN(mtu, exchange->mtu)))
+		status = ATT_ECODE_UNLIKELY;
+
+	if (exchange->func)
+		exchange->func(status, pdu, plen, exchange->user_data);
+}
+
+guint g_attrib_exchange_mtu(GAttrib *attrib, uint16_t mtu,
+				GAttribResultFunc func, gpointer user_data)
+{
+	struct mtu_exchange *exchange;
+	uint8_t pdu[3];
+	uint16_t plen;
+	guint id;
+
+	if (mtu > ATT_MAX_MTU)
+		mtu = ATT_MAX_MTU;
+
+	plen = enc_mtu_req(mtu, pdu, sizeof(pdu));
+	if (plen == 0)
+		return 0;
+
+	exchange = g_new0(struct mtu_exchange, 1);
+	exchange->attrib = attrib;
+	exchange->mtu = mtu;
+	exchange->func = func;
+	exchange->user_data = user_data;
+
+	id = g_attrib_send(attrib, 0, ATT_OP_MTU_REQ, pdu, plen,
+					exchange_mtu_cb, exchange, g_free);
+	if (id == 0)
+		g_free(exchange);
+
+	return id;
+}
+
 guint g_attrib_register(GAttrib *attrib, guint8 opcode,
 				GAttribNotifyFunc func, gpointer user_data,
 				GDestroyNotify notify)
@@ -67,7 +67,10 @@ guint g_attrib_register(GAttrib *attrib, guint8 opcode,
 gboolean g_attrib_is_encrypted(GAttrib *attrib);
 
 uint8_t *g_attrib_get_buffer(GAttrib *attrib, int *len);
+uint16_t g_attrib_get_mtu(GAttrib *attrib);
 gboolean g_attrib_set_mtu(GAttrib *attrib, int mtu);
+guint g_attrib_exchange_mtu(GAttrib *attrib, uint16_t mtu,
+				GAttribResultFunc func, gpointer user_data);
 
 gboolean g_attrib_unregister(GAttrib *attrib, guint id);
 gboolean g_attrib_unregister_all(GAttrib *attrib);
@@ -61,6 +61,11 @@ static gboolean opt_char_desc = FALSE;
 static gboolean opt_char_write = FALSE;
 static gboolean opt_char_write_req = FALSE;
 static gboolean opt_interactive = FALSE;
+static gchar *opt_bench = NULL;
+static int opt_bench_count = 0;
+static int opt_bench_duration = 0;
+static int opt_bench_conns = 1;
+static struct benchmark *bench = NULL;
 static GMainLoop *event_loop;
 static gboolean got_error = FALSE;
 static GSourceFunc operation;
@@ -460,6 +465,59 @@ static gboolean characteristics_desc(gpointer user_data)
 	return FALSE;
 }
 
+static void benchmark_done(struct benchmark *b, gpointer user_data)
+{
+	benchmark_report(b);
+	g_main_loop_quit(event_loop);
+}
+
+static gboolean benchmark_start(gpointer user_data)
+{
+	GAttrib *attrib = user_data;
+
+	/* MTU Exchange is only defined for LE; BR/EDR uses the L2CAP MTU */
+	benchmark_add(bench, attrib, opt_psm ? 0 : opt_mtu);
+
+	return FALSE;
+}
+
+static struct benchmark *benchmark_create(void)
+{
+	struct benchmark *b;
+	uint8_t *value = NULL;
+	size_t len = 0;
+
+	if (opt_handle <= 0) {
+		g_printerr("A valid handle is required\n");
+		return NULL;
+	}
+
+	/* LE has a single fixed ATT channel per device */
+	if (opt_bench_conns > 1 && !opt_psm) {
+		g_printerr("Multiple connections require --psm\n");
+		return NULL;
+	}
+
+	if (opt_value != NULL && opt_value[0] != '\0') {
+		len = gatt_attr_data_from_string(opt_value, &value);
+		if (len == 0) {
+			g_printerr("Invalid value\n");
+			return NULL;
+		}
+	}
+
+	b = benchmark_new(opt_bench, opt_handle, value, len,
+				MAX(opt_bench_count, 0),
+				MAX(opt_bench_duration, 0),
+				benchmark_done, NULL);
+	if (b == NULL)
+		g_printerr("Invalid benchmark operation: %s\n", opt_bench);
+
+	g_free(value);
+
+	return b;
+}
+
 static gboolean parse_uuid(const char *key, const char *value,
 				gpointer user_data, GError **error)
 {
@@ -497,6 +555,20 @@ static GOptionEntry char_rw_options[] = {
 	{NULL},
 };
 
+static GOptionEntry bench_options[] = {
+	{ "bench", 0, 0, G_OPTION_ARG_STRING, &opt_bench,
+		"Benchmark an operation on --handle, writes use --value or "
+		"fill the MTU", "read|write|write-cmd|notify" },
+	{ "bench-count", 0, 0, G_OPTION_ARG_INT, &opt_bench_count,
+		"Stop after N operations", "N" },
+	{ "bench-duration", 0, 0, G_OPTION_ARG_INT, &opt_bench_duration,
+		"Stop after N seconds (default 10 without count)", "N" },
+	{ "bench-conns", 0, 0, G_OPTION_ARG_INT, &opt_bench_conns,
+		"Number of ATT channels to the device driven at once "
+		"(BR/EDR only, they share one ACL link)", "N" },
+	{ NULL },
+};
+
 static GOptionEntry gatt_options[] = {
 	{ "primary", 0, 0, G_OPTION_ARG_NONE, &opt_primary,
 		"Primary Service Discovery", NULL },
@@ -535,9 +607,10 @@ static GOptionEntry options[] = {
 int main(int argc, char *argv[])
 {
 	GOptionContext *context;
-	GOptionGroup *gatt_group, *params_group, *char_rw_group;
+	GOptionGroup *gatt_group, *params_group, *char_rw_group, *bench_group;
 	GError *gerr = NULL;
 	GIOChannel *chan;
+	int i;
 
 	opt_sec_level = g_strdup("low");
 
@@ -567,6 +640,12 @@ int main(int argc, char *argv[])
 	g_option_context_add_group(context, char_rw_group);
 	g_option_group_add_entries(char_rw_group, char_rw_options);
 
+	/* Benchmark arguments */
+	bench_group = g_option_group_new("benchmark", "Benchmark arguments",
+				"Show all benchmark arguments", NULL, NULL);
+	g_option_context_add_group(context, bench_group);
+	g_option_group_add_entries(bench_group, bench_options);
+
 	if (g_option_context_parse(context, &argc, &argv, &gerr) == FALSE) {
 		g_printerr("%s\n", gerr->message);
 		g_error_free(gerr);
@@ -577,7 +656,15 @@ int main(int argc, char *argv[])
 		goto done;
 	}
 
-	if (opt_primary)
+	if (opt_bench) {
+		bench = benchmark_create();
+		if (bench == NULL) {
+			got_error = TRUE;
+			goto done;
+		}
+
+		operation = benchmark_start;
+	} else if (opt_primary)
 		operation = primary;
 	else if (opt_characteristics)
 		operation = characteristics;
@@ -604,6 +691,14 @@ int main(int argc, char *argv[])
 		goto done;
 	}
 
+	for (i = 1; bench && i < opt_bench_conns; i++) {
+		if (gatt_connect(opt_src, opt_dst, opt_sec_level, opt_psm,
+						opt_mtu, connect_cb) == NULL) {
+			got_error = TRUE;
+			goto done;
+		}
+	}
+
 	event_loop = g_main_loop_new(NULL, FALSE);
 
 	g_main_loop_run(event_loop);
@@ -611,11 +706,13 @@ int main(int argc, char *argv[])
 	g_main_loop_unref(event_loop);
 
 done:
+	benchmark_free(bench);
 	g_option_context_free(context);
 	g_free(opt_src);
 	g_free(opt_dst);
 	g_free(opt_uuid);
 	g_free(opt_sec_level);
+	g_free(opt_bench);
 
 	if (got_error)
 		exit(EXIT_FAILURE);
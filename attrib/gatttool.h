@@ -26,3 +26,17 @@ GIOChannel *gatt_connect(const gchar *src, const gchar *dst,
 			const gchar *sec_level, int psm, int mtu,
 			BtIOConnect connect_cb);
 size_t gatt_attr_data_from_string(const char *str, uint8_t **data);
+
+struct benchmark;
+typedef void (*benchmark_done_t) (struct benchmark *bench,
+							gpointer user_data);
+
+struct benchmark *benchmark_new(const char *op, uint16_t handle,
+					const uint8_t *value, size_t vlen,
+					unsigned int count,
+					unsigned int duration,
+					benchmark_done_t done,
+					gpointer user_data);
+gboolean benchmark_add(struct benchmark *bench, GAttrib *attrib, int mtu);
+void benchmark_report(struct benchmark *bench);
+void benchmark_free(struct benchmark *bench);
@@ -652,25 +652,14 @@ static void cmd_sec_level(int argcp, char **argvp)
 static void exchange_mtu_cb(guint8 status, const guint8 *pdu, guint16 plen,
 							gpointer user_data)
 {
-	uint16_t mtu;
-
 	if (status != 0) {
 		printf("Exchange MTU Request failed: %s\n",
 							att_ecode2str(status));
 		return;
 	}
 
-	if (!dec_mtu_resp(pdu, plen, &mtu)) {
-		printf("Protocol error\n");
-		return;
-	}
-
-	mtu = MIN(mtu, opt_mtu);
-	/* Set new value for MTU in client */
-	if (g_attrib_set_mtu(attrib, mtu))
-		printf("MTU was exchanged successfully: %d\n", mtu);
-	else
-		printf("Error exchanging MTU\n");
+	printf("MTU was exchanged successfully: %d\n",
+						g_attrib_get_mtu(attrib));
 }
 
 static void cmd_mtu(int argcp, char **argvp)
@@ -708,6 +697,65 @@ static void cmd_mtu(int argcp, char **argvp)
 	gatt_exchange_mtu(attrib, opt_mtu, exchange_mtu_cb, NULL);
 }
 
+static void bench_done(struct benchmark *bench, gpointer user_data)
+{
+	printf("\n");
+	benchmark_report(bench);
+	benchmark_free(bench);
+	rl_forced_update_display();
+}
+
+static void cmd_bench(int argcp, char **argvp)
+{
+	struct benchmark *bench;
+	unsigned int count = 0, duration = 0;
+	uint8_t *value = NULL;
+	size_t vlen = 0;
+	int handle;
+
+	if (conn_state != STATE_CONNECTED) {
+		printf("Command failed: disconnected\n");
+		return;
+	}
+
+	if (argcp < 3) {
+		printf("Usage: bench <read|write|write-cmd|notify> <handle> "
+					"[count] [seconds] [value]\n");
+		return;
+	}
+
+	handle = strtohandle(argvp[2]);
+	if (handle < 0) {
+		printf("Invalid handle: %s\n", argvp[2]);
+		return;
+	}
+
+	if (argcp > 3)
+		count = strtoul(argvp[3], NULL, 0);
+
+	if (argcp > 4)
+		duration = strtoul(argvp[4], NULL, 0);
+
+	if (argcp > 5) {
+		vlen = gatt_attr_data_from_string(argvp[5], &value);
+		if (vlen == 0) {
+			printf("Invalid value\n");
+			return;
+		}
+	}
+
+	bench = benchmark_new(argvp[1], handle, value, vlen, count, duration,
+							bench_done, NULL);
+	g_free(value);
+
+	if (bench == NULL) {
+		printf("Invalid benchmark operation: %s\n", argvp[1]);
+		return;
+	}
+
+	benchmark_add(bench, attrib, 0);
+}
+
 static struct {
 	const char *cmd;
 	void (*func)(int argcp, char **argvp);
@@ -742,6 +790,9 @@ static struct {
 		"Set security level. Default: low" },
 	{ "mtu",		cmd_mtu,	"<value>",
 		"Exchange MTU for GATT/ATT" },
+	{ "bench",		cmd_bench,
+		"<op> <handle> [count] [seconds] [value]",
+		"Benchmark read, write, write-cmd or notify" },
 	{ NULL, NULL, NULL}
 };
 
@@ -30,14 +30,35 @@
 #include <ctype.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdbool.h>
+#include <time.h>
 
 #include "bt.h"
+#include "mainloop.h"
 #include "btdev.h"
 
 #define le16_to_cpu(val) (val)
 #define cpu_to_le16(val) (val)
 
+#define ACL_HANDLE 42
+
+struct acl_pkt {
+	struct acl_pkt *next;
+	uint64_t time;		/* completion or delivery, in microseconds */
+	uint16_t len;
+	uint8_t data[0];
+};
+
+struct acl_queue {
+	struct acl_pkt *head;
+	struct acl_pkt *tail;
+};
+
 struct btdev {
+	struct btdev *next;
+	struct btdev *prev;
+	struct btdev *hash_next;
+
 	struct btdev *conn;
 
 	btdev_send_func send_handler;
@@ -73,49 +94,133 @@ struct btdev {
 	uint8_t  le_supported;
 	uint8_t  le_simultaneous;
 	uint8_t  le_event_mask[8];
+	uint8_t  le_adv_data[31];
+	uint8_t  le_adv_data_len;
+
+	struct btdev_link link;
+	uint64_t link_busy;
+	uint64_t link_last;
+	uint32_t link_seed;
+	int link_timer;
+	struct acl_queue tx_queue;
+	struct acl_queue rx_queue;
+
+	struct btdev_storm storm;
+	int storm_timer;
+	bool storm_inquiry;
+	bool storm_le;
+	uint64_t storm_inquiry_end;
+	uint64_t storm_last;
+	uint64_t storm_carry;
+	uint64_t storm_print;
+	unsigned int storm_count[3];
 };
 
-#define MAX_BTDEV_ENTRIES 16
+#define MIN_HASH_SIZE 64
 
-static struct btdev *btdev_list[MAX_BTDEV_ENTRIES] = { };
+/* Every device is on btdev_list and hashed by address, so populations
+ * of thousands of devices stay cheap to page and to name */
+static struct btdev *btdev_list = NULL;
+static struct btdev **btdev_hash = NULL;
+static unsigned int btdev_hash_size = 0;
+static unsigned int btdev_count = 0;
 
-static inline int add_btdev(struct btdev *btdev)
+static inline unsigned int hash_bdaddr(const uint8_t *bdaddr)
 {
-	int i, index = -1;
+	unsigned int i, hash = 0;
+
+	for (i = 0; i < 6; i++)
+		hash = hash * 31 + bdaddr[i];
 
-	for (i = 0; i < MAX_BTDEV_ENTRIES; i++) {
-		if (btdev_list[i] == NULL) {
-			index = i;
-			btdev_list[index] = btdev;
+	return hash & (btdev_hash_size - 1);
+}
+
+static void hash_insert(struct btdev *btdev)
+{
+	unsigned int hash = hash_bdaddr(btdev->bdaddr);
+
+	btdev->hash_next = btdev_hash[hash];
+	btdev_hash[hash] = btdev;
+}
+
+static void hash_remove(struct btdev *btdev)
+{
+	struct btdev **entry = &btdev_hash[hash_bdaddr(btdev->bdaddr)];
+
+	for (; *entry; entry = &(*entry)->hash_next) {
+		if (*entry == btdev) {
+			*entry = btdev->hash_next;
 			break;
 		}
 	}
+}
+
+static int hash_resize(unsigned int size)
+{
+	struct btdev **hash;
+	struct btdev *btdev;
+
+	hash = calloc(size, sizeof(*hash));
+	if (!hash)
+		return -1;
 
-	return index;
+	free(btdev_hash);
+	btdev_hash = hash;
+	btdev_hash_size = size;
+
+	for (btdev = btdev_list; btdev; btdev = btdev->next)
+		hash_insert(btdev);
+
+	return 0;
 }
 
-static inline int del_btdev(struct btdev *btdev)
+static inline int add_btdev(struct btdev *btdev)
 {
-	int i, index = -1;
+	if (btdev_count >= btdev_hash_size) {
+		unsigned int size = btdev_hash_size ? btdev_hash_size * 2 :
+								MIN_HASH_SIZE;
 
-	for (i = 0; i < MAX_BTDEV_ENTRIES; i++) {
-		if (btdev_list[i] == btdev) {
-			index = i;
-			btdev_list[index] = NULL;
-			break;
-		}
+		if (hash_resize(size) < 0)
+			return -1;
 	}
 
-	return index;
+	btdev->prev = NULL;
+	btdev->next = btdev_list;
+	if (btdev_list)
+		btdev_list->prev = btdev;
+	btdev_list = btdev;
+
+	hash_insert(btdev);
+
+	return btdev_count++;
+}
+
+static inline int del_btdev(struct btdev *btdev)
+{
+	hash_remove(btdev);
+
+	if (btdev->prev)
+		btdev->prev->next = btdev->next;
+	else
+		btdev_list = btdev->next;
+
+	if (btdev->next)
+		btdev->next->prev = btdev->prev;
+
+	return --btdev_count;
 }
 
 static inline struct btdev *find_btdev_by_bdaddr(const uint8_t *bdaddr)
 {
-	int i;
+	struct btdev *btdev;
+
+	if (!btdev_hash)
+		return NULL;
 
-	for (i = 0; i < MAX_BTDEV_ENTRIES; i++) {
-		if (btdev_list[i] && !memcmp(btdev_list[i]->bdaddr, bdaddr, 6))
-			return btdev_list[i];
+	for (btdev = btdev_hash[hash_bdaddr(bdaddr)]; btdev;
+						btdev = btdev->hash_next) {
+		if (!memcmp(btdev->bdaddr, bdaddr, 6))
+			return btdev;
 	}
 
 	return NULL;
@@ -160,6 +265,9 @@ static void hexdump(const unsigned char *buf, uint16_t len)
 	}
 }
 
+static struct btdev_link default_link;
+static struct btdev_storm default_storm;
+
 static void get_bdaddr(uint16_t id, uint8_t *bdaddr)
 {
 	bdaddr[0] = id & 0xff;
@@ -214,16 +322,73 @@ struct btdev *btdev_create(uint16_t id)
 
 	get_bdaddr(id, btdev->bdaddr);
 
-	add_btdev(btdev);
+	btdev->link_timer = -1;
+	btdev->link_seed = 0x2545f491 + id;
+	btdev_set_link(btdev, &default_link);
+
+	btdev->storm = default_storm;
+	btdev->storm_timer = -1;
+
+	if (add_btdev(btdev) < 0) {
+		free(btdev);
+		return NULL;
+	}
 
 	return btdev;
 }
 
+static void queue_flush(struct acl_queue *queue)
+{
+	while (queue->head) {
+		struct acl_pkt *pkt = queue->head;
+
+		queue->head = pkt->next;
+		free(pkt);
+	}
+
+	queue->tail = NULL;
+}
+
+static void link_flush(struct btdev *btdev)
+{
+	queue_flush(&btdev->tx_queue);
+	queue_flush(&btdev->rx_queue);
+
+	if (btdev->link_timer >= 0) {
+		mainloop_remove_timeout(btdev->link_timer);
+		btdev->link_timer = -1;
+	}
+}
+
+static void send_event(struct btdev *btdev, uint8_t event,
+						const void *data, uint8_t len);
+
 void btdev_destroy(struct btdev *btdev)
 {
 	if (!btdev)
 		return;
 
+	/* To the peer the device just went out of range */
+	if (btdev->conn) {
+		struct bt_hci_evt_disconnect_complete dc;
+		struct btdev *remote = btdev->conn;
+
+		link_flush(remote);
+		remote->conn = NULL;
+
+		dc.status = BT_HCI_ERR_SUCCESS;
+		dc.handle = cpu_to_le16(ACL_HANDLE);
+		dc.reason = BT_HCI_ERR_CONN_TIMEOUT;
+
+		send_event(remote, BT_HCI_EVT_DISCONNECT_COMPLETE,
+							&dc, sizeof(dc));
+	}
+
+	link_flush(btdev);
+
+	if (btdev->storm_timer >= 0)
+		mainloop_remove_timeout(btdev->storm_timer);
+
 	del_btdev(btdev);
 
 	free(btdev);
@@ -239,6 +404,98 @@ void btdev_set_send_handler(struct btdev *btdev, btdev_send_func handler,
 	btdev->send_data = user_data;
 }
 
+void btdev_set_link(struct btdev *btdev, const struct btdev_link *link)
+{
+	if (!btdev)
+		return;
+
+	btdev->link = *link;
+
+	if (link->acl_mtu)
+		btdev->acl_mtu = link->acl_mtu;
+
+	if (link->acl_max_pkt)
+		btdev->acl_max_pkt = link->acl_max_pkt;
+}
+
+/* Also applies to every device that already exists */
+void btdev_set_default_link(const struct btdev_link *link)
+{
+	struct btdev *btdev;
+
+	default_link = *link;
+
+	for (btdev = btdev_list; btdev; btdev = btdev->next)
+		btdev_set_link(btdev, link);
+}
+
+/* Only devices created afterwards generate storms */
+void btdev_set_default_storm(const struct btdev_storm *storm)
+{
+	default_storm = *storm;
+}
+
+void btdev_set_bdaddr(struct btdev *btdev, const uint8_t *bdaddr)
+{
+	if (!btdev)
+		return;
+
+	hash_remove(btdev);
+	memcpy(btdev->bdaddr, bdaddr, 6);
+	hash_insert(btdev);
+}
+
+void btdev_set_class(struct btdev *btdev, const uint8_t *dev_class)
+{
+	if (!btdev)
+		return;
+
+	memcpy(btdev->dev_class, dev_class, 3);
+}
+
+void btdev_set_name(struct btdev *btdev, const char *name)
+{
+	if (!btdev)
+		return;
+
+	memset(btdev->name, 0, sizeof(btdev->name));
+	strncpy((char *) btdev->name, name, sizeof(btdev->name) - 1);
+}
+
+void btdev_set_scan_enable(struct btdev *btdev, uint8_t scan_enable)
+{
+	if (!btdev)
+		return;
+
+	btdev->scan_enable = scan_enable;
+}
+
+void btdev_set_ext_inquiry_rsp(struct btdev *btdev, const uint8_t *data,
+								uint8_t len)
+{
+	if (!btdev)
+		return;
+
+	if (len > sizeof(btdev->ext_inquiry_rsp))
+		len = sizeof(btdev->ext_inquiry_rsp);
+
+	memset(btdev->ext_inquiry_rsp, 0, sizeof(btdev->ext_inquiry_rsp));
+	memcpy(btdev->ext_inquiry_rsp, data, len);
+}
+
+void btdev_set_adv_data(struct btdev *btdev, const uint8_t *data,
+								uint8_t len)
+{
+	if (!btdev)
+		return;
+
+	if (len > sizeof(btdev->le_adv_data))
+		len = sizeof(btdev->le_adv_data);
+
+	memcpy(btdev->le_adv_data, data, len);
+	btdev->le_adv_data_len = len;
+}
+
 static void send_packet(struct btdev *btdev, const void *data, uint16_t len)
 {
 	if (!btdev->send_handler)
@@ -317,41 +574,198 @@ static void cmd_status(struct btdev *btdev, uint8_t status, uint16_t opcode)
 	send_event(btdev, BT_HCI_EVT_CMD_STATUS, &cs, sizeof(cs));
 }
 
-static void num_completed_packets(struct btdev *btdev)
+static void num_completed_packets(struct btdev *btdev, uint16_t count)
 {
 	if (btdev->conn) {
 		struct bt_hci_evt_num_completed_packets ncp;
 
 		ncp.num_handles = 1;
-		ncp.handle = cpu_to_le16(42);
-		ncp.count = cpu_to_le16(1);
+		ncp.handle = cpu_to_le16(ACL_HANDLE);
+		ncp.count = cpu_to_le16(count);
 
 		send_event(btdev, BT_HCI_EVT_NUM_COMPLETED_PACKETS,
 							&ncp, sizeof(ncp));
 	}
 }
 
-static void inquiry_complete(struct btdev *btdev, uint8_t status)
+static uint64_t now_us(void)
 {
-	struct bt_hci_evt_inquiry_complete ic;
-	int i;
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/* Deterministic so that runs with loss and jitter are reproducible */
+static uint32_t link_random(struct btdev *btdev)
+{
+	uint32_t x = btdev->link_seed;
+
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+
+	btdev->link_seed = x;
+
+	return x;
+}
+
+static bool queue_push(struct acl_queue *queue, uint64_t time,
+					const void *data, uint16_t len)
+{
+	struct acl_pkt *pkt;
+
+	pkt = malloc(sizeof(*pkt) + len);
+	if (!pkt)
+		return false;
+
+	pkt->next = NULL;
+	pkt->time = time;
+	pkt->len = len;
+	if (len > 0)
+		memcpy(pkt->data, data, len);
+
+	if (queue->tail)
+		queue->tail->next = pkt;
+	else
+		queue->head = pkt;
+
+	queue->tail = pkt;
+
+	return true;
+}
+
+static struct acl_pkt *queue_pop(struct acl_queue *queue, uint64_t now)
+{
+	struct acl_pkt *pkt = queue->head;
+
+	if (!pkt || pkt->time > now)
+		return NULL;
+
+	queue->head = pkt->next;
+	if (!queue->head)
+		queue->tail = NULL;
+
+	return pkt;
+}
+
+static void link_schedule(struct btdev *btdev);
+
+static void link_timeout(int id, void *user_data)
+{
+	struct btdev *btdev = user_data;
+	struct acl_pkt *pkt;
+	uint64_t now = now_us();
+	uint16_t count = 0;
+
+	/* Buffers free up once the packet has left the radio */
+	while ((pkt = queue_pop(&btdev->tx_queue, now))) {
+		count++;
+		free(pkt);
+	}
+
+	if (count > 0)
+		num_completed_packets(btdev, count);
+
+	while ((pkt = queue_pop(&btdev->rx_queue, now))) {
+		if (btdev->conn)
+			send_packet(btdev->conn, pkt->data, pkt->len);
+		free(pkt);
+	}
+
+	link_schedule(btdev);
+}
+
+static void link_schedule(struct btdev *btdev)
+{
+	uint64_t next = UINT64_MAX, now;
+	unsigned int msec;
+
+	if (btdev->tx_queue.head)
+		next = btdev->tx_queue.head->time;
+
+	if (btdev->rx_queue.head && btdev->rx_queue.head->time < next)
+		next = btdev->rx_queue.head->time;
 
-	for (i = 0; i < MAX_BTDEV_ENTRIES; i++) {
-		if (!btdev_list[i] || btdev_list[i] == btdev)
+	if (next == UINT64_MAX)
+		return;
+
+	now = now_us();
+	msec = next > now ? (next - now + 999) / 1000 : 0;
+
+	if (btdev->link_timer < 0)
+		btdev->link_timer = mainloop_add_timeout_ms(msec, link_timeout,
+								btdev, NULL);
+	else
+		mainloop_modify_timeout_ms(btdev->link_timer, msec);
+}
+
+/*
+ * Packets are serialized onto the link at the configured bitrate and
+ * complete once transmitted. Surviving packets reach the remote after
+ * the propagation delay plus jitter, never overtaking each other.
+ */
+static void link_send(struct btdev *btdev, const void *data, uint16_t len)
+{
+	const struct btdev_link *link = &btdev->link;
+	uint64_t now = now_us(), start, end, delivery;
+
+	if (!link->bitrate && !link->delay && !link->jitter && !link->loss) {
+		if (btdev->conn)
+			send_packet(btdev->conn, data, len);
+		num_completed_packets(btdev, 1);
+		return;
+	}
+
+	start = btdev->link_busy > now ? btdev->link_busy : now;
+	end = start;
+	if (link->bitrate)
+		end += (uint64_t) len * 8 * 1000000 / link->bitrate;
+
+	btdev->link_busy = end;
+
+	if (!queue_push(&btdev->tx_queue, end, NULL, 0))
+		return;
+
+	if (link->loss && link_random(btdev) % 10000 < link->loss)
+		goto done;
+
+	delivery = end + link->delay;
+	if (link->jitter)
+		delivery += link_random(btdev) % (link->jitter + 1);
+
+	if (delivery < btdev->link_last)
+		delivery = btdev->link_last;
+
+	btdev->link_last = delivery;
+
+	queue_push(&btdev->rx_queue, delivery, data, len);
+
+done:
+	link_schedule(btdev);
+}
+
+static void inquiry_results(struct btdev *btdev)
+{
+	struct btdev *remote;
+
+	for (remote = btdev_list; remote; remote = remote->next) {
+		if (remote == btdev)
 			continue;
 
-		if (!(btdev_list[i]->scan_enable & 0x02))
+		if (!(remote->scan_enable & 0x02))
 			continue;
 
 		if (btdev->inquiry_mode == 0x02 &&
-					btdev_list[i]->ext_inquiry_rsp[0]) {
+					remote->ext_inquiry_rsp[0]) {
 			struct bt_hci_evt_ext_inquiry_result ir;
 
 			ir.num_resp = 0x01;
-			memcpy(ir.bdaddr, btdev_list[i]->bdaddr, 6);
-			memcpy(ir.dev_class, btdev_list[i]->dev_class, 3);
+			memcpy(ir.bdaddr, remote->bdaddr, 6);
+			memcpy(ir.dev_class, remote->dev_class, 3);
 			ir.rssi = -60;
-			memcpy(ir.data, btdev_list[i]->ext_inquiry_rsp, 240);
+			memcpy(ir.data, remote->ext_inquiry_rsp, 240);
 
 			send_event(btdev, BT_HCI_EVT_EXT_INQUIRY_RESULT,
 							&ir, sizeof(ir));
@@ -362,8 +776,8 @@ static void inquiry_complete(struct btdev *btdev, uint8_t status)
 			struct bt_hci_evt_inquiry_result_with_rssi ir;
 
 			ir.num_resp = 0x01;
-			memcpy(ir.bdaddr, btdev_list[i]->bdaddr, 6);
-			memcpy(ir.dev_class, btdev_list[i]->dev_class, 3);
+			memcpy(ir.bdaddr, remote->bdaddr, 6);
+			memcpy(ir.dev_class, remote->dev_class, 3);
 			ir.rssi = -60;
 
 			send_event(btdev, BT_HCI_EVT_INQUIRY_RESULT_WITH_RSSI,
@@ -372,19 +786,325 @@ static void inquiry_complete(struct btdev *btdev, uint8_t status)
 			struct bt_hci_evt_inquiry_result ir;
 
 			ir.num_resp = 0x01;
-			memcpy(ir.bdaddr, btdev_list[i]->bdaddr, 6);
-			memcpy(ir.dev_class, btdev_list[i]->dev_class, 3);
+			memcpy(ir.bdaddr, remote->bdaddr, 6);
+			memcpy(ir.dev_class, remote->dev_class, 3);
 
 			send_event(btdev, BT_HCI_EVT_INQUIRY_RESULT,
 							&ir, sizeof(ir));
 		}
         }
+}
+
+static void inquiry_complete(struct btdev *btdev, uint8_t status)
+{
+	struct bt_hci_evt_inquiry_complete ic;
 
 	ic.status = status;
 
 	send_event(btdev, BT_HCI_EVT_INQUIRY_COMPLETE, &ic, sizeof(ic));
 }
 
+static void le_adv_report(struct btdev *btdev, const uint8_t *bdaddr,
+				const uint8_t *data, uint8_t len, int8_t rssi)
+{
+	struct bt_hci_evt_le_adv_report *ar;
+	uint8_t buf[1 + sizeof(*ar) + 31 + 1];
+
+	buf[0] = BT_HCI_EVT_LE_ADV_REPORT;
+
+	ar = (void *) (buf + 1);
+	ar->num_reports = 0x01;
+	ar->event_type = 0x00;
+	ar->addr_type = 0x00;
+	memcpy(ar->addr, bdaddr, 6);
+	ar->data_len = len;
+	memcpy(ar->data, data, len);
+	ar->data[ar->data_len] = (uint8_t) rssi;
+
+	send_event(btdev, BT_HCI_EVT_LE_META_EVENT, buf,
+				1 + sizeof(*ar) + ar->data_len + 1);
+}
+
+static void le_scan_results(struct btdev *btdev)
+{
+	struct btdev *remote;
+
+	for (remote = btdev_list; remote; remote = remote->next) {
+		if (remote == btdev || !remote->le_adv_data_len)
+			continue;
+
+		le_adv_report(btdev, remote->bdaddr, remote->le_adv_data,
+						remote->le_adv_data_len, -60);
+	}
+}
+
+#define STORM_INTERVAL 10	/* milliseconds between bursts */
+
+static const char *storm_kind_str[] = { "inquiry", "extended", "LE" };
+
+static const uint8_t storm_class[] = { 0x0c, 0x02, 0x5a };
+
+enum {
+	STORM_RSSI,
+	STORM_EIR,
+	STORM_LE,
+};
+
+static void storm_bdaddr(struct btdev *btdev, uint8_t *bdaddr)
+{
+	uint32_t num = link_random(btdev) % btdev->storm.devices;
+
+	bdaddr[0] = num & 0xff;
+	bdaddr[1] = (num >> 8) & 0xff;
+	bdaddr[2] = (num >> 16) & 0xff;
+	bdaddr[3] = 0x00;
+	bdaddr[4] = 0xbb;
+	bdaddr[5] = 0x00;
+}
+
+/* A normal distribution is approximated by the sum of four uniform
+ * samples, which keeps the values inside the configured range */
+static int8_t storm_rssi(struct btdev *btdev)
+{
+	int min = btdev->storm.rssi_min, range;
+	unsigned int i, sum = 0;
+
+	range = btdev->storm.rssi_max - min + 1;
+	if (range <= 1)
+		return min;
+
+	if (!btdev->storm.rssi_normal)
+		return min + link_random(btdev) % range;
+
+	for (i = 0; i < 4; i++)
+		sum += link_random(btdev) % range;
+
+	return min + sum / 4;
+}
+
+static uint8_t storm_name(const uint8_t *bdaddr, uint8_t type, uint8_t *buf)
+{
+	int len;
+
+	len = sprintf((char *) buf + 2, "Storm %u",
+				bdaddr[0] | bdaddr[1] << 8 | bdaddr[2] << 16);
+
+	buf[0] = len + 1;
+	buf[1] = type;
+
+	return len + 2;
+}
+
+/* Payloads rotate between a plain name, a name with a service list and
+ * a name with random manufacturer data */
+static uint8_t storm_payload(struct btdev *btdev, const uint8_t *bdaddr,
+						uint8_t *buf, uint8_t max)
+{
+	uint8_t len = 0, i;
+
+	if (max == 31) {
+		buf[len++] = 0x02;
+		buf[len++] = 0x01;	/* Flags */
+		buf[len++] = 0x06;
+		len += storm_name(bdaddr, 0x08, buf + len);
+	} else
+		len += storm_name(bdaddr, 0x09, buf + len);
+
+	switch (link_random(btdev) % 3) {
+	case 1:
+		buf[len++] = 0x05;
+		buf[len++] = 0x03;	/* Complete list of 16-bit UUIDs */
+		buf[len++] = 0x0a;
+		buf[len++] = 0x11;
+		buf[len++] = 0x0f;
+		buf[len++] = 0x18;
+		break;
+	case 2:
+		buf[len++] = 0x07;
+		buf[len++] = 0xff;	/* Manufacturer specific data */
+		buf[len++] = 0x3f;
+		buf[len++] = 0x00;
+		for (i = 0; i < 4; i++)
+			buf[len++] = link_random(btdev);
+		break;
+	}
+
+	return len;
+}
+
+static void storm_report(struct btdev *btdev, int kind)
+{
+	uint8_t bdaddr[6], data[31], len;
+
+	storm_bdaddr(btdev, bdaddr);
+
+	switch (kind) {
+	case STORM_RSSI:
+	case STORM_EIR:
+		if (kind == STORM_EIR && btdev->inquiry_mode == 0x02) {
+			struct bt_hci_evt_ext_inquiry_result ir;
+
+			memset(&ir, 0, sizeof(ir));
+			ir.num_resp = 0x01;
+			memcpy(ir.bdaddr, bdaddr, 6);
+			memcpy(ir.dev_class, storm_class, 3);
+			ir.rssi = storm_rssi(btdev);
+			storm_payload(btdev, bdaddr, ir.data, sizeof(ir.data));
+
+			send_event(btdev, BT_HCI_EVT_EXT_INQUIRY_RESULT,
+							&ir, sizeof(ir));
+		} else {
+			struct bt_hci_evt_inquiry_result_with_rssi ir;
+
+			memset(&ir, 0, sizeof(ir));
+			ir.num_resp = 0x01;
+			memcpy(ir.bdaddr, bdaddr, 6);
+			memcpy(ir.dev_class, storm_class, 3);
+			ir.rssi = storm_rssi(btdev);
+
+			send_event(btdev, BT_HCI_EVT_INQUIRY_RESULT_WITH_RSSI,
+							&ir, sizeof(ir));
+		}
+		break;
+	case STORM_LE:
+		len = storm_payload(btdev, bdaddr, data, sizeof(data));
+		le_adv_report(btdev, bdaddr, data, len, storm_rssi(btdev));
+		break;
+	}
+
+	btdev->storm_count[kind]++;
+}
+
+static int storm_pick(struct btdev *btdev)
+{
+	unsigned int weight[3] = { 0, 0, 0 }, total, pick;
+	int kind;
+
+	if (btdev->storm_inquiry) {
+		weight[STORM_RSSI] = btdev->storm.mix_rssi;
+		weight[STORM_EIR] = btdev->storm.mix_eir;
+	}
+
+	if (btdev->storm_le)
+		weight[STORM_LE] = btdev->storm.mix_le;
+
+	total = weight[0] + weight[1] + weight[2];
+	if (!total)
+		return -1;
+
+	pick = link_random(btdev) % total;
+
+	for (kind = STORM_RSSI; kind < STORM_LE; kind++) {
+		if (pick < weight[kind])
+			break;
+		pick -= weight[kind];
+	}
+
+	return kind;
+}
+
+static void storm_print(struct btdev *btdev, uint64_t now)
+{
+	uint64_t elapsed = now - btdev->storm_print;
+	unsigned int total = 0;
+	int kind;
+
+	if (elapsed == 0)
+		return;
+
+	for (kind = STORM_RSSI; kind <= STORM_LE; kind++)
+		total += btdev->storm_count[kind];
+
+	printf("Storm %2.2X:%2.2X:%2.2X:%2.2X:%2.2X:%2.2X: %llu events/s",
+			btdev->bdaddr[5], btdev->bdaddr[4], btdev->bdaddr[3],
+			btdev->bdaddr[2], btdev->bdaddr[1], btdev->bdaddr[0],
+			(unsigned long long) total * 1000000 / elapsed);
+
+	for (kind = STORM_RSSI; kind <= STORM_LE; kind++) {
+		printf(" %s %u", storm_kind_str[kind],
+						btdev->storm_count[kind]);
+		btdev->storm_count[kind] = 0;
+	}
+
+	printf("\n");
+
+	btdev->storm_print = now;
+}
+
+static void storm_timeout(int id, void *user_data)
+{
+	struct btdev *btdev = user_data;
+	uint64_t now = now_us(), budget;
+
+	if (btdev->storm_inquiry && now >= btdev->storm_inquiry_end) {
+		btdev->storm_inquiry = false;
+		inquiry_complete(btdev, BT_HCI_ERR_SUCCESS);
+	}
+
+	/* Reports owed since the last burst, carrying the remainder */
+	budget = (now - btdev->storm_last) * btdev->storm.rate +
+							btdev->storm_carry;
+	btdev->storm_carry = budget % 1000000;
+	btdev->storm_last = now;
+
+	for (budget /= 1000000; budget > 0; budget--) {
+		int kind = storm_pick(btdev);
+
+		if (kind < 0)
+			break;
+
+		storm_report(btdev, kind);
+	}
+
+	if (now - btdev->storm_print >= 1000000)
+		storm_print(btdev, now);
+
+	if (btdev->storm_inquiry || btdev->storm_le) {
+		mainloop_modify_timeout_ms(id, STORM_INTERVAL);
+		return;
+	}
+
+	/* The inquiry ended with LE scanning off, so the next one needs a
+	 * new timer */
+	storm_print(btdev, now);
+	mainloop_remove_timeout(id);
+	btdev->storm_timer = -1;
+}
+
+static void storm_update(struct btdev *btdev)
+{
+	if (!btdev->storm_inquiry && !btdev->storm_le) {
+		if (btdev->storm_timer >= 0) {
+			storm_print(btdev, now_us());
+			mainloop_remove_timeout(btdev->storm_timer);
+			btdev->storm_timer = -1;
+		}
+		return;
+	}
+
+	if (btdev->storm_timer >= 0)
+		return;
+
+	btdev->storm_last = btdev->storm_print = now_us();
+	btdev->storm_carry = 0;
+
+	btdev->storm_timer = mainloop_add_timeout_ms(STORM_INTERVAL,
+						storm_timeout, btdev, NULL);
+}
+
+static bool storm_enabled(struct btdev *btdev)
+{
+	return btdev->storm.rate > 0 && btdev->storm.devices > 0;
+}
+
+static void storm_inquiry(struct btdev *btdev, uint8_t length)
+{
+	btdev->storm_inquiry = true;
+	btdev->storm_inquiry_end = now_us() + length * 1280000ULL;
+
+	storm_update(btdev);
+}
+
 static void conn_complete(struct btdev *btdev,
 					const uint8_t *bdaddr, uint8_t status)
 {
@@ -400,12 +1120,12 @@ static void conn_complete(struct btdev *btdev,
 		memcpy(cc.bdaddr, btdev->bdaddr, 6);
 		cc.encr_mode = 0x00;
 
-		cc.handle = cpu_to_le16(42);
+		cc.handle = cpu_to_le16(ACL_HANDLE);
 		cc.link_type = 0x01;
 
 		send_event(remote, BT_HCI_EVT_CONN_COMPLETE, &cc, sizeof(cc));
 
-		cc.handle = cpu_to_le16(42);
+		cc.handle = cpu_to_le16(ACL_HANDLE);
 		cc.link_type = 0x01;
 	} else {
 		cc.handle = cpu_to_le16(0x0000);
@@ -424,7 +1144,18 @@ static void conn_request(struct btdev *btdev, const uint8_t *bdaddr)
 	struct btdev *remote = find_btdev_by_bdaddr(bdaddr);
 
 	if (remote) {
-		if (remote->scan_enable & 0x01) {
+		/* Each device has a single link, which must not be taken
+		 * over by a second connection */
+		if (remote->conn == btdev)
+			conn_complete(btdev, bdaddr,
+					BT_HCI_ERR_ACL_CONN_EXISTS);
+		else if (remote->conn || btdev->conn)
+			conn_complete(btdev, bdaddr,
+					BT_HCI_ERR_LIMITED_RESOURCES);
+		/* Devices without a host behind them accept right away */
+		else if ((remote->scan_enable & 0x01) && !remote->send_handler)
+			conn_complete(btdev, bdaddr, BT_HCI_ERR_SUCCESS);
+		else if (remote->scan_enable & 0x01) {
 			struct bt_hci_evt_conn_request cr;
 
 			memcpy(cr.bdaddr, btdev->bdaddr, 6);
@@ -445,7 +1176,7 @@ static void disconnect_complete(struct btdev *btdev, uint16_t handle,
 	struct bt_hci_evt_disconnect_complete dc;
 	struct btdev *remote;
 
-	if (!btdev) {
+	if (!btdev->conn) {
 		dc.status = BT_HCI_ERR_UNKNOWN_CONN_ID;
 		dc.handle = cpu_to_le16(handle);
 		dc.reason = 0x00;
@@ -461,6 +1192,9 @@ static void disconnect_complete(struct btdev *btdev, uint16_t handle,
 
 	remote = btdev->conn;
 
+	link_flush(btdev);
+	link_flush(remote);
+
 	btdev->conn = NULL;
 	remote->conn = NULL;
 
@@ -569,6 +1303,7 @@ static void remote_version_complete(struct btdev *btdev, uint16_t handle)
 static void process_cmd(struct btdev *btdev, const void *data, uint16_t len)
 {
 	const struct bt_hci_cmd_hdr *hdr = data;
+	const struct bt_hci_cmd_inquiry *inq;
 	const struct bt_hci_cmd_create_conn *cc;
 	const struct bt_hci_cmd_disconnect *dc;
 	const struct bt_hci_cmd_create_conn_cancel *ccc;
@@ -595,6 +1330,7 @@ static void process_cmd(struct btdev *btdev, const void *data, uint16_t len)
 	const struct bt_hci_cmd_write_simple_pairing_mode *wspm;
 	const struct bt_hci_cmd_write_le_host_supported *wlhs;
 	const struct bt_hci_cmd_le_set_event_mask *lsem;
+	const struct bt_hci_cmd_le_set_scan_enable *lsse;
 	struct bt_hci_rsp_read_default_link_policy rdlp;
 	struct bt_hci_rsp_read_stored_link_key rslk;
 	struct bt_hci_rsp_write_stored_link_key wslk;
@@ -633,13 +1369,20 @@ static void process_cmd(struct btdev *btdev, const void *data, uint16_t len)
 
 	switch (opcode) {
 	case BT_HCI_CMD_INQUIRY:
+		inq = data + sizeof(*hdr);
 		cmd_status(btdev, BT_HCI_ERR_SUCCESS, opcode);
-		inquiry_complete(btdev, BT_HCI_ERR_SUCCESS);
+		inquiry_results(btdev);
+		if (storm_enabled(btdev))
+			storm_inquiry(btdev, inq->length);
+		else
+			inquiry_complete(btdev, BT_HCI_ERR_SUCCESS);
 		break;
 
 	case BT_HCI_CMD_INQUIRY_CANCEL:
 		status = BT_HCI_ERR_SUCCESS;
 		cmd_complete(btdev, opcode, &status, sizeof(status));
+		btdev->storm_inquiry = false;
+		storm_update(btdev);
 		break;
 
 	case BT_HCI_CMD_CREATE_CONN:
@@ -726,6 +1469,10 @@ static void process_cmd(struct btdev *btdev, const void *data, uint16_t len)
 		break;
 
 	case BT_HCI_CMD_RESET:
+		btdev->storm_inquiry = false;
+		btdev->storm_le = false;
+		storm_update(btdev);
+		link_flush(btdev);
 		status = BT_HCI_ERR_SUCCESS;
 		cmd_complete(btdev, opcode, &status, sizeof(status));
 		break;
@@ -1030,8 +1777,13 @@ static void process_cmd(struct btdev *btdev, const void *data, uint16_t len)
 		break;
 
 	case BT_HCI_CMD_LE_SET_SCAN_ENABLE:
+		lsse = data + sizeof(*hdr);
 		status = BT_HCI_ERR_SUCCESS;
 		cmd_complete(btdev, opcode, &status, sizeof(status));
+		if (lsse->enable)
+			le_scan_results(btdev);
+		btdev->storm_le = lsse->enable && storm_enabled(btdev);
+		storm_update(btdev);
 		break;
 
 	case BT_HCI_CMD_LE_READ_SUPPORTED_STATES:
@@ -1065,9 +1817,7 @@ void btdev_receive_h4(struct btdev *btdev, const void *data, uint16_t len)
 		process_cmd(btdev, data + 1, len - 1);
 		break;
 	case BT_H4_ACL_PKT:
-		if (btdev->conn)
-			send_packet(btdev->conn, data, len);
-		num_completed_packets(btdev);
+		link_send(btdev, data, len);
 		break;
 	default:
 		printf("Unsupported packet 0x%2.2x\n", pkt_type);
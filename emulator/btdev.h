@@ -23,16 +23,55 @@
  */
 
 #include <stdint.h>
+#include <stdbool.h>
 
 typedef void (*btdev_send_func) (const void *data, uint16_t len,
 							void *user_data);
 
 struct btdev;
 
+/* Link model applied to ACL data a device sends, all zero forwards
+ * packets instantly */
+struct btdev_link {
+	uint32_t bitrate;	/* bits per second, 0 for unlimited */
+	uint32_t delay;		/* propagation delay in microseconds */
+	uint32_t jitter;	/* maximum extra delay in microseconds */
+	uint16_t loss;		/* packets lost per 10000 */
+	uint16_t acl_mtu;	/* 0 keeps the controller default */
+	uint16_t acl_max_pkt;	/* 0 keeps the controller default */
+};
+
+/* Synthetic discovery results sent while the host is inquiring or
+ * scanning, report kinds are picked by relative weight */
+struct btdev_storm {
+	unsigned int devices;	/* distinct addresses reported */
+	unsigned int rate;	/* reports per second, 0 disables */
+	int8_t rssi_min;
+	int8_t rssi_max;
+	bool rssi_normal;	/* bell shaped instead of uniform */
+	uint8_t mix_rssi;	/* Inquiry Result with RSSI */
+	uint8_t mix_eir;	/* Extended Inquiry Result */
+	uint8_t mix_le;		/* LE Advertising Report */
+};
+
 struct btdev *btdev_create(uint16_t id);
 void btdev_destroy(struct btdev *btdev);
 
 void btdev_set_send_handler(struct btdev *btdev, btdev_send_func handler,
 							void *user_data);
 
+void btdev_set_default_link(const struct btdev_link *link);
+void btdev_set_link(struct btdev *btdev, const struct btdev_link *link);
+
+void btdev_set_default_storm(const struct btdev_storm *storm);
+
+void btdev_set_bdaddr(struct btdev *btdev, const uint8_t *bdaddr);
+void btdev_set_class(struct btdev *btdev, const uint8_t *dev_class);
+void btdev_set_name(struct btdev *btdev, const char *name);
+void btdev_set_scan_enable(struct btdev *btdev, uint8_t scan_enable);
+void btdev_set_ext_inquiry_rsp(struct btdev *btdev, const uint8_t *data,
+								uint8_t len);
+void btdev_set_adv_data(struct btdev *btdev, const uint8_t *data,
+								uint8_t len);
+
 void btdev_receive_h4(struct btdev *btdev, const void *data, uint16_t len);
@@ -27,10 +27,16 @@
 #endif
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <getopt.h>
 
 #include "mainloop.h"
 #include "server.h"
 #include "vhci.h"
+#include "btdev.h"
+#include "population.h"
 
 static void signal_callback(int signum, void *user_data)
 {
@@ -42,14 +48,171 @@ static void signal_callback(int signum, void *user_data)
 	}
 }
 
+/* Comma separated rate (bit/s), delay and jitter (us), loss (per
+ * 10000), mtu and pkts (controller buffers) */
+static bool parse_link(const char *spec, struct btdev_link *link)
+{
+	char *str, *pair, *ptr = NULL;
+	bool result = true;
+
+	str = strdup(spec);
+	if (!str)
+		return false;
+
+	for (pair = strtok_r(str, ",", &ptr); pair && result;
+					pair = strtok_r(NULL, ",", &ptr)) {
+		char *value = strchr(pair, '='), *end;
+		unsigned long val;
+
+		if (!value) {
+			result = false;
+			break;
+		}
+
+		*value++ = '\0';
+
+		val = strtoul(value, &end, 0);
+		if (*end || end == value) {
+			result = false;
+			break;
+		}
+
+		if (!strcmp(pair, "rate"))
+			link->bitrate = val;
+		else if (!strcmp(pair, "delay"))
+			link->delay = val;
+		else if (!strcmp(pair, "jitter"))
+			link->jitter = val;
+		else if (!strcmp(pair, "loss") && val <= 10000)
+			link->loss = val;
+		else if (!strcmp(pair, "mtu") && val <= 0xffff)
+			link->acl_mtu = val;
+		else if (!strcmp(pair, "pkts") && val <= 0xffff)
+			link->acl_max_pkt = val;
+		else
+			result = false;
+	}
+
+	free(str);
+
+	return result;
+}
+
+/* Comma separated devices, rate (reports/s), rssi=min:max,
+ * dist=uniform|normal and mix=rssi:eir:le report weights */
+static bool parse_storm(const char *spec, struct btdev_storm *storm)
+{
+	char *str, *pair, *ptr = NULL;
+	bool result = true;
+
+	str = strdup(spec);
+	if (!str)
+		return false;
+
+	for (pair = strtok_r(str, ",", &ptr); pair && result;
+					pair = strtok_r(NULL, ",", &ptr)) {
+		char *value = strchr(pair, '=');
+		unsigned int a, b, c;
+		int min, max;
+
+		if (!value) {
+			result = false;
+			break;
+		}
+
+		*value++ = '\0';
+
+		if (!strcmp(pair, "devices") && sscanf(value, "%u", &a) == 1)
+			storm->devices = a;
+		else if (!strcmp(pair, "rate") && sscanf(value, "%u", &a) == 1)
+			storm->rate = a;
+		else if (!strcmp(pair, "rssi") &&
+				sscanf(value, "%d:%d", &min, &max) == 2 &&
+				min >= -127 && min <= max && max <= 20) {
+			storm->rssi_min = min;
+			storm->rssi_max = max;
+		} else if (!strcmp(pair, "dist") && !strcmp(value, "uniform"))
+			storm->rssi_normal = false;
+		else if (!strcmp(pair, "dist") && !strcmp(value, "normal"))
+			storm->rssi_normal = true;
+		else if (!strcmp(pair, "mix") &&
+				sscanf(value, "%u:%u:%u", &a, &b, &c) == 3 &&
+				a <= 0xff && b <= 0xff && c <= 0xff) {
+			storm->mix_rssi = a;
+			storm->mix_eir = b;
+			storm->mix_le = c;
+		} else
+			result = false;
+	}
+
+	free(str);
+
+	return result;
+}
+
+static const struct option main_options[] = {
+	{ "population",	required_argument, NULL, 'p'	},
+	{ "link",	required_argument, NULL, 'l'	},
+	{ "storm",	required_argument, NULL, 's'	},
+	{ }
+};
+
 int main(int argc, char *argv[])
 {
 	struct vhci *vhci;
 	struct server *server;
+	struct btdev_link link;
+	struct btdev_storm storm;
 	sigset_t mask;
+	int count, exit_status;
 
 	mainloop_init();
 
+	for (;;) {
+		int opt;
+
+		opt = getopt_long(argc, argv, "p:l:s:", main_options, NULL);
+		if (opt < 0)
+			break;
+
+		switch (opt) {
+		case 'p':
+			count = population_create(optarg);
+			if (count < 0) {
+				fprintf(stderr, "Invalid population %s: %s\n",
+						optarg, strerror(-count));
+				return 1;
+			}
+			printf("Created %d virtual devices\n", count);
+			break;
+		case 'l':
+			memset(&link, 0, sizeof(link));
+			if (!parse_link(optarg, &link)) {
+				fprintf(stderr, "Invalid link model %s\n",
+								optarg);
+				return 1;
+			}
+			btdev_set_default_link(&link);
+			break;
+		case 's':
+			memset(&storm, 0, sizeof(storm));
+			storm.devices = 1000;
+			storm.rssi_min = -90;
+			storm.rssi_max = -40;
+			storm.mix_rssi = 1;
+			storm.mix_eir = 1;
+			storm.mix_le = 1;
+			if (!parse_storm(optarg, &storm)) {
+				fprintf(stderr, "Invalid storm %s\n", optarg);
+				return 1;
+			}
+			btdev_set_default_storm(&storm);
+			break;
+		default:
+			return 1;
+		}
+	}
+
 	sigemptyset(&mask);
 	sigaddset(&mask, SIGINT);
 	sigaddset(&mask, SIGTERM);
@@ -59,6 +222,7 @@ int main(int argc, char *argv[])
 	vhci = vhci_open(VHCI_TYPE_BREDR, 0x23);
 	if (!vhci) {
 		fprintf(stderr, "Failed to open Virtual HCI device\n");
+		population_destroy();
 		return 1;
 	}
 
@@ -66,8 +230,13 @@ int main(int argc, char *argv[])
 	if (!server) {
 		fprintf(stderr, "Failed to open server channel\n");
 		vhci_close(vhci);
+		population_destroy();
 		return 1;
 	}
 
-	return mainloop_run();
+	exit_status = mainloop_run();
+
+	population_destroy();
+
+	return exit_status;
 }
@@ -0,0 +1,272 @@
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *  Copyright (C) 2011-2012  Intel Corporation
+ *  Copyright (C) 2004-2010  Marcel Holtmann <marcel@holtmann.org>
+ *
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "btdev.h"
+#include "population.h"
+
+/*
+ * A population spec is a comma separated list of key=value pairs:
+ *
+ *   count=N		number of devices (default 1)
+ *   addr=XX:..:XX	first address, incremented per device
+ *   class=0xXXXXXX	class of device
+ *   name=TEXT		name, the first %u is replaced by the device number
+ *   eir=HEX		extended inquiry response, built from name if unset
+ *   adv=HEX		LE advertising data, no advertising if unset
+ *   scan=N		scan enable, defaults to inquiry and page scan
+ */
+
+struct population {
+	unsigned int count;
+	uint8_t bdaddr[6];
+	uint8_t dev_class[3];
+	char name[248];
+	uint8_t eir[240];
+	int eir_len;
+	uint8_t adv[31];
+	int adv_len;
+	uint8_t scan_enable;
+};
+
+static struct btdev **devices = NULL;
+static unsigned int num_devices = 0;
+
+static int parse_bdaddr(const char *str, uint8_t *bdaddr)
+{
+	unsigned int b[6];
+	int i;
+
+	if (sscanf(str, "%2x:%2x:%2x:%2x:%2x:%2x",
+				&b[5], &b[4], &b[3], &b[2], &b[1], &b[0]) != 6)
+		return -EINVAL;
+
+	for (i = 0; i < 6; i++)
+		bdaddr[i] = b[i];
+
+	return 0;
+}
+
+static int parse_hex(const char *str, uint8_t *buf, int max)
+{
+	int len = 0;
+
+	while (str[0] && str[1]) {
+		unsigned int val;
+
+		if (len == max || sscanf(str, "%2x", &val) != 1)
+			return -EINVAL;
+
+		buf[len++] = val;
+		str += 2;
+	}
+
+	return str[0] ? -EINVAL : len;
+}
+
+static int parse_pair(struct population *pop, const char *key,
+							const char *value)
+{
+	unsigned long val;
+	char *end;
+
+	if (!strcmp(key, "count")) {
+		val = strtoul(value, &end, 0);
+		if (*end || val == 0)
+			return -EINVAL;
+		pop->count = val;
+	} else if (!strcmp(key, "addr")) {
+		return parse_bdaddr(value, pop->bdaddr);
+	} else if (!strcmp(key, "class")) {
+		val = strtoul(value, &end, 16);
+		if (*end || val > 0xffffff)
+			return -EINVAL;
+		pop->dev_class[0] = val & 0xff;
+		pop->dev_class[1] = (val >> 8) & 0xff;
+		pop->dev_class[2] = (val >> 16) & 0xff;
+	} else if (!strcmp(key, "name")) {
+		strncpy(pop->name, value, sizeof(pop->name) - 1);
+	} else if (!strcmp(key, "eir")) {
+		pop->eir_len = parse_hex(value, pop->eir, sizeof(pop->eir));
+		if (pop->eir_len < 0)
+			return -EINVAL;
+	} else if (!strcmp(key, "adv")) {
+		pop->adv_len = parse_hex(value, pop->adv, sizeof(pop->adv));
+		if (pop->adv_len < 0)
+			return -EINVAL;
+	} else if (!strcmp(key, "scan")) {
+		val = strtoul(value, &end, 0);
+		if (*end || val > 0x03)
+			return -EINVAL;
+		pop->scan_enable = val;
+	} else
+		return -EINVAL;
+
+	return 0;
+}
+
+static int parse_spec(struct population *pop, const char *spec)
+{
+	char *str, *pair, *ptr = NULL;
+	int err = 0;
+
+	str = strdup(spec);
+	if (!str)
+		return -ENOMEM;
+
+	for (pair = strtok_r(str, ",", &ptr); pair;
+					pair = strtok_r(NULL, ",", &ptr)) {
+		char *value = strchr(pair, '=');
+
+		if (!value) {
+			err = -EINVAL;
+			break;
+		}
+
+		*value++ = '\0';
+
+		err = parse_pair(pop, pair, value);
+		if (err < 0)
+			break;
+	}
+
+	free(str);
+
+	return err;
+}
+
+static void expand_name(const char *template, unsigned int num,
+						char *name, size_t size)
+{
+	const char *ptr = strstr(template, "%u");
+
+	if (!ptr) {
+		snprintf(name, size, "%s", template);
+		return;
+	}
+
+	snprintf(name, size, "%.*s%u%s", (int) (ptr - template), template,
+								num, ptr + 2);
+}
+
+static uint8_t name_to_eir(const char *name, uint8_t *eir)
+{
+	size_t len = strlen(name);
+
+	if (len > 238)
+		len = 238;
+
+	eir[0] = len + 1;
+	eir[1] = 0x09;		/* Complete Local Name */
+	memcpy(eir + 2, name, len);
+
+	return len + 2;
+}
+
+static void next_bdaddr(uint8_t *bdaddr)
+{
+	int i;
+
+	for (i = 0; i < 6; i++)
+		if (++bdaddr[i] != 0x00)
+			break;
+}
+
+int population_create(const char *spec)
+{
+	struct population pop;
+	struct btdev **list;
+	uint8_t bdaddr[6];
+	unsigned int i;
+	int err;
+
+	memset(&pop, 0, sizeof(pop));
+	pop.count = 1;
+	parse_bdaddr("00:AA:02:00:00:00", pop.bdaddr);
+	strcpy(pop.name, "Device %u");
+	pop.eir_len = -1;
+	pop.scan_enable = 0x03;
+
+	err = parse_spec(&pop, spec);
+	if (err < 0)
+		return err;
+
+	list = realloc(devices, (num_devices + pop.count) * sizeof(*list));
+	if (!list)
+		return -ENOMEM;
+
+	devices = list;
+
+	memcpy(bdaddr, pop.bdaddr, 6);
+
+	for (i = 0; i < pop.count; i++) {
+		struct btdev *btdev;
+		char name[248];
+
+		btdev = btdev_create(0);
+		if (!btdev)
+			return i > 0 ? (int) i : -ENOMEM;
+
+		devices[num_devices++] = btdev;
+
+		expand_name(pop.name, i, name, sizeof(name));
+
+		btdev_set_bdaddr(btdev, bdaddr);
+		btdev_set_class(btdev, pop.dev_class);
+		btdev_set_name(btdev, name);
+		btdev_set_scan_enable(btdev, pop.scan_enable);
+
+		if (pop.eir_len < 0) {
+			uint8_t eir[240];
+
+			btdev_set_ext_inquiry_rsp(btdev, eir,
+						name_to_eir(name, eir));
+		} else
+			btdev_set_ext_inquiry_rsp(btdev, pop.eir, pop.eir_len);
+
+		if (pop.adv_len > 0)
+			btdev_set_adv_data(btdev, pop.adv, pop.adv_len);
+
+		next_bdaddr(bdaddr);
+	}
+
+	return pop.count;
+}
+
+void population_destroy(void)
+{
+	while (num_devices > 0)
+		btdev_destroy(devices[--num_devices]);
+
+	free(devices);
+	devices = NULL;
+}
@@ -243,7 +243,7 @@ static int open_server(const char *path)
 		return -1;
 	}
 
-	if (listen(fd, 5) < 0) {
+	if (listen(fd, SOMAXCONN) < 0) {
 		perror("Failed to listen server socket");
 		close(fd);
 		return -1;
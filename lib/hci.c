@@ -35,6 +35,7 @@
 #include <string.h>
 
 #include <sys/param.h>
+#include <sys/time.h>
 #include <sys/uio.h>
 #include <sys/poll.h>
 #include <sys/types.h>
@@ -1226,6 +1227,355 @@ done:
 	return 0;
 }
 
+/* Asynchronous command queue
+ *
+ * Commands are written as long as the controller grants credits
+ * (Num_HCI_Command_Packets) and their Command Complete or Command Status
+ * events are matched by opcode, in the order the commands were sent. */
+
+struct hci_cmd {
+	int id;
+	uint16_t opcode;
+	hci_cmd_func_t func;
+	void *user_data;
+	struct hci_cmd *next;
+	uint8_t plen;
+	uint8_t param[0];
+};
+
+struct hci_cmd_queue {
+	int dd;
+	int next_id;
+	uint8_t credits;
+	struct hci_cmd *queued, *queued_tail;
+	struct hci_cmd *sent, *sent_tail;
+};
+
+static void cmd_list_append(struct hci_cmd **head, struct hci_cmd **tail,
+							struct hci_cmd *cmd)
+{
+	cmd->next = NULL;
+
+	if (*tail)
+		(*tail)->next = cmd;
+	else
+		*head = cmd;
+
+	*tail = cmd;
+}
+
+static void cmd_list_free(struct hci_cmd *cmd)
+{
+	while (cmd) {
+		struct hci_cmd *next = cmd->next;
+
+		free(cmd);
+		cmd = next;
+	}
+}
+
+struct hci_cmd_queue *hci_cmd_queue_new(int dd)
+{
+	struct hci_cmd_queue *q;
+
+	q = malloc(sizeof(*q));
+	if (!q)
+		return NULL;
+
+	memset(q, 0, sizeof(*q));
+	q->dd = dd;
+	q->next_id = 1;
+
+	/* A controller accepts one command until it says otherwise */
+	q->credits = 1;
+
+	return q;
+}
+
+void hci_cmd_queue_free(struct hci_cmd_queue *q)
+{
+	if (!q)
+		return;
+
+	cmd_list_free(q->queued);
+	cmd_list_free(q->sent);
+	free(q);
+}
+
+static int cmd_queue_flush(struct hci_cmd_queue *q)
+{
+	while (q->queued && q->credits > 0) {
+		struct hci_cmd *cmd = q->queued;
+
+		if (hci_send_cmd(q->dd, cmd_opcode_ogf(cmd->opcode),
+					cmd_opcode_ocf(cmd->opcode),
+					cmd->plen, cmd->param) < 0)
+			return -1;
+
+		q->queued = cmd->next;
+		if (!q->queued)
+			q->queued_tail = NULL;
+
+		q->credits--;
+		cmd_list_append(&q->sent, &q->sent_tail, cmd);
+	}
+
+	return 0;
+}
+
+int hci_cmd_queue_send(struct hci_cmd_queue *q, uint16_t ogf, uint16_t ocf,
+				uint8_t plen, const void *param,
+				hci_cmd_func_t func, void *user_data)
+{
+	struct hci_cmd *cmd;
+
+	cmd = malloc(sizeof(*cmd) + plen);
+	if (!cmd)
+		return -1;
+
+	cmd->id = q->next_id++;
+	if (q->next_id <= 0)
+		q->next_id = 1;
+
+	cmd->opcode = cmd_opcode_pack(ogf, ocf);
+	cmd->func = func;
+	cmd->user_data = user_data;
+	cmd->plen = plen;
+	if (plen)
+		memcpy(cmd->param, param, plen);
+
+	cmd_list_append(&q->queued, &q->queued_tail, cmd);
+
+	/* Writes stop at the first failure, so the new command is still
+	 * queued and the caller keeps ownership of user_data */
+	if (cmd_queue_flush(q) < 0) {
+		int err = errno;
+
+		hci_cmd_queue_cancel(q, cmd->id);
+		errno = err;
+		return -1;
+	}
+
+	return cmd->id;
+}
+
+int hci_cmd_queue_cancel(struct hci_cmd_queue *q, int id)
+{
+	struct hci_cmd *cmd, *prev = NULL;
+
+	for (cmd = q->queued; cmd; prev = cmd, cmd = cmd->next) {
+		if (cmd->id != id)
+			continue;
+
+		if (prev)
+			prev->next = cmd->next;
+		else
+			q->queued = cmd->next;
+
+		if (q->queued_tail == cmd)
+			q->queued_tail = prev;
+
+		free(cmd);
+		return 0;
+	}
+
+	/* Already with the controller: its completion still returns
+	 * a credit, so only the callback goes away */
+	for (cmd = q->sent; cmd; cmd = cmd->next) {
+		if (cmd->id == id) {
+			cmd->func = NULL;
+			return 0;
+		}
+	}
+
+	errno = ENOENT;
+	return -1;
+}
+
+int hci_cmd_queue_pending(struct hci_cmd_queue *q)
+{
+	struct hci_cmd *cmd;
+	int n = 0;
+
+	for (cmd = q->queued; cmd; cmd = cmd->next)
+		n++;
+
+	for (cmd = q->sent; cmd; cmd = cmd->next)
+		n++;
+
+	return n;
+}
+
+static void cmd_queue_complete(struct hci_cmd_queue *q, uint16_t opcode,
+				uint8_t status, const void *param,
+				uint8_t plen)
+{
+	struct hci_cmd *cmd, *prev = NULL;
+
+	for (cmd = q->sent; cmd; prev = cmd, cmd = cmd->next)
+		if (cmd->opcode == opcode)
+			break;
+
+	if (!cmd)
+		return;
+
+	if (prev)
+		prev->next = cmd->next;
+	else
+		q->sent = cmd->next;
+
+	if (q->sent_tail == cmd)
+		q->sent_tail = prev;
+
+	if (cmd->func)
+		cmd->func(opcode, status, param, plen, cmd->user_data);
+
+	free(cmd);
+}
+
+int hci_cmd_queue_process(struct hci_cmd_queue *q, const void *buf, int len)
+{
+	const uint8_t *ptr = buf;
+	const hci_event_hdr *hdr;
+	const evt_cmd_complete *cc;
+	const evt_cmd_status *cs;
+	const uint8_t *param;
+	uint8_t plen, status;
+	uint16_t opcode;
+
+	if (len < 1 + HCI_EVENT_HDR_SIZE || ptr[0] != HCI_EVENT_PKT)
+		return 0;
+
+	hdr = (const void *) (ptr + 1);
+	ptr += 1 + HCI_EVENT_HDR_SIZE;
+	len -= 1 + HCI_EVENT_HDR_SIZE;
+
+	if (hdr->plen < len)
+		len = hdr->plen;
+
+	switch (hdr->evt) {
+	case EVT_CMD_COMPLETE:
+		if (len < EVT_CMD_COMPLETE_SIZE)
+			return 0;
+
+		cc = (const void *) ptr;
+		q->credits = cc->ncmd;
+		opcode = btohs(cc->opcode);
+
+		param = ptr + EVT_CMD_COMPLETE_SIZE;
+		plen = len - EVT_CMD_COMPLETE_SIZE;
+		status = plen > 0 ? param[0] : 0;
+		break;
+
+	case EVT_CMD_STATUS:
+		if (len < EVT_CMD_STATUS_SIZE)
+			return 0;
+
+		cs = (const void *) ptr;
+		q->credits = cs->ncmd;
+		opcode = btohs(cs->opcode);
+
+		param = NULL;
+		plen = 0;
+		status = cs->status;
+		break;
+
+	default:
+		return 0;
+	}
+
+	/* Opcode 0x0000 only hands out credits */
+	if (opcode != 0)
+		cmd_queue_complete(q, opcode, status, param, plen);
+
+	if (cmd_queue_flush(q) < 0)
+		return -1;
+
+	return 1;
+}
+
+/* Milliseconds left until deadline, never negative */
+static int cmd_queue_remaining(const struct timeval *deadline)
+{
+	struct timeval now, left;
+
+	gettimeofday(&now, NULL);
+
+	if (!timercmp(&now, deadline, <))
+		return 0;
+
+	timersub(deadline, &now, &left);
+
+	return left.tv_sec * 1000 + (left.tv_usec + 999) / 1000;
+}
+
+int hci_cmd_queue_wait(struct hci_cmd_queue *q, int to)
+{
+	unsigned char buf[HCI_MAX_EVENT_SIZE];
+	struct hci_filter nf, of;
+	struct timeval deadline;
+	socklen_t olen;
+	int err;
+
+	/* The timeout bounds the whole wait, not each event */
+	if (to >= 0) {
+		gettimeofday(&deadline, NULL);
+		deadline.tv_sec += to / 1000;
+		deadline.tv_usec += (to % 1000) * 1000;
+		if (deadline.tv_usec >= 1000000) {
+			deadline.tv_sec++;
+			deadline.tv_usec -= 1000000;
+		}
+	}
+
+	olen = sizeof(of);
+	if (getsockopt(q->dd, SOL_HCI, HCI_FILTER, &of, &olen) < 0)
+		return -1;
+
+	hci_filter_clear(&nf);
+	hci_filter_set_ptype(HCI_EVENT_PKT, &nf);
+	hci_filter_set_event(EVT_CMD_STATUS, &nf);
+	hci_filter_set_event(EVT_CMD_COMPLETE, &nf);
+	if (setsockopt(q->dd, SOL_HCI, HCI_FILTER, &nf, sizeof(nf)) < 0)
+		return -1;
+
+	while (q->sent || q->queued) {
+		struct pollfd p;
+		int n, len;
+
+		p.fd = q->dd; p.events = POLLIN;
+		while ((n = poll(&p, 1, to < 0 ? -1 :
+				cmd_queue_remaining(&deadline))) < 0) {
+			if (errno == EAGAIN || errno == EINTR)
+				continue;
+			goto failed;
+		}
+
+		if (!n) {
+			errno = ETIMEDOUT;
+			goto failed;
+		}
+
+		while ((len = read(q->dd, buf, sizeof(buf))) < 0) {
+			if (errno == EAGAIN || errno == EINTR)
+				continue;
+			goto failed;
+		}
+
+		if (hci_cmd_queue_process(q, buf, len) < 0)
+			goto failed;
+	}
+
+	setsockopt(q->dd, SOL_HCI, HCI_FILTER, &of, sizeof(of));
+	return 0;
+
+failed:
+	err = errno;
+	setsockopt(q->dd, SOL_HCI, HCI_FILTER, &of, sizeof(of));
+	errno = err;
+	return -1;
+}
+
 int hci_create_connection(int dd, const bdaddr_t *bdaddr, uint16_t ptype,
 				uint16_t clkoffset, uint8_t rswitch,
 				uint16_t *handle, int to)
@@ -53,6 +53,25 @@ int hci_close_dev(int dd);
 int hci_send_cmd(int dd, uint16_t ogf, uint16_t ocf, uint8_t plen, void *param);
 int hci_send_req(int dd, struct hci_request *req, int timeout);
 
+/* Called with the return parameters of Command Complete, or with NULL
+ * for Command Status; status is the first return parameter or the
+ * Command Status status */
+typedef void (*hci_cmd_func_t)(uint16_t opcode, uint8_t status,
+				const void *param, uint8_t plen,
+				void *user_data);
+
+struct hci_cmd_queue;
+
+struct hci_cmd_queue *hci_cmd_queue_new(int dd);
+void hci_cmd_queue_free(struct hci_cmd_queue *q);
+int hci_cmd_queue_send(struct hci_cmd_queue *q, uint16_t ogf, uint16_t ocf,
+				uint8_t plen, const void *param,
+				hci_cmd_func_t func, void *user_data);
+int hci_cmd_queue_cancel(struct hci_cmd_queue *q, int id);
+int hci_cmd_queue_pending(struct hci_cmd_queue *q);
+int hci_cmd_queue_process(struct hci_cmd_queue *q, const void *buf, int len);
+int hci_cmd_queue_wait(struct hci_cmd_queue *q, int to);
+
 int hci_create_connection(int dd, const bdaddr_t *bdaddr, uint16_t ptype, uint16_t clkoffset, uint8_t rswitch, uint16_t *handle, int to);
 int hci_disconnect(int dd, uint16_t handle, uint8_t reason, int to);
 
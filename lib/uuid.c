@@ -123,12 +123,144 @@ int bt_uuid_cmp(const bt_uuid_t *uuid1, const bt_uuid_t *uuid2)
 {
 	bt_uuid_t u1, u2;
 
+	/* Same-sized values share every other byte of the 128-bit form, so
+	 * comparing them in place gives the same ordering as expanding */
+	if (uuid1->type == uuid2->type) {
+		switch (uuid1->type) {
+		case BT_UUID16:
+			return memcmp(&uuid1->value.u16, &uuid2->value.u16,
+						sizeof(uuid1->value.u16));
+		case BT_UUID32:
+			return memcmp(&uuid1->value.u32, &uuid2->value.u32,
+						sizeof(uuid1->value.u32));
+		case BT_UUID128:
+			return bt_uuid128_cmp(uuid1, uuid2);
+		default:
+			break;
+		}
+	}
+
 	bt_uuid_to_uuid128(uuid1, &u1);
 	bt_uuid_to_uuid128(uuid2, &u2);
 
 	return bt_uuid128_cmp(&u1, &u2);
 }
 
+/*
+ * Reduce a UUID to its shortest equivalent form: values derived from the
+ * Bluetooth base UUID become 16-bit (or 32-bit) UUIDs. Two canonical UUIDs
+ * are equal if and only if their types and values are.
+ */
+void bt_uuid_to_canonical(const bt_uuid_t *src, bt_uuid_t *dst)
+{
+	uint32_t u32;
+
+	switch (src->type) {
+	case BT_UUID16:
+		*dst = *src;
+		return;
+	case BT_UUID32:
+		u32 = src->value.u32;
+		break;
+	case BT_UUID128:
+		if (memcmp(src->value.u128.data, bluetooth_base_uuid.data,
+						BASE_UUID32_OFFSET) != 0 ||
+			memcmp(&src->value.u128.data[BASE_UUID32_OFFSET + 4],
+				&bluetooth_base_uuid.data[BASE_UUID32_OFFSET + 4],
+				12 - BASE_UUID32_OFFSET) != 0) {
+			*dst = *src;
+			return;
+		}
+
+		memcpy(&u32, &src->value.u128.data[BASE_UUID32_OFFSET],
+								sizeof(u32));
+		break;
+	default:
+		*dst = *src;
+		return;
+	}
+
+	if (u32 <= 0xffff)
+		bt_uuid16_create(dst, u32);
+	else
+		bt_uuid32_create(dst, u32);
+}
+
+/*
+ * Equality-only comparison. Returns non-zero when both UUIDs denote the
+ * same value; UUIDs of the same type are compared without any conversion.
+ */
+int bt_uuid_equal(const bt_uuid_t *uuid1, const bt_uuid_t *uuid2)
+{
+	bt_uuid_t u1, u2;
+
+	if (uuid1->type == uuid2->type) {
+		switch (uuid1->type) {
+		case BT_UUID16:
+			return uuid1->value.u16 == uuid2->value.u16;
+		case BT_UUID32:
+			return uuid1->value.u32 == uuid2->value.u32;
+		case BT_UUID128:
+			return bt_uuid128_cmp(uuid1, uuid2) == 0;
+		default:
+			return 0;
+		}
+	}
+
+	bt_uuid_to_canonical(uuid1, &u1);
+	bt_uuid_to_canonical(uuid2, &u2);
+
+	if (u1.type != u2.type)
+		return 0;
+
+	switch (u1.type) {
+	case BT_UUID16:
+		return u1.value.u16 == u2.value.u16;
+	case BT_UUID32:
+		return u1.value.u32 == u2.value.u32;
+	case BT_UUID128:
+		return bt_uuid128_cmp(&u1, &u2) == 0;
+	default:
+		return 0;
+	}
+}
+
+/*
+ * Hash consistent with bt_uuid_equal(): equal UUIDs hash to the same value
+ * whatever their representation. Base UUIDs hash to their short value.
+ */
+unsigned int bt_uuid_hash(const bt_uuid_t *uuid)
+{
+	bt_uuid_t c;
+	unsigned int h;
+	int i;
+
+	if (uuid->type == BT_UUID16)
+		return uuid->value.u16;
+
+	bt_uuid_to_canonical(uuid, &c);
+
+	switch (c.type) {
+	case BT_UUID16:
+		return c.value.u16;
+	case BT_UUID32:
+		return c.value.u32;
+	case BT_UUID128:
+		break;
+	default:
+		return 0;
+	}
+
+	/* FNV-1a */
+	h = 2166136261U;
+	for (i = 0; i < 16; i++) {
+		h ^= c.value.u128.data[i];
+		h *= 16777619U;
+	}
+
+	return h;
+}
+
 /*
  * convert the UUID to string, copying a maximum of n characters.
  */
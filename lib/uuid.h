@@ -52,6 +52,9 @@ int bt_uuid128_create(bt_uuid_t *btuuid, uint128_t value);
 
 int bt_uuid_cmp(const bt_uuid_t *uuid1, const bt_uuid_t *uuid2);
 void bt_uuid_to_uuid128(const bt_uuid_t *src, bt_uuid_t *dst);
+void bt_uuid_to_canonical(const bt_uuid_t *src, bt_uuid_t *dst);
+int bt_uuid_equal(const bt_uuid_t *uuid1, const bt_uuid_t *uuid2);
+unsigned int bt_uuid_hash(const bt_uuid_t *uuid);
 
 #define MAX_LEN_UUID_STR 37
 
@@ -543,9 +543,24 @@ struct bt_hci_evt_ext_inquiry_result {
 	uint8_t  data[240];
 } __attribute__ ((packed));
 
+#define BT_HCI_EVT_LE_META_EVENT		0x3e
+
+#define BT_HCI_EVT_LE_ADV_REPORT		0x02
+struct bt_hci_evt_le_adv_report {
+	uint8_t  num_reports;
+	uint8_t  event_type;
+	uint8_t  addr_type;
+	uint8_t  addr[6];
+	uint8_t  data_len;
+	uint8_t  data[0];
+} __attribute__ ((packed));
+
 #define BT_HCI_ERR_SUCCESS			0x00
 #define BT_HCI_ERR_UNKNOWN_COMMAND		0x01
 #define BT_HCI_ERR_UNKNOWN_CONN_ID		0x02
 #define BT_HCI_ERR_HARDWARE_FAILURE		0x03
 #define BT_HCI_ERR_PAGE_TIMEOUT			0x04
+#define BT_HCI_ERR_CONN_TIMEOUT			0x08
+#define BT_HCI_ERR_ACL_CONN_EXISTS		0x0b
+#define BT_HCI_ERR_LIMITED_RESOURCES		0x0d
 #define BT_HCI_ERR_INVALID_PARAMETERS		0x12
@@ -29,12 +29,18 @@
 #include <stdio.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <limits.h>
 #include <unistd.h>
 #include <stdint.h>
+#include <stdlib.h>
+#include <stdbool.h>
 #include <string.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
+#include <sys/uio.h>
 #include <arpa/inet.h>
 
+#include "mainloop.h"
 #include "btsnoop.h"
 
 static inline uint64_t ntoh64(uint64_t n)
@@ -73,25 +79,223 @@ static const uint8_t btsnoop_id[] = { 0x62, 0x74, 0x73, 0x6e,
 static const uint32_t btsnoop_version = 1;
 static const uint32_t btsnoop_type = 1001;
 
+#define BTSNOOP_BUF_SIZE	(256 * 1024)
+#define BTSNOOP_BUF_ALIGN	4096
+#define BTSNOOP_FLUSH_INTERVAL	1
+
+static char *btsnoop_path = NULL;
 static int btsnoop_fd = -1;
 static uint16_t btsnoop_index = 0xffff;
+static int btsnoop_timer = -1;
+
+static uint8_t *btsnoop_buf = NULL;
+static size_t btsnoop_buf_len = 0;
+static uint32_t btsnoop_buf_records = 0;
+static bool btsnoop_need_hdr = true;
+
+static uint32_t btsnoop_drops = 0;
+static bool btsnoop_write_failed = false;
+
+static size_t btsnoop_max_size = 0;
+static unsigned int btsnoop_max_age = 0;
+static unsigned int btsnoop_max_files = 0;
+static size_t btsnoop_file_size = 0;
+static time_t btsnoop_file_start;
+
+static int write_iov(int fd, struct iovec *iov, int iovcnt)
+{
+	while (iovcnt > 0) {
+		ssize_t written;
+
+		written = writev(fd, iov, iovcnt);
+		if (written < 0) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+
+		/* Short write: skip what made it and retry the rest */
+		while (iovcnt > 0 && (size_t) written >= iov->iov_len) {
+			written -= iov->iov_len;
+			iov++;
+			iovcnt--;
+		}
+
+		if (iovcnt > 0) {
+			iov->iov_base = (uint8_t *) iov->iov_base + written;
+			iov->iov_len -= written;
+		}
+	}
+
+	return 0;
+}
+
+static int open_file(void)
+{
+	btsnoop_fd = open(btsnoop_path, O_WRONLY | O_CREAT | O_TRUNC,
+				S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+	if (btsnoop_fd < 0) {
+		fprintf(stderr, "Failed to open %s: %s\n", btsnoop_path,
+							strerror(errno));
+		return -1;
+	}
+
+	btsnoop_need_hdr = true;
+	btsnoop_file_size = BTSNOOP_HDR_SIZE;
+	btsnoop_file_start = 0;
+
+	return 0;
+}
+
+static void rotate_file(void)
+{
+	char from[PATH_MAX], to[PATH_MAX];
+	unsigned int i;
+
+	close(btsnoop_fd);
+	btsnoop_fd = -1;
+
+	/* path.1 is the most recent file, path.<count> the oldest */
+	for (i = btsnoop_max_files; i > 1; i--) {
+		snprintf(from, sizeof(from), "%s.%u", btsnoop_path, i - 1);
+		snprintf(to, sizeof(to), "%s.%u", btsnoop_path, i);
+		rename(from, to);
+	}
+
+	if (btsnoop_max_files > 0) {
+		snprintf(to, sizeof(to), "%s.1", btsnoop_path);
+		rename(btsnoop_path, to);
+	}
+
+	if (open_file() < 0) {
+		/* Another rotation would only shift out the saved files */
+		fprintf(stderr, "Rotation disabled, no longer writing %s\n",
+								btsnoop_path);
+		btsnoop_max_size = 0;
+		btsnoop_max_age = 0;
+	}
+}
+
+static void flush_buffer(void)
+{
+	struct btsnoop_hdr hdr;
+	struct iovec iov[2];
+	int iovcnt = 0;
+
+	if (btsnoop_buf_len == 0 || btsnoop_fd < 0)
+		return;
+
+	if (btsnoop_need_hdr) {
+		memcpy(hdr.id, btsnoop_id, sizeof(btsnoop_id));
+		hdr.version = htonl(btsnoop_version);
+		hdr.type = htonl(btsnoop_type);
+
+		iov[iovcnt].iov_base = &hdr;
+		iov[iovcnt].iov_len = BTSNOOP_HDR_SIZE;
+		iovcnt++;
+	}
+
+	iov[iovcnt].iov_base = btsnoop_buf;
+	iov[iovcnt].iov_len = btsnoop_buf_len;
+	iovcnt++;
+
+	btsnoop_file_size += btsnoop_buf_len;
+
+	if (write_iov(btsnoop_fd, iov, iovcnt) < 0) {
+		if (!btsnoop_write_failed)
+			fprintf(stderr, "Failed to write %s: %s\n",
+					btsnoop_path, strerror(errno));
+
+		btsnoop_write_failed = true;
+		btsnoop_drops += btsnoop_buf_records;
+	} else {
+		btsnoop_write_failed = false;
+		btsnoop_need_hdr = false;
+	}
+
+	btsnoop_buf_len = 0;
+	btsnoop_buf_records = 0;
+}
+
+static bool rotation_due(struct timeval *tv, size_t len)
+{
+	size_t used = btsnoop_file_size + btsnoop_buf_len;
+
+	if (btsnoop_max_files == 0)
+		return false;
+
+	if (btsnoop_file_start == 0) {
+		btsnoop_file_start = tv->tv_sec;
+		return false;
+	}
+
+	if (btsnoop_max_size > 0 && used + len > btsnoop_max_size)
+		return true;
+
+	if (btsnoop_max_age > 0 &&
+			tv->tv_sec - btsnoop_file_start >= btsnoop_max_age)
+		return true;
+
+	return false;
+}
+
+static void flush_timeout(int id, void *user_data)
+{
+	flush_buffer();
+
+	mainloop_modify_timeout(id, BTSNOOP_FLUSH_INTERVAL);
+}
+
+static void flush_timeout_destroy(void *user_data)
+{
+	btsnoop_timer = -1;
+}
+
+void btsnoop_set_rotation(size_t max_size, unsigned int max_age,
+						unsigned int max_files)
+{
+	btsnoop_max_size = max_size;
+	btsnoop_max_age = max_age;
+	btsnoop_max_files = max_files;
+}
 
 void btsnoop_open(const char *path)
 {
+	void *buf;
+
 	if (btsnoop_fd >= 0)
 		return;
 
-	btsnoop_fd = open(path, O_WRONLY | O_CREAT | O_TRUNC,
-				S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+	if (posix_memalign(&buf, BTSNOOP_BUF_ALIGN, BTSNOOP_BUF_SIZE) != 0)
+		return;
+
+	btsnoop_path = strdup(path);
+	if (!btsnoop_path) {
+		free(buf);
+		return;
+	}
+
+	if (open_file() < 0) {
+		free(btsnoop_path);
+		btsnoop_path = NULL;
+		free(buf);
+		return;
+	}
+
+	btsnoop_buf = buf;
+	btsnoop_buf_len = 0;
+	btsnoop_drops = 0;
+
+	btsnoop_timer = mainloop_add_timeout(BTSNOOP_FLUSH_INTERVAL,
+						flush_timeout, NULL,
+						flush_timeout_destroy);
 }
 
 void btsnoop_write(struct timeval *tv, uint16_t index, uint32_t flags,
 					const void *data, uint16_t size)
 {
-	struct btsnoop_hdr hdr;
-	struct btsnoop_pkt pkt;
+	struct btsnoop_pkt *pkt;
 	uint64_t ts;
-	ssize_t written;
 
 	if (!tv)
 		return;
@@ -99,47 +303,307 @@ void btsnoop_write(struct timeval *tv, uint16_t index, uint32_t flags,
 	if (btsnoop_fd < 0)
 		return;
 
-	if (btsnoop_index == 0xffff) {
-		memcpy(hdr.id, btsnoop_id, sizeof(btsnoop_id));
-		hdr.version = htonl(btsnoop_version);
-		hdr.type = htonl(btsnoop_type);
+	if (btsnoop_index == 0xffff)
+		btsnoop_index = index;
 
-		written = write(btsnoop_fd, &hdr, BTSNOOP_HDR_SIZE);
-		if (written < 0)
-			return;
+	if (index != btsnoop_index)
+		return;
 
-		btsnoop_index = index;
+	if (rotation_due(tv, BTSNOOP_PKT_SIZE + size)) {
+		flush_buffer();
+		rotate_file();
 	}
 
-	if (index != btsnoop_index)
+	if (btsnoop_buf_len + BTSNOOP_PKT_SIZE + size > BTSNOOP_BUF_SIZE)
+		flush_buffer();
+
+	/* Rotation may have failed to open the next file */
+	if (btsnoop_fd < 0) {
+		btsnoop_drops++;
 		return;
+	}
 
 	ts = (tv->tv_sec - 946684800ll) * 1000000ll + tv->tv_usec;
 
-	pkt.size  = htonl(size);
-	pkt.len   = htonl(size);
-	pkt.flags = htonl(flags);
-	pkt.drops = htonl(0);
-	pkt.ts    = hton64(ts + 0x00E03AB44A676000ll);
+	pkt = (void *) (btsnoop_buf + btsnoop_buf_len);
+	pkt->size  = htonl(size);
+	pkt->len   = htonl(size);
+	pkt->flags = htonl(flags);
+	pkt->drops = htonl(btsnoop_drops);
+	pkt->ts    = hton64(ts + 0x00E03AB44A676000ll);
 
-	written = write(btsnoop_fd, &pkt, BTSNOOP_PKT_SIZE);
-	if (written < 0)
-		return;
+	if (data && size > 0)
+		memcpy(pkt->data, data, size);
 
-	if (data && size > 0) {
-		written = write(btsnoop_fd, data, size);
-		if (written < 0)
-			return;
-	}
+	btsnoop_buf_len += BTSNOOP_PKT_SIZE + size;
+	btsnoop_buf_records++;
+}
+
+void btsnoop_add_drops(uint32_t count)
+{
+	btsnoop_drops += count;
 }
 
 void btsnoop_close(void)
 {
-	if (btsnoop_fd < 0)
+	if (btsnoop_fd < 0 && !btsnoop_path)
 		return;
 
-	close(btsnoop_fd);
-	btsnoop_fd = -1;
+	flush_buffer();
+
+	if (btsnoop_timer >= 0)
+		mainloop_remove_timeout(btsnoop_timer);
+
+	if (btsnoop_fd >= 0) {
+		close(btsnoop_fd);
+		btsnoop_fd = -1;
+	}
+
+	free(btsnoop_buf);
+	btsnoop_buf = NULL;
+	btsnoop_buf_len = 0;
+	btsnoop_buf_records = 0;
+
+	free(btsnoop_path);
+	btsnoop_path = NULL;
 
 	btsnoop_index = 0xffff;
 }
+
+/* Reading: the file is mapped as a whole and records are located through
+ * an index holding the offset of every BTSNOOP_INDEX_STRIDE-th record */
+
+#define BTSNOOP_INDEX_STRIDE 64
+
+static const uint8_t *read_map = NULL;
+static size_t read_map_size = 0;
+static size_t *read_index = NULL;
+static uint32_t read_count = 0;
+
+static uint32_t read_cursor = 0;
+static size_t read_cursor_offset = 0;
+
+static inline const struct btsnoop_pkt *read_pkt(size_t offset)
+{
+	return (const void *) (read_map + offset);
+}
+
+static inline size_t next_offset(size_t offset)
+{
+	return offset + BTSNOOP_PKT_SIZE + ntohl(read_pkt(offset)->len);
+}
+
+static void ts_to_tv(uint64_t ts, struct timeval *tv)
+{
+	ts = ntoh64(ts) - 0x00E03AB44A676000ll;
+
+	tv->tv_sec = ts / 1000000ll + 946684800ll;
+	tv->tv_usec = ts % 1000000ll;
+}
+
+static int build_index(void)
+{
+	size_t offset = BTSNOOP_HDR_SIZE;
+	uint32_t slots = 0;
+
+	while (offset + BTSNOOP_PKT_SIZE <= read_map_size) {
+		size_t next = next_offset(offset);
+
+		if (next > read_map_size) {
+			fprintf(stderr, "Truncated record %u, ignoring the rest"
+						" of the file\n", read_count);
+			break;
+		}
+
+		if (read_count % BTSNOOP_INDEX_STRIDE == 0) {
+			if (read_count / BTSNOOP_INDEX_STRIDE == slots) {
+				size_t *index;
+
+				slots = slots ? slots * 2 : 1024;
+				index = realloc(read_index,
+						slots * sizeof(*read_index));
+				if (!index)
+					return -ENOMEM;
+
+				read_index = index;
+			}
+
+			read_index[read_count / BTSNOOP_INDEX_STRIDE] = offset;
+		}
+
+		read_count++;
+		offset = next;
+	}
+
+	return 0;
+}
+
+int btsnoop_read_open(const char *path)
+{
+	const struct btsnoop_hdr *hdr;
+	struct stat st;
+	void *map;
+	int fd, err;
+
+	if (read_map)
+		return -EALREADY;
+
+	fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return -errno;
+
+	if (fstat(fd, &st) < 0) {
+		err = -errno;
+		close(fd);
+		return err;
+	}
+
+	if ((size_t) st.st_size < BTSNOOP_HDR_SIZE) {
+		close(fd);
+		return -EINVAL;
+	}
+
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	err = -errno;
+	close(fd);
+
+	if (map == MAP_FAILED)
+		return err;
+
+	madvise(map, st.st_size, MADV_SEQUENTIAL);
+
+	read_map = map;
+	read_map_size = st.st_size;
+
+	hdr = map;
+	if (memcmp(hdr->id, btsnoop_id, sizeof(btsnoop_id)) ||
+				ntohl(hdr->version) != btsnoop_version ||
+				ntohl(hdr->type) != btsnoop_type) {
+		btsnoop_read_close();
+		return -EINVAL;
+	}
+
+	err = build_index();
+	if (err < 0) {
+		btsnoop_read_close();
+		return err;
+	}
+
+	read_cursor = 0;
+	read_cursor_offset = BTSNOOP_HDR_SIZE;
+
+	return 0;
+}
+
+uint32_t btsnoop_read_count(void)
+{
+	return read_count;
+}
+
+static size_t record_offset(uint32_t n)
+{
+	size_t offset;
+	uint32_t i;
+
+	/* Sequential reads just step to the next record */
+	if (n == read_cursor)
+		return read_cursor_offset;
+
+	if (n == read_cursor + 1 && read_cursor < read_count)
+		offset = next_offset(read_cursor_offset);
+	else {
+		offset = read_index[n / BTSNOOP_INDEX_STRIDE];
+		for (i = 0; i < n % BTSNOOP_INDEX_STRIDE; i++)
+			offset = next_offset(offset);
+	}
+
+	read_cursor = n;
+	read_cursor_offset = offset;
+
+	return offset;
+}
+
+int btsnoop_read_record(uint32_t n, struct timeval *tv, uint32_t *flags,
+					const void **data, uint16_t *size)
+{
+	const struct btsnoop_pkt *pkt;
+	uint32_t len;
+
+	if (n >= read_count)
+		return -ERANGE;
+
+	pkt = read_pkt(record_offset(n));
+
+	len = ntohl(pkt->len);
+	if (len > UINT16_MAX)
+		len = UINT16_MAX;
+
+	if (tv)
+		ts_to_tv(pkt->ts, tv);
+	if (flags)
+		*flags = ntohl(pkt->flags);
+	if (data)
+		*data = pkt->data;
+	if (size)
+		*size = len;
+
+	return 0;
+}
+
+static int tv_cmp(const struct timeval *a, const struct timeval *b)
+{
+	if (a->tv_sec != b->tv_sec)
+		return a->tv_sec < b->tv_sec ? -1 : 1;
+
+	if (a->tv_usec != b->tv_usec)
+		return a->tv_usec < b->tv_usec ? -1 : 1;
+
+	return 0;
+}
+
+uint32_t btsnoop_read_find(const struct timeval *tv)
+{
+	uint32_t lo = 0, hi, n;
+	struct timeval cur;
+
+	if (read_count == 0)
+		return 0;
+
+	/* Binary search over the indexed records, then step through the
+	 * stride the first record at or after tv falls into */
+	hi = (read_count - 1) / BTSNOOP_INDEX_STRIDE + 1;
+
+	while (lo < hi) {
+		uint32_t mid = lo + (hi - lo) / 2;
+
+		ts_to_tv(read_pkt(read_index[mid])->ts, &cur);
+
+		if (tv_cmp(&cur, tv) < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	n = lo > 0 ? (lo - 1) * BTSNOOP_INDEX_STRIDE : 0;
+
+	for (; n < read_count; n++) {
+		btsnoop_read_record(n, &cur, NULL, NULL, NULL);
+		if (tv_cmp(&cur, tv) >= 0)
+			break;
+	}
+
+	return n;
+}
+
+void btsnoop_read_close(void)
+{
+	if (read_map)
+		munmap((void *) read_map, read_map_size);
+
+	read_map = NULL;
+	read_map_size = 0;
+
+	free(read_index);
+	read_index = NULL;
+	read_count = 0;
+}
@@ -22,9 +22,20 @@
  *
  */
 
+#include <stdint.h>
 #include <sys/time.h>
 
+void btsnoop_set_rotation(size_t max_size, unsigned int max_age,
+						unsigned int max_files);
 void btsnoop_open(const char *path);
 void btsnoop_write(struct timeval *tv, uint16_t index, uint32_t flags,
 					const void *data, uint16_t size);
+void btsnoop_add_drops(uint32_t count);
 void btsnoop_close(void);
+
+int btsnoop_read_open(const char *path);
+uint32_t btsnoop_read_count(void);
+int btsnoop_read_record(uint32_t n, struct timeval *tv, uint32_t *flags,
+					const void **data, uint16_t *size);
+uint32_t btsnoop_read_find(const struct timeval *tv);
+void btsnoop_read_close(void);
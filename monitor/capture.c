@@ -0,0 +1,402 @@
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *  Copyright (C) 2011-2012  Intel Corporation
+ *  Copyright (C) 2004-2010  Marcel Holtmann <marcel@holtmann.org>
+ *
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <errno.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+
+#include "mainloop.h"
+#include "btsnoop.h"
+#include "capture.h"
+
+/* Sockets are drained on a thread of their own into a single producer,
+ * single consumer ring, so a slow terminal only fills the ring and not
+ * the kernel socket buffers */
+
+#define CAPTURE_RING_SIZE	4096	/* power of two */
+#define CAPTURE_RING_MASK	(CAPTURE_RING_SIZE - 1)
+#define CAPTURE_READ_BUDGET	64	/* packets per socket and wakeup */
+#define MAX_CAPTURE_EVENTS	16
+
+struct capture_source {
+	int fd;
+	capture_read_func read;
+	capture_process_func process;
+	capture_destroy_func destroy;
+	void *user_data;
+};
+
+struct capture_slot {
+	struct capture_source *source;
+	bool closed;
+	struct capture_packet pkt;
+};
+
+static struct capture_slot *ring = NULL;
+static unsigned int ring_head = 0;	/* written by the capture thread */
+static unsigned int ring_tail = 0;	/* written by the mainloop thread */
+
+static unsigned int ring_max = 0;
+static unsigned int ring_overflows = 0;
+static unsigned long long ring_packets = 0;
+static unsigned int overflows_reported = 0;
+
+static pthread_t capture_thread;
+static int capture_epoll = -1;
+static int capture_stop = -1;
+static int capture_notify = -1;
+static bool capture_done = false;
+
+static struct capture_slot *ring_reserve(void)
+{
+	unsigned int tail = __atomic_load_n(&ring_tail, __ATOMIC_ACQUIRE);
+
+	if (ring_head - tail == CAPTURE_RING_SIZE)
+		return NULL;
+
+	return &ring[ring_head & CAPTURE_RING_MASK];
+}
+
+static void ring_commit(void)
+{
+	unsigned int tail = __atomic_load_n(&ring_tail, __ATOMIC_ACQUIRE);
+	unsigned int used = ring_head + 1 - tail;
+
+	if (used > __atomic_load_n(&ring_max, __ATOMIC_RELAXED))
+		__atomic_store_n(&ring_max, used, __ATOMIC_RELAXED);
+
+	__atomic_store_n(&ring_head, ring_head + 1, __ATOMIC_RELEASE);
+}
+
+static void push_closed(struct capture_source *source)
+{
+	struct capture_slot *slot;
+
+	/* The close marker must not be lost, so wait for room */
+	while (!(slot = ring_reserve()))
+		sched_yield();
+
+	slot->source = source;
+	slot->closed = true;
+
+	ring_commit();
+}
+
+static void close_source(struct capture_source *source)
+{
+	epoll_ctl(capture_epoll, EPOLL_CTL_DEL, source->fd, NULL);
+	push_closed(source);
+}
+
+/* Returns the number of packets read, or -1 once the source is closed */
+static int read_source(struct capture_source *source)
+{
+	struct capture_packet scratch;
+	unsigned int count;
+
+	for (count = 0; count < CAPTURE_READ_BUDGET; count++) {
+		struct capture_slot *slot = ring_reserve();
+		struct capture_packet *pkt = slot ? &slot->pkt : &scratch;
+		int err;
+
+		memset(&pkt->tv, 0, sizeof(pkt->tv));
+
+		err = source->read(source->fd, pkt, source->user_data);
+		if (err == -EAGAIN)
+			break;
+
+		if (err < 0) {
+			close_source(source);
+			return -1;
+		}
+
+		/* Stamp packets the kernel did not timestamp */
+		if (pkt->tv.tv_sec == 0 && pkt->tv.tv_usec == 0)
+			gettimeofday(&pkt->tv, NULL);
+
+		__atomic_add_fetch(&ring_packets, 1, __ATOMIC_RELAXED);
+
+		if (!slot) {
+			__atomic_add_fetch(&ring_overflows, 1,
+							__ATOMIC_RELAXED);
+			continue;
+		}
+
+		slot->source = source;
+		slot->closed = false;
+		ring_commit();
+	}
+
+	return count;
+}
+
+static void capture_loop(void)
+{
+	while (1) {
+		struct epoll_event events[MAX_CAPTURE_EVENTS];
+		bool notify = false;
+		int n, nfds;
+
+		nfds = epoll_wait(capture_epoll, events, MAX_CAPTURE_EVENTS, -1);
+		if (nfds < 0) {
+			if (errno == EINTR)
+				continue;
+			break;
+		}
+
+		for (n = 0; n < nfds; n++) {
+			struct capture_source *source = events[n].data.ptr;
+
+			if (!source)
+				return;
+
+			if (events[n].events & (EPOLLERR | EPOLLHUP)) {
+				int count;
+
+				/* Keep what is still queued on the socket */
+				do {
+					count = read_source(source);
+				} while (count > 0);
+
+				if (count == 0)
+					close_source(source);
+
+				notify = true;
+				continue;
+			}
+
+			if (read_source(source) != 0)
+				notify = true;
+		}
+
+		if (notify) {
+			uint64_t val = 1;
+
+			if (write(capture_notify, &val, sizeof(val)) < 0)
+				continue;
+		}
+	}
+}
+
+static void *capture_run(void *user_data)
+{
+	capture_loop();
+
+	__atomic_store_n(&capture_done, true, __ATOMIC_RELEASE);
+
+	return NULL;
+}
+
+static void process_ring(void)
+{
+	unsigned int head = __atomic_load_n(&ring_head, __ATOMIC_ACQUIRE);
+	unsigned int overflows;
+
+	while (ring_tail != head) {
+		struct capture_slot *slot = &ring[ring_tail & CAPTURE_RING_MASK];
+		struct capture_source *source = slot->source;
+
+		if (slot->closed) {
+			if (source->destroy)
+				source->destroy(source->user_data);
+
+			free(source);
+		} else
+			source->process(&slot->pkt, source->user_data);
+
+		__atomic_store_n(&ring_tail, ring_tail + 1, __ATOMIC_RELEASE);
+	}
+
+	/* Packets lost in the ring show up in the btsnoop drop count */
+	overflows = __atomic_load_n(&ring_overflows, __ATOMIC_RELAXED);
+	if (overflows != overflows_reported) {
+		btsnoop_add_drops(overflows - overflows_reported);
+		overflows_reported = overflows;
+	}
+}
+
+static void notify_callback(int fd, uint32_t events, void *user_data)
+{
+	uint64_t val;
+
+	if (events & (EPOLLERR | EPOLLHUP)) {
+		mainloop_remove_fd(fd);
+		return;
+	}
+
+	if (read(fd, &val, sizeof(val)) < 0)
+		return;
+
+	process_ring();
+}
+
+int capture_init(void)
+{
+	struct epoll_event ev;
+	int err;
+
+	ring = calloc(CAPTURE_RING_SIZE, sizeof(*ring));
+	if (!ring)
+		return -ENOMEM;
+
+	capture_epoll = epoll_create1(EPOLL_CLOEXEC);
+	capture_stop = eventfd(0, EFD_CLOEXEC);
+	capture_notify = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (capture_epoll < 0 || capture_stop < 0 || capture_notify < 0) {
+		err = -errno;
+		goto failed;
+	}
+
+	memset(&ev, 0, sizeof(ev));
+	ev.events = EPOLLIN;
+	ev.data.ptr = NULL;
+
+	if (epoll_ctl(capture_epoll, EPOLL_CTL_ADD, capture_stop, &ev) < 0) {
+		err = -errno;
+		goto failed;
+	}
+
+	err = mainloop_add_fd(capture_notify, EPOLLIN, notify_callback,
+								NULL, NULL);
+	if (err < 0)
+		goto failed;
+
+	err = -pthread_create(&capture_thread, NULL, capture_run, NULL);
+	if (err < 0) {
+		mainloop_remove_fd(capture_notify);
+		goto failed;
+	}
+
+	return 0;
+
+failed:
+	if (capture_notify >= 0)
+		close(capture_notify);
+	if (capture_stop >= 0)
+		close(capture_stop);
+	if (capture_epoll >= 0)
+		close(capture_epoll);
+
+	capture_notify = capture_stop = capture_epoll = -1;
+
+	free(ring);
+	ring = NULL;
+
+	return err;
+}
+
+int capture_add_fd(int fd, capture_read_func read,
+				capture_process_func process, void *user_data,
+				capture_destroy_func destroy)
+{
+	struct capture_source *source;
+	struct epoll_event ev;
+
+	if (fd < 0 || !read || !process)
+		return -EINVAL;
+
+	if (capture_epoll < 0)
+		return -ENOTCONN;
+
+	source = malloc(sizeof(*source));
+	if (!source)
+		return -ENOMEM;
+
+	source->fd = fd;
+	source->read = read;
+	source->process = process;
+	source->destroy = destroy;
+	source->user_data = user_data;
+
+	memset(&ev, 0, sizeof(ev));
+	ev.events = EPOLLIN;
+	ev.data.ptr = source;
+
+	if (epoll_ctl(capture_epoll, EPOLL_CTL_ADD, fd, &ev) < 0) {
+		free(source);
+		return -errno;
+	}
+
+	return 0;
+}
+
+void capture_print_stats(void)
+{
+	unsigned int head, tail;
+
+	if (!ring)
+		return;
+
+	head = __atomic_load_n(&ring_head, __ATOMIC_ACQUIRE);
+	tail = __atomic_load_n(&ring_tail, __ATOMIC_ACQUIRE);
+
+	fprintf(stderr, "Capture: %llu packets, ring %u/%u used (max %u), "
+			"%u overflows\n",
+			__atomic_load_n(&ring_packets, __ATOMIC_RELAXED),
+			head - tail, CAPTURE_RING_SIZE,
+			__atomic_load_n(&ring_max, __ATOMIC_RELAXED),
+			__atomic_load_n(&ring_overflows, __ATOMIC_RELAXED));
+}
+
+void capture_exit(void)
+{
+	uint64_t val = 1;
+
+	if (!ring)
+		return;
+
+	if (write(capture_stop, &val, sizeof(val)) == sizeof(val)) {
+		/* The thread may be waiting for room for a close marker */
+		while (!__atomic_load_n(&capture_done, __ATOMIC_ACQUIRE)) {
+			process_ring();
+			sched_yield();
+		}
+
+		pthread_join(capture_thread, NULL);
+	}
+
+	/* Whatever was captured still gets decoded and saved */
+	process_ring();
+
+	capture_print_stats();
+
+	close(capture_notify);
+	close(capture_stop);
+	close(capture_epoll);
+	capture_notify = capture_stop = capture_epoll = -1;
+
+	free(ring);
+	ring = NULL;
+	capture_done = false;
+}
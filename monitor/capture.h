@@ -0,0 +1,57 @@
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *  Copyright (C) 2011-2012  Intel Corporation
+ *  Copyright (C) 2004-2010  Marcel Holtmann <marcel@holtmann.org>
+ *
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <sys/time.h>
+
+#define CAPTURE_MAX_SIZE	1028	/* HCI_MAX_FRAME_SIZE */
+
+struct capture_packet {
+	struct timeval tv;
+	uint16_t index;
+	uint16_t opcode;
+	bool in;
+	uint16_t len;
+	uint8_t data[CAPTURE_MAX_SIZE];
+};
+
+/* Runs on the capture thread: fills pkt and returns 0, or returns
+ * -EAGAIN once the socket is drained and another negative error when
+ * the socket has to be closed */
+typedef int (*capture_read_func) (int fd, struct capture_packet *pkt,
+							void *user_data);
+
+typedef void (*capture_destroy_func) (void *user_data);
+
+/* Runs on the mainloop thread, in the order packets were read */
+typedef void (*capture_process_func) (struct capture_packet *pkt,
+							void *user_data);
+
+int capture_init(void);
+int capture_add_fd(int fd, capture_read_func read,
+				capture_process_func process, void *user_data,
+				capture_destroy_func destroy);
+void capture_print_stats(void);
+void capture_exit(void);
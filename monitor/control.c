@@ -38,7 +38,9 @@
 #include <bluetooth/mgmt.h>
 
 #include "mainloop.h"
+#include "capture.h"
 #include "packet.h"
+#include "filter.h"
 #include "control.h"
 
 struct control_data {
@@ -516,24 +518,19 @@ void control_message(uint16_t opcode, const void *data, uint16_t size)
 	}
 }
 
-static void data_callback(int fd, uint32_t events, void *user_data)
+static int data_read(int fd, struct capture_packet *pkt, void *user_data)
 {
-	struct control_data *data = user_data;
-	unsigned char buf[HCI_MAX_FRAME_SIZE];
 	unsigned char control[32];
 	struct mgmt_hdr hdr;
 	struct msghdr msg;
 	struct iovec iov[2];
-
-	if (events & (EPOLLERR | EPOLLHUP)) {
-		mainloop_remove_fd(fd);
-		return;
-	}
+	struct cmsghdr *cmsg;
+	ssize_t len;
 
 	iov[0].iov_base = &hdr;
 	iov[0].iov_len = MGMT_HDR_SIZE;
-	iov[1].iov_base = buf;
-	iov[1].iov_len = sizeof(buf);
+	iov[1].iov_base = pkt->data;
+	iov[1].iov_len = sizeof(pkt->data);
 
 	memset(&msg, 0, sizeof(msg));
 	msg.msg_iov = iov;
@@ -541,40 +538,42 @@ static void data_callback(int fd, uint32_t events, void *user_data)
 	msg.msg_control = control;
 	msg.msg_controllen = sizeof(control);
 
-	while (1) {
-		struct cmsghdr *cmsg;
-		struct timeval *tv = NULL;
-		uint16_t opcode, index, pktlen;
-		ssize_t len;
+	len = recvmsg(fd, &msg, MSG_DONTWAIT);
+	if (len < 0)
+		return errno == EAGAIN || errno == EINTR ? -EAGAIN : -errno;
+
+	if (len < MGMT_HDR_SIZE)
+		return -EAGAIN;
 
-		len = recvmsg(fd, &msg, MSG_DONTWAIT);
-		if (len < 0)
-			break;
+	for (cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL;
+				cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+		if (cmsg->cmsg_level != SOL_SOCKET)
+			continue;
 
-		if (len < MGMT_HDR_SIZE)
-			break;
+		if (cmsg->cmsg_type == SCM_TIMESTAMP)
+			memcpy(&pkt->tv, CMSG_DATA(cmsg), sizeof(pkt->tv));
+	}
 
-		for (cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL;
-					cmsg = CMSG_NXTHDR(&msg, cmsg)) {
-			if (cmsg->cmsg_level != SOL_SOCKET)
-				continue;
+	pkt->opcode = btohs(hdr.opcode);
+	pkt->index  = btohs(hdr.index);
+	pkt->len    = btohs(hdr.len);
 
-			if (cmsg->cmsg_type == SCM_TIMESTAMP)
-				tv = (struct timeval *) CMSG_DATA(cmsg);
-		}
+	return 0;
+}
 
-		opcode = btohs(hdr.opcode);
-		index  = btohs(hdr.index);
-		pktlen = btohs(hdr.len);
-
-		switch (data->channel) {
-		case HCI_CHANNEL_CONTROL:
-			packet_control(tv, index, opcode, buf, pktlen);
-			break;
-		case HCI_CHANNEL_MONITOR:
-			packet_monitor(tv, index, opcode, buf, pktlen);
-			break;
-		}
+static void data_process(struct capture_packet *pkt, void *user_data)
+{
+	struct control_data *data = user_data;
+
+	switch (data->channel) {
+	case HCI_CHANNEL_CONTROL:
+		packet_control(&pkt->tv, pkt->index, pkt->opcode,
+						pkt->data, pkt->len);
+		break;
+	case HCI_CHANNEL_MONITOR:
+		packet_monitor(&pkt->tv, pkt->index, pkt->opcode,
+						pkt->data, pkt->len);
+		break;
 	}
 }
 
@@ -611,6 +610,14 @@ static int open_socket(uint16_t channel)
 		return -1;
 	}
 
+	if (channel == HCI_CHANNEL_MONITOR) {
+		int err = filter_attach(fd, FILTER_SOCKET_MONITOR);
+
+		if (err < 0)
+			fprintf(stderr, "Failed to attach socket filter: %s\n",
+							strerror(-err));
+	}
+
 	return fd;
 }
 
@@ -631,7 +638,11 @@ static int open_channel(uint16_t channel)
 		return -1;
 	}
 
-	mainloop_add_fd(data->fd, EPOLLIN, data_callback, data, free_data);
+	if (capture_add_fd(data->fd, data_read, data_process,
+						data, free_data) < 0) {
+		free_data(data);
+		return -1;
+	}
 
 	return 0;
 }
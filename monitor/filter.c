@@ -0,0 +1,507 @@
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *  Copyright (C) 2011-2012  Intel Corporation
+ *  Copyright (C) 2004-2010  Marcel Holtmann <marcel@holtmann.org>
+ *
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <errno.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <linux/filter.h>
+
+#include <bluetooth/bluetooth.h>
+#include <bluetooth/hci.h>
+#include <bluetooth/hci_lib.h>
+
+#include "packet.h"
+#include "filter.h"
+
+#define FILTER_MAX_ENTRIES	16
+#define FILTER_MAX_CONNS	32
+#define FILTER_MAX_INSNS	256
+
+#define FILTER_ACCEPT		0xffffffff
+
+struct filter_list {
+	unsigned int count;
+	uint16_t value[FILTER_MAX_ENTRIES];
+};
+
+static struct filter_list index_filter;
+static struct filter_list event_filter;
+static struct filter_list opcode_filter;
+static struct filter_list handle_filter;
+static struct filter_list cid_filter;
+
+/* One bit per HCI packet type, empty means every type */
+static uint8_t ptype_mask = 0;
+
+/* Continuation fragments carry no CID, so remember whether the start
+ * of the current frame on each link passed the filter and how much of
+ * it is still to come. Starts dropped by the kernel are never seen, so
+ * a continuation only passes while a passed frame is incomplete. */
+struct conn_state {
+	uint16_t index;
+	uint16_t handle;
+	bool used;
+	bool pass;
+	int remaining;
+};
+
+static struct conn_state conn_list[FILTER_MAX_CONNS];
+static unsigned int conn_next = 0;
+
+static bool list_add(struct filter_list *list, uint16_t value)
+{
+	if (list->count == FILTER_MAX_ENTRIES)
+		return false;
+
+	list->value[list->count++] = value;
+
+	return true;
+}
+
+static bool list_match(const struct filter_list *list, uint16_t value)
+{
+	unsigned int i;
+
+	if (list->count == 0)
+		return true;
+
+	for (i = 0; i < list->count; i++)
+		if (list->value[i] == value)
+			return true;
+
+	return false;
+}
+
+bool filter_add_index(uint16_t index)
+{
+	return list_add(&index_filter, index);
+}
+
+bool filter_add_ptype(uint8_t type)
+{
+	switch (type) {
+	case HCI_COMMAND_PKT:
+	case HCI_ACLDATA_PKT:
+	case HCI_SCODATA_PKT:
+	case HCI_EVENT_PKT:
+		ptype_mask |= 1 << type;
+		return true;
+	}
+
+	return false;
+}
+
+bool filter_add_event(uint8_t event)
+{
+	return list_add(&event_filter, event);
+}
+
+bool filter_add_opcode(uint16_t opcode)
+{
+	return list_add(&opcode_filter, opcode);
+}
+
+bool filter_add_handle(uint16_t handle)
+{
+	return list_add(&handle_filter, handle & 0x0fff);
+}
+
+bool filter_add_cid(uint16_t cid)
+{
+	return list_add(&cid_filter, cid);
+}
+
+static bool ptype_match(uint8_t type)
+{
+	return ptype_mask == 0 || (ptype_mask & (1 << type));
+}
+
+bool filter_index(uint16_t index)
+{
+	return list_match(&index_filter, index);
+}
+
+static struct conn_state *get_conn(uint16_t index, uint16_t handle)
+{
+	struct conn_state *conn;
+	unsigned int i;
+
+	for (i = 0; i < FILTER_MAX_CONNS; i++) {
+		conn = &conn_list[i];
+
+		if (conn->used && conn->index == index &&
+						conn->handle == handle)
+			return conn;
+	}
+
+	conn = &conn_list[conn_next];
+	conn_next = (conn_next + 1) % FILTER_MAX_CONNS;
+
+	conn->used = true;
+	conn->index = index;
+	conn->handle = handle;
+	conn->pass = false;
+	conn->remaining = 0;
+
+	return conn;
+}
+
+static bool acl_match(uint16_t index, const uint8_t *data, uint16_t size)
+{
+	struct conn_state *conn;
+	uint16_t handle;
+
+	if (size < HCI_ACL_HDR_SIZE)
+		return false;
+
+	handle = bt_get_le16(data);
+
+	if (!list_match(&handle_filter, acl_handle(handle)))
+		return false;
+
+	if (cid_filter.count == 0)
+		return true;
+
+	conn = get_conn(index, acl_handle(handle));
+	size -= HCI_ACL_HDR_SIZE;
+
+	if ((acl_flags(handle) & 0x03) == ACL_CONT) {
+		if (!conn->pass || conn->remaining <= 0)
+			return false;
+
+		conn->remaining -= size;
+		return true;
+	}
+
+	if (size < 4) {
+		conn->pass = false;
+		conn->remaining = 0;
+		return false;
+	}
+
+	conn->pass = list_match(&cid_filter, bt_get_le16(data + 6));
+	conn->remaining = bt_get_le16(data + 4) - (size - 4);
+
+	return conn->pass;
+}
+
+bool filter_match(uint16_t index, uint8_t type,
+					const void *data, uint16_t size)
+{
+	const uint8_t *ptr = data;
+
+	if (!filter_index(index) || !ptype_match(type))
+		return false;
+
+	switch (type) {
+	case HCI_COMMAND_PKT:
+		return size < HCI_COMMAND_HDR_SIZE ||
+			list_match(&opcode_filter, bt_get_le16(ptr));
+	case HCI_EVENT_PKT:
+		return size < HCI_EVENT_HDR_SIZE ||
+			list_match(&event_filter, ptr[0]);
+	case HCI_ACLDATA_PKT:
+		return acl_match(index, ptr, size);
+	case HCI_SCODATA_PKT:
+		return size < HCI_SCO_HDR_SIZE ||
+			list_match(&handle_filter,
+					acl_handle(bt_get_le16(ptr)));
+	}
+
+	return true;
+}
+
+void filter_hci_setup(struct hci_filter *flt)
+{
+	unsigned int i;
+
+	hci_filter_clear(flt);
+
+	if (ptype_mask == 0)
+		hci_filter_all_ptypes(flt);
+	else {
+		for (i = 0; i < 8; i++)
+			if (ptype_mask & (1 << i))
+				hci_filter_set_ptype(i, flt);
+	}
+
+	if (event_filter.count == 0)
+		hci_filter_all_events(flt);
+	else {
+		for (i = 0; i < event_filter.count; i++)
+			hci_filter_set_event(event_filter.value[i], flt);
+	}
+}
+
+struct program {
+	struct sock_filter insn[FILTER_MAX_INSNS];
+	unsigned int len;
+};
+
+static void emit(struct program *prog, uint16_t code, uint8_t jt,
+						uint8_t jf, uint32_t k)
+{
+	struct sock_filter *insn;
+
+	if (prog->len == FILTER_MAX_INSNS)
+		return;
+
+	insn = &prog->insn[prog->len++];
+	insn->code = code;
+	insn->jt = jt;
+	insn->jf = jf;
+	insn->k = k;
+}
+
+static void emit_ret(struct program *prog, uint32_t k)
+{
+	emit(prog, BPF_RET | BPF_K, 0, 0, k);
+}
+
+/* Classic BPF loads halfwords in network order, so little endian fields
+ * are matched against their byte swapped value */
+static uint16_t swap16(uint16_t value)
+{
+	return (value << 8) | (value >> 8);
+}
+
+/* Falls through past the list on a match and rejects otherwise, so
+ * the next test can follow directly */
+static void emit_match(struct program *prog, const struct filter_list *list,
+					uint16_t (*key)(uint16_t value))
+{
+	unsigned int i;
+
+	for (i = 0; i < list->count; i++)
+		emit(prog, BPF_JMP | BPF_JEQ | BPF_K, list->count - i, 0,
+					key ? key(list->value[i]) :
+							list->value[i]);
+
+	emit_ret(prog, 0);
+}
+
+/* Handle bytes come out as low byte first, flags in the top nibble of
+ * the second byte are masked off */
+static uint16_t handle_key(uint16_t handle)
+{
+	return ((handle & 0xff) << 8) | (handle >> 8);
+}
+
+static void emit_handle(struct program *prog, unsigned int offset)
+{
+	if (handle_filter.count == 0)
+		return;
+
+	emit(prog, BPF_LD | BPF_H | BPF_ABS, 0, 0, offset);
+	emit(prog, BPF_ALU | BPF_AND | BPF_K, 0, 0, 0xff0f);
+	emit_match(prog, &handle_filter, handle_key);
+}
+
+static void section_command(struct program *prog, unsigned int offset)
+{
+	if (!ptype_match(HCI_COMMAND_PKT)) {
+		emit_ret(prog, 0);
+		return;
+	}
+
+	if (opcode_filter.count > 0) {
+		emit(prog, BPF_LD | BPF_H | BPF_ABS, 0, 0, offset);
+		emit_match(prog, &opcode_filter, swap16);
+	}
+
+	emit_ret(prog, FILTER_ACCEPT);
+}
+
+static void section_event(struct program *prog, unsigned int offset)
+{
+	if (!ptype_match(HCI_EVENT_PKT)) {
+		emit_ret(prog, 0);
+		return;
+	}
+
+	if (event_filter.count > 0) {
+		emit(prog, BPF_LD | BPF_B | BPF_ABS, 0, 0, offset);
+		emit_match(prog, &event_filter, NULL);
+	}
+
+	emit_ret(prog, FILTER_ACCEPT);
+}
+
+static void section_acldata(struct program *prog, unsigned int offset)
+{
+	if (!ptype_match(HCI_ACLDATA_PKT)) {
+		emit_ret(prog, 0);
+		return;
+	}
+
+	emit_handle(prog, offset);
+
+	if (cid_filter.count > 0) {
+		/* Continuation fragments are left for user space */
+		emit(prog, BPF_LD | BPF_B | BPF_ABS, 0, 0, offset + 1);
+		emit(prog, BPF_ALU | BPF_RSH | BPF_K, 0, 0, 4);
+		emit(prog, BPF_ALU | BPF_AND | BPF_K, 0, 0, 0x03);
+		emit(prog, BPF_JMP | BPF_JEQ | BPF_K,
+					cid_filter.count + 2, 0, ACL_CONT);
+		emit(prog, BPF_LD | BPF_H | BPF_ABS, 0, 0,
+					offset + HCI_ACL_HDR_SIZE + 2);
+		emit_match(prog, &cid_filter, swap16);
+	}
+
+	emit_ret(prog, FILTER_ACCEPT);
+}
+
+static void section_scodata(struct program *prog, unsigned int offset)
+{
+	if (!ptype_match(HCI_SCODATA_PKT)) {
+		emit_ret(prog, 0);
+		return;
+	}
+
+	emit_handle(prog, offset);
+	emit_ret(prog, FILTER_ACCEPT);
+}
+
+static void append(struct program *prog, const struct program *section)
+{
+	unsigned int len = section->len;
+
+	if (prog->len + len > FILTER_MAX_INSNS)
+		len = FILTER_MAX_INSNS - prog->len;
+
+	memcpy(prog->insn + prog->len, section->insn,
+					len * sizeof(struct sock_filter));
+	prog->len += len;
+}
+
+/*
+ * Raw sockets see the packet type byte followed by the packet, while
+ * the monitor channel prefixes a header with opcode, index and length.
+ * The program dispatches on the type to one section per packet type.
+ */
+static void build_program(struct program *prog, int socket_type)
+{
+	static struct program cmd, evt, acl, sco;
+	struct { uint16_t type; struct program *section; } dispatch[6];
+	unsigned int i, count, offset, base;
+
+	if (socket_type == FILTER_SOCKET_MONITOR) {
+		if (index_filter.count > 0) {
+			emit(prog, BPF_LD | BPF_H | BPF_ABS, 0, 0, 2);
+			emit_match(prog, &index_filter, swap16);
+		}
+
+		emit(prog, BPF_LD | BPF_H | BPF_ABS, 0, 0, 0);
+
+		dispatch[0].type = swap16(MONITOR_COMMAND_PKT);
+		dispatch[0].section = &cmd;
+		dispatch[1].type = swap16(MONITOR_EVENT_PKT);
+		dispatch[1].section = &evt;
+		dispatch[2].type = swap16(MONITOR_ACL_TX_PKT);
+		dispatch[2].section = &acl;
+		dispatch[3].type = swap16(MONITOR_ACL_RX_PKT);
+		dispatch[3].section = &acl;
+		dispatch[4].type = swap16(MONITOR_SCO_TX_PKT);
+		dispatch[4].section = &sco;
+		dispatch[5].type = swap16(MONITOR_SCO_RX_PKT);
+		dispatch[5].section = &sco;
+		count = 6;
+		offset = 6;
+	} else {
+		emit(prog, BPF_LD | BPF_B | BPF_ABS, 0, 0, 0);
+
+		dispatch[0].type = HCI_COMMAND_PKT;
+		dispatch[0].section = &cmd;
+		dispatch[1].type = HCI_EVENT_PKT;
+		dispatch[1].section = &evt;
+		dispatch[2].type = HCI_ACLDATA_PKT;
+		dispatch[2].section = &acl;
+		dispatch[3].type = HCI_SCODATA_PKT;
+		dispatch[3].section = &sco;
+		count = 4;
+		offset = 1;
+	}
+
+	cmd.len = evt.len = acl.len = sco.len = 0;
+
+	section_command(&cmd, offset);
+	section_event(&evt, offset);
+	section_acldata(&acl, offset);
+	section_scodata(&sco, offset);
+
+	/* Jump table, anything else such as index events is accepted */
+	base = prog->len;
+
+	for (i = 0; i < count; i++) {
+		unsigned int target = base + count + 1;
+
+		if (dispatch[i].section == &evt)
+			target += cmd.len;
+		else if (dispatch[i].section == &acl)
+			target += cmd.len + evt.len;
+		else if (dispatch[i].section == &sco)
+			target += cmd.len + evt.len + acl.len;
+
+		emit(prog, BPF_JMP | BPF_JEQ | BPF_K,
+				target - (base + i) - 1, 0, dispatch[i].type);
+	}
+
+	emit_ret(prog, FILTER_ACCEPT);
+
+	append(prog, &cmd);
+	append(prog, &evt);
+	append(prog, &acl);
+	append(prog, &sco);
+}
+
+int filter_attach(int fd, int socket_type)
+{
+	static struct program prog;
+	struct sock_fprog fprog;
+
+	if (index_filter.count == 0 && ptype_mask == 0 &&
+			event_filter.count == 0 && opcode_filter.count == 0 &&
+			handle_filter.count == 0 && cid_filter.count == 0)
+		return 0;
+
+	prog.len = 0;
+	build_program(&prog, socket_type);
+
+	if (prog.len == FILTER_MAX_INSNS)
+		return -E2BIG;
+
+	fprog.len = prog.len;
+	fprog.filter = prog.insn;
+
+	if (setsockopt(fd, SOL_SOCKET, SO_ATTACH_FILTER,
+					&fprog, sizeof(fprog)) < 0)
+		return -errno;
+
+	return 0;
+}
@@ -0,0 +1,45 @@
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *  Copyright (C) 2011-2012  Intel Corporation
+ *  Copyright (C) 2004-2010  Marcel Holtmann <marcel@holtmann.org>
+ *
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+
+struct hci_filter;
+
+#define FILTER_SOCKET_RAW	0
+#define FILTER_SOCKET_MONITOR	1
+
+bool filter_add_index(uint16_t index);
+bool filter_add_ptype(uint8_t type);
+bool filter_add_event(uint8_t event);
+bool filter_add_opcode(uint16_t opcode);
+bool filter_add_handle(uint16_t handle);
+bool filter_add_cid(uint16_t cid);
+
+bool filter_index(uint16_t index);
+bool filter_match(uint16_t index, uint8_t type,
+					const void *data, uint16_t size);
+
+void filter_hci_setup(struct hci_filter *flt);
+int filter_attach(int fd, int socket_type);
@@ -39,7 +39,9 @@
 #include <bluetooth/hci_lib.h>
 
 #include "mainloop.h"
+#include "capture.h"
 #include "packet.h"
+#include "filter.h"
 #include "hcidump.h"
 
 struct hcidump_data {
@@ -60,7 +62,7 @@ static int open_hci_dev(uint16_t index)
 {
 	struct sockaddr_hci addr;
 	struct hci_filter flt;
-	int fd, opt = 1;
+	int fd, err, opt = 1;
 
 	fd = socket(AF_BLUETOOTH, SOCK_RAW, BTPROTO_HCI);
 	if (fd < 0) {
@@ -69,9 +71,7 @@ static int open_hci_dev(uint16_t index)
 	}
 
 	/* Setup filter */
-	hci_filter_clear(&flt);
-	hci_filter_all_ptypes(&flt);
-	hci_filter_all_events(&flt);
+	filter_hci_setup(&flt);
 
 	if (setsockopt(fd, SOL_HCI, HCI_FILTER, &flt, sizeof(flt)) < 0) {
 		perror("Failed to set HCI filter");
@@ -79,6 +79,12 @@ static int open_hci_dev(uint16_t index)
 		return -1;
 	}
 
+	/* Opcodes, handles and CIDs are checked again in user space */
+	err = filter_attach(fd, FILTER_SOCKET_RAW);
+	if (err < 0)
+		fprintf(stderr, "Failed to attach socket filter: %s\n",
+							strerror(-err));
+
 	if (setsockopt(fd, SOL_HCI, HCI_DATA_DIR, &opt, sizeof(opt)) < 0) {
 		perror("Failed to enable HCI data direction info");
 		close(fd);
@@ -105,37 +111,32 @@ static int open_hci_dev(uint16_t index)
 	return fd;
 }
 
-static void device_callback(int fd, uint32_t events, void *user_data)
+static int device_read(int fd, struct capture_packet *pkt, void *user_data)
 {
 	struct hcidump_data *data = user_data;
-	unsigned char buf[HCI_MAX_FRAME_SIZE];
 	unsigned char control[64];
 	struct msghdr msg;
 	struct iovec iov;
 
-	if (events & (EPOLLERR | EPOLLHUP)) {
-		mainloop_remove_fd(fd);
-		return;
-	}
-
-	iov.iov_base = buf;
-	iov.iov_len = sizeof(buf);
+	iov.iov_base = pkt->data;
+	iov.iov_len = sizeof(pkt->data);
 
 	memset(&msg, 0, sizeof(msg));
 	msg.msg_iov = &iov;
 	msg.msg_iovlen = 1;
 	msg.msg_control = control;
-	msg.msg_controllen = sizeof(control);
 
 	while (1) {
 		struct cmsghdr *cmsg;
-		struct timeval *tv = NULL;
 		int *dir = NULL;
 		ssize_t len;
 
+		msg.msg_controllen = sizeof(control);
+
 		len = recvmsg(fd, &msg, MSG_DONTWAIT);
 		if (len < 0)
-			break;
+			return errno == EAGAIN || errno == EINTR ?
+							-EAGAIN : -errno;
 
 		for (cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL;
 					cmsg = CMSG_NXTHDR(&msg, cmsg)) {
@@ -147,7 +148,8 @@ static void device_callback(int fd, uint32_t events, void *user_data)
 				dir = (int *) CMSG_DATA(cmsg);
 				break;
 			case HCI_CMSG_TSTAMP:
-				tv = (struct timeval *) CMSG_DATA(cmsg);
+				memcpy(&pkt->tv, CMSG_DATA(cmsg),
+							sizeof(pkt->tv));
 				break;
 			}
 		}
@@ -155,22 +157,34 @@ static void device_callback(int fd, uint32_t events, void *user_data)
 		if (!dir || len < 1)
 			continue;
 
-		switch (buf[0]) {
-		case HCI_COMMAND_PKT:
-			packet_hci_command(tv, data->index, buf + 1, len - 1);
-			break;
-		case HCI_EVENT_PKT:
-			packet_hci_event(tv, data->index, buf + 1, len - 1);
-			break;
-		case HCI_ACLDATA_PKT:
-			packet_hci_acldata(tv, data->index, !!(*dir),
+		pkt->index = data->index;
+		pkt->in = !!(*dir);
+		pkt->len = len;
+
+		return 0;
+	}
+}
+
+static void device_process(struct capture_packet *pkt, void *user_data)
+{
+	const unsigned char *buf = pkt->data;
+	uint16_t len = pkt->len;
+
+	switch (buf[0]) {
+	case HCI_COMMAND_PKT:
+		packet_hci_command(&pkt->tv, pkt->index, buf + 1, len - 1);
+		break;
+	case HCI_EVENT_PKT:
+		packet_hci_event(&pkt->tv, pkt->index, buf + 1, len - 1);
+		break;
+	case HCI_ACLDATA_PKT:
+		packet_hci_acldata(&pkt->tv, pkt->index, pkt->in,
 							buf + 1, len - 1);
-			break;
-		case HCI_SCODATA_PKT:
-			packet_hci_scodata(tv, data->index, !!(*dir),
+		break;
+	case HCI_SCODATA_PKT:
+		packet_hci_scodata(&pkt->tv, pkt->index, pkt->in,
 							buf + 1, len - 1);
-			break;
-		}
+		break;
 	}
 }
 
@@ -178,6 +192,9 @@ static void open_device(uint16_t index)
 {
 	struct hcidump_data *data;
 
+	if (!filter_index(index))
+		return;
+
 	data = malloc(sizeof(*data));
 	if (!data)
 		return;
@@ -191,7 +208,9 @@ static void open_device(uint16_t index)
 		return;
 	}
 
-	mainloop_add_fd(data->fd, EPOLLIN, device_callback, data, free_data);
+	if (capture_add_fd(data->fd, device_read, device_process,
+						data, free_data) < 0)
+		free_data(data);
 }
 
 static void device_info(int fd, uint16_t index, uint8_t *type, uint8_t *bus,
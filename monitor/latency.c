@@ -0,0 +1,226 @@
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *  Copyright (C) 2011-2012  Intel Corporation
+ *  Copyright (C) 2004-2010  Marcel Holtmann <marcel@holtmann.org>
+ *
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "latency.h"
+
+struct pending_command {
+	struct pending_command *next;
+	uint16_t index;
+	uint16_t opcode;
+	uint64_t ts;
+};
+
+struct pending_acl {
+	struct pending_acl *next;
+	uint16_t index;
+	uint16_t handle;
+	struct latency_queue queue;
+};
+
+static struct pending_command *command_list = NULL;
+static struct pending_acl *acl_list = NULL;
+
+/* Latencies are measured between kernel timestamps, the time btmon got
+ * around to reading a packet says nothing about the controller */
+uint64_t latency_time(const struct timeval *tv)
+{
+	if (!tv)
+		return 0;
+
+	return tv->tv_sec * 1000000000ULL + tv->tv_usec * 1000ULL;
+}
+
+void latency_queue_push(struct latency_queue *queue, uint64_t ts)
+{
+	/* The oldest entry is overwritten when credits never come back */
+	queue->ts[queue->head] = ts;
+	queue->head = (queue->head + 1) % LATENCY_QUEUE_SIZE;
+	if (queue->count < LATENCY_QUEUE_SIZE)
+		queue->count++;
+}
+
+/* Completions return credits in the order packets were sent, so each
+ * one pairs with the oldest outstanding packet on the handle */
+bool latency_queue_pop(struct latency_queue *queue, uint64_t ts,
+							uint64_t *elapsed)
+{
+	unsigned int oldest;
+
+	if (queue->count == 0)
+		return false;
+
+	oldest = (queue->head + LATENCY_QUEUE_SIZE - queue->count) %
+							LATENCY_QUEUE_SIZE;
+
+	*elapsed = ts > queue->ts[oldest] ? ts - queue->ts[oldest] : 0;
+
+	queue->count--;
+
+	return true;
+}
+
+void latency_queue_reset(struct latency_queue *queue)
+{
+	queue->head = 0;
+	queue->count = 0;
+}
+
+void latency_command(uint16_t index, uint16_t opcode, uint64_t ts)
+{
+	struct pending_command *cmd;
+
+	for (cmd = command_list; cmd; cmd = cmd->next)
+		if (cmd->index == index && cmd->opcode == opcode)
+			break;
+
+	if (!cmd) {
+		cmd = malloc(sizeof(*cmd));
+		if (!cmd)
+			return;
+
+		cmd->index = index;
+		cmd->opcode = opcode;
+		cmd->next = command_list;
+		command_list = cmd;
+	}
+
+	cmd->ts = ts;
+}
+
+bool latency_command_done(uint16_t index, uint16_t opcode, uint64_t ts,
+							uint64_t *elapsed)
+{
+	struct pending_command *cmd, *prev = NULL;
+
+	for (cmd = command_list; cmd; prev = cmd, cmd = cmd->next) {
+		if (cmd->index != index || cmd->opcode != opcode)
+			continue;
+
+		if (prev)
+			prev->next = cmd->next;
+		else
+			command_list = cmd->next;
+
+		*elapsed = ts > cmd->ts ? ts - cmd->ts : 0;
+
+		free(cmd);
+
+		return true;
+	}
+
+	return false;
+}
+
+static struct pending_acl *find_acl(uint16_t index, uint16_t handle)
+{
+	struct pending_acl *acl;
+
+	for (acl = acl_list; acl; acl = acl->next)
+		if (acl->index == index && acl->handle == handle)
+			return acl;
+
+	return NULL;
+}
+
+void latency_acl_sent(uint16_t index, uint16_t handle, uint64_t ts)
+{
+	struct pending_acl *acl;
+
+	acl = find_acl(index, handle);
+	if (!acl) {
+		acl = malloc(sizeof(*acl));
+		if (!acl)
+			return;
+
+		memset(acl, 0, sizeof(*acl));
+		acl->index = index;
+		acl->handle = handle;
+		acl->next = acl_list;
+		acl_list = acl;
+	}
+
+	latency_queue_push(&acl->queue, ts);
+}
+
+unsigned int latency_acl_completed(uint16_t index, uint16_t handle,
+					uint16_t count, uint64_t ts,
+					uint64_t *min, uint64_t *max)
+{
+	struct pending_acl *acl;
+	unsigned int paired = 0;
+
+	acl = find_acl(index, handle);
+	if (!acl)
+		return 0;
+
+	for (; count > 0; count--, paired++) {
+		uint64_t elapsed;
+
+		if (!latency_queue_pop(&acl->queue, ts, &elapsed))
+			break;
+
+		if (paired == 0 || elapsed < *min)
+			*min = elapsed;
+
+		if (paired == 0 || elapsed > *max)
+			*max = elapsed;
+	}
+
+	return paired;
+}
+
+/* The handle may be reused by the next link, which must not pair its
+ * credits with packets of this one */
+void latency_disconnected(uint16_t index, uint16_t handle)
+{
+	struct pending_acl *acl;
+
+	acl = find_acl(index, handle);
+	if (acl)
+		latency_queue_reset(&acl->queue);
+}
+
+void latency_cleanup(void)
+{
+	while (command_list) {
+		struct pending_command *cmd = command_list;
+
+		command_list = cmd->next;
+		free(cmd);
+	}
+
+	while (acl_list) {
+		struct pending_acl *acl = acl_list;
+
+		acl_list = acl->next;
+		free(acl);
+	}
+}
@@ -0,0 +1,55 @@
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *  Copyright (C) 2011-2012  Intel Corporation
+ *  Copyright (C) 2004-2010  Marcel Holtmann <marcel@holtmann.org>
+ *
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <sys/time.h>
+
+#define LATENCY_QUEUE_SIZE 64	/* TX packets tracked per handle */
+
+/* Send times of the packets on a handle still waiting for their credit */
+struct latency_queue {
+	uint64_t ts[LATENCY_QUEUE_SIZE];
+	unsigned int head;
+	unsigned int count;
+};
+
+void latency_queue_push(struct latency_queue *queue, uint64_t ts);
+bool latency_queue_pop(struct latency_queue *queue, uint64_t ts,
+							uint64_t *elapsed);
+void latency_queue_reset(struct latency_queue *queue);
+
+uint64_t latency_time(const struct timeval *tv);
+
+void latency_command(uint16_t index, uint16_t opcode, uint64_t ts);
+bool latency_command_done(uint16_t index, uint16_t opcode, uint64_t ts,
+							uint64_t *elapsed);
+
+void latency_acl_sent(uint16_t index, uint16_t handle, uint64_t ts);
+unsigned int latency_acl_completed(uint16_t index, uint16_t handle,
+					uint16_t count, uint64_t ts,
+					uint64_t *min, uint64_t *max);
+void latency_disconnected(uint16_t index, uint16_t handle);
+
+void latency_cleanup(void);
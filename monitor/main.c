@@ -27,14 +27,26 @@
 #endif
 
 #include <stdio.h>
+#include <errno.h>
+#include <stdint.h>
 #include <stdlib.h>
+#include <limits.h>
+#include <string.h>
+#include <stdbool.h>
 #include <getopt.h>
 
+#include <bluetooth/bluetooth.h>
+#include <bluetooth/hci.h>
+
 #include "mainloop.h"
 #include "packet.h"
 #include "control.h"
 #include "hcidump.h"
 #include "btsnoop.h"
+#include "capture.h"
+#include "stats.h"
+#include "filter.h"
+#include "latency.h"
 
 static void signal_callback(int signum, void *user_data)
 {
@@ -43,25 +55,208 @@ static void signal_callback(int signum, void *user_data)
 	case SIGTERM:
 		mainloop_quit();
 		break;
+	case SIGUSR1:
+		capture_print_stats();
+		break;
 	}
 }
 
+static bool parse_index(const char *str)
+{
+	char *end;
+	unsigned long index;
+
+	if (!strncmp(str, "hci", 3))
+		str += 3;
+
+	index = strtoul(str, &end, 10);
+	if (end == str || *end != '\0' || index > 0xffff)
+		return false;
+
+	return filter_add_index(index);
+}
+
+static bool parse_ptype(const char *str)
+{
+	if (!strcmp(str, "cmd"))
+		return filter_add_ptype(HCI_COMMAND_PKT);
+	else if (!strcmp(str, "evt"))
+		return filter_add_ptype(HCI_EVENT_PKT);
+	else if (!strcmp(str, "acl"))
+		return filter_add_ptype(HCI_ACLDATA_PKT);
+	else if (!strcmp(str, "sco"))
+		return filter_add_ptype(HCI_SCODATA_PKT);
+
+	return false;
+}
+
+/* Numbers in any base strtoul understands, up to max */
+static bool parse_value(const char *str, unsigned long max,
+						unsigned long *value)
+{
+	char *end;
+
+	*value = strtoul(str, &end, 0);
+
+	return end != str && *end == '\0' && *value <= max;
+}
+
+static void stats_timeout(int id, void *user_data)
+{
+	unsigned int interval = *((unsigned int *) user_data);
+
+	stats_print();
+
+	mainloop_modify_timeout(id, interval);
+}
+
+/* Accepts "from", "from:" and "from:to"; to is left alone when missing */
+static bool parse_range(const char *str, double *from, double *to)
+{
+	char *end;
+
+	*from = strtod(str, &end);
+	if (end == str)
+		return false;
+
+	if (*end == '\0')
+		return true;
+
+	if (*end != ':')
+		return false;
+
+	str = end + 1;
+	if (*str == '\0')
+		return true;
+
+	*to = strtod(str, &end);
+
+	return end != str && *end == '\0';
+}
+
+static void tv_add(struct timeval *tv, double seconds)
+{
+	long long usec = seconds * 1000000;
+
+	usec += tv->tv_usec;
+	tv->tv_sec += usec / 1000000;
+	tv->tv_usec = usec % 1000000;
+}
+
+static int read_btsnoop(const char *path, double first, double last,
+						double from, double to)
+{
+	uint32_t n, start, end, count;
+	struct timeval tv;
+	int err;
+
+	err = btsnoop_read_open(path);
+	if (err < 0) {
+		fprintf(stderr, "Failed to read %s: %s\n", path,
+							strerror(-err));
+		return EXIT_FAILURE;
+	}
+
+	count = btsnoop_read_count();
+
+	start = first > 0 ? first : 0;
+	end = last >= 0 && last < count ? last + 1 : count;
+
+	/* Time ranges are relative to the first record */
+	if (count > 0 && (from > 0 || to >= 0)) {
+		struct timeval base, limit;
+
+		btsnoop_read_record(0, &base, NULL, NULL, NULL);
+
+		limit = base;
+		tv_add(&limit, from);
+		n = btsnoop_read_find(&limit);
+		if (n > start)
+			start = n;
+
+		if (to >= 0) {
+			limit = base;
+			tv_add(&limit, to);
+			n = btsnoop_read_find(&limit);
+			if (n < end)
+				end = n;
+		}
+	}
+
+	/* Decoding is bound by output, so keep printf from flushing
+	 * every line */
+	setvbuf(stdout, NULL, _IOFBF, 1 << 20);
+
+	for (n = start; n < end; n++) {
+		const void *data;
+		uint32_t flags;
+		uint16_t size;
+
+		if (btsnoop_read_record(n, &tv, &flags, &data, &size) < 0)
+			break;
+
+		switch (flags & 0x03) {
+		case 0x00:
+			packet_hci_acldata(&tv, 0, false, data, size);
+			break;
+		case 0x01:
+			packet_hci_acldata(&tv, 0, true, data, size);
+			break;
+		case 0x02:
+			packet_hci_command(&tv, 0, data, size);
+			break;
+		case 0x03:
+			packet_hci_event(&tv, 0, data, size);
+			break;
+		}
+	}
+
+	btsnoop_read_close();
+
+	return EXIT_SUCCESS;
+}
+
 static const struct option main_options[] = {
 	{ "btsnoop",	required_argument, NULL, 'b'	},
+	{ "rotate-size",	required_argument, NULL, 's'	},
+	{ "rotate-time",	required_argument, NULL, 't'	},
+	{ "rotate-count",	required_argument, NULL, 'n'	},
+	{ "read",	required_argument, NULL, 'r'	},
+	{ "records",	required_argument, NULL, 'R'	},
+	{ "time",	required_argument, NULL, 'T'	},
+	{ "stats",	no_argument,       NULL, 'S'	},
+	{ "stats-interval",	required_argument, NULL, 'i'	},
+	{ "json",	no_argument,       NULL, 'j'	},
+	{ "index",	required_argument, NULL, 'I'	},
+	{ "type",	required_argument, NULL, 'P'	},
+	{ "event",	required_argument, NULL, 'E'	},
+	{ "opcode",	required_argument, NULL, 'O'	},
+	{ "handle",	required_argument, NULL, 'H'	},
+	{ "cid",	required_argument, NULL, 'C'	},
+	{ "latency",	no_argument,       NULL, 'L'	},
 	{ }
 };
 
 int main(int argc, char *argv[])
 {
 	unsigned long filter_mask = 0;
+	size_t rotate_size = 0;
+	unsigned int rotate_time = 0, rotate_count = 0;
+	const char *read_path = NULL;
+	double first = 0, last = -1, from = 0, to = -1;
+	static unsigned int stats_interval = 0;
+	bool stats = false, json = false;
+	unsigned long value;
 	sigset_t mask;
+	int exit_status;
 
 	mainloop_init();
 
 	for (;;) {
 		int opt;
 
-		opt = getopt_long(argc, argv, "b", main_options, NULL);
+		opt = getopt_long(argc, argv, "b:s:t:n:r:R:T:Si:jI:P:E:O:H:C:L",
+						main_options, NULL);
 		if (opt < 0)
 			break;
 
@@ -69,15 +264,122 @@ int main(int argc, char *argv[])
 		case 'b':
 			btsnoop_open(optarg);
 			break;
+		case 's':
+			/* Megabytes */
+			if (!parse_value(optarg, SIZE_MAX >> 20, &value) ||
+								value == 0) {
+				fprintf(stderr, "Invalid rotation size\n");
+				return EXIT_FAILURE;
+			}
+			rotate_size = (size_t) value << 20;
+			break;
+		case 't':
+			/* Seconds */
+			if (!parse_value(optarg, UINT_MAX, &value) ||
+								value == 0) {
+				fprintf(stderr, "Invalid rotation time\n");
+				return EXIT_FAILURE;
+			}
+			rotate_time = value;
+			break;
+		case 'n':
+			if (!parse_value(optarg, UINT_MAX, &value) ||
+								value == 0) {
+				fprintf(stderr, "Invalid rotation count\n");
+				return EXIT_FAILURE;
+			}
+			rotate_count = value;
+			break;
+		case 'r':
+			read_path = optarg;
+			break;
+		case 'R':
+			if (!parse_range(optarg, &first, &last)) {
+				fprintf(stderr, "Invalid record range\n");
+				return EXIT_FAILURE;
+			}
+			break;
+		case 'T':
+			if (!parse_range(optarg, &from, &to)) {
+				fprintf(stderr, "Invalid time range\n");
+				return EXIT_FAILURE;
+			}
+			break;
+		case 'S':
+			stats = true;
+			break;
+		case 'i':
+			/* Seconds */
+			if (!parse_value(optarg, UINT_MAX, &value) ||
+								value == 0) {
+				fprintf(stderr, "Invalid statistics interval\n");
+				return EXIT_FAILURE;
+			}
+			stats_interval = value;
+			stats = true;
+			break;
+		case 'j':
+			json = true;
+			break;
+		case 'L':
+			filter_mask |= PACKET_FILTER_SHOW_LATENCY;
+			break;
+		case 'I':
+			if (!parse_index(optarg)) {
+				fprintf(stderr, "Invalid index filter\n");
+				return EXIT_FAILURE;
+			}
+			break;
+		case 'P':
+			if (!parse_ptype(optarg)) {
+				fprintf(stderr, "Invalid packet type filter\n");
+				return EXIT_FAILURE;
+			}
+			break;
+		case 'E':
+			if (!parse_value(optarg, 0xff, &value) ||
+						!filter_add_event(value)) {
+				fprintf(stderr, "Invalid event filter\n");
+				return EXIT_FAILURE;
+			}
+			break;
+		case 'O':
+			if (!parse_value(optarg, 0xffff, &value) ||
+						!filter_add_opcode(value)) {
+				fprintf(stderr, "Invalid opcode filter\n");
+				return EXIT_FAILURE;
+			}
+			break;
+		case 'H':
+			if (!parse_value(optarg, 0x0eff, &value) ||
+						!filter_add_handle(value)) {
+				fprintf(stderr, "Invalid handle filter\n");
+				return EXIT_FAILURE;
+			}
+			break;
+		case 'C':
+			if (!parse_value(optarg, 0xffff, &value) ||
+						!filter_add_cid(value)) {
+				fprintf(stderr, "Invalid CID filter\n");
+				return EXIT_FAILURE;
+			}
+			break;
 		default:
 			return EXIT_FAILURE;
 		}
 	}
 
+	if ((rotate_size > 0 || rotate_time > 0) && rotate_count == 0) {
+		fprintf(stderr, "Rotation requires --rotate-count\n");
+		return EXIT_FAILURE;
+	}
+
+	btsnoop_set_rotation(rotate_size, rotate_time, rotate_count);
 
 	sigemptyset(&mask);
 	sigaddset(&mask, SIGINT);
 	sigaddset(&mask, SIGTERM);
+	sigaddset(&mask, SIGUSR1);
 
 	mainloop_set_signal(&mask, signal_callback, NULL, NULL);
 
@@ -85,14 +387,54 @@ int main(int argc, char *argv[])
 	filter_mask |= PACKET_FILTER_SHOW_TIME;
 	filter_mask |= PACKET_FILTER_SHOW_ACL_DATA;
 
+	if (stats) {
+		filter_mask |= PACKET_FILTER_STATS;
+		stats_enable(json);
+	}
+
 	packet_set_filter(filter_mask);
 
+	if (read_path) {
+		exit_status = read_btsnoop(read_path, first, last, from, to);
+		btsnoop_close();
+
+		if (stats) {
+			stats_print();
+			stats_cleanup();
+		}
+
+		latency_cleanup();
+
+		return exit_status;
+	}
+
 	printf("Bluetooth monitor ver %s\n", VERSION);
 
+	if (capture_init() < 0) {
+		fprintf(stderr, "Failed to start capture thread\n");
+		return EXIT_FAILURE;
+	}
+
 	if (control_tracing() < 0) {
 		if (hcidump_tracing() < 0)
 			return EXIT_FAILURE;
 	}
 
-	return mainloop_run();
+	if (stats_interval > 0)
+		mainloop_add_timeout(stats_interval, stats_timeout,
+						&stats_interval, NULL);
+
+	exit_status = mainloop_run();
+
+	capture_exit();
+	btsnoop_close();
+
+	if (stats) {
+		stats_print();
+		stats_cleanup();
+	}
+
+	latency_cleanup();
+
+	return exit_status;
 }
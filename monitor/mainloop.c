@@ -30,15 +30,19 @@
 #include <errno.h>
 #include <unistd.h>
 #include <stdlib.h>
+#include <stdbool.h>
 #include <string.h>
 #include <signal.h>
+#include <time.h>
 #include <sys/signalfd.h>
 #include <sys/timerfd.h>
 #include <sys/epoll.h>
 
 #include "mainloop.h"
 
-#define MAX_EPOLL_EVENTS 10
+#define MAX_EPOLL_EVENTS 64
+
+#define MIN_LIST_SIZE 64
 
 static int epoll_fd;
 static int epoll_terminate;
@@ -51,17 +55,43 @@ struct mainloop_data {
 	void *user_data;
 };
 
-#define MAX_MAINLOOP_ENTRIES 128
-
-static struct mainloop_data *mainloop_list[MAX_MAINLOOP_ENTRIES];
+/* Indexed by file descriptor and grown on demand */
+static struct mainloop_data **mainloop_list;
+static unsigned int mainloop_size;
 
 struct timeout_data {
-	int fd;
+	int id;
+	int heap_index;
+	uint64_t expire;
 	mainloop_timeout_func callback;
 	mainloop_destroy_func destroy;
 	void *user_data;
 };
 
+/*
+ * All timeouts share one timerfd armed for the earliest expiry. Armed
+ * timeouts live in a binary min-heap, and every timeout has a slot in
+ * timeout_list where its id is the slot number plus one.
+ */
+static int timer_fd = -1;
+static struct timeout_data **timeout_heap;
+static unsigned int timeout_heap_len;
+static struct timeout_data **timeout_list;
+static unsigned int timeout_size;
+
+struct idle_data {
+	struct idle_data *next;
+	int id;
+	mainloop_idle_func callback;
+	mainloop_destroy_func destroy;
+	void *user_data;
+};
+
+static struct idle_data *idle_head;
+static struct idle_data *idle_tail;
+static struct idle_data *idle_run;
+static int idle_id;
+
 struct signal_data {
 	int fd;
 	sigset_t mask;
@@ -74,12 +104,19 @@ static struct signal_data *signal_data;
 
 void mainloop_init(void)
 {
-	unsigned int i;
-
 	epoll_fd = epoll_create1(EPOLL_CLOEXEC);
 
-	for (i = 0; i < MAX_MAINLOOP_ENTRIES; i++)
-		mainloop_list[i] = NULL;
+	mainloop_list = NULL;
+	mainloop_size = 0;
+
+	timer_fd = -1;
+	timeout_heap = NULL;
+	timeout_heap_len = 0;
+	timeout_list = NULL;
+	timeout_size = 0;
+
+	idle_head = idle_tail = NULL;
+	idle_id = 0;
 
 	epoll_terminate = 0;
 }
@@ -108,6 +145,29 @@ static void signal_callback(int fd, uint32_t events, void *user_data)
 		data->callback(si.ssi_signo, data->user_data);
 }
 
+/* Callbacks added while idle callbacks run are left for the next
+ * iteration, so a callback re-adding itself cannot starve the loop */
+static void run_idle(void)
+{
+	idle_run = idle_head;
+	idle_head = idle_tail = NULL;
+
+	while (idle_run) {
+		struct idle_data *data = idle_run;
+
+		idle_run = data->next;
+
+		data->callback(data->user_data);
+
+		if (data->destroy)
+			data->destroy(data->user_data);
+
+		free(data);
+	}
+}
+
+static void free_timeouts(void);
+
 int mainloop_run(void)
 {
 	unsigned int i;
@@ -132,16 +192,28 @@ int mainloop_run(void)
 		struct epoll_event events[MAX_EPOLL_EVENTS];
 		int n, nfds;
 
-		nfds = epoll_wait(epoll_fd, events, MAX_EPOLL_EVENTS, -1);
+		nfds = epoll_wait(epoll_fd, events, MAX_EPOLL_EVENTS,
+							idle_head ? 0 : -1);
 		if (nfds < 0)
 			continue;
 
 		for (n = 0; n < nfds; n++) {
-			struct mainloop_data *data = events[n].data.ptr;
+			struct mainloop_data *data;
+			int fd = events[n].data.fd;
+
+			/* An earlier callback may have removed this one */
+			if ((unsigned int) fd >= mainloop_size)
+				continue;
+
+			data = mainloop_list[fd];
+			if (!data)
+				continue;
 
 			data->callback(data->fd, events[n].events,
 							data->user_data);
 		}
+
+		run_idle();
 	}
 
 	if (signal_data) {
@@ -152,7 +224,22 @@ int mainloop_run(void)
 			signal_data->destroy(signal_data->user_data);
 	}
 
-	for (i = 0; i < MAX_MAINLOOP_ENTRIES; i++) {
+	free_timeouts();
+
+	while (idle_head) {
+		struct idle_data *data = idle_head;
+
+		idle_head = data->next;
+
+		if (data->destroy)
+			data->destroy(data->user_data);
+
+		free(data);
+	}
+
+	idle_tail = NULL;
+
+	for (i = 0; i < mainloop_size; i++) {
 		struct mainloop_data *data = mainloop_list[i];
 
 		mainloop_list[i] = NULL;
@@ -167,12 +254,39 @@ int mainloop_run(void)
 		}
 	}
 
+	free(mainloop_list);
+	mainloop_list = NULL;
+	mainloop_size = 0;
+
 	close(epoll_fd);
 	epoll_fd = 0;
 
 	return 0;
 }
 
+static int grow_list(void ***list, unsigned int *size, unsigned int needed)
+{
+	unsigned int new_size = *size ? *size : MIN_LIST_SIZE;
+	void **new_list;
+
+	while (new_size <= needed)
+		new_size *= 2;
+
+	if (new_size == *size)
+		return 0;
+
+	new_list = realloc(*list, new_size * sizeof(void *));
+	if (!new_list)
+		return -ENOMEM;
+
+	memset(new_list + *size, 0, (new_size - *size) * sizeof(void *));
+
+	*list = new_list;
+	*size = new_size;
+
+	return 0;
+}
+
 int mainloop_add_fd(int fd, uint32_t events, mainloop_event_func callback,
 				void *user_data, mainloop_destroy_func destroy)
 {
@@ -180,9 +294,15 @@ int mainloop_add_fd(int fd, uint32_t events, mainloop_event_func callback,
 	struct epoll_event ev;
 	int err;
 
-	if (fd < 0 || fd > MAX_MAINLOOP_ENTRIES - 1 || !callback)
+	if (fd < 0 || !callback)
 		return -EINVAL;
 
+	if (grow_list((void ***) &mainloop_list, &mainloop_size, fd) < 0)
+		return -ENOMEM;
+
+	if (mainloop_list[fd])
+		return -EEXIST;
+
 	data = malloc(sizeof(*data));
 	if (!data)
 		return -ENOMEM;
@@ -196,7 +316,7 @@ int mainloop_add_fd(int fd, uint32_t events, mainloop_event_func callback,
 
 	memset(&ev, 0, sizeof(ev));
 	ev.events = events;
-	ev.data.ptr = data;
+	ev.data.fd = fd;
 
 	err = epoll_ctl(epoll_fd, EPOLL_CTL_ADD, data->fd, &ev);
 	if (err < 0) {
@@ -209,16 +329,24 @@ int mainloop_add_fd(int fd, uint32_t events, mainloop_event_func callback,
 	return 0;
 }
 
+static struct mainloop_data *find_fd(int fd)
+{
+	if (fd < 0 || (unsigned int) fd >= mainloop_size)
+		return NULL;
+
+	return mainloop_list[fd];
+}
+
 int mainloop_modify_fd(int fd, uint32_t events)
 {
 	struct mainloop_data *data;
 	struct epoll_event ev;
 	int err;
 
-	if (fd < 0 || fd > MAX_MAINLOOP_ENTRIES - 1)
+	if (fd < 0)
 		return -EINVAL;
 
-	data = mainloop_list[fd];
+	data = find_fd(fd);
 	if (!data)
 		return -ENXIO;
 
@@ -227,7 +355,7 @@ int mainloop_modify_fd(int fd, uint32_t events)
 
 	memset(&ev, 0, sizeof(ev));
 	ev.events = events;
-	ev.data.ptr = data;
+	ev.data.fd = fd;
 
 	err = epoll_ctl(epoll_fd, EPOLL_CTL_MOD, data->fd, &ev);
 	if (err < 0)
@@ -243,10 +371,10 @@ int mainloop_remove_fd(int fd)
 	struct mainloop_data *data;
 	int err;
 
-	if (fd < 0 || fd > MAX_MAINLOOP_ENTRIES - 1)
+	if (fd < 0)
 		return -EINVAL;
 
-	data = mainloop_list[fd];
+	data = find_fd(fd);
 	if (!data)
 		return -ENXIO;
 
@@ -262,96 +390,278 @@ int mainloop_remove_fd(int fd)
 	return err;
 }
 
-static void timeout_destroy(void *user_data)
+static uint64_t now_ms(void)
 {
-	struct timeout_data *data = user_data;
+	struct timespec ts;
 
-	close(data->fd);
-	data->fd = -1;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
 
-	if (data->destroy)
-		data->destroy(data->user_data);
+	return (uint64_t) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
 }
 
-static void timeout_callback(int fd, uint32_t events, void *user_data)
+static void heap_swap(unsigned int a, unsigned int b)
 {
-	struct timeout_data *data = user_data;
-	uint64_t expired;
-	ssize_t result;
+	struct timeout_data *tmp = timeout_heap[a];
 
-	if (events & (EPOLLERR | EPOLLHUP))
+	timeout_heap[a] = timeout_heap[b];
+	timeout_heap[b] = tmp;
+
+	timeout_heap[a]->heap_index = a;
+	timeout_heap[b]->heap_index = b;
+}
+
+static void heap_up(unsigned int i)
+{
+	while (i > 0) {
+		unsigned int parent = (i - 1) / 2;
+
+		if (timeout_heap[parent]->expire <= timeout_heap[i]->expire)
+			break;
+
+		heap_swap(i, parent);
+		i = parent;
+	}
+}
+
+static void heap_down(unsigned int i)
+{
+	while (1) {
+		unsigned int left = 2 * i + 1, right = left + 1, min = i;
+
+		if (left < timeout_heap_len && timeout_heap[left]->expire <
+						timeout_heap[min]->expire)
+			min = left;
+
+		if (right < timeout_heap_len && timeout_heap[right]->expire <
+						timeout_heap[min]->expire)
+			min = right;
+
+		if (min == i)
+			break;
+
+		heap_swap(i, min);
+		i = min;
+	}
+}
+
+static void heap_remove(struct timeout_data *data)
+{
+	unsigned int i = data->heap_index;
+
+	if (data->heap_index < 0)
 		return;
 
-	result = read(data->fd, &expired, sizeof(expired));
-	if (result != sizeof(expired))
+	data->heap_index = -1;
+
+	if (--timeout_heap_len == i)
 		return;
 
-	if (data->callback)
-		data->callback(data->fd, data->user_data);
+	timeout_heap[i] = timeout_heap[timeout_heap_len];
+	timeout_heap[i]->heap_index = i;
+
+	heap_up(i);
+	heap_down(timeout_heap[i]->heap_index);
+}
+
+static int heap_insert(struct timeout_data *data)
+{
+	unsigned int size = timeout_size;
+
+	/* The heap never holds more entries than there are timeouts */
+	if (!timeout_heap) {
+		timeout_heap = calloc(size, sizeof(*timeout_heap));
+		if (!timeout_heap)
+			return -ENOMEM;
+	}
+
+	data->heap_index = timeout_heap_len;
+	timeout_heap[timeout_heap_len++] = data;
+
+	heap_up(data->heap_index);
+
+	return 0;
 }
 
-static inline int timeout_set(int fd, unsigned int seconds)
+static void timer_update(void)
 {
 	struct itimerspec itimer;
+	uint64_t expire;
 
 	memset(&itimer, 0, sizeof(itimer));
-	itimer.it_interval.tv_sec = 0;
-	itimer.it_interval.tv_nsec = 0;
-	itimer.it_value.tv_sec = seconds;
-	itimer.it_value.tv_nsec = 0;
 
-	return timerfd_settime(fd, 0, &itimer, NULL);
+	/* Zero disarms the timer when nothing is pending */
+	if (timeout_heap_len > 0) {
+		expire = timeout_heap[0]->expire;
+		if (expire == 0)
+			expire = 1;
+
+		itimer.it_value.tv_sec = expire / 1000;
+		itimer.it_value.tv_nsec = (expire % 1000) * 1000000;
+	}
+
+	timerfd_settime(timer_fd, TFD_TIMER_ABSTIME, &itimer, NULL);
 }
 
-int mainloop_add_timeout(unsigned int seconds, mainloop_timeout_func callback,
+static void timer_callback(int fd, uint32_t events, void *user_data)
+{
+	uint64_t expired, now;
+	ssize_t result;
+
+	if (events & (EPOLLERR | EPOLLHUP))
+		return;
+
+	result = read(fd, &expired, sizeof(expired));
+	if (result < 0 && errno != EAGAIN)
+		return;
+
+	now = now_ms();
+
+	/* Timeouts are one-shot, callbacks re-arm them as needed */
+	while (timeout_heap_len > 0 && timeout_heap[0]->expire <= now) {
+		struct timeout_data *data = timeout_heap[0];
+
+		heap_remove(data);
+
+		data->callback(data->id, data->user_data);
+	}
+
+	timer_update();
+}
+
+static void timer_destroy(void *user_data)
+{
+	close(timer_fd);
+	timer_fd = -1;
+}
+
+static struct timeout_data *find_timeout(int id)
+{
+	if (id <= 0 || (unsigned int) id > timeout_size)
+		return NULL;
+
+	return timeout_list[id - 1];
+}
+
+static int timeout_set(struct timeout_data *data, uint64_t msec)
+{
+	heap_remove(data);
+
+	data->expire = now_ms() + msec;
+
+	if (heap_insert(data) < 0)
+		return -ENOMEM;
+
+	timer_update();
+
+	return 0;
+}
+
+/* Timeouts added without arming stay idle until modified */
+static int add_timeout(uint64_t msec, bool armed,
+				mainloop_timeout_func callback,
 				void *user_data, mainloop_destroy_func destroy)
 {
 	struct timeout_data *data;
+	unsigned int i, old_size = timeout_size;
 
 	if (!callback)
 		return -EINVAL;
 
+	if (timer_fd < 0) {
+		timer_fd = timerfd_create(CLOCK_MONOTONIC,
+						TFD_NONBLOCK | TFD_CLOEXEC);
+		if (timer_fd < 0)
+			return -EIO;
+
+		if (mainloop_add_fd(timer_fd, EPOLLIN, timer_callback,
+						NULL, timer_destroy) < 0) {
+			close(timer_fd);
+			timer_fd = -1;
+			return -EIO;
+		}
+	}
+
+	for (i = 0; i < timeout_size; i++)
+		if (!timeout_list[i])
+			break;
+
+	if (i == timeout_size) {
+		if (grow_list((void ***) &timeout_list, &timeout_size, i) < 0)
+			return -ENOMEM;
+
+		/* Keep the heap as large as the list */
+		if (timeout_heap && timeout_size != old_size) {
+			struct timeout_data **heap;
+
+			heap = realloc(timeout_heap,
+					timeout_size * sizeof(*heap));
+			if (!heap)
+				return -ENOMEM;
+
+			timeout_heap = heap;
+		}
+	}
+
 	data = malloc(sizeof(*data));
 	if (!data)
 		return -ENOMEM;
 
 	memset(data, 0, sizeof(*data));
+	data->id = i + 1;
+	data->heap_index = -1;
 	data->callback = callback;
 	data->destroy = destroy;
 	data->user_data = user_data;
 
-	data->fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
-	if (data->fd < 0) {
+	timeout_list[i] = data;
+
+	if (armed && timeout_set(data, msec) < 0) {
+		timeout_list[i] = NULL;
 		free(data);
 		return -EIO;
 	}
 
-	if (seconds > 0) {
-		if (timeout_set(data->fd, seconds) < 0) {
-			close(data->fd);
-			free(data);
-			return -EIO;
-		}
-	}
+	return data->id;
+}
 
-	if (mainloop_add_fd(data->fd, EPOLLIN | EPOLLONESHOT,
-				timeout_callback, data, timeout_destroy) < 0) {
-		close(data->fd);
-		free(data);
-		return -EIO;
-	}
+int mainloop_add_timeout(unsigned int seconds, mainloop_timeout_func callback,
+				void *user_data, mainloop_destroy_func destroy)
+{
+	return add_timeout((uint64_t) seconds * 1000, seconds > 0, callback,
+						user_data, destroy);
+}
 
-	return data->fd;
+int mainloop_add_timeout_ms(unsigned int msec, mainloop_timeout_func callback,
+				void *user_data, mainloop_destroy_func destroy)
+{
+	return add_timeout(msec, true, callback, user_data, destroy);
 }
 
 int mainloop_modify_timeout(int id, unsigned int seconds)
 {
+	struct timeout_data *data;
+
+	data = find_timeout(id);
+	if (!data)
+		return -ENXIO;
+
 	if (seconds > 0) {
-		if (timeout_set(id, seconds) < 0)
+		if (timeout_set(data, (uint64_t) seconds * 1000) < 0)
 			return -EIO;
 	}
 
-	if (mainloop_modify_fd(id, EPOLLIN | EPOLLONESHOT) < 0)
+	return 0;
+}
+
+int mainloop_modify_timeout_ms(int id, unsigned int msec)
+{
+	struct timeout_data *data;
+
+	data = find_timeout(id);
+	if (!data)
+		return -ENXIO;
+
+	if (timeout_set(data, msec) < 0)
 		return -EIO;
 
 	return 0;
@@ -359,7 +669,128 @@ int mainloop_modify_timeout(int id, unsigned int seconds)
 
 int mainloop_remove_timeout(int id)
 {
-	return mainloop_remove_fd(id);
+	struct timeout_data *data;
+
+	data = find_timeout(id);
+	if (!data)
+		return -ENXIO;
+
+	heap_remove(data);
+	timeout_list[id - 1] = NULL;
+
+	if (timer_fd >= 0)
+		timer_update();
+
+	if (data->destroy)
+		data->destroy(data->user_data);
+
+	free(data);
+
+	return 0;
+}
+
+static void free_timeouts(void)
+{
+	unsigned int i;
+
+	for (i = 0; i < timeout_size; i++) {
+		struct timeout_data *data = timeout_list[i];
+
+		if (!data)
+			continue;
+
+		timeout_list[i] = NULL;
+
+		if (data->destroy)
+			data->destroy(data->user_data);
+
+		free(data);
+	}
+
+	free(timeout_list);
+	timeout_list = NULL;
+	timeout_size = 0;
+
+	free(timeout_heap);
+	timeout_heap = NULL;
+	timeout_heap_len = 0;
+}
+
+int mainloop_add_idle(mainloop_idle_func callback, void *user_data,
+					mainloop_destroy_func destroy)
+{
+	struct idle_data *data;
+
+	if (!callback)
+		return -EINVAL;
+
+	data = malloc(sizeof(*data));
+	if (!data)
+		return -ENOMEM;
+
+	memset(data, 0, sizeof(*data));
+	data->callback = callback;
+	data->destroy = destroy;
+	data->user_data = user_data;
+
+	/* Keep ids positive across wrap around */
+	if (++idle_id <= 0)
+		idle_id = 1;
+
+	data->id = idle_id;
+
+	if (idle_tail)
+		idle_tail->next = data;
+	else
+		idle_head = data;
+
+	idle_tail = data;
+
+	return data->id;
+}
+
+static struct idle_data *unlink_idle(struct idle_data **head, int id)
+{
+	struct idle_data *data, *prev = NULL;
+
+	for (data = *head; data; prev = data, data = data->next) {
+		if (data->id != id)
+			continue;
+
+		if (prev)
+			prev->next = data->next;
+		else
+			*head = data->next;
+
+		return data;
+	}
+
+	return NULL;
+}
+
+int mainloop_remove_idle(int id)
+{
+	struct idle_data *data;
+
+	/* Also look at callbacks queued behind the one running now */
+	data = unlink_idle(&idle_run, id);
+	if (!data) {
+		data = unlink_idle(&idle_head, id);
+		if (!data)
+			return -ENXIO;
+
+		if (idle_tail == data) {
+			for (idle_tail = idle_head; idle_tail && idle_tail->next;
+						idle_tail = idle_tail->next);
+		}
+	}
+
+	if (data->destroy)
+		data->destroy(data->user_data);
+
+	free(data);
+
+	return 0;
 }
 
 int mainloop_set_signal(sigset_t *mask, mainloop_signal_func callback,
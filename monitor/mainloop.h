@@ -30,6 +30,7 @@ typedef void (*mainloop_destroy_func) (void *user_data);
 typedef void (*mainloop_event_func) (int fd, uint32_t events, void *user_data);
 typedef void (*mainloop_timeout_func) (int id, void *user_data);
 typedef void (*mainloop_signal_func) (int signum, void *user_data);
+typedef void (*mainloop_idle_func) (void *user_data);
 
 void mainloop_init(void);
 void mainloop_quit(void);
@@ -43,7 +44,14 @@ int mainloop_remove_fd(int fd);
 int mainloop_add_timeout(unsigned int seconds, mainloop_timeout_func callback,
 				void *user_data, mainloop_destroy_func destroy);
 int mainloop_modify_timeout(int fd, unsigned int seconds);
+int mainloop_add_timeout_ms(unsigned int msec, mainloop_timeout_func callback,
+				void *user_data, mainloop_destroy_func destroy);
+int mainloop_modify_timeout_ms(int id, unsigned int msec);
 int mainloop_remove_timeout(int id);
 
+int mainloop_add_idle(mainloop_idle_func callback, void *user_data,
+					mainloop_destroy_func destroy);
+int mainloop_remove_idle(int id);
+
 int mainloop_set_signal(sigset_t *mask, mainloop_signal_func callback,
 				void *user_data, mainloop_destroy_func destroy);
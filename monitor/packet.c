@@ -42,6 +42,9 @@
 
 #include "control.h"
 #include "btsnoop.h"
+#include "stats.h"
+#include "filter.h"
+#include "latency.h"
 #include "packet.h"
 
 static unsigned long filter_mask = 0;
@@ -51,6 +54,79 @@ void packet_set_filter(unsigned long filter)
 	filter_mask = filter;
 }
 
+static void print_latency(uint64_t ns)
+{
+	printf("%-12c%s: %llu.%3.3llu ms\n", ' ', "Latency",
+			(unsigned long long) ns / 1000000,
+			(unsigned long long) (ns / 1000) % 1000);
+}
+
+static void print_completed_latency(uint16_t index, uint64_t ts,
+					const uint8_t *data, uint16_t size)
+{
+	uint8_t i, num;
+
+	if (size < 1)
+		return;
+
+	num = data[0];
+	data++;
+	size--;
+
+	for (i = 0; i < num && size >= 4; i++, data += 4, size -= 4) {
+		uint16_t handle = acl_handle(bt_get_le16(data));
+		uint16_t count = bt_get_le16(data + 2);
+		uint64_t min, max;
+		unsigned int paired;
+
+		paired = latency_acl_completed(index, handle, count, ts,
+								&min, &max);
+		if (!paired)
+			continue;
+
+		printf("%-12cLatency: handle %d, %u packets, "
+				"%llu.%3.3llu - %llu.%3.3llu ms\n", ' ',
+				handle, paired,
+				(unsigned long long) min / 1000000,
+				(unsigned long long) (min / 1000) % 1000,
+				(unsigned long long) max / 1000000,
+				(unsigned long long) (max / 1000) % 1000);
+	}
+}
+
+static void event_latency(uint16_t index, uint64_t ts, uint8_t evt,
+					const uint8_t *data, uint16_t size)
+{
+	uint64_t elapsed;
+	uint16_t opcode;
+
+	switch (evt) {
+	case EVT_CMD_COMPLETE:
+		if (size < EVT_CMD_COMPLETE_SIZE)
+			return;
+		opcode = bt_get_le16(data + 1);
+		break;
+	case EVT_CMD_STATUS:
+		if (size < EVT_CMD_STATUS_SIZE)
+			return;
+		opcode = bt_get_le16(data + 2);
+		break;
+	case EVT_NUM_COMP_PKTS:
+		print_completed_latency(index, ts, data, size);
+		return;
+	case EVT_DISCONN_COMPLETE:
+		if (size >= EVT_DISCONN_COMPLETE_SIZE && data[0] == 0)
+			latency_disconnected(index,
+					acl_handle(bt_get_le16(data + 1)));
+		return;
+	default:
+		return;
+	}
+
+	if (latency_command_done(index, opcode, ts, &elapsed))
+		print_latency(elapsed);
+}
+
 static void print_channel_header(struct timeval *tv, uint16_t index,
 							uint16_t channel)
 {
@@ -133,15 +209,6 @@ void packet_control(struct timeval *tv, uint16_t index, uint16_t opcode,
 	control_message(opcode, data, size);
 }
 
-#define MONITOR_NEW_INDEX	0
-#define MONITOR_DEL_INDEX	1
-#define MONITOR_COMMAND_PKT	2
-#define MONITOR_EVENT_PKT	3
-#define MONITOR_ACL_TX_PKT	4
-#define MONITOR_ACL_RX_PKT	5
-#define MONITOR_SCO_TX_PKT	6
-#define MONITOR_SCO_RX_PKT	7
-
 struct monitor_new_index {
 	uint8_t  type;
 	uint8_t  bus;
@@ -571,8 +638,16 @@ void packet_hci_command(struct timeval *tv, uint16_t index,
 	uint16_t ogf = cmd_opcode_ogf(opcode);
 	uint16_t ocf = cmd_opcode_ocf(opcode);
 
+	if (!filter_match(index, HCI_COMMAND_PKT, data, size))
+		return;
+
 	btsnoop_write(tv, index, 0x02, data, size);
 
+	if (filter_mask & PACKET_FILTER_STATS) {
+		stats_command(tv, index, data, size);
+		return;
+	}
+
 	print_header(tv, index);
 
 	if (size < HCI_COMMAND_HDR_SIZE) {
@@ -583,6 +658,9 @@ void packet_hci_command(struct timeval *tv, uint16_t index,
 	printf("< HCI Command: %s (0x%2.2x|0x%4.4x) plen %d\n",
 				opcode2str(opcode), ogf, ocf, hdr->plen);
 
+	if (filter_mask & PACKET_FILTER_SHOW_LATENCY)
+		latency_command(index, opcode, latency_time(tv));
+
 	data += HCI_COMMAND_HDR_SIZE;
 	size -= HCI_COMMAND_HDR_SIZE;
 
@@ -594,8 +672,16 @@ void packet_hci_event(struct timeval *tv, uint16_t index,
 {
 	const hci_event_hdr *hdr = data;
 
+	if (!filter_match(index, HCI_EVENT_PKT, data, size))
+		return;
+
 	btsnoop_write(tv, index, 0x03, data, size);
 
+	if (filter_mask & PACKET_FILTER_STATS) {
+		stats_event(tv, index, data, size);
+		return;
+	}
+
 	print_header(tv, index);
 
 	if (size < HCI_EVENT_HDR_SIZE) {
@@ -610,6 +696,9 @@ void packet_hci_event(struct timeval *tv, uint16_t index,
 	size -= HCI_EVENT_HDR_SIZE;
 
 	packet_hexdump(data, size);
+
+	if (filter_mask & PACKET_FILTER_SHOW_LATENCY)
+		event_latency(index, latency_time(tv), hdr->evt, data, size);
 }
 
 void packet_hci_acldata(struct timeval *tv, uint16_t index, bool in,
@@ -620,8 +709,16 @@ void packet_hci_acldata(struct timeval *tv, uint16_t index, bool in,
 	uint16_t dlen = btohs(hdr->dlen);
 	uint8_t flags = acl_flags(handle);
 
+	if (!filter_match(index, HCI_ACLDATA_PKT, data, size))
+		return;
+
 	btsnoop_write(tv, index, in ? 0x01 : 0x00, data, size);
 
+	if (filter_mask & PACKET_FILTER_STATS) {
+		stats_acldata(tv, index, in, data, size);
+		return;
+	}
+
 	print_header(tv, index);
 
 	if (size < HCI_ACL_HDR_SIZE) {
@@ -632,6 +729,9 @@ void packet_hci_acldata(struct timeval *tv, uint16_t index, bool in,
 	printf("%c ACL Data: handle %d flags 0x%2.2x dlen %d\n",
 			in ? '>' : '<', acl_handle(handle), flags, dlen);
 
+	if (!in && (filter_mask & PACKET_FILTER_SHOW_LATENCY))
+		latency_acl_sent(index, acl_handle(handle), latency_time(tv));
+
 	data += HCI_ACL_HDR_SIZE;
 	size -= HCI_ACL_HDR_SIZE;
 
@@ -646,6 +746,14 @@ void packet_hci_scodata(struct timeval *tv, uint16_t index, bool in,
 	uint16_t handle = btohs(hdr->handle);
 	uint8_t flags = acl_flags(handle);
 
+	if (!filter_match(index, HCI_SCODATA_PKT, data, size))
+		return;
+
+	if (filter_mask & PACKET_FILTER_STATS) {
+		stats_scodata(tv, index, in, data, size);
+		return;
+	}
+
 	print_header(tv, index);
 
 	if (size < HCI_SCO_HDR_SIZE) {
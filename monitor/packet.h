@@ -30,6 +30,17 @@
 #define PACKET_FILTER_SHOW_TIME		(1 << 2)
 #define PACKET_FILTER_SHOW_ACL_DATA	(1 << 3)
 #define PACKET_FILTER_SHOW_SCO_DATA	(1 << 4)
+#define PACKET_FILTER_STATS		(1 << 5)
+#define PACKET_FILTER_SHOW_LATENCY	(1 << 6)
+
+#define MONITOR_NEW_INDEX	0
+#define MONITOR_DEL_INDEX	1
+#define MONITOR_COMMAND_PKT	2
+#define MONITOR_EVENT_PKT	3
+#define MONITOR_ACL_TX_PKT	4
+#define MONITOR_ACL_RX_PKT	5
+#define MONITOR_SCO_TX_PKT	6
+#define MONITOR_SCO_RX_PKT	7
 
 void packet_set_filter(unsigned long filter);
 
@@ -0,0 +1,694 @@
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *  Copyright (C) 2011-2012  Intel Corporation
+ *  Copyright (C) 2004-2010  Marcel Holtmann <marcel@holtmann.org>
+ *
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <bluetooth/bluetooth.h>
+#include <bluetooth/hci.h>
+
+#include "latency.h"
+#include "stats.h"
+
+enum {
+	DIR_TX,
+	DIR_RX,
+};
+
+static const char *dir_str[] = { "TX", "RX" };
+
+struct latency {
+	unsigned long count;
+	double total;
+	double min;
+	double max;
+};
+
+struct cid_stats {
+	struct cid_stats *next;
+	uint16_t cid;
+	unsigned long frames[2];
+	unsigned long long bytes[2];
+};
+
+/* L2CAP reassembly state for one direction, only the basic header is
+ * kept since frames are counted and not decoded */
+struct reassembly {
+	bool active;
+	uint8_t hdr[4];
+	uint8_t hdr_len;
+	int remaining;
+};
+
+struct conn_stats {
+	struct conn_stats *next;
+	uint16_t handle;
+	bool sco;
+	unsigned long packets[2];
+	unsigned long long bytes[2];
+	unsigned long packets_mark[2];	/* counts at the last print */
+	unsigned long long bytes_mark[2];
+	struct timeval first;
+	struct timeval last;
+	struct reassembly frag[2];
+	struct latency_queue sent;
+	struct latency credits;
+	struct cid_stats *cids;
+};
+
+struct opcode_stats {
+	struct opcode_stats *next;
+	uint16_t opcode;
+	unsigned long count;
+	bool pending;
+	struct timeval sent;
+	struct latency latency;
+};
+
+struct index_stats {
+	struct index_stats *next;
+	uint16_t index;
+	unsigned long commands;
+	unsigned long events;
+	struct conn_stats *conns;
+	struct opcode_stats *opcodes;
+};
+
+static struct index_stats *index_list = NULL;
+static bool stats_json = false;
+
+/* Rates cover the time from the last print to the newest packet */
+static struct timeval stats_mark;
+static struct timeval stats_now;
+
+void stats_enable(bool json)
+{
+	stats_json = json;
+}
+
+static double tv_diff(const struct timeval *a, const struct timeval *b)
+{
+	return (a->tv_sec - b->tv_sec) + (a->tv_usec - b->tv_usec) / 1e6;
+}
+
+static void latency_add(struct latency *lat, double value)
+{
+	if (lat->count == 0 || value < lat->min)
+		lat->min = value;
+
+	if (lat->count == 0 || value > lat->max)
+		lat->max = value;
+
+	lat->total += value;
+	lat->count++;
+}
+
+static struct index_stats *get_index(uint16_t index)
+{
+	struct index_stats *stats;
+
+	for (stats = index_list; stats; stats = stats->next)
+		if (stats->index == index)
+			return stats;
+
+	stats = calloc(1, sizeof(*stats));
+	if (!stats)
+		return NULL;
+
+	stats->index = index;
+	stats->next = index_list;
+	index_list = stats;
+
+	return stats;
+}
+
+static struct conn_stats *get_conn(struct index_stats *stats,
+						uint16_t handle, bool sco)
+{
+	struct conn_stats *conn;
+
+	for (conn = stats->conns; conn; conn = conn->next)
+		if (conn->handle == handle)
+			return conn;
+
+	conn = calloc(1, sizeof(*conn));
+	if (!conn)
+		return NULL;
+
+	conn->handle = handle;
+	conn->sco = sco;
+	conn->next = stats->conns;
+	stats->conns = conn;
+
+	return conn;
+}
+
+static struct opcode_stats *get_opcode(struct index_stats *stats,
+							uint16_t opcode)
+{
+	struct opcode_stats *op;
+
+	for (op = stats->opcodes; op; op = op->next)
+		if (op->opcode == opcode)
+			return op;
+
+	op = calloc(1, sizeof(*op));
+	if (!op)
+		return NULL;
+
+	op->opcode = opcode;
+	op->next = stats->opcodes;
+	stats->opcodes = op;
+
+	return op;
+}
+
+static struct cid_stats *get_cid(struct conn_stats *conn, uint16_t cid)
+{
+	struct cid_stats *stats;
+
+	for (stats = conn->cids; stats; stats = stats->next)
+		if (stats->cid == cid)
+			return stats;
+
+	stats = calloc(1, sizeof(*stats));
+	if (!stats)
+		return NULL;
+
+	stats->cid = cid;
+	stats->next = conn->cids;
+	conn->cids = stats;
+
+	return stats;
+}
+
+void stats_command(struct timeval *tv, uint16_t index,
+					const void *data, uint16_t size)
+{
+	const hci_command_hdr *hdr = data;
+	struct index_stats *stats;
+	struct opcode_stats *op;
+
+	stats = get_index(index);
+	if (!stats)
+		return;
+
+	stats->commands++;
+
+	if (size < HCI_COMMAND_HDR_SIZE)
+		return;
+
+	op = get_opcode(stats, btohs(hdr->opcode));
+	if (!op)
+		return;
+
+	op->count++;
+
+	if (tv) {
+		op->sent = *tv;
+		op->pending = true;
+	}
+}
+
+static void command_done(struct timeval *tv, struct index_stats *stats,
+							uint16_t opcode)
+{
+	struct opcode_stats *op;
+
+	for (op = stats->opcodes; op; op = op->next) {
+		if (op->opcode != opcode)
+			continue;
+
+		if (op->pending && tv)
+			latency_add(&op->latency, tv_diff(tv, &op->sent));
+
+		op->pending = false;
+		break;
+	}
+}
+
+static void disconnected(struct index_stats *stats, const uint8_t *data)
+{
+	const evt_disconn_complete *evt = (const void *) data;
+	struct conn_stats *conn;
+
+	if (evt->status)
+		return;
+
+	for (conn = stats->conns; conn; conn = conn->next) {
+		if (conn->handle != acl_handle(btohs(evt->handle)))
+			continue;
+
+		/* The handle may be reused by the next link, which must not
+		 * inherit credits or fragments of this one */
+		latency_queue_reset(&conn->sent);
+		memset(conn->frag, 0, sizeof(conn->frag));
+		break;
+	}
+}
+
+static void completed_packets(struct timeval *tv, struct index_stats *stats,
+					const uint8_t *data, uint16_t size)
+{
+	uint8_t i, num = data[0];
+
+	data++;
+	size--;
+
+	for (i = 0; i < num && size >= 4; i++, data += 4, size -= 4) {
+		uint16_t handle = acl_handle(bt_get_le16(data));
+		uint16_t count = bt_get_le16(data + 2);
+		struct conn_stats *conn;
+
+		for (conn = stats->conns; conn; conn = conn->next)
+			if (conn->handle == handle)
+				break;
+
+		if (!conn)
+			continue;
+
+		for (; count > 0; count--) {
+			uint64_t elapsed;
+
+			if (!latency_queue_pop(&conn->sent, latency_time(tv),
+								&elapsed))
+				break;
+
+			latency_add(&conn->credits, elapsed / 1e9);
+		}
+	}
+}
+
+void stats_event(struct timeval *tv, uint16_t index,
+					const void *data, uint16_t size)
+{
+	const hci_event_hdr *hdr = data;
+	struct index_stats *stats;
+	const uint8_t *ptr = data;
+
+	stats = get_index(index);
+	if (!stats)
+		return;
+
+	stats->events++;
+
+	if (size < HCI_EVENT_HDR_SIZE)
+		return;
+
+	ptr += HCI_EVENT_HDR_SIZE;
+	size -= HCI_EVENT_HDR_SIZE;
+
+	switch (hdr->evt) {
+	case EVT_DISCONN_COMPLETE:
+		if (size >= EVT_DISCONN_COMPLETE_SIZE)
+			disconnected(stats, ptr);
+		break;
+	case EVT_CMD_COMPLETE:
+		if (size >= EVT_CMD_COMPLETE_SIZE)
+			command_done(tv, stats, bt_get_le16(ptr + 1));
+		break;
+	case EVT_CMD_STATUS:
+		if (size >= EVT_CMD_STATUS_SIZE)
+			command_done(tv, stats, bt_get_le16(ptr + 2));
+		break;
+	case EVT_NUM_COMP_PKTS:
+		if (size >= EVT_NUM_COMP_PKTS_SIZE && tv)
+			completed_packets(tv, stats, ptr, size);
+		break;
+	}
+}
+
+static void count_packet(struct conn_stats *conn, struct timeval *tv,
+						int dir, uint16_t size)
+{
+	conn->packets[dir]++;
+	conn->bytes[dir] += size;
+
+	if (!tv)
+		return;
+
+	if (conn->first.tv_sec == 0)
+		conn->first = *tv;
+
+	conn->last = *tv;
+
+	if (timercmp(tv, &stats_now, >))
+		stats_now = *tv;
+}
+
+static void reassemble(struct conn_stats *conn, int dir, uint8_t flags,
+					const uint8_t *data, uint16_t size)
+{
+	struct reassembly *frag = &conn->frag[dir];
+	struct cid_stats *cid;
+	uint16_t len;
+
+	if (flags != ACL_CONT) {
+		frag->active = true;
+		frag->hdr_len = 0;
+	} else if (!frag->active)
+		return;
+
+	while (frag->hdr_len < 4 && size > 0) {
+		frag->hdr[frag->hdr_len++] = *data++;
+		size--;
+
+		if (frag->hdr_len == 4)
+			frag->remaining = bt_get_le16(frag->hdr);
+	}
+
+	if (frag->hdr_len < 4)
+		return;
+
+	frag->remaining -= size;
+	if (frag->remaining > 0)
+		return;
+
+	frag->active = false;
+
+	len = bt_get_le16(frag->hdr);
+
+	cid = get_cid(conn, bt_get_le16(frag->hdr + 2));
+	if (!cid)
+		return;
+
+	cid->frames[dir]++;
+	cid->bytes[dir] += len;
+}
+
+void stats_acldata(struct timeval *tv, uint16_t index, bool in,
+					const void *data, uint16_t size)
+{
+	const hci_acl_hdr *hdr = data;
+	struct index_stats *stats;
+	struct conn_stats *conn;
+	uint16_t handle;
+	int dir = in ? DIR_RX : DIR_TX;
+
+	if (size < HCI_ACL_HDR_SIZE)
+		return;
+
+	stats = get_index(index);
+	if (!stats)
+		return;
+
+	handle = btohs(hdr->handle);
+
+	conn = get_conn(stats, acl_handle(handle), false);
+	if (!conn)
+		return;
+
+	size -= HCI_ACL_HDR_SIZE;
+
+	count_packet(conn, tv, dir, size);
+
+	if (dir == DIR_TX && tv)
+		latency_queue_push(&conn->sent, latency_time(tv));
+
+	reassemble(conn, dir, acl_flags(handle) & 0x03,
+				(const uint8_t *) data + HCI_ACL_HDR_SIZE, size);
+}
+
+void stats_scodata(struct timeval *tv, uint16_t index, bool in,
+					const void *data, uint16_t size)
+{
+	const hci_sco_hdr *hdr = data;
+	struct index_stats *stats;
+	struct conn_stats *conn;
+
+	if (size < HCI_SCO_HDR_SIZE)
+		return;
+
+	stats = get_index(index);
+	if (!stats)
+		return;
+
+	conn = get_conn(stats, acl_handle(btohs(hdr->handle)), true);
+	if (!conn)
+		return;
+
+	count_packet(conn, tv, in ? DIR_RX : DIR_TX,
+					size - HCI_SCO_HDR_SIZE);
+}
+
+static double conn_period(struct conn_stats *conn)
+{
+	if (timercmp(&stats_mark, &conn->first, >))
+		return tv_diff(&stats_now, &stats_mark);
+
+	return tv_diff(&stats_now, &conn->first);
+}
+
+static double conn_rate(struct conn_stats *conn, int dir)
+{
+	double period = conn_period(conn);
+
+	if (period <= 0)
+		return 0;
+
+	return (conn->bytes[dir] - conn->bytes_mark[dir]) / period;
+}
+
+static double conn_packet_rate(struct conn_stats *conn, int dir)
+{
+	double period = conn_period(conn);
+
+	if (period <= 0)
+		return 0;
+
+	return (conn->packets[dir] - conn->packets_mark[dir]) / period;
+}
+
+static double latency_avg(const struct latency *lat)
+{
+	return lat->count ? lat->total / lat->count : 0;
+}
+
+static void print_latency_json(const char *name, const struct latency *lat)
+{
+	printf("\"%s\":{\"count\":%lu,\"avg_ms\":%.3f,\"min_ms\":%.3f,"
+			"\"max_ms\":%.3f}", name, lat->count,
+			latency_avg(lat) * 1000, lat->min * 1000,
+			lat->max * 1000);
+}
+
+static void print_conn_json(struct conn_stats *conn)
+{
+	struct cid_stats *cid;
+	int dir;
+
+	printf("{\"handle\":%u,\"type\":\"%s\"", conn->handle,
+						conn->sco ? "sco" : "acl");
+
+	for (dir = DIR_TX; dir <= DIR_RX; dir++)
+		printf(",\"%s\":{\"packets\":%lu,\"bytes\":%llu,"
+				"\"packets_per_sec\":%.0f,"
+				"\"bytes_per_sec\":%.0f}",
+				dir == DIR_TX ? "tx" : "rx",
+				conn->packets[dir], conn->bytes[dir],
+				conn_packet_rate(conn, dir),
+				conn_rate(conn, dir));
+
+	if (!conn->sco) {
+		printf(",");
+		print_latency_json("credit_latency", &conn->credits);
+
+		printf(",\"cids\":[");
+		for (cid = conn->cids; cid; cid = cid->next)
+			printf("%s{\"cid\":%u,\"tx_frames\":%lu,"
+				"\"tx_bytes\":%llu,\"rx_frames\":%lu,"
+				"\"rx_bytes\":%llu}",
+				cid == conn->cids ? "" : ",", cid->cid,
+				cid->frames[DIR_TX], cid->bytes[DIR_TX],
+				cid->frames[DIR_RX], cid->bytes[DIR_RX]);
+		printf("]");
+	}
+
+	printf("}");
+}
+
+static void print_json(void)
+{
+	struct index_stats *stats;
+
+	printf("{\"indexes\":[");
+
+	for (stats = index_list; stats; stats = stats->next) {
+		struct conn_stats *conn;
+		struct opcode_stats *op;
+
+		printf("%s{\"index\":%u,\"commands\":%lu,\"events\":%lu,"
+				"\"connections\":[",
+				stats == index_list ? "" : ",", stats->index,
+				stats->commands, stats->events);
+
+		for (conn = stats->conns; conn; conn = conn->next) {
+			if (conn != stats->conns)
+				printf(",");
+			print_conn_json(conn);
+		}
+
+		printf("],\"opcodes\":[");
+
+		for (op = stats->opcodes; op; op = op->next) {
+			printf("%s{\"opcode\":%u,\"count\":%lu,",
+					op == stats->opcodes ? "" : ",",
+					op->opcode, op->count);
+			print_latency_json("latency", &op->latency);
+			printf("}");
+		}
+
+		printf("]}");
+	}
+
+	printf("]}\n");
+}
+
+static void print_table(void)
+{
+	struct index_stats *stats;
+
+	for (stats = index_list; stats; stats = stats->next) {
+		struct conn_stats *conn;
+		struct opcode_stats *op;
+
+		printf("hci%u: %lu commands, %lu events\n", stats->index,
+					stats->commands, stats->events);
+
+		if (stats->conns)
+			printf("  %-8s %-3s %10s %12s %10s %12s\n", "Handle",
+					"Dir", "Packets", "Bytes", "Packets/s",
+					"Bytes/s");
+
+		for (conn = stats->conns; conn; conn = conn->next) {
+			struct cid_stats *cid;
+			int dir;
+
+			for (dir = DIR_TX; dir <= DIR_RX; dir++)
+				printf("  %-4s%-4u %-3s %10lu %12llu %10.0f "
+					"%12.0f\n", conn->sco ? "SCO" : "ACL",
+					conn->handle, dir_str[dir],
+					conn->packets[dir], conn->bytes[dir],
+					conn_packet_rate(conn, dir),
+					conn_rate(conn, dir));
+
+			if (conn->credits.count > 0)
+				printf("    credits: %lu, %.3f ms avg, "
+					"%.3f ms min, %.3f ms max\n",
+					conn->credits.count,
+					latency_avg(&conn->credits) * 1000,
+					conn->credits.min * 1000,
+					conn->credits.max * 1000);
+
+			for (cid = conn->cids; cid; cid = cid->next)
+				printf("    CID 0x%4.4x: TX %lu frames %llu bytes,"
+					" RX %lu frames %llu bytes\n", cid->cid,
+					cid->frames[DIR_TX], cid->bytes[DIR_TX],
+					cid->frames[DIR_RX], cid->bytes[DIR_RX]);
+		}
+
+		if (stats->opcodes)
+			printf("  %-15s %8s %10s %10s %10s\n", "Opcode",
+					"Count", "Avg ms", "Min ms", "Max ms");
+
+		for (op = stats->opcodes; op; op = op->next)
+			printf("  0x%2.2x|0x%4.4x %12lu %10.3f %10.3f %10.3f\n",
+					cmd_opcode_ogf(op->opcode),
+					cmd_opcode_ocf(op->opcode), op->count,
+					latency_avg(&op->latency) * 1000,
+					op->latency.min * 1000,
+					op->latency.max * 1000);
+	}
+}
+
+static void mark_rates(void)
+{
+	struct index_stats *stats;
+
+	for (stats = index_list; stats; stats = stats->next) {
+		struct conn_stats *conn;
+
+		for (conn = stats->conns; conn; conn = conn->next) {
+			memcpy(conn->packets_mark, conn->packets,
+						sizeof(conn->packets));
+			memcpy(conn->bytes_mark, conn->bytes,
+						sizeof(conn->bytes));
+		}
+	}
+
+	stats_mark = stats_now;
+}
+
+void stats_print(void)
+{
+	if (stats_json)
+		print_json();
+	else
+		print_table();
+
+	fflush(stdout);
+
+	mark_rates();
+}
+
+void stats_cleanup(void)
+{
+	while (index_list) {
+		struct index_stats *stats = index_list;
+
+		index_list = stats->next;
+
+		while (stats->conns) {
+			struct conn_stats *conn = stats->conns;
+
+			stats->conns = conn->next;
+
+			while (conn->cids) {
+				struct cid_stats *cid = conn->cids;
+
+				conn->cids = cid->next;
+				free(cid);
+			}
+
+			free(conn);
+		}
+
+		while (stats->opcodes) {
+			struct opcode_stats *op = stats->opcodes;
+
+			stats->opcodes = op->next;
+			free(op);
+		}
+
+		free(stats);
+	}
+
+	memset(&stats_mark, 0, sizeof(stats_mark));
+	memset(&stats_now, 0, sizeof(stats_now));
+}
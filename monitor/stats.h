@@ -0,0 +1,41 @@
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *  Copyright (C) 2011-2012  Intel Corporation
+ *  Copyright (C) 2004-2010  Marcel Holtmann <marcel@holtmann.org>
+ *
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <sys/time.h>
+
+void stats_enable(bool json);
+
+void stats_command(struct timeval *tv, uint16_t index,
+					const void *data, uint16_t size);
+void stats_event(struct timeval *tv, uint16_t index,
+					const void *data, uint16_t size);
+void stats_acldata(struct timeval *tv, uint16_t index, bool in,
+					const void *data, uint16_t size);
+void stats_scodata(struct timeval *tv, uint16_t index, bool in,
+					const void *data, uint16_t size);
+
+void stats_print(void);
+void stats_cleanup(void);
@@ -41,6 +41,7 @@
 #include <glib.h>
 
 #include "glib-compat.h"
+#include "glib-helper.h"
 #include "hcid.h"
 #include "sdpd.h"
 #include "btio.h"
@@ -65,7 +66,14 @@
 #define LENGTH_BR_INQ 0x08
 #define LENGTH_BR_LE_INQ 0x04
 
+#define MAX_NAME_REQS 2 /* Remote Name Requests in flight */
+#define MAX_NAME_ATTEMPTS 3
+#define NAME_STALE_CYCLES 1 /* inquiries a device may be missing from */
+#define NAME_PHASE_TIMEOUT 10 /* seconds of name resolution per cycle */
+
 static int start_scanning(int index, int timeout);
+static void set_state(int index, int state);
+static void init_step_done(int index, int bit);
 
 static int child_pipe[2] = { -1, -1 };
 
@@ -79,12 +87,14 @@ enum adapter_type {
 	UNKNOWN,
 };
 
-/* Commands sent by kernel on starting an adapter */
+/* Commands sent by kernel on starting an adapter, plus the ones
+ * init_steps adds on top of them */
 enum {
 	PENDING_BDADDR,
 	PENDING_VERSION,
 	PENDING_FEATURES,
 	PENDING_NAME,
+	PENDING_EXT_FEATURES,
 };
 
 struct bt_conn {
@@ -118,6 +128,10 @@ struct found_dev {
 	bdaddr_t bdaddr;
 	int8_t rssi;
 	enum name_state name_state;
+	unsigned int cycle;	/* last inquiry the device was seen in */
+	uint8_t attempts;	/* failed name requests */
+	gboolean cancelled;	/* pending request cancelled by timeout */
+	gboolean waiting;	/* a D-Bus client waits for the device */
 };
 
 static int max_dev = -1;
@@ -153,6 +167,9 @@ static struct dev_info {
 
 	gboolean up;
 	uint32_t pending;
+	uint32_t init_sent;	/* pending bits with a command queued */
+	GTimer *init_timer;
+	struct hci_cmd_queue *cmdq;
 
 	GIOChannel *io;
 	guint watch_id;
@@ -166,9 +183,18 @@ static struct dev_info {
 	GSList *uuids;
 
 	GSList *connections;
+	GHashTable *conn_by_handle;
+	GHashTable *conn_by_addr;
 
 	GSList *found_devs;
 	GSList *need_name;
+	GSList *name_sent;	/* name requests without Command Status */
+	unsigned int name_reqs;
+	unsigned int name_reqs_max;
+	unsigned int discov_cycle;
+	gboolean names_active;
+	gboolean names_expired;
+	guint name_timeout_id;
 
 	guint stop_scan_id;
 
@@ -204,6 +230,17 @@ static void found_dev_cleanup(struct dev_info *info)
 
 	g_slist_free_full(info->need_name, g_free);
 	info->need_name = NULL;
+
+	g_slist_free(info->name_sent);
+	info->name_sent = NULL;
+	info->name_reqs = 0;
+
+	if (info->name_timeout_id > 0) {
+		g_source_remove(info->name_timeout_id);
+		info->name_timeout_id = 0;
+	}
+
+	info->names_active = FALSE;
 }
 
 static int resolve_name(struct dev_info *info, bdaddr_t *bdaddr)
@@ -225,21 +262,209 @@ static int resolve_name(struct dev_info *info, bdaddr_t *bdaddr)
 	return 0;
 }
 
-static int resolve_names(struct dev_info *info, struct btd_adapter *adapter)
+static int cancel_name(struct dev_info *info, bdaddr_t *bdaddr)
 {
-	struct found_dev *dev;
+	remote_name_req_cancel_cp cp;
+
+	memset(&cp, 0, sizeof(cp));
+	bacpy(&cp.bdaddr, bdaddr);
+
+	if (hci_send_cmd(info->sk, OGF_LINK_CTL, OCF_REMOTE_NAME_REQ_CANCEL,
+				REMOTE_NAME_REQ_CANCEL_CP_SIZE, &cp) < 0)
+		return -errno;
+
+	return 0;
+}
+
+/* Devices a D-Bus client is creating or pairing with go first, then the
+ * ones that failed the least and finally the strongest signals */
+static int name_prio_cmp(gconstpointer a, gconstpointer b)
+{
+	const struct found_dev *d1 = a, *d2 = b;
+	int rssi1, rssi2;
+
+	if (d1->waiting != d2->waiting)
+		return d1->waiting ? -1 : 1;
+
+	if (d1->attempts != d2->attempts)
+		return d1->attempts - d2->attempts;
+
+	rssi1 = d1->rssi < 0 ? -d1->rssi : d1->rssi;
+	rssi2 = d2->rssi < 0 ? -d2->rssi : d2->rssi;
+
+	return rssi1 - rssi2;
+}
+
+static void update_name_priorities(struct dev_info *info)
+{
+	struct btd_adapter *adapter;
+	GSList *l;
+
+	adapter = manager_find_adapter_by_id(info->id);
+
+	for (l = info->need_name; l != NULL; l = g_slist_next(l)) {
+		struct found_dev *dev = l->data;
+		struct btd_device *device;
+		char addr[18];
+
+		dev->waiting = FALSE;
 
-	DBG("found_dev %u need_name %u", g_slist_length(info->found_devs),
+		if (adapter == NULL)
+			continue;
+
+		ba2str(&dev->bdaddr, addr);
+
+		device = adapter_find_device(adapter, addr);
+		if (device == NULL)
+			continue;
+
+		dev->waiting = device_is_creating(device, NULL) ||
+					device_is_bonding(device, NULL);
+	}
+
+	info->need_name = g_slist_sort(info->need_name, name_prio_cmp);
+}
+
+static void names_finished(struct dev_info *info)
+{
+	DBG("hci%d %u names left for the next cycle", info->id,
 					g_slist_length(info->need_name));
 
-	if (g_slist_length(info->need_name) == 0)
-		return -ENOENT;
+	if (info->name_timeout_id > 0) {
+		g_source_remove(info->name_timeout_id);
+		info->name_timeout_id = 0;
+	}
 
-	dev = info->need_name->data;
-	resolve_name(info, &dev->bdaddr);
-	dev->name_state = NAME_PENDING;
+	info->names_active = FALSE;
 
-	return 0;
+	if (info->discov_state == DISCOV_NAMES)
+		set_state(info->id, DISCOV_HALTED);
+}
+
+/* Keeps up to name_reqs_max Remote Name Requests in flight */
+static void resolve_names(struct dev_info *info)
+{
+	GSList *l;
+
+	if (!info->names_active)
+		return;
+
+	if (!info->names_expired)
+		update_name_priorities(info);
+
+	for (l = info->need_name; l != NULL && !info->names_expired &&
+				info->name_reqs < info->name_reqs_max;
+						l = g_slist_next(l)) {
+		struct found_dev *dev = l->data;
+
+		if (dev->name_state != NAME_NEEDED)
+			continue;
+
+		if (resolve_name(info, &dev->bdaddr) < 0)
+			break;
+
+		dev->name_state = NAME_PENDING;
+		info->name_reqs++;
+		info->name_sent = g_slist_append(info->name_sent, dev);
+	}
+
+	DBG("found_dev %u need_name %u pending %u",
+					g_slist_length(info->found_devs),
+					g_slist_length(info->need_name),
+					info->name_reqs);
+
+	if (info->name_reqs == 0)
+		names_finished(info);
+}
+
+static void name_resolved(struct dev_info *info, GSList *match,
+							uint8_t status)
+{
+	struct found_dev *dev = match->data;
+	gboolean cancelled = dev->cancelled;
+
+	info->name_reqs--;
+	dev->cancelled = FALSE;
+
+	/* Requests cut short by the name phase timeout did not fail */
+	if (status != 0 && (cancelled ||
+				++dev->attempts < MAX_NAME_ATTEMPTS)) {
+		/* Retried later on, behind the devices not tried yet */
+		dev->name_state = NAME_NEEDED;
+		goto done;
+	}
+
+	dev->name_state = NAME_NOT_NEEDED;
+
+	info->need_name = g_slist_remove_link(info->need_name, match);
+
+	match->next = info->found_devs;
+	info->found_devs = match;
+	info->found_devs = g_slist_sort(info->found_devs, found_dev_rssi_cmp);
+
+done:
+	resolve_names(info);
+}
+
+static gboolean names_timeout(gpointer user_data)
+{
+	struct dev_info *info = &devs[GPOINTER_TO_INT(user_data)];
+	GSList *l;
+
+	DBG("hci%d", info->id);
+
+	info->name_timeout_id = 0;
+	info->names_expired = TRUE;
+
+	/* Leave the controller to the next inquiry; pending requests
+	 * complete with an error and are retried in the next cycle */
+	for (l = info->need_name; l != NULL; l = g_slist_next(l)) {
+		struct found_dev *dev = l->data;
+
+		if (dev->name_state != NAME_PENDING)
+			continue;
+
+		cancel_name(info, &dev->bdaddr);
+		dev->cancelled = TRUE;
+	}
+
+	if (info->name_reqs == 0)
+		names_finished(info);
+
+	return FALSE;
+}
+
+/* Returns TRUE if name resolution goes on in the background */
+static gboolean start_names(struct dev_info *info)
+{
+	GSList *l, *next;
+
+	if (info->names_active)
+		return TRUE;
+
+	for (l = info->need_name; l != NULL; l = next) {
+		struct found_dev *dev = l->data;
+
+		next = g_slist_next(l);
+
+		if (info->discov_cycle - dev->cycle <= NAME_STALE_CYCLES)
+			continue;
+
+		info->need_name = g_slist_delete_link(info->need_name, l);
+		g_free(dev);
+	}
+
+	if (info->need_name == NULL)
+		return FALSE;
+
+	info->names_active = TRUE;
+	info->names_expired = FALSE;
+	info->name_timeout_id = g_timeout_add_seconds(NAME_PHASE_TIMEOUT,
+				names_timeout, GINT_TO_POINTER(info->id));
+
+	resolve_names(info);
+
+	return info->names_active;
 }
 
 static void set_state(int index, int state)
@@ -262,15 +487,19 @@ static void set_state(int index, int state)
 
 	switch (dev->discov_state) {
 	case DISCOV_HALTED:
-		found_dev_cleanup(dev);
+		/* Unresolved names are carried over to the next cycle */
+		g_slist_free_full(dev->found_devs, g_free);
+		dev->found_devs = NULL;
 		adapter_set_discovering(adapter, FALSE);
 		break;
 	case DISCOV_INQ:
+		dev->discov_cycle++;
+		/* fall through */
 	case DISCOV_SCAN:
 		adapter_set_discovering(adapter, TRUE);
 		break;
 	case DISCOV_NAMES:
-		if (resolve_names(dev, adapter) < 0)
+		if (!dev->names_active)
 			set_state(index, DISCOV_HALTED);
 		break;
 	}
@@ -322,6 +551,14 @@ static struct dev_info *init_dev_info(int index, int sk, gboolean registered,
 	dev->already_up = already_up;
 	dev->io_capability = 0x03; /* No Input No Output */
 	dev->discov_state = DISCOV_HALTED;
+	dev->name_reqs_max = MAX_NAME_REQS;
+
+	/* Keys point into the bt_conn entries owned by dev->connections */
+	dev->conn_by_handle = g_hash_table_new(g_direct_hash, g_direct_equal);
+	dev->conn_by_addr = g_hash_table_new(bt_bdaddr_hash, bt_bdaddr_equal);
+
+	if (sk >= 0)
+		dev->cmdq = hci_cmd_queue_new(sk);
 
 	return dev;
 }
@@ -901,44 +1138,46 @@ static int hciops_set_did(int index, uint16_t vendor, uint16_t product,
 
 /* Start of HCI event callbacks */
 
-static gint conn_handle_cmp(gconstpointer a, gconstpointer b)
+static struct bt_conn *find_conn_by_handle(struct dev_info *dev,
+							uint16_t handle)
 {
-	const struct bt_conn *conn = a;
-	uint16_t handle = *((const uint16_t *) b);
+	if (dev->conn_by_handle == NULL)
+		return NULL;
 
-	return (int) conn->handle - (int) handle;
+	return g_hash_table_lookup(dev->conn_by_handle,
+						GUINT_TO_POINTER(handle));
 }
 
-static struct bt_conn *find_conn_by_handle(struct dev_info *dev,
-							uint16_t handle)
+static struct bt_conn *find_connection(struct dev_info *dev, bdaddr_t *bdaddr)
 {
-	GSList *match;
-
-	match = g_slist_find_custom(dev->connections, &handle,
-							conn_handle_cmp);
-	if (match)
-		return match->data;
+	if (dev->conn_by_addr == NULL)
+		return NULL;
 
-	return NULL;
+	return g_hash_table_lookup(dev->conn_by_addr, bdaddr);
 }
 
-static gint conn_bdaddr_cmp(gconstpointer a, gconstpointer b)
+static void set_conn_handle(struct dev_info *dev, struct bt_conn *conn,
+							uint16_t handle)
 {
-	const struct bt_conn *conn = a;
-	const bdaddr_t *bdaddr = b;
+	if (find_conn_by_handle(dev, conn->handle) == conn)
+		g_hash_table_remove(dev->conn_by_handle,
+					GUINT_TO_POINTER(conn->handle));
+
+	conn->handle = handle;
 
-	return bacmp(&conn->bdaddr, bdaddr);
+	g_hash_table_replace(dev->conn_by_handle, GUINT_TO_POINTER(handle),
+									conn);
 }
 
-static struct bt_conn *find_connection(struct dev_info *dev, bdaddr_t *bdaddr)
+static void remove_connection(struct dev_info *dev, struct bt_conn *conn)
 {
-	GSList *match;
+	if (find_conn_by_handle(dev, conn->handle) == conn)
+		g_hash_table_remove(dev->conn_by_handle,
+					GUINT_TO_POINTER(conn->handle));
 
-	match = g_slist_find_custom(dev->connections, bdaddr, conn_bdaddr_cmp);
-	if (match)
-		return match->data;
+	g_hash_table_remove(dev->conn_by_addr, &conn->bdaddr);
 
-	return NULL;
+	dev->connections = g_slist_remove(dev->connections, conn);
 }
 
 static struct bt_conn *get_connection(struct dev_info *dev, bdaddr_t *bdaddr)
@@ -957,7 +1196,8 @@ static struct bt_conn *get_connection(struct dev_info *dev, bdaddr_t *bdaddr)
 	conn->rem_auth = 0xff;
 	bacpy(&conn->bdaddr, bdaddr);
 
-	dev->connections = g_slist_append(dev->connections, conn);
+	dev->connections = g_slist_prepend(dev->connections, conn);
+	g_hash_table_insert(dev->conn_by_addr, &conn->bdaddr, conn);
 
 	return conn;
 }
@@ -1564,6 +1804,118 @@ static inline void remote_features_notify(int index, void *ptr)
 	write_features_info(&dev->bdaddr, &evt->bdaddr, NULL, evt->features);
 }
 
+/* Adapter initialisation as a dependency graph: every step answers one
+ * pending bit and is queued as soon as the step it depends on is done,
+ * so independent reads are pipelined up to the controller's command
+ * credits. init_adapter runs once no bit is left. */
+static const struct init_step {
+	int bit;
+	int after;	/* pending bit that must be cleared first, or -1 */
+	uint16_t ogf;
+	uint16_t ocf;
+} init_steps[] = {
+	{ PENDING_FEATURES, -1, OGF_INFO_PARAM, OCF_READ_LOCAL_FEATURES },
+	{ PENDING_VERSION, -1, OGF_INFO_PARAM, OCF_READ_LOCAL_VERSION },
+	{ PENDING_NAME, -1, OGF_HOST_CTL, OCF_READ_LOCAL_NAME },
+	{ PENDING_BDADDR, -1, OGF_INFO_PARAM, OCF_READ_BD_ADDR },
+	{ PENDING_EXT_FEATURES, PENDING_FEATURES, OGF_INFO_PARAM,
+						OCF_READ_LOCAL_EXT_FEATURES },
+	{ }
+};
+
+static void init_step_status(uint16_t opcode, uint8_t status,
+				const void *param, uint8_t plen,
+				void *user_data)
+{
+	int index = GPOINTER_TO_INT(user_data);
+	const struct init_step *step;
+
+	/* Results are handled by cmd_complete like any other event */
+	if (!status)
+		return;
+
+	error("hci%d init command 0x%04x failed: status 0x%02x",
+						index, opcode, status);
+
+	/* No result is coming, so initialisation goes on without it */
+	for (step = init_steps; step->ocf; step++) {
+		if (cmd_opcode_pack(step->ogf, step->ocf) == opcode) {
+			init_step_done(index, step->bit);
+			break;
+		}
+	}
+}
+
+static void init_steps_run(int index)
+{
+	struct dev_info *dev = &devs[index];
+	const struct init_step *step;
+
+	if (!dev->up)
+		return;
+
+	for (step = init_steps; step->ocf; step++) {
+		uint8_t page_num = 0x01;
+		uint8_t plen = 0;
+
+		if (!hci_test_bit(step->bit, &dev->pending))
+			continue;
+
+		if (hci_test_bit(step->bit, &dev->init_sent))
+			continue;
+
+		if (step->after >= 0 &&
+				hci_test_bit(step->after, &dev->pending))
+			continue;
+
+		if (step->bit == PENDING_EXT_FEATURES) {
+			if (!(dev->features[7] & LMP_EXT_FEAT)) {
+				hci_clear_bit(step->bit, &dev->pending);
+				continue;
+			}
+
+			plen = 1;
+		}
+
+		if (hci_cmd_queue_send(dev->cmdq, step->ogf, step->ocf, plen,
+					&page_num, init_step_status,
+					GINT_TO_POINTER(index)) < 0) {
+			error("Unable to queue init command on hci%d: %s (%d)",
+						index, strerror(errno), errno);
+			/* Nothing would retry it, so don't wait for it */
+			hci_clear_bit(step->bit, &dev->pending);
+			continue;
+		}
+
+		hci_set_bit(step->bit, &dev->init_sent);
+	}
+
+	if (dev->pending)
+		return;
+
+	if (dev->init_timer) {
+		info("hci%d initialized in %.1f ms", index,
+			g_timer_elapsed(dev->init_timer, NULL) * 1000);
+		g_timer_destroy(dev->init_timer);
+		dev->init_timer = NULL;
+	}
+
+	init_adapter(index);
+}
+
+static void init_step_done(int index, int bit)
+{
+	struct dev_info *dev = &devs[index];
+
+	if (!hci_test_bit(bit, &dev->pending))
+		return;
+
+	hci_clear_bit(bit, &dev->pending);
+	hci_clear_bit(bit, &dev->init_sent);
+
+	init_steps_run(index);
+}
+
 static void read_local_version_complete(int index,
 				const read_local_version_rp *rp)
 {
@@ -1578,15 +1930,9 @@ static void read_local_version_complete(int index,
 	dev->ver.lmp_ver = rp->lmp_ver;
 	dev->ver.lmp_subver = btohs(bt_get_unaligned(&rp->lmp_subver));
 
-	if (!dev->pending)
-		return;
-
-	hci_clear_bit(PENDING_VERSION, &dev->pending);
-
 	DBG("Got version for hci%d", index);
 
-	if (!dev->pending && dev->up)
-		init_adapter(index);
+	init_step_done(index, PENDING_VERSION);
 }
 
 static void read_local_features_complete(int index,
@@ -1599,15 +1945,9 @@ static void read_local_features_complete(int index,
 
 	memcpy(dev->features, rp->features, 8);
 
-	if (!dev->pending)
-		return;
-
-	hci_clear_bit(PENDING_FEATURES, &dev->pending);
-
 	DBG("Got features for hci%d", index);
 
-	if (!dev->pending && dev->up)
-		init_adapter(index);
+	init_step_done(index, PENDING_FEATURES);
 }
 
 static void update_name(int index, const char *name)
@@ -1632,17 +1972,14 @@ static void read_local_name_complete(int index, read_local_name_rp *rp)
 
 	memcpy(dev->name, rp->name, 248);
 
-	if (!dev->pending) {
+	if (!hci_test_bit(PENDING_NAME, &dev->pending)) {
 		update_name(index, (char *) rp->name);
 		return;
 	}
 
-	hci_clear_bit(PENDING_NAME, &dev->pending);
-
 	DBG("Got name for hci%d", index);
 
-	if (!dev->pending && dev->up)
-		init_adapter(index);
+	init_step_done(index, PENDING_NAME);
 }
 
 static void read_tx_power_complete(int index, void *ptr)
@@ -1681,14 +2018,18 @@ static void read_local_ext_features_complete(int index,
 
 	DBG("hci%d status %u", index, rp->status);
 
+	/* Initialisation goes on without the extended features */
 	if (rp->status)
-		return;
+		goto done;
 
 	/* Local Extended feature page number is 1 */
 	if (rp->page_num != 1)
-		return;
+		goto done;
 
 	memcpy(dev->extfeatures, rp->features, sizeof(dev->extfeatures));
+
+done:
+	init_step_done(index, PENDING_EXT_FEATURES);
 }
 
 static void read_bd_addr_complete(int index, read_bd_addr_rp *rp)
@@ -1702,15 +2043,9 @@ static void read_bd_addr_complete(int index, read_bd_addr_rp *rp)
 
 	bacpy(&dev->bdaddr, &rp->bdaddr);
 
-	if (!dev->pending)
-		return;
-
-	hci_clear_bit(PENDING_BDADDR, &dev->pending);
-
 	DBG("Got bdaddr for hci%d", index);
 
-	if (!dev->pending && dev->up)
-		init_adapter(index);
+	init_step_done(index, PENDING_BDADDR);
 }
 
 static inline void cs_inquiry_evt(int index, uint8_t status)
@@ -1723,13 +2058,51 @@ static inline void cs_inquiry_evt(int index, uint8_t status)
 	set_state(index, DISCOV_INQ);
 }
 
+static inline void cs_remote_name_req(int index, uint8_t status)
+{
+	struct dev_info *dev = &devs[index];
+	struct found_dev *found;
+	GSList *match;
+
+	if (dev->name_sent == NULL)
+		return;
+
+	/* Command Status events come in the order the requests were sent */
+	found = dev->name_sent->data;
+	dev->name_sent = g_slist_delete_link(dev->name_sent, dev->name_sent);
+
+	if (status == 0)
+		return;
+
+	DBG("hci%d status 0x%02x with %u requests", index, status,
+							dev->name_reqs);
+
+	switch (status) {
+	case HCI_COMMAND_DISALLOWED:
+	case HCI_MEMORY_FULL:
+	case HCI_MAX_NUMBER_OF_CONNECTIONS:
+		dev->name_reqs_max = MAX(dev->name_reqs - 1, 1);
+		break;
+	}
+
+	match = g_slist_find(dev->need_name, found);
+	if (match)
+		name_resolved(dev, match, status);
+}
+
 static inline void cmd_status(int index, void *ptr)
 {
 	evt_cmd_status *evt = ptr;
 	uint16_t opcode = btohs(evt->opcode);
 
-	if (opcode == cmd_opcode_pack(OGF_LINK_CTL, OCF_INQUIRY))
+	switch (opcode) {
+	case cmd_opcode_pack(OGF_LINK_CTL, OCF_INQUIRY):
 		cs_inquiry_evt(index, evt->status);
+		break;
+	case cmd_opcode_pack(OGF_LINK_CTL, OCF_REMOTE_NAME_REQ):
+		cs_remote_name_req(index, evt->status);
+		break;
+	}
 }
 
 static gboolean discoverable_timeout_handler(gpointer user_data)
@@ -1886,6 +2259,7 @@ static void read_local_oob_data_complete(int index, uint8_t status,
 
 static inline void inquiry_complete_evt(int index, uint8_t status)
 {
+	struct dev_info *dev = &devs[index];
 	int adapter_type;
 	struct btd_adapter *adapter;
 
@@ -1900,6 +2274,9 @@ static inline void inquiry_complete_evt(int index, uint8_t status)
 		return;
 	}
 
+	/* Names are resolved while LE scanning goes on */
+	start_names(dev);
+
 	adapter_type = get_adapter_type(index);
 
 	if (adapter_type == BR_EDR_LE &&
@@ -1929,7 +2306,7 @@ static inline void cc_le_set_scan_enable(int index, uint8_t status)
 	}
 
 	if (info->discov_state == DISCOV_SCAN)
-		set_state(index, DISCOV_HALTED);
+		set_state(index, DISCOV_NAMES);
 	else
 		set_state(index, DISCOV_SCAN);
 }
@@ -2009,10 +2386,8 @@ static inline void remote_name_information(int index, void *ptr)
 {
 	struct dev_info *dev = &devs[index];
 	evt_remote_name_req_complete *evt = ptr;
-	struct btd_adapter *adapter;
 	char name[MAX_NAME_LENGTH + 1];
 	struct found_dev *found;
-
 	GSList *match;
 
 	DBG("hci%d status %u", index, evt->status);
@@ -2024,28 +2399,19 @@ static inline void remote_name_information(int index, void *ptr)
 		btd_event_remote_name(&dev->bdaddr, &evt->bdaddr, name);
 	}
 
-	adapter = manager_find_adapter_by_id(index);
-	if (!adapter) {
-		error("No matching adapter found");
-		return;
-	}
-
 	match = g_slist_find_custom(dev->need_name, &evt->bdaddr,
 							found_dev_bda_cmp);
 	if (match == NULL)
 		return;
 
 	found = match->data;
-	found->name_state = NAME_NOT_NEEDED;
-
-	dev->need_name = g_slist_remove_link(dev->need_name, match);
+	if (found->name_state != NAME_PENDING)
+		return;
 
-	match->next = dev->found_devs;
-	dev->found_devs = match;
-	dev->found_devs = g_slist_sort(dev->found_devs, found_dev_rssi_cmp);
+	/* Completion before Command Status: nothing left to match */
+	dev->name_sent = g_slist_remove(dev->name_sent, found);
 
-	if (resolve_names(dev, adapter) < 0)
-		set_state(index, DISCOV_HALTED);
+	name_resolved(dev, match, evt->status);
 }
 
 static inline void remote_version_information(int index, void *ptr)
@@ -2081,9 +2447,20 @@ static void dev_found(struct dev_info *info, bdaddr_t *dba, addr_type_t type,
 		goto event;
 	}
 
+	/* Still waiting for its name since an earlier cycle */
+	match = g_slist_find_custom(info->need_name, dba, found_dev_bda_cmp);
+	if (match != NULL) {
+		dev = match->data;
+		dev->rssi = rssi;
+		dev->cycle = info->discov_cycle;
+		cfm_name = 0;
+		goto event;
+	}
+
 	dev = g_new0(struct found_dev, 1);
 	bacpy(&dev->bdaddr, dba);
 	dev->rssi = rssi;
+	dev->cycle = info->discov_cycle;
 	if (cfm_name)
 		dev->name_state = NAME_UNKNOWN;
 	else
@@ -2253,7 +2630,7 @@ static inline void conn_failed(int index, bdaddr_t *bdaddr, uint8_t status)
 
 	bonding_complete(dev, conn, status);
 
-	dev->connections = g_slist_remove(dev->connections, conn);
+	remove_connection(dev, conn);
 	conn_free(conn);
 }
 
@@ -2276,7 +2653,7 @@ static inline void conn_complete(int index, void *ptr)
 	}
 
 	conn = get_connection(dev, &evt->bdaddr);
-	conn->handle = btohs(evt->handle);
+	set_conn_handle(dev, conn, btohs(evt->handle));
 
 	btd_event_conn_complete(&dev->bdaddr, &evt->bdaddr, ADDR_TYPE_BREDR,
 								NULL, NULL);
@@ -2325,7 +2702,7 @@ static inline void le_conn_complete(int index, void *ptr)
 	}
 
 	conn = get_connection(dev, &evt->peer_bdaddr);
-	conn->handle = btohs(evt->handle);
+	set_conn_handle(dev, conn, btohs(evt->handle));
 
 	type = le_addr_type(evt->peer_bdaddr_type);
 	btd_event_conn_complete(&dev->bdaddr, &evt->peer_bdaddr, type,
@@ -2360,7 +2737,7 @@ static inline void disconn_complete(int index, void *ptr)
 	if (conn == NULL)
 		return;
 
-	dev->connections = g_slist_remove(dev->connections, conn);
+	remove_connection(dev, conn);
 
 	btd_event_disconn_complete(&dev->bdaddr, &conn->bdaddr);
 
@@ -2467,10 +2844,18 @@ static void stop_hci_dev(int index)
 
 	hci_close_dev(dev->sk);
 
+	found_dev_cleanup(dev);
+
 	g_slist_free_full(dev->keys, g_free);
 	g_slist_free_full(dev->uuids, g_free);
+	g_hash_table_destroy(dev->conn_by_handle);
+	g_hash_table_destroy(dev->conn_by_addr);
 	g_slist_free_full(dev->connections, g_free);
 
+	hci_cmd_queue_free(dev->cmdq);
+	if (dev->init_timer)
+		g_timer_destroy(dev->init_timer);
+
 	init_dev_info(index, -1, dev->registered, dev->already_up);
 }
 
@@ -2506,6 +2891,12 @@ static gboolean io_security_event(GIOChannel *chan, GIOCondition cond,
 	if (type != HCI_EVENT_PKT)
 		return TRUE;
 
+	/* Hand out credits to queued commands before the event itself
+	 * is handled below */
+	if (hci_cmd_queue_process(dev->cmdq, buf, len) < 0)
+		error("Unable to send queued commands on hci%d: %s (%d)",
+						index, strerror(errno), errno);
+
 	eh = (hci_event_hdr *) ptr;
 	ptr += HCI_EVENT_HDR_SIZE;
 
@@ -2728,52 +3119,32 @@ static void device_devup_setup(int index)
 	bacpy(&dev->bdaddr, &di.bdaddr);
 	memcpy(dev->features, di.features, 8);
 
-	if (dev->features[7] & LMP_EXT_FEAT) {
-		uint8_t page_num = 0x01;
-
-		hci_send_cmd(dev->sk, OGF_INFO_PARAM,
-				OCF_READ_LOCAL_EXT_FEATURES, 1, &page_num);
-	}
+	if (dev->init_timer == NULL)
+		dev->init_timer = g_timer_new();
 
 	/* Set page timeout */
 	if ((main_opts.flags & (1 << HCID_SET_PAGETO))) {
 		write_page_timeout_cp cp;
 
 		cp.timeout = htobs(main_opts.pageto);
-		hci_send_cmd(dev->sk, OGF_HOST_CTL, OCF_WRITE_PAGE_TIMEOUT,
-					WRITE_PAGE_TIMEOUT_CP_SIZE, &cp);
+		hci_cmd_queue_send(dev->cmdq, OGF_HOST_CTL,
+					OCF_WRITE_PAGE_TIMEOUT,
+					WRITE_PAGE_TIMEOUT_CP_SIZE, &cp,
+					NULL, NULL);
 	}
 
 	bacpy(&cp.bdaddr, BDADDR_ANY);
 	cp.read_all = 1;
-	hci_send_cmd(dev->sk, OGF_HOST_CTL, OCF_READ_STORED_LINK_KEY,
-					READ_STORED_LINK_KEY_CP_SIZE, &cp);
-
-	if (!dev->pending) {
-		init_adapter(index);
-		return;
-	}
+	hci_cmd_queue_send(dev->cmdq, OGF_HOST_CTL, OCF_READ_STORED_LINK_KEY,
+					READ_STORED_LINK_KEY_CP_SIZE, &cp,
+					NULL, NULL);
 
 	/* Even though it shouldn't happen (assuming the kernel behaves
 	 * properly) it seems like we might miss the very first
-	 * initialization commands that the kernel sends. So check for
-	 * it here and resend the ones we haven't seen their results yet */
-
-	if (hci_test_bit(PENDING_FEATURES, &dev->pending))
-		hci_send_cmd(dev->sk, OGF_INFO_PARAM,
-					OCF_READ_LOCAL_FEATURES, 0, NULL);
-
-	if (hci_test_bit(PENDING_VERSION, &dev->pending))
-		hci_send_cmd(dev->sk, OGF_INFO_PARAM,
-					OCF_READ_LOCAL_VERSION, 0, NULL);
-
-	if (hci_test_bit(PENDING_NAME, &dev->pending))
-		hci_send_cmd(dev->sk, OGF_HOST_CTL,
-					OCF_READ_LOCAL_NAME, 0, 0);
-
-	if (hci_test_bit(PENDING_BDADDR, &dev->pending))
-		hci_send_cmd(dev->sk, OGF_INFO_PARAM,
-					OCF_READ_BD_ADDR, 0, NULL);
+	 * initialization commands that the kernel sends. So resend the
+	 * ones we haven't seen their results yet */
+	dev->init_sent = 0;
+	init_steps_run(index);
 }
 
 static void init_pending(int index)
@@ -2784,6 +3155,8 @@ static void init_pending(int index)
 	hci_set_bit(PENDING_VERSION, &dev->pending);
 	hci_set_bit(PENDING_FEATURES, &dev->pending);
 	hci_set_bit(PENDING_NAME, &dev->pending);
+	hci_set_bit(PENDING_EXT_FEATURES, &dev->pending);
+	dev->init_sent = 0;
 }
 
 static struct dev_info *init_device(int index, gboolean already_up)
@@ -2815,6 +3188,8 @@ static struct dev_info *init_device(int index, gboolean already_up)
 	if (already_up)
 		return dev;
 
+	dev->init_timer = g_timer_new();
+
 	/* Do initialization in the separate process */
 	pid = fork();
 	switch (pid) {
@@ -2881,7 +3256,7 @@ static void init_conn_list(int index)
 			continue;
 
 		conn = get_connection(dev, &ci->bdaddr);
-		conn->handle = ci->handle;
+		set_conn_handle(dev, conn, ci->handle);
 	}
 
 failed:
@@ -2916,6 +3291,16 @@ static void device_event(int event, int index)
 		devs[index].cache_enable = TRUE;
 		devs[index].discov_state = DISCOV_HALTED;
 		reset_discoverable_timeout(index);
+
+		/* Commands left with the controller will never complete */
+		hci_cmd_queue_free(devs[index].cmdq);
+		devs[index].cmdq = hci_cmd_queue_new(devs[index].sk);
+
+		if (devs[index].init_timer) {
+			g_timer_destroy(devs[index].init_timer);
+			devs[index].init_timer = NULL;
+		}
+
 		if (!devs[index].pending) {
 			struct btd_adapter *adapter;
 
@@ -2971,10 +3356,11 @@ static gboolean init_known_adapters(gpointer user_data)
 
 		init_conn_list(dr->dev_id);
 
+		/* Address and features come from the kernel; the rest is
+		 * read in parallel for all adapters by device_devup_setup */
 		dev->pending = 0;
 		hci_set_bit(PENDING_VERSION, &dev->pending);
-		hci_send_cmd(dev->sk, OGF_INFO_PARAM,
-					OCF_READ_LOCAL_VERSION, 0, NULL);
+		hci_set_bit(PENDING_EXT_FEATURES, &dev->pending);
 		device_event(HCI_DEV_UP, dr->dev_id);
 	}
 
@@ -3248,36 +3634,21 @@ static int hciops_stop_scanning(int index)
 	return le_set_scan_enable(index, 0);
 }
 
-static int cancel_resolve_name(int index)
+static void cancel_resolve_name(int index)
 {
 	struct dev_info *info = &devs[index];
-	struct found_dev *dev;
-	remote_name_req_cancel_cp cp;
-	struct btd_adapter *adapter;
+	GSList *l;
 
 	DBG("hci%d", index);
 
-	if (g_slist_length(info->need_name) == 0)
-		return 0;
-
-	dev = info->need_name->data;
-	if (dev->name_state != NAME_PENDING)
-		return 0;
+	for (l = info->need_name; l != NULL; l = g_slist_next(l)) {
+		struct found_dev *dev = l->data;
 
-	memset(&cp, 0, sizeof(cp));
-	bacpy(&cp.bdaddr, &dev->bdaddr);
-
-	adapter = manager_find_adapter_by_id(index);
-	if (adapter)
-		adapter_set_discovering(adapter, FALSE);
+		if (dev->name_state == NAME_PENDING)
+			cancel_name(info, &dev->bdaddr);
+	}
 
 	found_dev_cleanup(info);
-
-	if (hci_send_cmd(info->sk, OGF_LINK_CTL, OCF_REMOTE_NAME_REQ_CANCEL,
-				REMOTE_NAME_REQ_CANCEL_CP_SIZE, &cp) < 0)
-		return -errno;
-
-	return 0;
 }
 
 static int hciops_start_discovery(int index)
@@ -3304,13 +3675,20 @@ static int hciops_stop_discovery(int index)
 
 	DBG("index %d", index);
 
+	/* Also drops the names carried over between cycles */
+	cancel_resolve_name(index);
+
+	/* The controller limit is probed again by the next discovery */
+	dev->name_reqs_max = MAX_NAME_REQS;
+
 	switch (dev->discov_state) {
 	case DISCOV_INQ:
 		return hciops_stop_inquiry(index);
 	case DISCOV_SCAN:
 		return hciops_stop_scanning(index);
 	case DISCOV_NAMES:
-		cancel_resolve_name(index);
+		set_state(index, DISCOV_HALTED);
+		return 0;
 	default:
 		return -EINVAL;
 	}
@@ -3854,6 +4232,22 @@ static int hciops_confirm_name(int index, bdaddr_t *bdaddr, addr_type_t type,
 
 	match = g_slist_find_custom(info->found_devs, bdaddr,
 						found_dev_bda_cmp);
+	if (match == NULL && name_known) {
+		/* Learnt the name since an earlier cycle */
+		match = g_slist_find_custom(info->need_name, bdaddr,
+							found_dev_bda_cmp);
+		if (match == NULL)
+			return -ENOENT;
+
+		dev = match->data;
+		if (dev->name_state == NAME_PENDING)
+			return 0;
+
+		info->need_name = g_slist_remove_link(info->need_name, match);
+		match->next = info->found_devs;
+		info->found_devs = match;
+	}
+
 	if (match == NULL)
 		return -ENOENT;
 
@@ -52,6 +52,8 @@
 #include "glib-compat.h"
 
 #define MGMT_BUF_SIZE 1024
+#define MGMT_EVENT_BUDGET 32 /* events handled per main loop wakeup */
+#define MGMT_RATE_INTERVAL 10 /* seconds between event rate reports */
 
 struct pending_uuid {
 	uuid_t uuid;
@@ -162,7 +164,7 @@ static void get_connections(int sk, uint16_t index)
 						strerror(errno), errno);
 }
 
-static void mgmt_index_added(int sk, uint16_t index)
+static void mgmt_index_added(int sk, uint16_t index, void *buf, size_t len)
 {
 	add_controller(index);
 	read_info(sk, index);
@@ -186,7 +188,8 @@ static void remove_controller(uint16_t index)
 	DBG("Removed controller %u", index);
 }
 
-static void mgmt_index_removed(int sk, uint16_t index)
+static void mgmt_index_removed(int sk, uint16_t index, void *buf,
+								size_t len)
 {
 	remove_controller(index);
 }
@@ -1701,38 +1704,75 @@ static void mgmt_new_ltk(int sk, uint16_t index, void *buf, size_t len)
 		bonding_complete(info, &ev->key.addr.bdaddr, 0);
 }
 
-static gboolean mgmt_event(GIOChannel *io, GIOCondition cond, gpointer user_data)
-{
-	char buf[MGMT_BUF_SIZE];
-	struct mgmt_hdr *hdr = (void *) buf;
-	int sk;
-	ssize_t ret;
-	uint16_t len, opcode, index;
+static void mgmt_class_changed(int sk, uint16_t index, void *buf, size_t len)
+{
+	DBG("hci%u Class of Device changed", index);
+}
+
+typedef void (*mgmt_event_func_t) (int sk, uint16_t index, void *buf,
+								size_t len);
+
+static const mgmt_event_func_t mgmt_handlers[] = {
+	[MGMT_EV_CMD_COMPLETE]		= mgmt_cmd_complete,
+	[MGMT_EV_CMD_STATUS]		= mgmt_cmd_status,
+	[MGMT_EV_CONTROLLER_ERROR]	= mgmt_controller_error,
+	[MGMT_EV_INDEX_ADDED]		= mgmt_index_added,
+	[MGMT_EV_INDEX_REMOVED]		= mgmt_index_removed,
+	[MGMT_EV_NEW_SETTINGS]		= mgmt_new_settings,
+	[MGMT_EV_CLASS_OF_DEV_CHANGED]	= mgmt_class_changed,
+	[MGMT_EV_NEW_LINK_KEY]		= mgmt_new_link_key,
+	[MGMT_EV_DEVICE_CONNECTED]	= mgmt_device_connected,
+	[MGMT_EV_DEVICE_DISCONNECTED]	= mgmt_device_disconnected,
+	[MGMT_EV_CONNECT_FAILED]	= mgmt_connect_failed,
+	[MGMT_EV_PIN_CODE_REQUEST]	= mgmt_pin_code_request,
+	[MGMT_EV_USER_CONFIRM_REQUEST]	= mgmt_user_confirm_request,
+	[MGMT_EV_AUTH_FAILED]		= mgmt_auth_failed,
+	[MGMT_EV_LOCAL_NAME_CHANGED]	= mgmt_local_name_changed,
+	[MGMT_EV_DEVICE_FOUND]		= mgmt_device_found,
+	[MGMT_EV_DISCOVERING]		= mgmt_discovering,
+	[MGMT_EV_DEVICE_BLOCKED]	= mgmt_device_blocked,
+	[MGMT_EV_DEVICE_UNBLOCKED]	= mgmt_device_unblocked,
+	[MGMT_EV_DEVICE_UNPAIRED]	= mgmt_device_unpaired,
+	[MGMT_EV_USER_PASSKEY_REQUEST]	= mgmt_passkey_request,
+	[MGMT_EV_NEW_LONG_TERM_KEY]	= mgmt_new_ltk,
+};
 
-	DBG("cond %d", cond);
+static GTimer *event_timer = NULL;
+static unsigned int event_count = 0;
+static unsigned int event_wakeups = 0;
 
-	if (cond & G_IO_NVAL)
-		return FALSE;
+static void update_event_rate(unsigned int count)
+{
+	gdouble elapsed;
 
-	sk = g_io_channel_unix_get_fd(io);
+	event_count += count;
+	event_wakeups++;
 
-	if (cond & (G_IO_ERR | G_IO_HUP)) {
-		error("Error on management socket");
-		return FALSE;
+	if (event_timer == NULL) {
+		event_timer = g_timer_new();
+		return;
 	}
 
-	ret = read(sk, buf, sizeof(buf));
-	if (ret < 0) {
-		error("Unable to read from management socket: %s (%d)",
-						strerror(errno), errno);
-		return TRUE;
-	}
+	elapsed = g_timer_elapsed(event_timer, NULL);
+	if (elapsed < MGMT_RATE_INTERVAL)
+		return;
 
-	DBG("Received %zd bytes from management socket", ret);
+	DBG("%u events in %u wakeups, %.1f events/s", event_count,
+					event_wakeups, event_count / elapsed);
+
+	event_count = 0;
+	event_wakeups = 0;
+	g_timer_start(event_timer);
+}
+
+static void mgmt_dispatch(int sk, void *buf, ssize_t ret)
+{
+	struct mgmt_hdr *hdr = buf;
+	uint16_t len, opcode, index;
 
 	if (ret < MGMT_HDR_SIZE) {
 		error("Too small Management packet");
-		return TRUE;
+		return;
 	}
 
 	opcode = btohs(bt_get_unaligned(&hdr->opcode));
@@ -1741,81 +1781,54 @@ static gboolean mgmt_event(GIOChannel *io, GIOCondition cond, gpointer user_data
 
 	if (ret != MGMT_HDR_SIZE + len) {
 		error("Packet length mismatch. ret %zd len %u", ret, len);
-		return TRUE;
+		return;
 	}
 
-	switch (opcode) {
-	case MGMT_EV_CMD_COMPLETE:
-		mgmt_cmd_complete(sk, index, buf + MGMT_HDR_SIZE, len);
-		break;
-	case MGMT_EV_CMD_STATUS:
-		mgmt_cmd_status(sk, index, buf + MGMT_HDR_SIZE, len);
-		break;
-	case MGMT_EV_CONTROLLER_ERROR:
-		mgmt_controller_error(sk, index, buf + MGMT_HDR_SIZE, len);
-		break;
-	case MGMT_EV_INDEX_ADDED:
-		mgmt_index_added(sk, index);
-		break;
-	case MGMT_EV_INDEX_REMOVED:
-		mgmt_index_removed(sk, index);
-		break;
-	case MGMT_EV_NEW_SETTINGS:
-		mgmt_new_settings(sk, index, buf + MGMT_HDR_SIZE, len);
-		break;
-	case MGMT_EV_CLASS_OF_DEV_CHANGED:
-		DBG("hci%u Class of Device changed", index);
-		break;
-	case MGMT_EV_NEW_LINK_KEY:
-		mgmt_new_link_key(sk, index, buf + MGMT_HDR_SIZE, len);
-		break;
-	case MGMT_EV_DEVICE_CONNECTED:
-		mgmt_device_connected(sk, index, buf + MGMT_HDR_SIZE, len);
-		break;
-	case MGMT_EV_DEVICE_DISCONNECTED:
-		mgmt_device_disconnected(sk, index, buf + MGMT_HDR_SIZE, len);
-		break;
-	case MGMT_EV_CONNECT_FAILED:
-		mgmt_connect_failed(sk, index, buf + MGMT_HDR_SIZE, len);
-		break;
-	case MGMT_EV_PIN_CODE_REQUEST:
-		mgmt_pin_code_request(sk, index, buf + MGMT_HDR_SIZE, len);
-		break;
-	case MGMT_EV_USER_CONFIRM_REQUEST:
-		mgmt_user_confirm_request(sk, index, buf + MGMT_HDR_SIZE, len);
-		break;
-	case MGMT_EV_AUTH_FAILED:
-		mgmt_auth_failed(sk, index, buf + MGMT_HDR_SIZE, len);
-		break;
-	case MGMT_EV_LOCAL_NAME_CHANGED:
-		mgmt_local_name_changed(sk, index, buf + MGMT_HDR_SIZE, len);
-		break;
-	case MGMT_EV_DEVICE_FOUND:
-		mgmt_device_found(sk, index, buf + MGMT_HDR_SIZE, len);
-		break;
-	case MGMT_EV_DISCOVERING:
-		mgmt_discovering(sk, index, buf + MGMT_HDR_SIZE, len);
-		break;
-	case MGMT_EV_DEVICE_BLOCKED:
-		mgmt_device_blocked(sk, index, buf + MGMT_HDR_SIZE, len);
-		break;
-	case MGMT_EV_DEVICE_UNBLOCKED:
-		mgmt_device_unblocked(sk, index, buf + MGMT_HDR_SIZE, len);
-		break;
-	case MGMT_EV_DEVICE_UNPAIRED:
-		mgmt_device_unpaired(sk, index, buf + MGMT_HDR_SIZE, len);
-		break;
-	case MGMT_EV_USER_PASSKEY_REQUEST:
-		mgmt_passkey_request(sk, index, buf + MGMT_HDR_SIZE, len);
-		break;
-	case MGMT_EV_NEW_LONG_TERM_KEY:
-		mgmt_new_ltk(sk, index, buf + MGMT_HDR_SIZE, len);
-		break;
-	default:
+	if (opcode >= G_N_ELEMENTS(mgmt_handlers) ||
+					mgmt_handlers[opcode] == NULL) {
 		error("Unknown Management opcode %u (index %u)", opcode, index);
-		break;
+		return;
 	}
 
+	mgmt_handlers[opcode](sk, index, (char *) buf + MGMT_HDR_SIZE, len);
+}
+
+static gboolean mgmt_event(GIOChannel *io, GIOCondition cond, gpointer user_data)
+{
+	char buf[MGMT_BUF_SIZE];
+	unsigned int count;
+	int sk;
+
+	if (cond & G_IO_NVAL)
+		return FALSE;
+
+	sk = g_io_channel_unix_get_fd(io);
+
+	if (cond & (G_IO_ERR | G_IO_HUP)) {
+		error("Error on management socket");
+		return FALSE;
+	}
+
+	/* Drain what the kernel has queued, but leave the rest of a long
+	 * burst to the next iteration so other sources get their turn */
+	for (count = 0; count < MGMT_EVENT_BUDGET; count++) {
+		ssize_t ret;
+
+		ret = recv(sk, buf, sizeof(buf), count ? MSG_DONTWAIT : 0);
+		if (ret < 0) {
+			if (errno == EAGAIN || errno == EINTR)
+				break;
+
+			error("Unable to read from management socket: %s (%d)",
+							strerror(errno), errno);
+			break;
+		}
+
+		mgmt_dispatch(sk, buf, ret);
+	}
+
+	update_event_rate(count);
+
 	return TRUE;
 }
 
@@ -1880,6 +1893,11 @@ static void mgmt_cleanup(void)
 		g_source_remove(mgmt_watch);
 		mgmt_watch = 0;
 	}
+
+	if (event_timer != NULL) {
+		g_timer_destroy(event_timer);
+		event_timer = NULL;
+	}
 }
 
 static int mgmt_start_discovery(int index)
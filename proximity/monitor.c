@@ -45,6 +45,7 @@
 #include "att.h"
 #include "gattrib.h"
 #include "gatt.h"
+#include "gatt-cache.h"
 #include "attio.h"
 #include "monitor.h"
 #include "textfile.h"
@@ -176,6 +177,9 @@ static void char_discovered_cb(GSList *characteristics, guint8 status,
 		return;
 	}
 
+	if (characteristics == NULL)
+		return;
+
 	DBG("Setting alert level \"%s\" on Reporter", monitor->linklosslevel);
 
 	/* Assume there is a single Alert Level characteristic */
@@ -201,9 +205,9 @@ static int write_alert_level(struct monitor *monitor)
 
 	bt_uuid16_create(&uuid, ALERT_LEVEL_CHR_UUID);
 
-	/* FIXME: use cache (requires service changed support) ? */
-	gatt_discover_char(monitor->attrib, linkloss->start, linkloss->end,
-					&uuid, char_discovered_cb, monitor);
+	gatt_cache_discover_char(btd_device_get_gatt_cache(monitor->device),
+				monitor->attrib, linkloss->start, linkloss->end,
+				&uuid, char_discovered_cb, monitor);
 
 	return 0;
 }
@@ -243,6 +247,9 @@ static void tx_power_handle_cb(GSList *characteristics, guint8 status,
 		return;
 	}
 
+	if (characteristics == NULL)
+		return;
+
 	chr = characteristics->data;
 	monitor->txpowerhandle = chr->value_handle;
 
@@ -265,7 +272,8 @@ static void read_tx_power(struct monitor *monitor)
 
 	bt_uuid16_create(&uuid, POWER_LEVEL_CHR_UUID);
 
-	gatt_discover_char(monitor->attrib, txpower->start, txpower->end,
+	gatt_cache_discover_char(btd_device_get_gatt_cache(monitor->device),
+				monitor->attrib, txpower->start, txpower->end,
 				&uuid, tx_power_handle_cb, monitor);
 }
 
@@ -330,6 +338,9 @@ static void immediate_handle_cb(GSList *characteristics, guint8 status,
 		return;
 	}
 
+	if (characteristics == NULL)
+		return;
+
 	chr = characteristics->data;
 	monitor->immediatehandle = chr->value_handle;
 
@@ -346,8 +357,10 @@ static void discover_immediate_handle(struct monitor *monitor)
 
 	bt_uuid16_create(&uuid, ALERT_LEVEL_CHR_UUID);
 
-	gatt_discover_char(monitor->attrib, immediate->start, immediate->end,
-					&uuid, immediate_handle_cb, monitor);
+	gatt_cache_discover_char(btd_device_get_gatt_cache(monitor->device),
+				monitor->attrib, immediate->start,
+				immediate->end, &uuid, immediate_handle_cb,
+				monitor);
 }
 
 static void attio_connected_cb(GAttrib *attrib, gpointer user_data)
@@ -60,6 +60,7 @@
 #include "att.h"
 #include "attrib-server.h"
 #include "eir.h"
+#include "stored-device.h"
 
 /* Flags Descriptions */
 #define EIR_LIM_DISC                0x01 /* LE Limited Discoverable Mode */
@@ -97,8 +98,21 @@ struct session_req {
 	uint8_t			mode;		/* Requested mode */
 	int			refcount;	/* Session refcount */
 	gboolean		got_reply;	/* Agent reply received */
+	uint8_t			report_mode;	/* DeviceFound reporting */
+	uint32_t		report_window;	/* Coalescing window (ms) */
+	uint8_t			rssi_delta;	/* Min RSSI change reported */
 };
 
+/* Ordered from the most to the least verbose */
+enum {
+	REPORT_FULL,		/* every property in each DeviceFound */
+	REPORT_CHANGED,		/* only properties changed since last time */
+	REPORT_BATCH,		/* changed properties in DevicesFound */
+};
+
+#define DEFAULT_REPORT_WINDOW	500
+#define MAX_REPORT_WINDOW	10000
+
 struct service_auth {
 	service_auth_cb cb;
 	void *user_data;
@@ -126,12 +140,26 @@ struct btd_adapter {
 	struct session_req *pending_mode;
 	int state;			/* standard inq, periodic inq, name
 					 * resolving, suspended discovery */
-	GSList *found_devices;
-	GSList *oor_devices;		/* out of range device list */
+	GHashTable *found_devices;	/* remote_dev_info by address */
+	GSequence *found_by_rssi;	/* found devices, strongest first */
+	unsigned int found_gen;		/* current discovery cycle */
+	gboolean oor_tracking;		/* report out of range devices */
+	GSList *found_pending;		/* devices waiting to be reported */
+	guint report_id;		/* report window timer */
+	uint8_t report_mode;		/* most verbose session mode */
+	uint32_t report_window;		/* shortest session window (ms) */
+	uint8_t rssi_delta;		/* smallest session RSSI delta */
+	GTimer *report_clock;
+	unsigned int reports_forwarded;
+	unsigned int reports_suppressed;
 	struct agent *agent;		/* For the new API */
 	guint auth_idle_id;		/* Ongoing authorization */
 	GSList *connections;		/* Connected devices */
 	GSList *devices;		/* Devices structure pointers */
+	GSList *devices_tail;		/* Last element of devices */
+	GHashTable *devices_by_addr;	/* btd_device by address */
+	GHashTable *devices_by_path;	/* btd_device by object path */
+	struct stored_devices *stored_devices;	/* not yet created */
 	GSList *mode_sessions;		/* Request Mode sessions */
 	GSList *disc_sessions;		/* Discovery sessions */
 	guint discov_id;		/* Discovery timer */
@@ -466,34 +494,340 @@ static uint8_t get_needed_mode(struct btd_adapter *adapter, uint8_t mode)
 	return mode;
 }
 
-static GSList *remove_bredr(GSList *all)
+static int dev_rssi_cmp(gconstpointer a, gconstpointer b, gpointer user_data)
 {
-	GSList *l, *le;
+	const struct remote_dev_info *d1 = a, *d2 = b;
+	int rssi1, rssi2;
+
+	rssi1 = d1->rssi < 0 ? -d1->rssi : d1->rssi;
+	rssi2 = d2->rssi < 0 ? -d2->rssi : d2->rssi;
+
+	return rssi1 - rssi2;
+}
+
+static void found_device_add(struct btd_adapter *adapter,
+						struct remote_dev_info *dev)
+{
+	dev->generation = adapter->found_gen;
+	dev->rssi_pos = g_sequence_insert_sorted(adapter->found_by_rssi, dev,
+							dev_rssi_cmp, NULL);
+	g_hash_table_insert(adapter->found_devices, &dev->bdaddr, dev);
+}
+
+/* The RSSI ordering owns the entry: this frees it */
+static void found_device_remove(struct btd_adapter *adapter,
+						struct remote_dev_info *dev)
+{
+	if (dev->queued)
+		adapter->found_pending = g_slist_remove(adapter->found_pending,
+									dev);
+
+	g_hash_table_remove(adapter->found_devices, &dev->bdaddr);
+	g_sequence_remove(dev->rssi_pos);
+}
+
+static void found_devices_clear(struct btd_adapter *adapter)
+{
+	GSequence *seq = adapter->found_by_rssi;
+
+	if (adapter->report_id > 0) {
+		g_source_remove(adapter->report_id);
+		adapter->report_id = 0;
+	}
+
+	g_slist_free(adapter->found_pending);
+	adapter->found_pending = NULL;
+
+	g_hash_table_remove_all(adapter->found_devices);
+	g_sequence_remove_range(g_sequence_get_begin_iter(seq),
+					g_sequence_get_end_iter(seq));
+}
+
+static char **strlist2array(GSList *list)
+{
+	unsigned int i, n;
+	char **array;
+
+	if (list == NULL)
+		return NULL;
+
+	n = g_slist_length(list);
+	array = g_new0(char *, n + 1);
+
+	for (i = 0; list; list = list->next, i++)
+		array[i] = g_strdup((const gchar *) list->data);
+
+	return array;
+}
+
+static void append_found_device(DBusMessageIter *iter,
+					struct btd_adapter *adapter,
+					struct remote_dev_info *dev,
+					uint8_t props)
+{
+	DBusMessageIter dict;
+	struct btd_device *device;
+	char peer_addr[18];
+	const char *icon, *paddr = peer_addr;
+	dbus_bool_t paired = FALSE, trusted = FALSE;
+	dbus_int16_t rssi = dev->rssi;
+	char *alias;
+	size_t uuid_count;
+
+	ba2str(&dev->bdaddr, peer_addr);
+
+	device = adapter_find_device(adapter, paddr);
+	if (device) {
+		paired = device_is_paired(device);
+		trusted = device_is_trusted(device);
+	}
+
+	/* The uuids string array is updated only if necessary */
+	uuid_count = g_slist_length(dev->services);
+	if (dev->services && dev->uuid_count != uuid_count) {
+		g_strfreev(dev->uuids);
+		dev->uuids = strlist2array(dev->services);
+		dev->uuid_count = uuid_count;
+	}
+
+	if (!dev->alias) {
+		if (!dev->name) {
+			alias = g_strdup(peer_addr);
+			g_strdelimit(alias, ":", '-');
+		} else
+			alias = g_strdup(dev->name);
+	} else
+		alias = g_strdup(dev->alias);
+
+	dbus_message_iter_append_basic(iter, DBUS_TYPE_STRING, &paddr);
+
+	dbus_message_iter_open_container(iter, DBUS_TYPE_ARRAY,
+			DBUS_DICT_ENTRY_BEGIN_CHAR_AS_STRING
+			DBUS_TYPE_STRING_AS_STRING DBUS_TYPE_VARIANT_AS_STRING
+			DBUS_DICT_ENTRY_END_CHAR_AS_STRING, &dict);
+
+	if (props == DEV_FOUND_ALL) {
+		dict_append_entry(&dict, "Address", DBUS_TYPE_STRING, &paddr);
 
-	for (l = all, le = NULL; l; l = l->next) {
-		struct remote_dev_info *dev = l->data;
 		if (dev->type == ADDR_TYPE_BREDR) {
-			dev_info_free(dev);
-			continue;
+			icon = class_to_icon(dev->class);
+
+			dict_append_entry(&dict, "Class", DBUS_TYPE_UINT32,
+								&dev->class);
+			dict_append_entry(&dict, "Icon", DBUS_TYPE_STRING,
+									&icon);
+		}
+	}
+
+	if (props & DEV_FOUND_RSSI)
+		dict_append_entry(&dict, "RSSI", DBUS_TYPE_INT16, &rssi);
+
+	if (props & DEV_FOUND_NAME) {
+		dict_append_entry(&dict, "Name", DBUS_TYPE_STRING, &dev->name);
+		dict_append_entry(&dict, "Alias", DBUS_TYPE_STRING, &alias);
+	}
+
+	if (props == DEV_FOUND_ALL) {
+		if (dev->type != ADDR_TYPE_BREDR) {
+			dbus_bool_t broadcaster;
+
+			if (dev->flags & (EIR_LIM_DISC | EIR_GEN_DISC))
+				broadcaster = FALSE;
+			else
+				broadcaster = TRUE;
+
+			dev->legacy = FALSE;
+
+			dict_append_entry(&dict, "LegacyPairing",
+					DBUS_TYPE_BOOLEAN, &dev->legacy);
+			dict_append_entry(&dict, "Paired", DBUS_TYPE_BOOLEAN,
+								&paired);
+			dict_append_entry(&dict, "Broadcaster",
+					DBUS_TYPE_BOOLEAN, &broadcaster);
+		} else {
+			dict_append_entry(&dict, "LegacyPairing",
+					DBUS_TYPE_BOOLEAN, &dev->legacy);
+			dict_append_entry(&dict, "Paired", DBUS_TYPE_BOOLEAN,
+								&paired);
+			dict_append_entry(&dict, "Trusted", DBUS_TYPE_BOOLEAN,
+								&trusted);
 		}
+	}
+
+	if ((props & DEV_FOUND_UUIDS) && uuid_count > 0)
+		dict_append_array(&dict, "UUIDs", DBUS_TYPE_STRING,
+						&dev->uuids, uuid_count);
+
+	dbus_message_iter_close_container(iter, &dict);
+
+	g_free(alias);
+
+	dev->reported = TRUE;
+	dev->reported_rssi = dev->rssi;
+	dev->changed = 0;
+}
+
+static uint8_t found_device_props(struct btd_adapter *adapter,
+					struct remote_dev_info *dev)
+{
+	if (adapter->report_mode == REPORT_FULL)
+		return DEV_FOUND_ALL;
+
+	return dev->changed;
+}
+
+static void emit_device_found(struct btd_adapter *adapter,
+					struct remote_dev_info *dev)
+{
+	DBusMessage *signal;
+	DBusMessageIter iter;
 
-		le = g_slist_append(le, dev);
+	signal = dbus_message_new_signal(adapter->path, ADAPTER_INTERFACE,
+					"DeviceFound");
+	if (!signal) {
+		error("Unable to allocate new %s.DeviceFound signal",
+				ADAPTER_INTERFACE);
+		return;
 	}
 
-	g_slist_free(all);
+	dbus_message_iter_init_append(signal, &iter);
+	append_found_device(&iter, adapter, dev,
+					found_device_props(adapter, dev));
+
+	g_dbus_send_message(connection, signal);
+}
+
+static void emit_devices_found(struct btd_adapter *adapter, GSList *list)
+{
+	DBusMessage *signal;
+	DBusMessageIter iter, array;
+
+	signal = dbus_message_new_signal(adapter->path, ADAPTER_INTERFACE,
+					"DevicesFound");
+	if (!signal) {
+		error("Unable to allocate new %s.DevicesFound signal",
+				ADAPTER_INTERFACE);
+		return;
+	}
 
-	return le;
+	dbus_message_iter_init_append(signal, &iter);
+	dbus_message_iter_open_container(&iter, DBUS_TYPE_ARRAY,
+			DBUS_STRUCT_BEGIN_CHAR_AS_STRING
+			DBUS_TYPE_STRING_AS_STRING
+			DBUS_TYPE_ARRAY_AS_STRING
+			DBUS_DICT_ENTRY_BEGIN_CHAR_AS_STRING
+			DBUS_TYPE_STRING_AS_STRING DBUS_TYPE_VARIANT_AS_STRING
+			DBUS_DICT_ENTRY_END_CHAR_AS_STRING
+			DBUS_STRUCT_END_CHAR_AS_STRING, &array);
+
+	for (; list; list = list->next) {
+		struct remote_dev_info *dev = list->data;
+		DBusMessageIter entry;
+
+		dbus_message_iter_open_container(&array, DBUS_TYPE_STRUCT,
+								NULL, &entry);
+		append_found_device(&entry, adapter, dev,
+					found_device_props(adapter, dev));
+		dbus_message_iter_close_container(&array, &entry);
+	}
+
+	dbus_message_iter_close_container(&iter, &array);
+
+	g_dbus_send_message(connection, signal);
+}
+
+static void flush_found_devices(struct btd_adapter *adapter)
+{
+	GSList *list, *l;
+
+	if (adapter->report_id > 0) {
+		g_source_remove(adapter->report_id);
+		adapter->report_id = 0;
+	}
+
+	list = g_slist_reverse(adapter->found_pending);
+	adapter->found_pending = NULL;
+
+	for (l = list; l; l = l->next) {
+		struct remote_dev_info *dev = l->data;
+
+		dev->queued = FALSE;
+	}
+
+	if (list == NULL)
+		goto done;
+
+	if (adapter->report_mode == REPORT_BATCH)
+		emit_devices_found(adapter, list);
+	else
+		for (l = list; l; l = l->next)
+			emit_device_found(adapter, l->data);
+
+done:
+	g_slist_free(list);
+}
+
+static gboolean report_timeout(gpointer user_data)
+{
+	struct btd_adapter *adapter = user_data;
+
+	adapter->report_id = 0;
+
+	flush_found_devices(adapter);
+
+	return FALSE;
+}
+
+void adapter_found_device_changed(struct btd_adapter *adapter,
+					struct remote_dev_info *dev,
+					uint8_t changed)
+{
+	if (!dev->reported)
+		changed = DEV_FOUND_ALL;
+
+	dev->changed |= changed;
+	if (dev->changed == 0)
+		return;
+
+	if (adapter->report_window == 0) {
+		emit_device_found(adapter, dev);
+		return;
+	}
+
+	if (!dev->queued) {
+		dev->queued = TRUE;
+		adapter->found_pending = g_slist_prepend(adapter->found_pending,
+									dev);
+	}
+
+	if (adapter->report_id == 0)
+		adapter->report_id = g_timeout_add(adapter->report_window,
+							report_timeout, adapter);
+}
+
+static void remove_bredr(struct btd_adapter *adapter)
+{
+	GSequenceIter *iter;
+
+	iter = g_sequence_get_begin_iter(adapter->found_by_rssi);
+
+	while (!g_sequence_iter_is_end(iter)) {
+		struct remote_dev_info *dev = g_sequence_get(iter);
+
+		iter = g_sequence_iter_next(iter);
+
+		if (dev->type == ADDR_TYPE_BREDR)
+			found_device_remove(adapter, dev);
+	}
 }
 
 /* Called when a session gets removed or the adapter is stopped */
 static void stop_discovery(struct btd_adapter *adapter)
 {
-	adapter->found_devices = remove_bredr(adapter->found_devices);
+	flush_found_devices(adapter);
+	remove_bredr(adapter);
 
-	if (adapter->oor_devices) {
-		g_slist_free(adapter->oor_devices);
-		adapter->oor_devices = NULL;
-	}
+	adapter->oor_tracking = FALSE;
 
 	/* Reset if suspended, otherwise remove timer (software scheduler)
 	 * or request inquiry to stop */
@@ -512,6 +846,40 @@ static void stop_discovery(struct btd_adapter *adapter)
 		adapter_ops->stop_discovery(adapter->dev_id);
 }
 
+static void update_report_policy(struct btd_adapter *adapter)
+{
+	uint8_t mode = REPORT_BATCH, delta = UINT8_MAX;
+	uint32_t window = UINT32_MAX;
+	GSList *l;
+
+	for (l = adapter->disc_sessions; l; l = l->next) {
+		struct session_req *req = l->data;
+
+		mode = MIN(mode, req->report_mode);
+		window = MIN(window, req->report_window);
+		delta = MIN(delta, req->rssi_delta);
+	}
+
+	if (adapter->disc_sessions == NULL) {
+		mode = REPORT_FULL;
+		window = 0;
+		delta = 0;
+	}
+
+	if (mode == REPORT_BATCH && window == 0)
+		window = DEFAULT_REPORT_WINDOW;
+
+	DBG("mode %u window %u rssi delta %u", mode, window, delta);
+
+	/* Pending reports follow the previous policy */
+	if (mode != adapter->report_mode || window != adapter->report_window)
+		flush_found_devices(adapter);
+
+	adapter->report_mode = mode;
+	adapter->report_window = window;
+	adapter->rssi_delta = delta;
+}
+
 static void session_remove(struct session_req *req)
 {
 	struct btd_adapter *adapter = req->adapter;
@@ -541,6 +909,8 @@ static void session_remove(struct session_req *req)
 		adapter->disc_sessions = g_slist_remove(adapter->disc_sessions,
 							req);
 
+		update_report_policy(adapter);
+
 		if (adapter->disc_sessions)
 			return;
 
@@ -773,23 +1143,62 @@ static DBusMessage *set_name(DBusConnection *conn, DBusMessage *msg,
 	return dbus_message_new_method_return(msg);
 }
 
-struct btd_device *adapter_find_device(struct btd_adapter *adapter,
-							const char *dest)
+/* Object paths used to be matched case-insensitively */
+static guint path_hash(gconstpointer key)
 {
-	struct btd_device *device;
+	const char *p;
+	guint h = 5381;
+
+	for (p = key; *p != '\0'; p++)
+		h = (h << 5) + h + g_ascii_tolower(*p);
+
+	return h;
+}
+
+static gboolean path_equal(gconstpointer a, gconstpointer b)
+{
+	return g_ascii_strcasecmp(a, b) == 0;
+}
+
+static void adapter_add_device(struct btd_adapter *adapter,
+						struct btd_device *device)
+{
+	bdaddr_t *bdaddr = g_new(bdaddr_t, 1);
 	GSList *l;
 
-	if (!adapter)
-		return NULL;
+	device_get_address(device, bdaddr, NULL);
 
-	l = g_slist_find_custom(adapter->devices, dest,
-					(GCompareFunc) device_address_cmp);
-	if (!l)
-		return NULL;
+	/* Appended through the tail to keep the creation order */
+	l = g_slist_append(NULL, device);
+	if (adapter->devices_tail)
+		adapter->devices_tail->next = l;
+	else
+		adapter->devices = l;
+	adapter->devices_tail = l;
 
-	device = l->data;
+	g_hash_table_replace(adapter->devices_by_addr, bdaddr, device);
+	g_hash_table_replace(adapter->devices_by_path,
+					(gpointer) device_get_path(device), device);
+}
 
-	return device;
+static void adapter_del_device(struct btd_adapter *adapter,
+						struct btd_device *device)
+{
+	bdaddr_t bdaddr;
+
+	device_get_address(device, &bdaddr, NULL);
+
+	if (g_hash_table_lookup(adapter->devices_by_addr, &bdaddr) == device)
+		g_hash_table_remove(adapter->devices_by_addr, &bdaddr);
+
+	g_hash_table_remove(adapter->devices_by_path,
+						device_get_path(device));
+
+	if (adapter->devices_tail && adapter->devices_tail->data == device) {
+		adapter->devices = g_slist_remove(adapter->devices, device);
+		adapter->devices_tail = g_slist_last(adapter->devices);
+	} else
+		adapter->devices = g_slist_remove(adapter->devices, device);
 }
 
 static void adapter_update_devices(struct btd_adapter *adapter)
@@ -811,6 +1220,170 @@ static void adapter_update_devices(struct btd_adapter *adapter)
 	g_free(devices);
 }
 
+static GSList *string_to_primary_list(char *str)
+{
+	GSList *l = NULL;
+	char **services;
+	int i;
+
+	if (str == NULL)
+		return NULL;
+
+	services = g_strsplit(str, " ", 0);
+	if (services == NULL)
+		return NULL;
+
+	for (i = 0; services[i]; i++) {
+		struct att_primary *prim;
+		int ret;
+
+		prim = g_new0(struct att_primary, 1);
+
+		ret = sscanf(services[i], "%04hX#%04hX#%s", &prim->start,
+							&prim->end, prim->uuid);
+
+		if (ret < 3) {
+			g_free(prim);
+			continue;
+		}
+
+		l = g_slist_append(l, prim);
+	}
+
+	g_strfreev(services);
+
+	return l;
+}
+
+static void stored_device_load_profiles(struct btd_device *device,
+							const char *value)
+{
+	GSList *list, *uuids = bt_string2list(value);
+
+	list = device_services_from_record(device, uuids);
+	if (list)
+		device_register_services(connection, device, list, ATT_PSM);
+
+	device_probe_drivers(device, uuids);
+
+	g_slist_free_full(uuids, g_free);
+}
+
+static void stored_device_load_primary(struct btd_device *device,
+								char *value)
+{
+	GSList *services, *uuids, *l;
+
+	services = string_to_primary_list(value);
+	if (services == NULL)
+		return;
+
+	for (l = services, uuids = NULL; l; l = l->next) {
+		struct att_primary *prim = l->data;
+		uuids = g_slist_append(uuids, prim->uuid);
+	}
+
+	device_register_services(connection, device, services, -1);
+
+	device_probe_drivers(device, uuids);
+
+	g_slist_free(uuids);
+}
+
+static struct btd_device *create_stored_device(struct btd_adapter *adapter,
+							const char *address,
+							addr_type_t type)
+{
+	struct btd_device *device;
+
+	device = device_create(connection, adapter, address, type);
+	if (!device)
+		return NULL;
+
+	device_set_temporary(device, FALSE);
+	adapter_add_device(adapter, device);
+
+	return device;
+}
+
+/* With LazyDeviceLoading, BR/EDR devices from storage are only indexed by
+ * load_devices and get their btd_device on first lookup */
+static void *materialize_device(const struct stored_device *stored,
+							void *user_data)
+{
+	struct btd_adapter *adapter = user_data;
+	char filename[PATH_MAX + 1];
+	char srcaddr[18], address[18];
+	struct btd_device *device;
+	char *value;
+
+	ba2str(&adapter->bdaddr, srcaddr);
+	ba2str(&stored->bdaddr, address);
+
+	DBG("%s", address);
+
+	device = create_stored_device(adapter, address, stored->type);
+	if (!device)
+		return NULL;
+
+	switch (stored->source) {
+	case STORED_PROFILES:
+		create_name(filename, PATH_MAX, STORAGEDIR, srcaddr,
+								"profiles");
+		value = textfile_get(filename, address);
+		if (value)
+			stored_device_load_profiles(device, value);
+		free(value);
+		break;
+	case STORED_PRIMARY:
+		create_name(filename, PATH_MAX, STORAGEDIR, srcaddr, "primary");
+		value = textfile_get(filename, address);
+		if (value)
+			stored_device_load_primary(device, value);
+		free(value);
+		break;
+	}
+
+	return device;
+}
+
+static struct btd_device *find_device_by_bdaddr(struct btd_adapter *adapter,
+							const bdaddr_t *bdaddr)
+{
+	struct btd_device *device;
+
+	device = g_hash_table_lookup(adapter->devices_by_addr, bdaddr);
+	if (device)
+		return device;
+
+	device = stored_devices_take(adapter->stored_devices, bdaddr,
+						materialize_device, adapter);
+	if (device)
+		adapter_update_devices(adapter);
+
+	return device;
+}
+
+static void materialize_stored_devices(struct btd_adapter *adapter)
+{
+	if (stored_devices_take_all(adapter->stored_devices,
+					materialize_device, adapter) > 0)
+		adapter_update_devices(adapter);
+}
+
+struct btd_device *adapter_find_device(struct btd_adapter *adapter,
+							const char *dest)
+{
+	bdaddr_t bdaddr;
+
+	if (!adapter || !dest || bachk(dest) < 0)
+		return NULL;
+
+	str2ba(dest, &bdaddr);
+
+	return find_device_by_bdaddr(adapter, &bdaddr);
+}
+
 static void adapter_emit_uuids_updated(struct btd_adapter *adapter)
 {
 	char **uuids;
@@ -939,7 +1512,7 @@ static struct btd_device *adapter_create_device(DBusConnection *conn,
 
 	device_set_temporary(device, TRUE);
 
-	adapter->devices = g_slist_append(adapter->devices, device);
+	adapter_add_device(adapter, device);
 
 	path = device_get_path(device);
 	g_dbus_emit_signal(conn, adapter->path,
@@ -959,7 +1532,7 @@ void adapter_remove_device(DBusConnection *conn, struct btd_adapter *adapter,
 	const gchar *dev_path = device_get_path(device);
 	struct agent *agent;
 
-	adapter->devices = g_slist_remove(adapter->devices, device);
+	adapter_del_device(adapter, device);
 	adapter->connections = g_slist_remove(adapter->connections, device);
 
 	adapter_update_devices(adapter);
@@ -1010,31 +1583,88 @@ static gboolean discovery_cb(gpointer user_data)
 	return FALSE;
 }
 
+static int parse_discovery_options(DBusMessageIter *props,
+						struct session_req *opts)
+{
+	while (dbus_message_iter_get_arg_type(props) == DBUS_TYPE_DICT_ENTRY) {
+		const char *key, *str;
+		DBusMessageIter value, entry;
+		dbus_int16_t delta;
+		int var;
+
+		dbus_message_iter_recurse(props, &entry);
+		dbus_message_iter_get_basic(&entry, &key);
+
+		dbus_message_iter_next(&entry);
+		dbus_message_iter_recurse(&entry, &value);
+
+		var = dbus_message_iter_get_arg_type(&value);
+		if (g_str_equal(key, "Report")) {
+			if (var != DBUS_TYPE_STRING)
+				return -EINVAL;
+			dbus_message_iter_get_basic(&value, &str);
+			if (g_str_equal(str, "full"))
+				opts->report_mode = REPORT_FULL;
+			else if (g_str_equal(str, "changed"))
+				opts->report_mode = REPORT_CHANGED;
+			else if (g_str_equal(str, "batch"))
+				opts->report_mode = REPORT_BATCH;
+			else
+				return -EINVAL;
+		} else if (g_str_equal(key, "Window")) {
+			if (var != DBUS_TYPE_UINT32)
+				return -EINVAL;
+			dbus_message_iter_get_basic(&value,
+						&opts->report_window);
+			if (opts->report_window > MAX_REPORT_WINDOW)
+				return -EINVAL;
+		} else if (g_str_equal(key, "RSSIDelta")) {
+			if (var != DBUS_TYPE_INT16)
+				return -EINVAL;
+			dbus_message_iter_get_basic(&value, &delta);
+			if (delta < 0 || delta > INT8_MAX)
+				return -EINVAL;
+			opts->rssi_delta = delta;
+		} else
+			return -EINVAL;
+
+		dbus_message_iter_next(props);
+	}
+
+	return 0;
+}
+
 static DBusMessage *adapter_start_discovery(DBusConnection *conn,
 						DBusMessage *msg, void *data)
 {
-	struct session_req *req;
+	struct session_req *req, opts;
 	struct btd_adapter *adapter = data;
 	const char *sender = dbus_message_get_sender(msg);
+	DBusMessageIter iter, props;
 	int err;
 
 	if (!adapter->up)
 		return btd_error_not_ready(msg);
 
+	memset(&opts, 0, sizeof(opts));
+
+	if (dbus_message_iter_init(msg, &iter)) {
+		dbus_message_iter_recurse(&iter, &props);
+		if (parse_discovery_options(&props, &opts) < 0)
+			return btd_error_invalid_args(msg);
+	}
+
 	req = find_session(adapter->disc_sessions, sender);
 	if (req) {
 		session_ref(req);
-		return dbus_message_new_method_return(msg);
+		goto update;
 	}
 
 	if (adapter->disc_sessions)
 		goto done;
 
-	g_slist_free_full(adapter->found_devices, dev_info_free);
-	adapter->found_devices = NULL;
-
-	g_slist_free(adapter->oor_devices);
-	adapter->oor_devices = NULL;
+	found_devices_clear(adapter);
+	adapter->oor_tracking = FALSE;
 
 	if (adapter->discov_suspended)
 		goto done;
@@ -1049,6 +1679,13 @@ done:
 
 	adapter->disc_sessions = g_slist_append(adapter->disc_sessions, req);
 
+update:
+	req->report_mode = opts.report_mode;
+	req->report_window = opts.report_window;
+	req->rssi_delta = opts.rssi_delta;
+
+	update_report_policy(adapter);
+
 	return dbus_message_new_method_return(msg);
 }
 
@@ -1140,7 +1777,17 @@ static DBusMessage *get_properties(DBusConnection *conn,
 	dict_append_entry(&dict, "Discovering", DBUS_TYPE_BOOLEAN,
 							&adapter->discovering);
 
-	/* Devices */
+	/* ReportsForwarded */
+	dict_append_entry(&dict, "ReportsForwarded", DBUS_TYPE_UINT32,
+						&adapter->reports_forwarded);
+
+	/* ReportsSuppressed */
+	dict_append_entry(&dict, "ReportsSuppressed", DBUS_TYPE_UINT32,
+						&adapter->reports_suppressed);
+
+	/* Devices, which has to agree with ListDevices */
+	materialize_stored_devices(adapter);
+
 	devices = g_new0(char *, g_slist_length(adapter->devices) + 1);
 	for (i = 0, l = adapter->devices; l; l = l->next, i++) {
 		struct btd_device *dev = l->data;
@@ -1324,6 +1971,8 @@ static DBusMessage *list_devices(DBusConnection *conn,
 	if (!dbus_message_has_signature(msg, DBUS_TYPE_INVALID_AS_STRING))
 		return btd_error_invalid_args(msg);
 
+	materialize_stored_devices(adapter);
+
 	reply = dbus_message_new_method_return(msg);
 	if (!reply)
 		return NULL;
@@ -1518,32 +2167,21 @@ static DBusMessage *create_paired_device(DBusConnection *conn,
 	return device_create_bonding(device, conn, msg, agent_path, cap);
 }
 
-static gint device_path_cmp(struct btd_device *device, const gchar *path)
-{
-	const gchar *dev_path = device_get_path(device);
-
-	return strcasecmp(dev_path, path);
-}
-
 static DBusMessage *remove_device(DBusConnection *conn, DBusMessage *msg,
 								void *data)
 {
 	struct btd_adapter *adapter = data;
 	struct btd_device *device;
 	const char *path;
-	GSList *l;
 
 	if (dbus_message_get_args(msg, NULL, DBUS_TYPE_OBJECT_PATH, &path,
 						DBUS_TYPE_INVALID) == FALSE)
 		return btd_error_invalid_args(msg);
 
-	l = g_slist_find_custom(adapter->devices,
-			path, (GCompareFunc) device_path_cmp);
-	if (!l)
+	device = g_hash_table_lookup(adapter->devices_by_path, path);
+	if (!device)
 		return btd_error_does_not_exist(msg);
 
-	device = l->data;
-
 	if (device_is_temporary(device) || device_is_busy(device))
 		return g_dbus_create_error(msg,
 				ERROR_INTERFACE ".DoesNotExist",
@@ -1567,20 +2205,16 @@ static DBusMessage *find_device(DBusConnection *conn, DBusMessage *msg,
 	struct btd_device *device;
 	DBusMessage *reply;
 	const gchar *address;
-	GSList *l;
 	const gchar *dev_path;
 
 	if (!dbus_message_get_args(msg, NULL, DBUS_TYPE_STRING, &address,
 						DBUS_TYPE_INVALID))
 		return btd_error_invalid_args(msg);
 
-	l = g_slist_find_custom(adapter->devices,
-			address, (GCompareFunc) device_address_cmp);
-	if (!l)
+	device = adapter_find_device(adapter, address);
+	if (!device)
 		return btd_error_does_not_exist(msg);
 
-	device = l->data;
-
 	reply = dbus_message_new_method_return(msg);
 	if (!reply)
 		return NULL;
@@ -1667,6 +2301,8 @@ static GDBusMethodTable adapter_methods[] = {
 						G_DBUS_METHOD_FLAG_ASYNC},
 	{ "ReleaseSession",	"",	"",	release_session		},
 	{ "StartDiscovery",	"",	"",	adapter_start_discovery },
+	{ "StartDiscoveryWithOptions", "a{sv}", "",
+						adapter_start_discovery },
 	{ "StopDiscovery",	"",	"",	adapter_stop_discovery,
 						G_DBUS_METHOD_FLAG_ASYNC},
 	{ "ListDevices",	"",	"ao",	list_devices,
@@ -1690,35 +2326,58 @@ static GDBusSignalTable adapter_signals[] = {
 	{ "DeviceCreated",		"o"		},
 	{ "DeviceRemoved",		"o"		},
 	{ "DeviceFound",		"sa{sv}"	},
+	{ "DevicesFound",		"a(sa{sv})"	},
 	{ "DeviceDisappeared",		"s"		},
 	{ }
 };
 
+static gboolean stored_device_known(struct btd_adapter *adapter,
+							const char *address)
+{
+	bdaddr_t bdaddr;
+
+	str2ba(address, &bdaddr);
+
+	if (g_hash_table_lookup(adapter->devices_by_addr, &bdaddr))
+		return TRUE;
+
+	return stored_devices_contains(adapter->stored_devices, &bdaddr);
+}
+
+static struct btd_device *load_stored_device(struct btd_adapter *adapter,
+							const char *address,
+							addr_type_t type,
+							uint8_t source)
+{
+	bdaddr_t bdaddr;
+
+	/* LE profiles register for auto connection when they are probed,
+	 * so LE devices can't wait for a lookup */
+	if (!main_opts.lazy_devices || type != ADDR_TYPE_BREDR ||
+						source == STORED_PRIMARY)
+		return create_stored_device(adapter, address, type);
+
+	str2ba(address, &bdaddr);
+	stored_devices_add(adapter->stored_devices, &bdaddr, type, source);
+
+	return NULL;
+}
+
 static void create_stored_device_from_profiles(char *key, char *value,
 						void *user_data)
 {
 	struct btd_adapter *adapter = user_data;
-	GSList *list, *uuids = bt_string2list(value);
 	struct btd_device *device;
 
-	if (g_slist_find_custom(adapter->devices,
-				key, (GCompareFunc) device_address_cmp))
+	if (stored_device_known(adapter, key))
 		return;
 
-	device = device_create(connection, adapter, key, ADDR_TYPE_BREDR);
+	device = load_stored_device(adapter, key, ADDR_TYPE_BREDR,
+							STORED_PROFILES);
 	if (!device)
 		return;
 
-	device_set_temporary(device, FALSE);
-	adapter->devices = g_slist_append(adapter->devices, device);
-
-	list = device_services_from_record(device, uuids);
-	if (list)
-		device_register_services(connection, device, list, ATT_PSM);
-
-	device_probe_drivers(device, uuids);
-
-	g_slist_free_full(uuids, g_free);
+	stored_device_load_profiles(device, value);
 }
 
 struct adapter_keys {
@@ -1811,22 +2470,16 @@ static void create_stored_device_from_linkkeys(char *key, char *value,
 {
 	struct adapter_keys *keys = user_data;
 	struct btd_adapter *adapter = keys->adapter;
-	struct btd_device *device;
 	struct link_key_info *info;
 
 	info = get_key_info(key, value);
 	if (info)
-		keys->keys = g_slist_append(keys->keys, info);
+		keys->keys = g_slist_prepend(keys->keys, info);
 
-	if (g_slist_find_custom(adapter->devices, key,
-					(GCompareFunc) device_address_cmp))
+	if (stored_device_known(adapter, key))
 		return;
 
-	device = device_create(connection, adapter, key, ADDR_TYPE_BREDR);
-	if (device) {
-		device_set_temporary(device, FALSE);
-		adapter->devices = g_slist_append(adapter->devices, device);
-	}
+	load_stored_device(adapter, key, ADDR_TYPE_BREDR, STORED_OTHER);
 }
 
 static void create_stored_device_from_ltks(char *key, char *value,
@@ -1834,7 +2487,6 @@ static void create_stored_device_from_ltks(char *key, char *value,
 {
 	struct adapter_keys *keys = user_data;
 	struct btd_adapter *adapter = keys->adapter;
-	struct btd_device *device;
 	struct smp_ltk_info *info;
 	char srcaddr[18];
 	bdaddr_t src;
@@ -1843,10 +2495,9 @@ static void create_stored_device_from_ltks(char *key, char *value,
 	if (info == NULL)
 		return;
 
-	keys->keys = g_slist_append(keys->keys, info);
+	keys->keys = g_slist_prepend(keys->keys, info);
 
-	if (g_slist_find_custom(adapter->devices, key,
-					(GCompareFunc) device_address_cmp))
+	if (stored_device_known(adapter, key))
 		return;
 
 	adapter_get_address(adapter, &src);
@@ -1855,63 +2506,20 @@ static void create_stored_device_from_ltks(char *key, char *value,
 	if (g_strcmp0(srcaddr, key) == 0)
 		return;
 
-	device = device_create(connection, adapter, key, info->addr_type);
-	if (device) {
-		device_set_temporary(device, FALSE);
-		adapter->devices = g_slist_append(adapter->devices, device);
-	}
+	load_stored_device(adapter, key, info->addr_type, STORED_OTHER);
 }
 
 static void create_stored_device_from_blocked(char *key, char *value,
 							void *user_data)
 {
 	struct btd_adapter *adapter = user_data;
-	struct btd_device *device;
 
-	if (g_slist_find_custom(adapter->devices,
-				key, (GCompareFunc) device_address_cmp))
+	/* Blocking has to reach the kernel right away, so blocked devices
+	 * are always created */
+	if (adapter_find_device(adapter, key))
 		return;
 
-	device = device_create(connection, adapter, key, ADDR_TYPE_BREDR);
-	if (device) {
-		device_set_temporary(device, FALSE);
-		adapter->devices = g_slist_append(adapter->devices, device);
-	}
-}
-
-static GSList *string_to_primary_list(char *str)
-{
-	GSList *l = NULL;
-	char **services;
-	int i;
-
-	if (str == NULL)
-		return NULL;
-
-	services = g_strsplit(str, " ", 0);
-	if (services == NULL)
-		return NULL;
-
-	for (i = 0; services[i]; i++) {
-		struct att_primary *prim;
-		int ret;
-
-		prim = g_new0(struct att_primary, 1);
-
-		ret = sscanf(services[i], "%04hX#%04hX#%s", &prim->start,
-							&prim->end, prim->uuid);
-
-		if (ret < 3) {
-			g_free(prim);
-			continue;
-		}
-
-		l = g_slist_append(l, prim);
-	}
-
-	g_strfreev(services);
-
-	return l;
+	create_stored_device(adapter, key, ADDR_TYPE_BREDR);
 }
 
 static void create_stored_device_from_primary(char *key, char *value,
@@ -1919,34 +2527,17 @@ static void create_stored_device_from_primary(char *key, char *value,
 {
 	struct btd_adapter *adapter = user_data;
 	struct btd_device *device;
-	GSList *services, *uuids, *l;
 
-	if (g_slist_find_custom(adapter->devices,
-			key, (GCompareFunc) device_address_cmp))
+	if (stored_device_known(adapter, key))
 		return;
 
 	/* FIXME: Get the correct LE addr type (public/random) */
-	device = device_create(connection, adapter, key, ADDR_TYPE_LE_PUBLIC);
+	device = load_stored_device(adapter, key, ADDR_TYPE_LE_PUBLIC,
+							STORED_PRIMARY);
 	if (!device)
 		return;
 
-	device_set_temporary(device, FALSE);
-	adapter->devices = g_slist_append(adapter->devices, device);
-
-	services = string_to_primary_list(value);
-	if (services == NULL)
-		return;
-
-	for (l = services, uuids = NULL; l; l = l->next) {
-		struct att_primary *prim = l->data;
-		uuids = g_slist_append(uuids, prim->uuid);
-	}
-
-	device_register_services(connection, device, services, -1);
-
-	device_probe_drivers(device, uuids);
-
-	g_slist_free(uuids);
+	stored_device_load_primary(device, value);
 }
 
 static void smp_key_free(void *data)
@@ -2107,10 +2698,9 @@ static void call_adapter_powered_callbacks(struct btd_adapter *adapter,
        }
 }
 
-static void emit_device_disappeared(gpointer data, gpointer user_data)
+static void emit_device_disappeared(struct btd_adapter *adapter,
+						struct remote_dev_info *dev)
 {
-	struct remote_dev_info *dev = data;
-	struct btd_adapter *adapter = user_data;
 	char address[18];
 	const char *paddr = address;
 
@@ -2120,8 +2710,26 @@ static void emit_device_disappeared(gpointer data, gpointer user_data)
 			ADAPTER_INTERFACE, "DeviceDisappeared",
 			DBUS_TYPE_STRING, &paddr,
 			DBUS_TYPE_INVALID);
+}
 
-	adapter->found_devices = g_slist_remove(adapter->found_devices, dev);
+/* Drops the devices not reported during the current discovery cycle */
+static void remove_out_of_range(struct btd_adapter *adapter)
+{
+	GSequenceIter *iter;
+
+	iter = g_sequence_get_begin_iter(adapter->found_by_rssi);
+
+	while (!g_sequence_iter_is_end(iter)) {
+		struct remote_dev_info *dev = g_sequence_get(iter);
+
+		iter = g_sequence_iter_next(iter);
+
+		if (dev->generation == adapter->found_gen)
+			continue;
+
+		emit_device_disappeared(adapter, dev);
+		found_device_remove(adapter, dev);
+	}
 }
 
 void btd_adapter_get_mode(struct btd_adapter *adapter, uint8_t *mode,
@@ -2356,9 +2964,17 @@ static void adapter_free(gpointer user_data)
 
 	sdp_list_free(adapter->services, NULL);
 
-	g_slist_free_full(adapter->found_devices, dev_info_free);
+	if (adapter->report_id > 0)
+		g_source_remove(adapter->report_id);
 
-	g_slist_free(adapter->oor_devices);
+	g_slist_free(adapter->found_pending);
+	g_timer_destroy(adapter->report_clock);
+	g_hash_table_destroy(adapter->found_devices);
+	g_sequence_free(adapter->found_by_rssi);
+
+	g_hash_table_destroy(adapter->devices_by_addr);
+	g_hash_table_destroy(adapter->devices_by_path);
+	stored_devices_free(adapter->stored_devices);
 
 	g_free(adapter->path);
 	g_free(adapter->name);
@@ -2444,6 +3060,17 @@ struct btd_adapter *adapter_create(DBusConnection *conn, int id)
 
 	adapter->dev_id = id;
 
+	adapter->found_devices = g_hash_table_new(bt_bdaddr_hash,
+							bt_bdaddr_equal);
+	adapter->found_by_rssi = g_sequence_new(dev_info_free);
+
+	adapter->report_clock = g_timer_new();
+
+	adapter->devices_by_addr = g_hash_table_new_full(bt_bdaddr_hash,
+						bt_bdaddr_equal, g_free, NULL);
+	adapter->devices_by_path = g_hash_table_new(path_hash, path_equal);
+	adapter->stored_devices = stored_devices_new();
+
 	snprintf(path, sizeof(path), "%s/hci%d", base_path, id);
 	adapter->path = g_strdup(path);
 
@@ -2464,9 +3091,15 @@ void adapter_remove(struct btd_adapter *adapter)
 
 	DBG("Removing adapter %s", adapter->path);
 
+	g_hash_table_remove_all(adapter->devices_by_addr);
+	g_hash_table_remove_all(adapter->devices_by_path);
+	stored_devices_clear(adapter->stored_devices);
+
 	for (l = adapter->devices; l; l = l->next)
 		device_remove(l->data, FALSE);
 	g_slist_free(adapter->devices);
+	adapter->devices = NULL;
+	adapter->devices_tail = NULL;
 
 	unload_drivers(adapter);
 	if (main_opts.attrib_server)
@@ -2516,9 +3149,21 @@ void adapter_set_discovering(struct btd_adapter *adapter,
 	if (discovering)
 		return;
 
-	g_slist_foreach(adapter->oor_devices, emit_device_disappeared, adapter);
-	g_slist_free_full(adapter->oor_devices, dev_info_free);
-	adapter->oor_devices = g_slist_copy(adapter->found_devices);
+	flush_found_devices(adapter);
+
+	emit_property_changed(connection, path, ADAPTER_INTERFACE,
+				"ReportsForwarded", DBUS_TYPE_UINT32,
+				&adapter->reports_forwarded);
+	emit_property_changed(connection, path, ADAPTER_INTERFACE,
+				"ReportsSuppressed", DBUS_TYPE_UINT32,
+				&adapter->reports_suppressed);
+
+	if (adapter->oor_tracking)
+		remove_out_of_range(adapter);
+
+	/* Devices must be reported again during the next cycle */
+	adapter->oor_tracking = TRUE;
+	adapter->found_gen++;
 
 	if (!adapter_has_discov_sessions(adapter) || adapter->discov_suspended)
 		return;
@@ -2537,10 +3182,7 @@ static void suspend_discovery(struct btd_adapter *adapter)
 
 	DBG("Suspending discovery");
 
-	if (adapter->oor_devices) {
-		g_slist_free(adapter->oor_devices);
-		adapter->oor_devices = NULL;
-	}
+	adapter->oor_tracking = FALSE;
 
 	adapter->discov_suspended = TRUE;
 
@@ -2551,188 +3193,20 @@ static void suspend_discovery(struct btd_adapter *adapter)
 		adapter_ops->stop_discovery(adapter->dev_id);
 }
 
-static int found_device_cmp(gconstpointer a, gconstpointer b)
-{
-	const struct remote_dev_info *d = a;
-	const bdaddr_t *bdaddr = b;
-
-	if (bacmp(bdaddr, BDADDR_ANY) == 0)
-		return 0;
-
-	return bacmp(&d->bdaddr, bdaddr);
-}
-
 struct remote_dev_info *adapter_search_found_devices(struct btd_adapter *adapter,
 							bdaddr_t *bdaddr)
 {
-	GSList *l;
-
-	l = g_slist_find_custom(adapter->found_devices, bdaddr,
-							found_device_cmp);
-	if (l)
-		return l->data;
-
-	return NULL;
-}
-
-static int dev_rssi_cmp(struct remote_dev_info *d1, struct remote_dev_info *d2)
-{
-	int rssi1, rssi2;
-
-	rssi1 = d1->rssi < 0 ? -d1->rssi : d1->rssi;
-	rssi2 = d2->rssi < 0 ? -d2->rssi : d2->rssi;
-
-	return rssi1 - rssi2;
-}
-
-static void append_dict_valist(DBusMessageIter *iter,
-					const char *first_key,
-					va_list var_args)
-{
-	DBusMessageIter dict;
-	const char *key;
-	int type;
-	int n_elements;
-	void *val;
-
-	dbus_message_iter_open_container(iter, DBUS_TYPE_ARRAY,
-			DBUS_DICT_ENTRY_BEGIN_CHAR_AS_STRING
-			DBUS_TYPE_STRING_AS_STRING DBUS_TYPE_VARIANT_AS_STRING
-			DBUS_DICT_ENTRY_END_CHAR_AS_STRING, &dict);
-
-	key = first_key;
-	while (key) {
-		type = va_arg(var_args, int);
-		val = va_arg(var_args, void *);
-		if (type == DBUS_TYPE_ARRAY) {
-			n_elements = va_arg(var_args, int);
-			if (n_elements > 0)
-				dict_append_array(&dict, key, DBUS_TYPE_STRING,
-						val, n_elements);
-		} else
-			dict_append_entry(&dict, key, type, val);
-		key = va_arg(var_args, char *);
-	}
-
-	dbus_message_iter_close_container(iter, &dict);
-}
-
-static void emit_device_found(const char *path, const char *address,
-				const char *first_key, ...)
-{
-	DBusMessage *signal;
-	DBusMessageIter iter;
-	va_list var_args;
-
-	signal = dbus_message_new_signal(path, ADAPTER_INTERFACE,
-					"DeviceFound");
-	if (!signal) {
-		error("Unable to allocate new %s.DeviceFound signal",
-				ADAPTER_INTERFACE);
-		return;
-	}
-	dbus_message_iter_init_append(signal, &iter);
-	dbus_message_iter_append_basic(&iter, DBUS_TYPE_STRING, &address);
-
-	va_start(var_args, first_key);
-	append_dict_valist(&iter, first_key, var_args);
-	va_end(var_args);
+	GSequenceIter *iter;
 
-	g_dbus_send_message(connection, signal);
-}
-
-static char **strlist2array(GSList *list)
-{
-	unsigned int i, n;
-	char **array;
+	if (bacmp(bdaddr, BDADDR_ANY) != 0)
+		return g_hash_table_lookup(adapter->found_devices, bdaddr);
 
-	if (list == NULL)
+	/* Any device: the one with the strongest signal */
+	iter = g_sequence_get_begin_iter(adapter->found_by_rssi);
+	if (g_sequence_iter_is_end(iter))
 		return NULL;
 
-	n = g_slist_length(list);
-	array = g_new0(char *, n + 1);
-
-	for (i = 0; list; list = list->next, i++)
-		array[i] = g_strdup((const gchar *) list->data);
-
-	return array;
-}
-
-void adapter_emit_device_found(struct btd_adapter *adapter,
-						struct remote_dev_info *dev)
-{
-	struct btd_device *device;
-	char peer_addr[18], local_addr[18];
-	const char *icon, *paddr = peer_addr;
-	dbus_bool_t paired = FALSE, trusted = FALSE;
-	dbus_int16_t rssi = dev->rssi;
-	char *alias;
-	size_t uuid_count;
-
-	ba2str(&dev->bdaddr, peer_addr);
-	ba2str(&adapter->bdaddr, local_addr);
-
-	device = adapter_find_device(adapter, paddr);
-	if (device) {
-		paired = device_is_paired(device);
-		trusted = device_is_trusted(device);
-	}
-
-	/* The uuids string array is updated only if necessary */
-	uuid_count = g_slist_length(dev->services);
-	if (dev->services && dev->uuid_count != uuid_count) {
-		g_strfreev(dev->uuids);
-		dev->uuids = strlist2array(dev->services);
-		dev->uuid_count = uuid_count;
-	}
-
-	if (!dev->alias) {
-		if (!dev->name) {
-			alias = g_strdup(peer_addr);
-			g_strdelimit(alias, ":", '-');
-		} else
-			alias = g_strdup(dev->name);
-	} else
-		alias = g_strdup(dev->alias);
-
-	if (dev->type != ADDR_TYPE_BREDR) {
-		gboolean broadcaster;
-
-		if (dev->flags & (EIR_LIM_DISC | EIR_GEN_DISC))
-			broadcaster = FALSE;
-		else
-			broadcaster = TRUE;
-
-		dev->legacy = FALSE;
-
-		emit_device_found(adapter->path, paddr,
-				"Address", DBUS_TYPE_STRING, &paddr,
-				"RSSI", DBUS_TYPE_INT16, &rssi,
-				"Name", DBUS_TYPE_STRING, &dev->name,
-				"Alias", DBUS_TYPE_STRING, &alias,
-				"LegacyPairing", DBUS_TYPE_BOOLEAN, &dev->legacy,
-				"Paired", DBUS_TYPE_BOOLEAN, &paired,
-				"Broadcaster", DBUS_TYPE_BOOLEAN, &broadcaster,
-				"UUIDs", DBUS_TYPE_ARRAY, &dev->uuids, uuid_count,
-				NULL);
-	} else {
-		icon = class_to_icon(dev->class);
-
-		emit_device_found(adapter->path, paddr,
-				"Address", DBUS_TYPE_STRING, &paddr,
-				"Class", DBUS_TYPE_UINT32, &dev->class,
-				"Icon", DBUS_TYPE_STRING, &icon,
-				"RSSI", DBUS_TYPE_INT16, &rssi,
-				"Name", DBUS_TYPE_STRING, &dev->name,
-				"Alias", DBUS_TYPE_STRING, &alias,
-				"LegacyPairing", DBUS_TYPE_BOOLEAN, &dev->legacy,
-				"Paired", DBUS_TYPE_BOOLEAN, &paired,
-				"Trusted", DBUS_TYPE_BOOLEAN, &trusted,
-				"UUIDs", DBUS_TYPE_ARRAY, &dev->uuids, uuid_count,
-				NULL);
-	}
-
-	g_free(alias);
+	return g_sequence_get(iter);
 }
 
 static struct remote_dev_info *found_device_new(const bdaddr_t *bdaddr,
@@ -2812,6 +3286,67 @@ static char *read_stored_data(bdaddr_t *local, bdaddr_t *peer, const char *file)
 	return textfile_get(filename, peer_addr);
 }
 
+/*
+ * Duplicate reports are checked against the found device they refer to,
+ * the same state adapter_update_found_devices() keeps. The first report
+ * of every device in a discovery cycle always gets through.
+ */
+gboolean adapter_filter_report(struct btd_adapter *adapter, bdaddr_t *bdaddr,
+					int8_t rssi, uint8_t *data,
+					uint8_t data_len)
+{
+	struct remote_dev_info *dev;
+	struct eir_view view;
+	unsigned int hysteresis;
+	gdouble now;
+
+	if (main_opts.report_refresh == 0)
+		goto forward;
+
+	dev = g_hash_table_lookup(adapter->found_devices, bdaddr);
+	if (dev == NULL || dev->generation != adapter->found_gen)
+		goto forward;
+
+	if (eir_parse_view(&view, data, data_len) < 0 ||
+						view.hash != dev->eir_hash)
+		goto forward;
+
+	/* Also skip RSSI changes no discovery session wants reported */
+	hysteresis = main_opts.report_hysteresis;
+	if (adapter->rssi_delta > hysteresis + 1)
+		hysteresis = adapter->rssi_delta - 1;
+
+	now = g_timer_elapsed(adapter->report_clock, NULL);
+
+	if ((unsigned int) abs(dev->rssi - rssi) <= hysteresis &&
+			now - dev->forwarded < main_opts.report_refresh) {
+		adapter->reports_suppressed++;
+		return TRUE;
+	}
+
+	dev->forwarded = now;
+
+forward:
+	adapter->reports_forwarded++;
+
+	return FALSE;
+}
+
+static uint8_t found_device_set_rssi(struct btd_adapter *adapter,
+					struct remote_dev_info *dev,
+					int8_t rssi)
+{
+	if (dev->rssi != rssi) {
+		dev->rssi = rssi;
+		g_sequence_sort_changed(dev->rssi_pos, dev_rssi_cmp, NULL);
+	}
+
+	if (abs(dev->rssi - dev->reported_rssi) >= MAX(adapter->rssi_delta, 1))
+		return DEV_FOUND_RSSI;
+
+	return 0;
+}
+
 void adapter_update_found_devices(struct btd_adapter *adapter,
 					bdaddr_t *bdaddr, addr_type_t type,
 					int8_t rssi, uint8_t confirm_name,
@@ -2819,18 +3354,36 @@ void adapter_update_found_devices(struct btd_adapter *adapter,
 {
 	struct remote_dev_info *dev;
 	struct eir_data eir_data;
+	struct eir_view view;
 	char *alias, *name;
 	gboolean legacy, name_known;
 	uint32_t dev_class;
+	uint8_t changed = 0;
+	size_t uuid_count;
 	int err;
 
-	memset(&eir_data, 0, sizeof(eir_data));
-	err = eir_parse(&eir_data, data, data_len);
+	err = eir_parse_view(&view, data, data_len);
 	if (err < 0) {
 		error("Error parsing EIR data: %s (%d)", strerror(-err), -err);
 		return;
 	}
 
+	/* Repeated reports usually carry the very same data: skip the
+	 * storage writes and string conversions for them */
+	dev = g_hash_table_lookup(adapter->found_devices, bdaddr);
+	if (dev && dev->eir_hash == view.hash) {
+		dev->generation = adapter->found_gen;
+
+		if (dev->rssi != rssi)
+			adapter_found_device_changed(adapter, dev,
+				found_device_set_rssi(adapter, dev, rssi));
+
+		return;
+	}
+
+	memset(&eir_data, 0, sizeof(eir_data));
+	eir_parse(&eir_data, data, data_len);
+
 	dev_class = eir_data.dev_class[0] | (eir_data.dev_class[1] << 8) |
 						(eir_data.dev_class[2] << 16);
 	if (dev_class != 0)
@@ -2839,16 +3392,16 @@ void adapter_update_found_devices(struct btd_adapter *adapter,
 	if (eir_data.name != NULL && eir_data.name_complete)
 		write_device_name(&adapter->bdaddr, bdaddr, eir_data.name);
 
-	dev = adapter_search_found_devices(adapter, bdaddr);
 	if (dev) {
-		adapter->oor_devices = g_slist_remove(adapter->oor_devices,
-							dev);
+		dev->generation = adapter->found_gen;
+		dev->eir_hash = view.hash;
 
 		/* If an existing device had no name but the newly received EIR
 		 * data has (complete or not), we want to present it to the
 		 * user. */
 		if (dev->name == NULL && eir_data.name != NULL) {
 			dev->name = g_strdup(eir_data.name);
+			changed |= DEV_FOUND_NAME;
 			goto done;
 		}
 
@@ -2889,18 +3442,21 @@ void adapter_update_found_devices(struct btd_adapter *adapter,
 	free(name);
 	free(alias);
 
-	adapter->found_devices = g_slist_prepend(adapter->found_devices, dev);
-
-done:
 	dev->rssi = rssi;
+	dev->eir_hash = view.hash;
+	dev->forwarded = g_timer_elapsed(adapter->report_clock, NULL);
+	found_device_add(adapter, dev);
 
-	adapter->found_devices = g_slist_sort(adapter->found_devices,
-						(GCompareFunc) dev_rssi_cmp);
+done:
+	changed |= found_device_set_rssi(adapter, dev, rssi);
 
+	uuid_count = g_slist_length(dev->services);
 	g_slist_foreach(eir_data.services, remove_same_uuid, dev);
 	g_slist_foreach(eir_data.services, dev_prepend_uuid, dev);
+	if (g_slist_length(dev->services) != uuid_count)
+		changed |= DEV_FOUND_UUIDS;
 
-	adapter_emit_device_found(adapter, dev);
+	adapter_found_device_changed(adapter, dev, changed);
 
 	eir_data_free(&eir_data);
 }
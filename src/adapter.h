@@ -80,8 +80,22 @@ struct remote_dev_info {
 	GSList *services;
 	uint8_t bdaddr_type;
 	uint8_t flags;
+	GSequenceIter *rssi_pos;	/* position in the RSSI ordering */
+	unsigned int generation;	/* discovery cycle last seen in */
+	uint8_t changed;		/* DEV_FOUND_* not yet reported */
+	gboolean reported;		/* DeviceFound sent at least once */
+	gboolean queued;		/* waiting for the report window */
+	int8_t reported_rssi;		/* RSSI in the last report */
+	uint32_t eir_hash;		/* of the last EIR data processed */
+	gdouble forwarded;		/* last report let through the filter */
 };
 
+/* Properties of a found device that changed since its last report */
+#define DEV_FOUND_RSSI		0x01
+#define DEV_FOUND_NAME		0x02
+#define DEV_FOUND_UUIDS		0x04
+#define DEV_FOUND_ALL		0xff
+
 void btd_adapter_start(struct btd_adapter *adapter);
 
 int btd_adapter_stop(struct btd_adapter *adapter);
@@ -117,12 +131,16 @@ void adapter_set_state(struct btd_adapter *adapter, int state);
 int adapter_get_state(struct btd_adapter *adapter);
 struct remote_dev_info *adapter_search_found_devices(struct btd_adapter *adapter,
 							bdaddr_t *bdaddr);
+gboolean adapter_filter_report(struct btd_adapter *adapter, bdaddr_t *bdaddr,
+					int8_t rssi, uint8_t *data,
+					uint8_t data_len);
 void adapter_update_found_devices(struct btd_adapter *adapter,
 					bdaddr_t *bdaddr, addr_type_t type,
 					int8_t rssi, uint8_t confirm_name,
 					uint8_t *data, uint8_t data_len);
-void adapter_emit_device_found(struct btd_adapter *adapter,
-						struct remote_dev_info *dev);
+void adapter_found_device_changed(struct btd_adapter *adapter,
+					struct remote_dev_info *dev,
+					uint8_t changed);
 void adapter_mode_changed(struct btd_adapter *adapter, uint8_t scan_mode);
 int adapter_set_name(struct btd_adapter *adapter, const char *name);
 void adapter_name_changed(struct btd_adapter *adapter, const char *name);
@@ -70,7 +70,6 @@ struct gatt_channel {
 	bdaddr_t src;
 	bdaddr_t dst;
 	GAttrib *attrib;
-	guint mtu;
 	gboolean le;
 	guint id;
 	gboolean encrypted;
@@ -270,7 +269,7 @@ static struct attribute *find_primary_range(struct gatt_server *server,
 
 	attrib = l->data;
 
-	if (bt_uuid_cmp(&attrib->uuid, &prim_uuid) != 0)
+	if (!bt_uuid_equal(&attrib->uuid, &prim_uuid))
 		return NULL;
 
 	*end = start;
@@ -278,8 +277,8 @@ static struct attribute *find_primary_range(struct gatt_server *server,
 	for (l = l->next; l; l = l->next) {
 		struct attribute *a = l->data;
 
-		if (bt_uuid_cmp(&a->uuid, &prim_uuid) == 0 ||
-				bt_uuid_cmp(&a->uuid, &snd_uuid) == 0)
+		if (bt_uuid_equal(&a->uuid, &prim_uuid) ||
+				bt_uuid_equal(&a->uuid, &snd_uuid))
 			break;
 
 		*end = a->handle;
@@ -414,8 +413,8 @@ static uint16_t read_by_group(struct gatt_channel *channel, uint16_t start,
 	 * types may be used in the Read By Group Type Request.
 	 */
 
-	if (bt_uuid_cmp(uuid, &prim_uuid) != 0 &&
-		bt_uuid_cmp(uuid, &snd_uuid) != 0)
+	if (!bt_uuid_equal(uuid, &prim_uuid) &&
+		!bt_uuid_equal(uuid, &snd_uuid))
 		return enc_error_resp(ATT_OP_READ_BY_GROUP_REQ, 0x0000,
 					ATT_ECODE_UNSUPP_GRP_TYPE, pdu, len);
 
@@ -432,13 +431,13 @@ static uint16_t read_by_group(struct gatt_channel *channel, uint16_t start,
 			break;
 
 		/* The old group ends when a new one starts */
-		if (old && (bt_uuid_cmp(&a->uuid, &prim_uuid) == 0 ||
-				bt_uuid_cmp(&a->uuid, &snd_uuid) == 0)) {
+		if (old && (bt_uuid_equal(&a->uuid, &prim_uuid) ||
+				bt_uuid_equal(&a->uuid, &snd_uuid))) {
 			old->end = last_handle;
 			old = NULL;
 		}
 
-		if (bt_uuid_cmp(&a->uuid, uuid) != 0) {
+		if (!bt_uuid_equal(&a->uuid, uuid)) {
 			/* Still inside a service, update its last handle */
 			if (old)
 				last_handle = a->handle;
@@ -534,7 +533,7 @@ static uint16_t read_by_type(struct gatt_channel *channel, uint16_t start,
 		if (a->handle > end)
 			break;
 
-		if (bt_uuid_cmp(&a->uuid, uuid)  != 0)
+		if (!bt_uuid_equal(&a->uuid, uuid))
 			continue;
 
 		status = att_check_reqs(channel, ATT_OP_READ_BY_TYPE_REQ,
@@ -691,7 +690,7 @@ static int find_by_type(struct gatt_channel *channel, uint16_t start,
 			break;
 
 		/* Primary service? Attribute value matches? */
-		if ((bt_uuid_cmp(&a->uuid, uuid) == 0) && (a->len == vlen) &&
+		if (bt_uuid_equal(&a->uuid, uuid) && (a->len == vlen) &&
 					(memcmp(a->data, value, vlen) == 0)) {
 
 			range = g_new0(struct att_range, 1);
@@ -705,8 +704,8 @@ static int find_by_type(struct gatt_channel *channel, uint16_t start,
 			/* Update the last found handle or reset the pointer
 			 * to track that a new group started: Primary or
 			 * Secondary service. */
-			if (bt_uuid_cmp(&a->uuid, &prim_uuid) == 0 ||
-					bt_uuid_cmp(&a->uuid, &snd_uuid) == 0)
+			if (bt_uuid_equal(&a->uuid, &prim_uuid) ||
+					bt_uuid_equal(&a->uuid, &snd_uuid))
 				range = NULL;
 			else
 				range->end = a->handle;
@@ -741,7 +740,7 @@ static uint16_t read_value(struct gatt_channel *channel, uint16_t handle,
 
 	a = l->data;
 
-	if (bt_uuid_cmp(&ccc_uuid, &a->uuid) == 0 &&
+	if (bt_uuid_equal(&ccc_uuid, &a->uuid) &&
 		read_device_ccc(&channel->src, &channel->dst,
 					handle, &cccval) == 0) {
 		uint8_t config[2];
@@ -783,7 +782,7 @@ static uint16_t read_blob(struct gatt_channel *channel, uint16_t handle,
 		return enc_error_resp(ATT_OP_READ_BLOB_REQ, handle,
 					ATT_ECODE_INVALID_OFFSET, pdu, len);
 
-	if (bt_uuid_cmp(&ccc_uuid, &a->uuid) == 0 &&
+	if (bt_uuid_equal(&ccc_uuid, &a->uuid) &&
 		read_device_ccc(&channel->src, &channel->dst,
 					handle, &cccval) == 0) {
 		uint8_t config[2];
@@ -827,7 +826,7 @@ static uint16_t write_value(struct gatt_channel *channel, uint16_t handle,
 		return enc_error_resp(ATT_OP_WRITE_REQ, handle, status, pdu,
 									len);
 
-	if (bt_uuid_cmp(&ccc_uuid, &a->uuid) != 0) {
+	if (!bt_uuid_equal(&ccc_uuid, &a->uuid)) {
 
 		attrib_db_update(channel->server->adapter, handle, NULL,
 							value, vlen, NULL);
@@ -849,18 +848,14 @@ static uint16_t write_value(struct gatt_channel *channel, uint16_t handle,
 static uint16_t mtu_exchange(struct gatt_channel *channel, uint16_t mtu,
 		uint8_t *pdu, int len)
 {
-	guint old_mtu = channel->mtu;
+	uint16_t plen;
 
-	if (mtu < ATT_DEFAULT_LE_MTU)
-		channel->mtu = ATT_DEFAULT_LE_MTU;
-	else
-		channel->mtu = MIN(mtu, channel->mtu);
+	/* Encoded with the MTU in use until the response is sent */
+	plen = enc_mtu_resp(ATT_MAX_MTU, pdu, len);
 
-	bt_io_set(channel->server->le_io, BT_IO_L2CAP, NULL,
-			BT_IO_OPT_OMTU, channel->mtu,
-			BT_IO_OPT_INVALID);
+	g_attrib_set_mtu(channel->attrib, MIN(mtu, ATT_MAX_MTU));
 
-	return enc_mtu_resp(old_mtu, pdu, len);
+	return plen;
 }
 
 static void channel_remove(struct gatt_channel *channel)
@@ -883,11 +878,14 @@ static void channel_handler(const uint8_t *ipdu, uint16_t len,
 {
 	struct gatt_channel *channel = user_data;
 	uint8_t opdu[ATT_MAX_MTU], value[ATT_MAX_MTU];
-	uint16_t length, start, end, mtu, offset;
+	uint16_t length, start, end, mtu, client_mtu, offset;
 	bt_uuid_t uuid;
 	uint8_t status = 0;
 	int vlen;
 
+	/* Responses are filled up to the MTU negotiated on this bearer */
+	mtu = g_attrib_get_mtu(channel->attrib);
+
 	DBG("op 0x%02x", ipdu[0]);
 
 	switch (ipdu[0]) {
@@ -898,8 +896,12 @@ static void channel_handler(const uint8_t *ipdu, uint16_t len,
 			goto done;
 		}
 
+		/* Attribute types in the database are compared against it
+		 * once per attribute: normalize it up front */
+		bt_uuid_to_canonical(&uuid, &uuid);
+
 		length = read_by_group(channel, start, end, &uuid, opdu,
-								channel->mtu);
+								mtu);
 		break;
 	case ATT_OP_READ_BY_TYPE_REQ:
 		length = dec_read_by_type_req(ipdu, len, &start, &end, &uuid);
@@ -908,8 +910,10 @@ static void channel_handler(const uint8_t *ipdu, uint16_t len,
 			goto done;
 		}
 
+		bt_uuid_to_canonical(&uuid, &uuid);
+
 		length = read_by_type(channel, start, end, &uuid, opdu,
-								channel->mtu);
+								mtu);
 		break;
 	case ATT_OP_READ_REQ:
 		length = dec_read_req(ipdu, len, &start);
@@ -918,7 +922,7 @@ static void channel_handler(const uint8_t *ipdu, uint16_t len,
 			goto done;
 		}
 
-		length = read_value(channel, start, opdu, channel->mtu);
+		length = read_value(channel, start, opdu, mtu);
 		break;
 	case ATT_OP_READ_BLOB_REQ:
 		length = dec_read_blob_req(ipdu, len, &start, &offset);
@@ -927,7 +931,7 @@ static void channel_handler(const uint8_t *ipdu, uint16_t len,
 			goto done;
 		}
 
-		length = read_blob(channel, start, offset, opdu, channel->mtu);
+		length = read_blob(channel, start, offset, opdu, mtu);
 		break;
 	case ATT_OP_MTU_REQ:
 		if (!channel->le) {
@@ -935,13 +939,13 @@ static void channel_handler(const uint8_t *ipdu, uint16_t len,
 			goto done;
 		}
 
-		length = dec_mtu_req(ipdu, len, &mtu);
+		length = dec_mtu_req(ipdu, len, &client_mtu);
 		if (length == 0) {
 			status = ATT_ECODE_INVALID_PDU;
 			goto done;
 		}
 
-		length = mtu_exchange(channel, mtu, opdu, channel->mtu);
+		length = mtu_exchange(channel, client_mtu, opdu, mtu);
 		break;
 	case ATT_OP_FIND_INFO_REQ:
 		length = dec_find_info_req(ipdu, len, &start, &end);
@@ -950,7 +954,7 @@ static void channel_handler(const uint8_t *ipdu, uint16_t len,
 			goto done;
 		}
 
-		length = find_info(channel, start, end, opdu, channel->mtu);
+		length = find_info(channel, start, end, opdu, mtu);
 		break;
 	case ATT_OP_WRITE_REQ:
 		length = dec_write_req(ipdu, len, &start, value, &vlen);
@@ -960,13 +964,13 @@ static void channel_handler(const uint8_t *ipdu, uint16_t len,
 		}
 
 		length = write_value(channel, start, value, vlen, opdu,
-								channel->mtu);
+								mtu);
 		break;
 	case ATT_OP_WRITE_CMD:
 		length = dec_write_cmd(ipdu, len, &start, value, &vlen);
 		if (length > 0)
 			write_value(channel, start, value, vlen, opdu,
-								channel->mtu);
+								mtu);
 		return;
 	case ATT_OP_FIND_BY_TYPE_REQ:
 		length = dec_find_by_type_req(ipdu, len, &start, &end,
@@ -976,8 +980,10 @@ static void channel_handler(const uint8_t *ipdu, uint16_t len,
 			goto done;
 		}
 
+		bt_uuid_to_canonical(&uuid, &uuid);
+
 		length = find_by_type(channel, start, end, &uuid, value, vlen,
-							opdu, channel->mtu);
+							opdu, mtu);
 		break;
 	case ATT_OP_HANDLE_CNF:
 		return;
@@ -996,7 +1002,7 @@ static void channel_handler(const uint8_t *ipdu, uint16_t len,
 done:
 	if (status)
 		length = enc_error_resp(ipdu[0], 0x0000, status, opdu,
-								channel->mtu);
+								mtu);
 
 	g_attrib_send(channel->attrib, 0, opdu[0], opdu, length,
 							NULL, NULL, NULL);
@@ -1020,7 +1026,6 @@ guint attrib_channel_attach(GAttrib *attrib)
 			BT_IO_OPT_SOURCE_BDADDR, &channel->src,
 			BT_IO_OPT_DEST_BDADDR, &channel->dst,
 			BT_IO_OPT_CID, &cid,
-			BT_IO_OPT_OMTU, &channel->mtu,
 			BT_IO_OPT_INVALID);
 	if (gerr) {
 		error("bt_io_get: %s", gerr->message);
@@ -1047,9 +1052,6 @@ guint attrib_channel_attach(GAttrib *attrib)
 	if (device == NULL || device_is_bonded(device) == FALSE)
 		delete_device_ccc(&channel->src, &channel->dst);
 
-	if (channel->mtu > ATT_MAX_MTU)
-		channel->mtu = ATT_MAX_MTU;
-
 	if (cid != ATT_CID)
 		channel->le = FALSE;
 	else
@@ -1305,14 +1307,14 @@ static uint16_t find_uuid16_avail(struct btd_adapter *adapter, uint16_t nitems)
 	for (dl = server->database, handle = 0x0001; dl; dl = dl->next) {
 		struct attribute *a = dl->data;
 
-		if ((bt_uuid_cmp(&a->uuid, &prim_uuid) == 0 ||
-				bt_uuid_cmp(&a->uuid, &snd_uuid) == 0) &&
+		if ((bt_uuid_equal(&a->uuid, &prim_uuid) ||
+				bt_uuid_equal(&a->uuid, &snd_uuid)) &&
 				a->handle - handle >= nitems)
 			/* Note: the range above excludes the current handle */
 			return handle;
 
-		if (a->len == 16 && (bt_uuid_cmp(&a->uuid, &prim_uuid) == 0 ||
-				bt_uuid_cmp(&a->uuid, &snd_uuid) == 0)) {
+		if (a->len == 16 && (bt_uuid_equal(&a->uuid, &prim_uuid) ||
+				bt_uuid_equal(&a->uuid, &snd_uuid))) {
 			/* 128 bit UUID service definition */
 			return 0;
 		}
@@ -1350,8 +1352,8 @@ static uint16_t find_uuid128_avail(struct btd_adapter *adapter, uint16_t nitems)
 		if (handle == 0)
 			handle = a->handle;
 
-		if (bt_uuid_cmp(&a->uuid, &prim_uuid) != 0 &&
-				bt_uuid_cmp(&a->uuid, &snd_uuid) != 0)
+		if (!bt_uuid_equal(&a->uuid, &prim_uuid) &&
+				!bt_uuid_equal(&a->uuid, &snd_uuid))
 			continue;
 
 		if (end - handle >= nitems)
@@ -58,6 +58,7 @@
 #include "glib-helper.h"
 #include "sdp-client.h"
 #include "gatt.h"
+#include "gatt-cache.h"
 #include "agent.h"
 #include "sdp-xml.h"
 #include "storage.h"
@@ -149,6 +150,7 @@ struct btd_device {
 	struct authentication_req *authr;	/* authentication request */
 	GSList		*disconnects;		/* disconnects message */
 	GAttrib		*attrib;
+	struct gatt_cache *gatt_cache;		/* Remote attribute cache */
 	GSList		*attios;
 	GSList		*attios_offline;
 	guint		attachid;		/* Attrib server attach */
@@ -216,6 +218,9 @@ static void att_cleanup(struct btd_device *device)
 		device->att_io = NULL;
 	}
 
+	if (device->gatt_cache)
+		gatt_cache_detach(device->gatt_cache);
+
 	if (device->attrib) {
 		g_attrib_unref(device->attrib);
 		device->attrib = NULL;
@@ -262,6 +267,9 @@ static void device_free(gpointer user_data)
 
 	att_cleanup(device);
 
+	if (device->gatt_cache)
+		gatt_cache_free(device->gatt_cache);
+
 	if (device->tmp_records)
 		sdp_list_free(device->tmp_records,
 					(sdp_free_func_t) sdp_record_free);
@@ -1870,6 +1878,15 @@ static void att_connect_cb(GIOChannel *io, GError *gerr, gpointer user_data)
 	device->cleanup_id = g_io_add_watch(io, G_IO_HUP,
 					attrib_disconnected_cb, device);
 
+	/* Exchanged first so that every following PDU can use it */
+	if (main_opts.attrib_mtu > ATT_DEFAULT_LE_MTU && device_is_le(device))
+		g_attrib_exchange_mtu(attrib, main_opts.attrib_mtu, NULL,
+									NULL);
+
+	/* Queued ahead of any profile request so a stale cache is
+	 * dropped before it gets used */
+	gatt_cache_attach(btd_device_get_gatt_cache(device), attrib);
+
 	if (attcb->success)
 		attcb->success(user_data);
 done:
@@ -2830,6 +2847,19 @@ GSList *btd_device_get_primaries(struct btd_device *device)
 	return device->primaries;
 }
 
+struct gatt_cache *btd_device_get_gatt_cache(struct btd_device *device)
+{
+	bdaddr_t sba;
+
+	if (device->gatt_cache)
+		return device->gatt_cache;
+
+	adapter_get_address(device->adapter, &sba);
+	device->gatt_cache = gatt_cache_new(&sba, &device->bdaddr);
+
+	return device->gatt_cache;
+}
+
 void btd_device_add_uuid(struct btd_device *device, const char *uuid)
 {
 	GSList *uuid_list;
@@ -2928,6 +2958,8 @@ static gboolean notify_attios(gpointer user_data)
 	if (device->attrib == NULL)
 		return FALSE;
 
+	gatt_cache_attach(btd_device_get_gatt_cache(device), device->attrib);
+
 	g_slist_foreach(device->attios_offline, attio_connected, device->attrib);
 	device->attios = g_slist_concat(device->attios, device->attios_offline);
 	device->attios_offline = NULL;
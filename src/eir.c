@@ -34,6 +34,7 @@
 #include <bluetooth/bluetooth.h>
 #include <bluetooth/hci.h>
 #include <bluetooth/sdp.h>
+#include <bluetooth/sdp_lib.h>
 
 #include "glib-compat.h"
 #include "glib-helper.h"
@@ -47,67 +48,71 @@ void eir_data_free(struct eir_data *eir)
 	eir->name = NULL;
 }
 
-static void eir_parse_uuid16(struct eir_data *eir, void *data, uint8_t len)
+static void eir_view_add_uuids(struct eir_view *view, uint8_t type,
+					uint8_t offset, uint8_t len)
 {
-	uint16_t *uuid16 = data;
-	uuid_t service;
-	char *uuid_str;
-	unsigned int i;
-
-	service.type = SDP_UUID16;
-	for (i = 0; i < len / 2; i++, uuid16++) {
-		service.value.uuid16 = btohs(bt_get_unaligned(uuid16));
-		uuid_str = bt_uuid2string(&service);
-		eir->services = g_slist_append(eir->services, uuid_str);
+	struct eir_field *field;
+	unsigned int size;
+
+	switch (type) {
+	case EIR_UUID16_SOME:
+	case EIR_UUID16_ALL:
+		size = 2;
+		break;
+	case EIR_UUID32_SOME:
+	case EIR_UUID32_ALL:
+		size = 4;
+		break;
+	default:
+		size = 16;
+		break;
 	}
-}
 
-static void eir_parse_uuid32(struct eir_data *eir, void *data, uint8_t len)
-{
-	uint32_t *uuid32 = data;
-	uuid_t service;
-	char *uuid_str;
-	unsigned int i;
+	if (len < size || view->uuid_fields == EIR_MAX_UUID_FIELDS)
+		return;
 
-	service.type = SDP_UUID32;
-	for (i = 0; i < len / 4; i++, uuid32++) {
-		service.value.uuid32 = btohl(bt_get_unaligned(uuid32));
-		uuid_str = bt_uuid2string(&service);
-		eir->services = g_slist_append(eir->services, uuid_str);
-	}
+	field = &view->uuids[view->uuid_fields++];
+	field->type = type;
+	field->offset = offset;
+	field->len = len - len % size;
+
+	view->uuid_count += len / size;
 }
 
-static void eir_parse_uuid128(struct eir_data *eir, uint8_t *data, uint8_t len)
+/* FNV-1a */
+static uint32_t eir_hash(const uint8_t *data, size_t len)
 {
-	uint8_t *uuid_ptr = data;
-	uuid_t service;
-	char *uuid_str;
-	unsigned int i;
-	int k;
+	uint32_t hash = 2166136261u;
+	size_t i;
 
-	service.type = SDP_UUID128;
-	for (i = 0; i < len / 16; i++) {
-		for (k = 0; k < 16; k++)
-			service.value.uuid128.data[k] = uuid_ptr[16 - k - 1];
-		uuid_str = bt_uuid2string(&service);
-		eir->services = g_slist_append(eir->services, uuid_str);
-		uuid_ptr += 16;
+	for (i = 0; i < len; i++) {
+		hash ^= data[i];
+		hash *= 16777619u;
 	}
+
+	return hash;
 }
 
-int eir_parse(struct eir_data *eir, uint8_t *eir_data, uint8_t eir_len)
+int eir_parse_view(struct eir_view *view, const uint8_t *eir_data,
+							uint8_t eir_len)
 {
+	const uint8_t *start = eir_data;
 	uint16_t len = 0;
 
-	eir->flags = -1;
+	memset(view, 0, sizeof(*view));
+	view->data = eir_data;
+	view->flags = -1;
 
 	/* No EIR data to parse */
-	if (eir_data == NULL)
+	if (eir_data == NULL) {
+		view->hash = eir_hash(NULL, 0);
 		return 0;
+	}
 
 	while (len < eir_len - 1) {
 		uint8_t field_len = eir_data[0];
-		uint8_t data_len, *data = &eir_data[2];
+		uint8_t data_len, offset = eir_data - start + 2;
+		const uint8_t *data = &eir_data[2];
 
 		/* Check for the end of EIR */
 		if (field_len == 0)
@@ -116,32 +121,24 @@ int eir_parse(struct eir_data *eir, uint8_t *eir_data, uint8_t eir_len)
 		len += field_len + 1;
 
 		/* Bail out if got incorrect length */
-		if (len > eir_len) {
-			eir_data_free(eir);
+		if (len > eir_len)
 			return -EINVAL;
-		}
 
 		data_len = field_len - 1;
 
 		switch (eir_data[1]) {
 		case EIR_UUID16_SOME:
 		case EIR_UUID16_ALL:
-			eir_parse_uuid16(eir, data, data_len);
-			break;
-
 		case EIR_UUID32_SOME:
 		case EIR_UUID32_ALL:
-			eir_parse_uuid32(eir, data, data_len);
-			break;
-
 		case EIR_UUID128_SOME:
 		case EIR_UUID128_ALL:
-			eir_parse_uuid128(eir, data, data_len);
+			eir_view_add_uuids(view, eir_data[1], offset, data_len);
 			break;
 
 		case EIR_FLAGS:
 			if (data_len > 0)
-				eir->flags = *data;
+				view->flags = *data;
 			break;
 
 		case EIR_NAME_SHORT:
@@ -151,24 +148,121 @@ int eir_parse(struct eir_data *eir, uint8_t *eir_data, uint8_t eir_len)
 			while (data_len > 0 && data[data_len - 1] == '\0')
 				data_len--;
 
-			if (!g_utf8_validate((char *) data, data_len, NULL))
+			if (!g_utf8_validate((const char *) data, data_len,
+									NULL))
 				break;
 
-			g_free(eir->name);
-
-			eir->name = g_strndup((char *) data, data_len);
-			eir->name_complete = eir_data[1] == EIR_NAME_COMPLETE;
+			view->name.type = eir_data[1];
+			view->name.offset = offset;
+			view->name.len = data_len;
 			break;
 
 		case EIR_CLASS_OF_DEV:
 			if (data_len < 3)
 				break;
-			memcpy(eir->dev_class, data, 3);
+			view->dev_class.type = eir_data[1];
+			view->dev_class.offset = offset;
+			view->dev_class.len = 3;
 		}
 
 		eir_data += field_len + 1;
 	}
 
+	view->len = len;
+	view->hash = eir_hash(start, len);
+
+	return 0;
+}
+
+gboolean eir_view_get_uuid(const struct eir_view *view, unsigned int index,
+								uuid_t *uuid)
+{
+	const struct eir_field *field;
+	const uint8_t *data;
+	unsigned int i, count;
+	int k;
+
+	for (i = 0; i < view->uuid_fields; i++, index -= count) {
+		field = &view->uuids[i];
+
+		switch (field->type) {
+		case EIR_UUID16_SOME:
+		case EIR_UUID16_ALL:
+			count = field->len / 2;
+			if (index >= count)
+				continue;
+			data = view->data + field->offset + index * 2;
+			sdp_uuid16_create(uuid, bt_get_le16(data));
+			return TRUE;
+
+		case EIR_UUID32_SOME:
+		case EIR_UUID32_ALL:
+			count = field->len / 4;
+			if (index >= count)
+				continue;
+			data = view->data + field->offset + index * 4;
+			sdp_uuid32_create(uuid, bt_get_le32(data));
+			return TRUE;
+
+		default:
+			count = field->len / 16;
+			if (index >= count)
+				continue;
+			data = view->data + field->offset + index * 16;
+			memset(uuid, 0, sizeof(*uuid));
+			uuid->type = SDP_UUID128;
+			for (k = 0; k < 16; k++)
+				uuid->value.uuid128.data[k] = data[16 - k - 1];
+			return TRUE;
+		}
+	}
+
+	return FALSE;
+}
+
+char *eir_view_get_name(const struct eir_view *view)
+{
+	if (view->name.type == 0)
+		return NULL;
+
+	return g_strndup((const char *) view->data + view->name.offset,
+							view->name.len);
+}
+
+int eir_parse(struct eir_data *eir, uint8_t *eir_data, uint8_t eir_len)
+{
+	struct eir_view view;
+	GSList *services = NULL;
+	unsigned int i;
+	int err;
+
+	err = eir_parse_view(&view, eir_data, eir_len);
+	if (err < 0) {
+		eir_data_free(eir);
+		return err;
+	}
+
+	eir->flags = view.flags;
+
+	for (i = 0; i < view.uuid_count; i++) {
+		uuid_t service;
+
+		eir_view_get_uuid(&view, i, &service);
+		services = g_slist_prepend(services, bt_uuid2string(&service));
+	}
+
+	eir->services = g_slist_concat(eir->services,
+						g_slist_reverse(services));
+
+	if (view.name.type != 0) {
+		g_free(eir->name);
+		eir->name = eir_view_get_name(&view);
+		eir->name_complete = view.name.type == EIR_NAME_COMPLETE;
+	}
+
+	if (view.dev_class.type != 0)
+		memcpy(eir->dev_class, view.data + view.dev_class.offset, 3);
+
 	return 0;
 }
 
@@ -48,8 +48,38 @@ struct eir_data {
 	gboolean name_complete;
 };
 
+/* Location of a field payload inside the parsed buffer */
+struct eir_field {
+	uint8_t type;
+	uint8_t offset;
+	uint8_t len;
+};
+
+/* A UUID field takes at least four bytes, so no data of up to 255
+ * bytes can hold more of them */
+#define EIR_MAX_UUID_FIELDS 64
+
+/* Parse result pointing into the caller's buffer; nothing is allocated,
+ * so the buffer must outlive the view */
+struct eir_view {
+	const uint8_t *data;
+	uint8_t len;			/* bytes up to the terminator */
+	int flags;
+	struct eir_field name;		/* type is 0 when absent */
+	struct eir_field dev_class;	/* type is 0 when absent */
+	struct eir_field uuids[EIR_MAX_UUID_FIELDS];
+	unsigned int uuid_fields;
+	unsigned int uuid_count;
+	uint32_t hash;			/* of the significant bytes */
+};
+
 void eir_data_free(struct eir_data *eir);
 int eir_parse(struct eir_data *eir, uint8_t *eir_data, uint8_t eir_len);
+int eir_parse_view(struct eir_view *view, const uint8_t *eir_data,
+							uint8_t eir_len);
+gboolean eir_view_get_uuid(const struct eir_view *view, unsigned int index,
+								uuid_t *uuid);
+char *eir_view_get_name(const struct eir_view *view);
 void eir_create(const char *name, int8_t tx_power, uint16_t did_vendor,
 			uint16_t did_product, uint16_t did_version,
 			GSList *uuids, uint8_t *data);
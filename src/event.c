@@ -260,6 +260,11 @@ void btd_event_device_found(bdaddr_t *local, bdaddr_t *peer, addr_type_t type,
 		return;
 	}
 
+	/* The controller is waiting for an answer to the first report */
+	if (!confirm_name && adapter_filter_report(adapter, peer, rssi,
+							data, data_len))
+		return;
+
 	update_lastseen(local, peer);
 
 	if (data)
@@ -338,7 +343,8 @@ void btd_event_remote_name(bdaddr_t *local, bdaddr_t *peer, char *name)
 	if (dev_info) {
 		g_free(dev_info->name);
 		dev_info->name = g_strdup(name);
-		adapter_emit_device_found(adapter, dev_info);
+		adapter_found_device_changed(adapter, dev_info,
+							DEV_FOUND_NAME);
 	}
 
 	if (device)
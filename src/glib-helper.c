@@ -255,3 +255,20 @@ GSList *bt_string2list(const gchar *str)
 
 	return l;
 }
+
+guint bt_bdaddr_hash(gconstpointer key)
+{
+	const bdaddr_t *bdaddr = key;
+	guint h = 5381;
+	int i;
+
+	for (i = 0; i < 6; i++)
+		h = (h << 5) + h + bdaddr->b[i];
+
+	return h;
+}
+
+gboolean bt_bdaddr_equal(gconstpointer a, gconstpointer b)
+{
+	return bacmp(a, b) == 0;
+}
@@ -38,7 +38,11 @@ struct main_opts {
 	gboolean	reverse_sdp;
 	gboolean	name_resolv;
 	gboolean	debug_keys;
+	gboolean	lazy_devices;
 	gboolean	attrib_server;
+	uint16_t	attrib_mtu;
+	uint8_t		report_hysteresis;
+	uint16_t	report_refresh;
 
 	uint8_t		mode;
 	uint8_t		discov_interval;
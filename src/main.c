@@ -222,6 +222,13 @@ static void parse_config(GKeyFile *config)
 	else
 		main_opts.debug_keys = boolean;
 
+	boolean = g_key_file_get_boolean(config, "General",
+						"LazyDeviceLoading", &err);
+	if (err)
+		g_clear_error(&err);
+	else
+		main_opts.lazy_devices = boolean;
+
 	boolean = g_key_file_get_boolean(config, "General",
 						"AttributeServer", &err);
 	if (err)
@@ -229,6 +236,26 @@ static void parse_config(GKeyFile *config)
 	else
 		main_opts.attrib_server = boolean;
 
+	val = g_key_file_get_integer(config, "General", "AttributeMTU", &err);
+	if (err)
+		g_clear_error(&err);
+	else
+		main_opts.attrib_mtu = val;
+
+	val = g_key_file_get_integer(config, "General",
+					"ReportRSSIHysteresis", &err);
+	if (err)
+		g_clear_error(&err);
+	else
+		main_opts.report_hysteresis = val;
+
+	val = g_key_file_get_integer(config, "General",
+					"ReportRefreshInterval", &err);
+	if (err)
+		g_clear_error(&err);
+	else
+		main_opts.report_refresh = val;
+
 	main_opts.link_mode = HCI_LM_ACCEPT;
 
 	main_opts.link_policy = HCI_LP_RSWITCH | HCI_LP_SNIFF |
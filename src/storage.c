@@ -1187,6 +1187,10 @@ int delete_device_service(const bdaddr_t *sba, const bdaddr_t *dba)
 	create_filename(filename, PATH_MAX, sba, "ccc");
 	delete_by_pattern(filename, address);
 
+	/* Deleting the attribute cache of a given address */
+	create_filename(filename, PATH_MAX, sba, "attcache");
+	textfile_del(filename, address);
+
 	create_filename(filename, PATH_MAX, sba, "primary");
 	return textfile_del(filename, address);
 }
@@ -1232,6 +1236,34 @@ char *read_device_characteristics(const bdaddr_t *sba, const bdaddr_t *dba,
 	return textfile_caseget(filename, key);
 }
 
+int write_device_attribute_cache(const bdaddr_t *sba, const bdaddr_t *dba,
+							const char *cache)
+{
+	char filename[PATH_MAX + 1], addr[18];
+
+	create_filename(filename, PATH_MAX, sba, "attcache");
+
+	create_file(filename, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+
+	ba2str(dba, addr);
+
+	if (cache == NULL || *cache == '\0')
+		return textfile_del(filename, addr);
+
+	return textfile_put(filename, addr, cache);
+}
+
+char *read_device_attribute_cache(const bdaddr_t *sba, const bdaddr_t *dba)
+{
+	char filename[PATH_MAX + 1], addr[18];
+
+	create_filename(filename, PATH_MAX, sba, "attcache");
+
+	ba2str(dba, addr);
+
+	return textfile_caseget(filename, addr);
+}
+
 int write_device_attribute(const bdaddr_t *sba, const bdaddr_t *dba,
 					uint16_t handle, const char *chars)
 {
@@ -84,6 +84,9 @@ char *read_device_characteristics(const bdaddr_t *sba, const bdaddr_t *dba,
 int write_device_attribute(const bdaddr_t *sba, const bdaddr_t *dba,
                                         uint16_t handle, const char *chars);
 int read_device_attributes(const bdaddr_t *sba, textfile_cb func, void *data);
+int write_device_attribute_cache(const bdaddr_t *sba, const bdaddr_t *dba,
+							const char *cache);
+char *read_device_attribute_cache(const bdaddr_t *sba, const bdaddr_t *dba);
 int read_device_ccc(bdaddr_t *local, bdaddr_t *peer, uint16_t handle,
 							uint16_t *value);
 int write_device_ccc(bdaddr_t *local, bdaddr_t *peer, uint16_t handle,
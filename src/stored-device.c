@@ -0,0 +1,134 @@
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *  Copyright (C) 2012  Intel Corporation
+ *
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdint.h>
+#include <glib.h>
+
+#include <bluetooth/bluetooth.h>
+#include <bluetooth/sdp.h>
+
+#include "glib-helper.h"
+#include "stored-device.h"
+
+struct stored_devices {
+	GHashTable *table;
+};
+
+struct stored_devices *stored_devices_new(void)
+{
+	struct stored_devices *index;
+
+	index = g_new0(struct stored_devices, 1);
+	index->table = g_hash_table_new_full(bt_bdaddr_hash, bt_bdaddr_equal,
+								NULL, g_free);
+
+	return index;
+}
+
+void stored_devices_free(struct stored_devices *index)
+{
+	if (index == NULL)
+		return;
+
+	g_hash_table_destroy(index->table);
+	g_free(index);
+}
+
+void stored_devices_add(struct stored_devices *index, const bdaddr_t *bdaddr,
+						uint8_t type, uint8_t source)
+{
+	struct stored_device *stored;
+
+	stored = g_new0(struct stored_device, 1);
+	bacpy(&stored->bdaddr, bdaddr);
+	stored->type = type;
+	stored->source = source;
+
+	g_hash_table_replace(index->table, &stored->bdaddr, stored);
+}
+
+gboolean stored_devices_contains(struct stored_devices *index,
+							const bdaddr_t *bdaddr)
+{
+	return g_hash_table_lookup(index->table, bdaddr) != NULL;
+}
+
+unsigned int stored_devices_count(struct stored_devices *index)
+{
+	return g_hash_table_size(index->table);
+}
+
+void stored_devices_clear(struct stored_devices *index)
+{
+	g_hash_table_remove_all(index->table);
+}
+
+void *stored_devices_take(struct stored_devices *index, const bdaddr_t *bdaddr,
+				stored_device_create_t create, void *user_data)
+{
+	struct stored_device *stored;
+	void *device;
+	bdaddr_t ba;
+
+	stored = g_hash_table_lookup(index->table, bdaddr);
+	if (stored == NULL)
+		return NULL;
+
+	/* create may take other entries, or replace this one */
+	bacpy(&ba, bdaddr);
+
+	device = create(stored, user_data);
+
+	/* Keep the entry so a later lookup can retry */
+	if (device != NULL)
+		g_hash_table_remove(index->table, &ba);
+
+	return device;
+}
+
+unsigned int stored_devices_take_all(struct stored_devices *index,
+				stored_device_create_t create, void *user_data)
+{
+	GHashTableIter iter;
+	gpointer key;
+	GSList *l, *addrs = NULL;
+	unsigned int count = 0;
+
+	/* Creating a device may look up, and so take, other entries */
+	g_hash_table_iter_init(&iter, index->table);
+	while (g_hash_table_iter_next(&iter, &key, NULL))
+		addrs = g_slist_prepend(addrs, g_memdup(key, sizeof(bdaddr_t)));
+
+	for (l = addrs; l; l = l->next) {
+		if (stored_devices_take(index, l->data, create, user_data))
+			count++;
+	}
+
+	g_slist_free_full(addrs, g_free);
+
+	return count;
+}
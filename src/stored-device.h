@@ -0,0 +1,56 @@
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *  Copyright (C) 2012  Intel Corporation
+ *
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+/* Devices found in storage whose btd_device has not been created yet */
+
+enum {
+	STORED_OTHER,
+	STORED_PROFILES,
+	STORED_PRIMARY,
+};
+
+struct stored_device {
+	bdaddr_t bdaddr;
+	uint8_t type;		/* addr_type_t */
+	uint8_t source;		/* file the services are loaded from */
+};
+
+struct stored_devices;
+
+typedef void *(*stored_device_create_t) (const struct stored_device *stored,
+							void *user_data);
+
+struct stored_devices *stored_devices_new(void);
+void stored_devices_free(struct stored_devices *index);
+
+void stored_devices_add(struct stored_devices *index, const bdaddr_t *bdaddr,
+						uint8_t type, uint8_t source);
+gboolean stored_devices_contains(struct stored_devices *index,
+							const bdaddr_t *bdaddr);
+unsigned int stored_devices_count(struct stored_devices *index);
+void stored_devices_clear(struct stored_devices *index);
+
+void *stored_devices_take(struct stored_devices *index, const bdaddr_t *bdaddr,
+				stored_device_create_t create, void *user_data);
+unsigned int stored_devices_take_all(struct stored_devices *index,
+				stored_device_create_t create, void *user_data);
@@ -0,0 +1,95 @@
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *  Copyright (C) 2011  Intel Corporation
+ *
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include <glib.h>
+
+#include <bluetooth/bluetooth.h>
+#include <bluetooth/hci.h>
+#include <bluetooth/sdp.h>
+
+#include "eir.h"
+
+/* Flags, two 16-bit UUIDs, a 128-bit UUID, a complete name and the
+ * Class of Device, as sent by a typical phone */
+static const uint8_t sample_eir[] = {
+	0x02, EIR_FLAGS, 0x06,
+	0x05, EIR_UUID16_ALL, 0x0d, 0x18, 0x0f, 0x18,
+	0x11, EIR_UUID128_ALL, 0xfb, 0x34, 0x9b, 0x5f, 0x80, 0x00, 0x00, 0x80,
+			0x00, 0x10, 0x00, 0x00, 0x0a, 0x11, 0x00, 0x00,
+	0x0a, EIR_NAME_COMPLETE, 'T', 'e', 's', 't', ' ', 'n', 'a', 'm', 'e',
+	0x04, EIR_CLASS_OF_DEV, 0x0c, 0x02, 0x5a,
+};
+
+int main(int argc, char *argv[])
+{
+	uint8_t buf[HCI_MAX_EIR_LENGTH];
+	struct eir_view view;
+	struct eir_data data;
+	double parse, parse_view;
+	GTimer *timer;
+	int i, iterations = 100000;
+
+	if (argc > 1)
+		iterations = atoi(argv[1]);
+
+	if (iterations <= 0) {
+		fprintf(stderr, "Usage: %s [iterations]\n", argv[0]);
+		return 1;
+	}
+
+	memset(buf, 0, sizeof(buf));
+	memcpy(buf, sample_eir, sizeof(sample_eir));
+
+	timer = g_timer_new();
+
+	for (i = 0; i < iterations; i++) {
+		memset(&data, 0, sizeof(data));
+		eir_parse(&data, buf, HCI_MAX_EIR_LENGTH);
+		eir_data_free(&data);
+	}
+
+	parse = g_timer_elapsed(timer, NULL);
+	g_timer_start(timer);
+
+	for (i = 0; i < iterations; i++)
+		eir_parse_view(&view, buf, HCI_MAX_EIR_LENGTH);
+
+	parse_view = g_timer_elapsed(timer, NULL);
+	g_timer_destroy(timer);
+
+	printf("eir_parse: %.0f ns, eir_parse_view: %.0f ns per report\n",
+					parse * 1e9 / iterations,
+					parse_view * 1e9 / iterations);
+
+	return 0;
+}
@@ -207,6 +207,28 @@ int main(int argc, char *argv[])
 		return 1;
 	}
 
+	if (!bt_uuid_equal(&u, &u128) || !bt_uuid_equal(&u4, &u2)) {
+		printf("Fail %d\n", __LINE__);
+		return 1;
+	}
+
+	if (bt_uuid_equal(&ub, &u128)) {
+		printf("Fail %d\n", __LINE__);
+		return 1;
+	}
+
+	if (bt_uuid_hash(&u) != bt_uuid_hash(&u128) ||
+				bt_uuid_hash(&u5) != bt_uuid_hash(&u2)) {
+		printf("Fail %d\n", __LINE__);
+		return 1;
+	}
+
+	bt_uuid_to_canonical(&u5, &u3);
+	if (u3.type != u.type) {
+		printf("Fail %d\n", __LINE__);
+		return 1;
+	}
+
 	memcpy(&n, xuuidthirtytwo, 16);
 	ntoh128(&n, &i);
 
@@ -308,6 +330,28 @@ int main(int argc, char *argv[])
 		return 1;
 	}
 
+	if (!bt_uuid_equal(&u, &u128) || !bt_uuid_equal(&u4, &u2)) {
+		printf("Fail %d\n", __LINE__);
+		return 1;
+	}
+
+	if (bt_uuid_equal(&ub, &u128)) {
+		printf("Fail %d\n", __LINE__);
+		return 1;
+	}
+
+	if (bt_uuid_hash(&u) != bt_uuid_hash(&u128) ||
+				bt_uuid_hash(&u5) != bt_uuid_hash(&u2)) {
+		printf("Fail %d\n", __LINE__);
+		return 1;
+	}
+
+	bt_uuid_to_canonical(&u5, &u3);
+	if (u3.type != u.type) {
+		printf("Fail %d\n", __LINE__);
+		return 1;
+	}
+
 	for (s = 0; malformed[s]; ++s) {
 		if (bt_string_to_uuid(&u3, malformed[s]) == 0) {
 			printf("Fail %s %d\n", malformed[s], __LINE__);
@@ -37,6 +37,7 @@
 #include "attio.h"
 #include "att.h"
 #include "gatt.h"
+#include "gatt-cache.h"
 #include "thermometer.h"
 #include "glib-compat.h"
 
@@ -350,7 +351,7 @@ static void process_thermometer_desc(struct descriptor *desc)
 
 	bt_uuid16_create(&btuuid, GATT_CLIENT_CHARAC_CFG_UUID);
 
-	if (bt_uuid_cmp(&desc->uuid, &btuuid) == 0) {
+	if (bt_uuid_equal(&desc->uuid, &btuuid)) {
 		uint8_t atval[2];
 		uint16_t val;
 		char *msg;
@@ -387,7 +388,7 @@ static void process_thermometer_desc(struct descriptor *desc)
 
 	bt_uuid16_create(&btuuid, GATT_CHARAC_VALID_RANGE_UUID);
 
-	if (bt_uuid_cmp(&desc->uuid, &btuuid) == 0 && g_strcmp0(ch->attr.uuid,
+	if (bt_uuid_equal(&desc->uuid, &btuuid) && g_strcmp0(ch->attr.uuid,
 					MEASUREMENT_INTERVAL_UUID) == 0) {
 		gatt_read_char(ch->t->attrib, desc->handle, 0,
 						valid_range_desc_cb, desc);
@@ -400,13 +401,11 @@ done:
 								ch->attr.uuid);
 }
 
-static void discover_desc_cb(guint8 status, const guint8 *pdu, guint16 len,
+static void discover_desc_cb(GSList *descriptors, guint8 status,
 							gpointer user_data)
 {
 	struct characteristic *ch = user_data;
-	struct att_data_list *list;
-	uint8_t format;
-	int i;
+	GSList *l;
 
 	if (status != 0) {
 		error("Discover all characteristic descriptors failed [%s]: %s",
@@ -414,29 +413,18 @@ static void discover_desc_cb(guint8 status, const guint8 *pdu, guint16 len,
 		return;
 	}
 
-	list = dec_find_info_resp(pdu, len, &format);
-	if (list == NULL)
-		return;
-
-	for (i = 0; i < list->num; i++) {
+	for (l = descriptors; l; l = l->next) {
+		struct att_desc *d = l->data;
 		struct descriptor *desc;
-		uint8_t *value;
 
-		value = list->data[i];
 		desc = g_new0(struct descriptor, 1);
-		desc->handle = att_get_u16(value);
+		desc->handle = d->handle;
+		desc->uuid = d->uuid;
 		desc->ch = ch;
 
-		if (format == 0x01)
-			desc->uuid = att_get_uuid16(&value[2]);
-		else
-			desc->uuid = att_get_uuid128(&value[2]);
-
 		ch->desc = g_slist_append(ch->desc, desc);
 		process_thermometer_desc(desc);
 	}
-
-	att_data_list_free(list);
 }
 
 static void read_temp_type_cb(guint8 status, const guint8 *pdu, guint16 len,
@@ -549,7 +537,9 @@ static void configure_thermometer_cb(GSList *characteristics, guint8 status,
 		else
 			continue;
 
-		gatt_find_info(t->attrib, start, end, discover_desc_cb, ch);
+		gatt_cache_discover_desc(btd_device_get_gatt_cache(t->dev),
+					t->attrib, start, end,
+					discover_desc_cb, ch);
 	}
 }
 
@@ -1186,8 +1176,9 @@ static void attio_connected_cb(GAttrib *attrib, gpointer user_data)
 							ind_handler, t, NULL);
 	t->attnotid = g_attrib_register(t->attrib, ATT_OP_HANDLE_NOTIFY,
 							notif_handler, t, NULL);
-	gatt_discover_char(t->attrib, t->svc_range->start, t->svc_range->end,
-					NULL, configure_thermometer_cb, t);
+	gatt_cache_discover_char(btd_device_get_gatt_cache(t->dev), t->attrib,
+				t->svc_range->start, t->svc_range->end, NULL,
+				configure_thermometer_cb, t);
 }
 
 static void attio_disconnected_cb(gpointer user_data)
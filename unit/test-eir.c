@@ -55,6 +55,120 @@ START_TEST(test_basic)
 }
 END_TEST
 
+/* Flags, two 16-bit UUIDs, a 128-bit UUID, a complete name and the
+ * Class of Device, as sent by a typical phone */
+static const uint8_t sample_eir[] = {
+	0x02, EIR_FLAGS, 0x06,
+	0x05, EIR_UUID16_ALL, 0x0d, 0x18, 0x0f, 0x18,
+	0x11, EIR_UUID128_ALL, 0xfb, 0x34, 0x9b, 0x5f, 0x80, 0x00, 0x00, 0x80,
+			0x00, 0x10, 0x00, 0x00, 0x0a, 0x11, 0x00, 0x00,
+	0x0a, EIR_NAME_COMPLETE, 'T', 'e', 's', 't', ' ', 'n', 'a', 'm', 'e',
+	0x04, EIR_CLASS_OF_DEV, 0x0c, 0x02, 0x5a,
+};
+
+static void fill_sample(uint8_t *buf)
+{
+	memset(buf, 0, HCI_MAX_EIR_LENGTH);
+	memcpy(buf, sample_eir, sizeof(sample_eir));
+}
+
+START_TEST(test_view)
+{
+	struct eir_view view;
+	struct eir_data data;
+	uint8_t buf[HCI_MAX_EIR_LENGTH];
+	uuid_t uuid;
+	char *name;
+	int err;
+
+	fill_sample(buf);
+	memset(&data, 0, sizeof(data));
+
+	err = eir_parse_view(&view, buf, HCI_MAX_EIR_LENGTH);
+	ck_assert(err == 0);
+	ck_assert(view.len == sizeof(sample_eir));
+	ck_assert(view.flags == 0x06);
+	ck_assert(view.uuid_count == 3);
+	ck_assert(view.name.type == EIR_NAME_COMPLETE);
+	ck_assert(view.dev_class.type == EIR_CLASS_OF_DEV);
+
+	ck_assert(eir_view_get_uuid(&view, 1, &uuid));
+	ck_assert(uuid.type == SDP_UUID16 && uuid.value.uuid16 == 0x180f);
+	ck_assert(eir_view_get_uuid(&view, 2, &uuid));
+	ck_assert(uuid.type == SDP_UUID128);
+	ck_assert(!eir_view_get_uuid(&view, 3, &uuid));
+
+	name = eir_view_get_name(&view);
+	ck_assert(g_strcmp0(name, "Test name") == 0);
+	g_free(name);
+
+	err = eir_parse(&data, buf, HCI_MAX_EIR_LENGTH);
+	ck_assert(err == 0);
+	ck_assert(g_slist_length(data.services) == 3);
+	ck_assert(g_strcmp0(data.name, "Test name") == 0);
+	ck_assert(data.name_complete);
+	ck_assert(data.dev_class[2] == 0x5a);
+
+	eir_data_free(&data);
+}
+END_TEST
+
+START_TEST(test_hash)
+{
+	struct eir_view view;
+	uint8_t buf[HCI_MAX_EIR_LENGTH];
+	uint32_t hash;
+
+	fill_sample(buf);
+	ck_assert(eir_parse_view(&view, buf, HCI_MAX_EIR_LENGTH) == 0);
+	hash = view.hash;
+
+	/* Padding after the terminator is not part of the content */
+	ck_assert(eir_parse_view(&view, buf, sizeof(sample_eir) + 1) == 0);
+	ck_assert(view.hash == hash);
+
+	buf[sizeof(sample_eir) - 1] ^= 0x01;
+	ck_assert(eir_parse_view(&view, buf, HCI_MAX_EIR_LENGTH) == 0);
+	ck_assert(view.hash != hash);
+}
+END_TEST
+
+START_TEST(test_invalid)
+{
+	struct eir_view view;
+	uint8_t buf[HCI_MAX_EIR_LENGTH];
+
+	fill_sample(buf);
+
+	/* The name field runs past the end of the data */
+	ck_assert(eir_parse_view(&view, buf, sizeof(sample_eir) - 8) < 0);
+}
+END_TEST
+
+START_TEST(test_many_uuids)
+{
+	struct eir_view view;
+	uint8_t buf[HCI_MAX_EIR_LENGTH], *ptr = buf;
+	uuid_t uuid;
+	int i;
+
+	memset(buf, 0, sizeof(buf));
+
+	/* One 16-bit UUID per field, more fields than a phone would send */
+	for (i = 0; i < 40; i++) {
+		*ptr++ = 0x03;
+		*ptr++ = EIR_UUID16_SOME;
+		*ptr++ = i;
+		*ptr++ = 0x11;
+	}
+
+	ck_assert(eir_parse_view(&view, buf, HCI_MAX_EIR_LENGTH) == 0);
+	ck_assert(view.uuid_count == 40);
+	ck_assert(eir_view_get_uuid(&view, 39, &uuid));
+	ck_assert(uuid.value.uuid16 == 0x1127);
+}
+END_TEST
+
 static void add_test(Suite *s, const char *name, TFun func)
 {
 	TCase *t;
@@ -73,6 +187,10 @@ int main(int argc, char *argv[])
 	s = suite_create("EIR");
 
 	add_test(s, "basic", test_basic);
+	add_test(s, "view", test_view);
+	add_test(s, "hash", test_hash);
+	add_test(s, "invalid", test_invalid);
+	add_test(s, "many-uuids", test_many_uuids);
 
 	sr = srunner_create(s);
 
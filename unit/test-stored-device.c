@@ -0,0 +1,230 @@
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *  Copyright (C) 2012  Intel Corporation
+ *
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <check.h>
+
+#include <stdint.h>
+#include <string.h>
+
+#include <glib.h>
+
+#include <bluetooth/bluetooth.h>
+
+#include "stored-device.h"
+
+struct create_data {
+	struct stored_devices *index;
+	unsigned int calls;
+	gboolean fail;
+	uint8_t type;
+	uint8_t source;
+	const bdaddr_t *from;
+	const bdaddr_t *take;	/* entry to take when creating from */
+};
+
+static int dummy_device;
+
+static void *create_device(const struct stored_device *stored,
+							void *user_data)
+{
+	struct create_data *data = user_data;
+
+	data->calls++;
+	data->type = stored->type;
+	data->source = stored->source;
+
+	if (data->from && bacmp(&stored->bdaddr, data->from) == 0)
+		stored_devices_take(data->index, data->take, create_device,
+									data);
+
+	if (data->fail)
+		return NULL;
+
+	return &dummy_device;
+}
+
+static const bdaddr_t addr1 = { { 0x01, 0x00, 0x00, 0x00, 0x00, 0x00 } };
+static const bdaddr_t addr2 = { { 0x02, 0x00, 0x00, 0x00, 0x00, 0x00 } };
+static const bdaddr_t addr3 = { { 0x03, 0x00, 0x00, 0x00, 0x00, 0x00 } };
+
+START_TEST(test_add)
+{
+	struct stored_devices *index;
+
+	index = stored_devices_new();
+
+	stored_devices_add(index, &addr1, 0, STORED_PROFILES);
+	stored_devices_add(index, &addr2, 0, STORED_OTHER);
+	stored_devices_add(index, &addr1, 0, STORED_OTHER);
+
+	ck_assert(stored_devices_count(index) == 2);
+	ck_assert(stored_devices_contains(index, &addr1));
+	ck_assert(stored_devices_contains(index, &addr2));
+	ck_assert(!stored_devices_contains(index, &addr3));
+
+	stored_devices_clear(index);
+	ck_assert(stored_devices_count(index) == 0);
+
+	stored_devices_free(index);
+}
+END_TEST
+
+START_TEST(test_take)
+{
+	struct create_data data;
+	struct stored_devices *index;
+
+	memset(&data, 0, sizeof(data));
+	index = stored_devices_new();
+	data.index = index;
+
+	stored_devices_add(index, &addr1, 1, STORED_PROFILES);
+
+	ck_assert(stored_devices_take(index, &addr2, create_device,
+							&data) == NULL);
+	ck_assert(data.calls == 0);
+
+	ck_assert(stored_devices_take(index, &addr1, create_device,
+							&data) == &dummy_device);
+	ck_assert(data.calls == 1);
+	ck_assert(data.type == 1);
+	ck_assert(data.source == STORED_PROFILES);
+	ck_assert(!stored_devices_contains(index, &addr1));
+
+	stored_devices_free(index);
+}
+END_TEST
+
+START_TEST(test_take_failed)
+{
+	struct create_data data;
+	struct stored_devices *index;
+
+	memset(&data, 0, sizeof(data));
+	index = stored_devices_new();
+	data.index = index;
+	data.fail = TRUE;
+
+	stored_devices_add(index, &addr1, 0, STORED_PROFILES);
+
+	ck_assert(stored_devices_take(index, &addr1, create_device,
+							&data) == NULL);
+	ck_assert(stored_devices_contains(index, &addr1));
+
+	data.fail = FALSE;
+
+	ck_assert(stored_devices_take(index, &addr1, create_device,
+							&data) == &dummy_device);
+	ck_assert(data.calls == 2);
+	ck_assert(!stored_devices_contains(index, &addr1));
+
+	stored_devices_free(index);
+}
+END_TEST
+
+START_TEST(test_take_all)
+{
+	struct create_data data;
+	struct stored_devices *index;
+
+	memset(&data, 0, sizeof(data));
+	index = stored_devices_new();
+	data.index = index;
+
+	stored_devices_add(index, &addr1, 0, STORED_PROFILES);
+	stored_devices_add(index, &addr2, 0, STORED_PROFILES);
+	stored_devices_add(index, &addr3, 0, STORED_OTHER);
+
+	/* Creating one device looks up another stored one */
+	data.from = &addr1;
+	data.take = &addr2;
+
+	stored_devices_take_all(index, create_device, &data);
+	ck_assert(data.calls == 3);
+	ck_assert(stored_devices_count(index) == 0);
+
+	stored_devices_free(index);
+}
+END_TEST
+
+START_TEST(test_take_all_failed)
+{
+	struct create_data data;
+	struct stored_devices *index;
+
+	memset(&data, 0, sizeof(data));
+	index = stored_devices_new();
+	data.index = index;
+	data.fail = TRUE;
+
+	stored_devices_add(index, &addr1, 0, STORED_PROFILES);
+	stored_devices_add(index, &addr2, 0, STORED_OTHER);
+
+	ck_assert(stored_devices_take_all(index, create_device, &data) == 0);
+	ck_assert(data.calls == 2);
+	ck_assert(stored_devices_count(index) == 2);
+
+	stored_devices_free(index);
+}
+END_TEST
+
+static void add_test(Suite *s, const char *name, TFun func)
+{
+	TCase *t;
+
+	t = tcase_create(name);
+	tcase_add_test(t, func);
+	suite_add_tcase(s, t);
+}
+
+int main(int argc, char *argv[])
+{
+	int fails;
+	SRunner *sr;
+	Suite *s;
+
+	s = suite_create("Stored devices");
+
+	add_test(s, "add", test_add);
+	add_test(s, "take", test_take);
+	add_test(s, "take-failed", test_take_failed);
+	add_test(s, "take-all", test_take_all);
+	add_test(s, "take-all-failed", test_take_all_failed);
+
+	sr = srunner_create(s);
+
+	srunner_run_all(sr, CK_NORMAL);
+
+	fails = srunner_ntests_failed(sr);
+
+	srunner_free(sr);
+
+	if (fails > 0)
+		return -1;
+
+	return 0;
+}